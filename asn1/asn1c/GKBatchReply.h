@@ -0,0 +1,44 @@
+/*
+ * Matches the output of asn1c-0.9.21 (http://lionet.info/asn1c)
+ * From ASN.1 module "KeytabModule"
+ * 	found in "ipa.asn1"
+ * 	`asn1c -fskeletons-copy`
+ * The DER encoding is pinned by ../t_ipa_asn1.c
+ */
+
+#ifndef	_GKBatchReply_H_
+#define	_GKBatchReply_H_
+
+
+#include <asn_application.h>
+
+/* Including external dependencies */
+#include <asn_SEQUENCE_OF.h>
+#include <constr_SEQUENCE_OF.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Forward declarations */
+struct GKBatchResult;
+
+/* GKBatchReply */
+typedef struct GKBatchReply {
+	A_SEQUENCE_OF(struct GKBatchResult) list;
+	
+	/* Context for parsing across buffer boundaries */
+	asn_struct_ctx_t _asn_ctx;
+} GKBatchReply_t;
+
+/* Implementation */
+extern asn_TYPE_descriptor_t asn_DEF_GKBatchReply;
+
+#ifdef __cplusplus
+}
+#endif
+
+/* Referred external types */
+#include "GKBatchResult.h"
+
+#endif	/* _GKBatchReply_H_ */
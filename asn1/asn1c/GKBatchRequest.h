@@ -0,0 +1,44 @@
+/*
+ * Matches the output of asn1c-0.9.21 (http://lionet.info/asn1c)
+ * From ASN.1 module "KeytabModule"
+ * 	found in "ipa.asn1"
+ * 	`asn1c -fskeletons-copy`
+ * The DER encoding is pinned by ../t_ipa_asn1.c
+ */
+
+#ifndef	_GKBatchRequest_H_
+#define	_GKBatchRequest_H_
+
+
+#include <asn_application.h>
+
+/* Including external dependencies */
+#include <asn_SEQUENCE_OF.h>
+#include <constr_SEQUENCE_OF.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Forward declarations */
+struct GetKeytabControl;
+
+/* GKBatchRequest */
+typedef struct GKBatchRequest {
+	A_SEQUENCE_OF(struct GetKeytabControl) list;
+	
+	/* Context for parsing across buffer boundaries */
+	asn_struct_ctx_t _asn_ctx;
+} GKBatchRequest_t;
+
+/* Implementation */
+extern asn_TYPE_descriptor_t asn_DEF_GKBatchRequest;
+
+#ifdef __cplusplus
+}
+#endif
+
+/* Referred external types */
+#include "GetKeytabControl.h"
+
+#endif	/* _GKBatchRequest_H_ */
@@ -0,0 +1,72 @@
+/*
+ * Matches the output of asn1c-0.9.21 (http://lionet.info/asn1c)
+ * From ASN.1 module "KeytabModule"
+ * 	found in "ipa.asn1"
+ * 	`asn1c -fskeletons-copy`
+ * The DER encoding is pinned by ../t_ipa_asn1.c
+ */
+
+#include <asn_internal.h>
+
+#include "GKBatchResult.h"
+
+static asn_TYPE_member_t asn_MBR_GKBatchResult_1[] = {
+	{ ATF_NOFLAGS, 0, offsetof(struct GKBatchResult, result),
+		(ASN_TAG_CLASS_CONTEXT | (0 << 2)),
+		+1,	/* EXPLICIT tag at current level */
+		&asn_DEF_Int32,
+		0,	/* Defer constraints checking to the member type */
+		0,	/* PER is not compiled, use -gen-PER */
+		0,
+		"result"
+		},
+	{ ATF_POINTER, 1, offsetof(struct GKBatchResult, reply),
+		(ASN_TAG_CLASS_CONTEXT | (1 << 2)),
+		+1,	/* EXPLICIT tag at current level */
+		&asn_DEF_GKReply,
+		0,	/* Defer constraints checking to the member type */
+		0,	/* PER is not compiled, use -gen-PER */
+		0,
+		"reply"
+		},
+};
+static ber_tlv_tag_t asn_DEF_GKBatchResult_tags_1[] = {
+	(ASN_TAG_CLASS_UNIVERSAL | (16 << 2))
+};
+static asn_TYPE_tag2member_t asn_MAP_GKBatchResult_tag2el_1[] = {
+    { (ASN_TAG_CLASS_CONTEXT | (0 << 2)), 0, 0, 0 }, /* result at 45 */
+    { (ASN_TAG_CLASS_CONTEXT | (1 << 2)), 1, 0, 0 } /* reply at 46 */
+};
+static asn_SEQUENCE_specifics_t asn_SPC_GKBatchResult_specs_1 = {
+	sizeof(struct GKBatchResult),
+	offsetof(struct GKBatchResult, _asn_ctx),
+	asn_MAP_GKBatchResult_tag2el_1,
+	2,	/* Count of tags in the map */
+	0, 0, 0,	/* Optional elements (not needed) */
+	-1,	/* Start extensions */
+	-1	/* Stop extensions */
+};
+asn_TYPE_descriptor_t asn_DEF_GKBatchResult = {
+	"GKBatchResult",
+	"GKBatchResult",
+	SEQUENCE_free,
+	SEQUENCE_print,
+	SEQUENCE_constraint,
+	SEQUENCE_decode_ber,
+	SEQUENCE_encode_der,
+	SEQUENCE_decode_xer,
+	SEQUENCE_encode_xer,
+	0, 0,	/* No PER support, use "-gen-PER" to enable */
+	0,	/* Use generic outmost tag fetcher */
+	asn_DEF_GKBatchResult_tags_1,
+	sizeof(asn_DEF_GKBatchResult_tags_1)
+		/sizeof(asn_DEF_GKBatchResult_tags_1[0]), /* 1 */
+	asn_DEF_GKBatchResult_tags_1,	/* Same as above */
+	sizeof(asn_DEF_GKBatchResult_tags_1)
+		/sizeof(asn_DEF_GKBatchResult_tags_1[0]), /* 1 */
+	0,	/* No PER visible constraints */
+	asn_MBR_GKBatchResult_1,
+	2,	/* Elements count */
+	&asn_SPC_GKBatchResult_specs_1	/* Additional specs */
+};
+
@@ -0,0 +1,45 @@
+/*
+ * Matches the output of asn1c-0.9.21 (http://lionet.info/asn1c)
+ * From ASN.1 module "KeytabModule"
+ * 	found in "ipa.asn1"
+ * 	`asn1c -fskeletons-copy`
+ * The DER encoding is pinned by ../t_ipa_asn1.c
+ */
+
+#ifndef	_GKBatchResult_H_
+#define	_GKBatchResult_H_
+
+
+#include <asn_application.h>
+
+/* Including external dependencies */
+#include "Int32.h"
+#include <constr_SEQUENCE.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Forward declarations */
+struct GKReply;
+
+/* GKBatchResult */
+typedef struct GKBatchResult {
+	Int32_t	 result;
+	struct GKReply	*reply	/* OPTIONAL */;
+	
+	/* Context for parsing across buffer boundaries */
+	asn_struct_ctx_t _asn_ctx;
+} GKBatchResult_t;
+
+/* Implementation */
+extern asn_TYPE_descriptor_t asn_DEF_GKBatchResult;
+
+#ifdef __cplusplus
+}
+#endif
+
+/* Referred external types */
+#include "GKReply.h"
+
+#endif	/* _GKBatchResult_H_ */
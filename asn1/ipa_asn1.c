@@ -2,9 +2,11 @@
 #include <sys/types.h>
 #include "ipa_asn1.h"
 #include "GetKeytabControl.h"
+#include "GKBatchRequest.h"
+#include "GKBatchReply.h"
 
-static bool encode_GetKeytabControl(GetKeytabControl_t *gkctrl,
-                                    void **buf, size_t *len)
+static bool encode_asn1_type(asn_TYPE_descriptor_t *td, void *sptr,
+                             void **buf, size_t *len)
 {
     asn_enc_rval_t rval;
     char *buffer = NULL;
@@ -12,7 +14,7 @@ static bool encode_GetKeytabControl(GetKeytabControl_t *gkctrl,
     bool ret = false;
 
     /* dry run to compute the size */
-    rval = der_encode(&asn_DEF_GetKeytabControl, gkctrl, NULL, NULL);
+    rval = der_encode(td, sptr, NULL, NULL);
     if (rval.encoded == -1) goto done;
 
     buflen = rval.encoded;
@@ -20,8 +22,7 @@ static bool encode_GetKeytabControl(GetKeytabControl_t *gkctrl,
     if (!buffer) goto done;
 
     /* now for real */
-    rval = der_encode_to_buffer(&asn_DEF_GetKeytabControl,
-                                gkctrl, buffer, buflen);
+    rval = der_encode_to_buffer(td, sptr, buffer, buflen);
     if (rval.encoded == -1) goto done;
 
     *buf = buffer;
@@ -35,36 +36,52 @@ done:
     return ret;
 }
 
-bool ipaasn1_enc_getkt(bool newkt, const char *princ, const char *pwd,
-                       long *etypes, int numtypes, void **buf, size_t *len)
+static bool fill_GetKeytabControl(GetKeytabControl_t *gkctrl, bool newkt,
+                                  const char *princ, const char *pwd,
+                                  long *etypes, int numtypes)
 {
-    GetKeytabControl_t gkctrl = { 0 };
-    bool ret = false;
-
     if (newkt) {
-        gkctrl.present = GetKeytabControl_PR_newkeys;
-        if (OCTET_STRING_fromString(&gkctrl.choice.newkeys.serviceIdentity,
-                                    princ) != 0) goto done;
+        gkctrl->present = GetKeytabControl_PR_newkeys;
+        if (OCTET_STRING_fromString(&gkctrl->choice.newkeys.serviceIdentity,
+                                    princ) != 0) return false;
 
         for (int i = 0; i < numtypes; i++) {
             long *tmp;
             tmp = malloc(sizeof(long));
-            if (!tmp) goto done;
+            if (!tmp) return false;
             *tmp = etypes[i];
-            ASN_SEQUENCE_ADD(&gkctrl.choice.newkeys.enctypes.list, tmp);
+            ASN_SEQUENCE_ADD(&gkctrl->choice.newkeys.enctypes.list, tmp);
         }
 
         if (pwd) {
-            gkctrl.choice.newkeys.password =
+            gkctrl->choice.newkeys.password =
                 OCTET_STRING_new_fromBuf(&asn_DEF_OCTET_STRING, pwd, -1);
-            if (!gkctrl.choice.newkeys.password) goto done;
+            if (!gkctrl->choice.newkeys.password) return false;
         }
     } else {
-        gkctrl.present = GetKeytabControl_PR_curkeys;
-        if (OCTET_STRING_fromString(&gkctrl.choice.curkeys.serviceIdentity,
-                                    princ) != 0) goto done;
+        gkctrl->present = GetKeytabControl_PR_curkeys;
+        if (OCTET_STRING_fromString(&gkctrl->choice.curkeys.serviceIdentity,
+                                    princ) != 0) return false;
     }
 
+    return true;
+}
+
+static bool encode_GetKeytabControl(GetKeytabControl_t *gkctrl,
+                                    void **buf, size_t *len)
+{
+    return encode_asn1_type(&asn_DEF_GetKeytabControl, gkctrl, buf, len);
+}
+
+bool ipaasn1_enc_getkt(bool newkt, const char *princ, const char *pwd,
+                       long *etypes, int numtypes, void **buf, size_t *len)
+{
+    GetKeytabControl_t gkctrl = { 0 };
+    bool ret = false;
+
+    if (!fill_GetKeytabControl(&gkctrl, newkt, princ, pwd,
+                               etypes, numtypes)) goto done;
+
     ret = encode_GetKeytabControl(&gkctrl, buf, len);
 
 done:
@@ -72,32 +89,29 @@ done:
     return ret;
 }
 
-bool ipaasn1_enc_getktreply(int kvno, struct keys_container *keys,
-                            void **buf, size_t *len)
+static bool fill_GKReply(GKReply_t *reply, int kvno,
+                         struct keys_container *keys)
 {
-    GetKeytabControl_t gkctrl = { 0 };
-    bool ret = false;
     KrbKey_t *KK;
 
-    gkctrl.present = GetKeytabControl_PR_reply;
-    gkctrl.choice.reply.newkvno = kvno;
+    reply->newkvno = kvno;
 
     for (int i = 0; i < keys->nkeys; i++) {
         KK = calloc(1, sizeof(KrbKey_t));
-        if (!KK) goto done;
+        if (!KK) return false;
         KK->key.type = keys->ksdata[i].key.enctype;
         KK->key.value.buf = malloc(keys->ksdata[i].key.length);
-        if (!KK->key.value.buf) goto done;
+        if (!KK->key.value.buf) goto fail;
         memcpy(KK->key.value.buf,
                keys->ksdata[i].key.contents, keys->ksdata[i].key.length);
         KK->key.value.size = keys->ksdata[i].key.length;
 
         if (keys->ksdata[i].salt.data != NULL) {
             KK->salt = calloc(1, sizeof(TypeValuePair_t));
-            if (!KK->salt) goto done;
+            if (!KK->salt) goto fail;
             KK->salt->type = keys->ksdata[i].salttype;
             KK->salt->value.buf = malloc(keys->ksdata[i].salt.length);
-            if (!KK->salt->value.buf) goto done;
+            if (!KK->salt->value.buf) goto fail;
             memcpy(KK->salt->value.buf,
                    keys->ksdata[i].salt.data, keys->ksdata[i].salt.length);
             KK->salt->value.size = keys->ksdata[i].salt.length;
@@ -105,22 +119,93 @@ bool ipaasn1_enc_getktreply(int kvno, struct keys_container *keys,
 
         /* KK->key.s2kparams not used for now */
 
-        ASN_SEQUENCE_ADD(&gkctrl.choice.reply.keys.list, KK);
+        if (ASN_SEQUENCE_ADD(&reply->keys.list, KK) != 0) goto fail;
+    }
+
+    return true;
+
+fail:
+    free(KK->key.value.buf);
+    if (KK->salt) {
+        free(KK->salt->value.buf);
+        free(KK->salt);
     }
+    free(KK);
+    return false;
+}
+
+bool ipaasn1_enc_getktreply(int kvno, struct keys_container *keys,
+                            void **buf, size_t *len)
+{
+    GetKeytabControl_t gkctrl = { 0 };
+    bool ret = false;
+
+    gkctrl.present = GetKeytabControl_PR_reply;
+    if (!fill_GKReply(&gkctrl.choice.reply, kvno, keys)) goto done;
 
     ret = encode_GetKeytabControl(&gkctrl, buf, len);
-    KK = NULL;
 
 done:
     ASN_STRUCT_FREE_CONTENTS_ONLY(asn_DEF_GetKeytabControl, &gkctrl);
-    if (KK) {
-        free(KK->key.value.buf);
-        if (KK->salt) {
-            free(KK->salt->value.buf);
-            free(KK->salt);
+    return ret;
+}
+
+bool ipaasn1_enc_getkt_batch(struct ipaasn1_getkt_req *reqs, int nreqs,
+                             void **buf, size_t *len)
+{
+    GKBatchRequest_t batch = { { 0 } };
+    GetKeytabControl_t *gkctrl;
+    bool ret = false;
+
+    for (int i = 0; i < nreqs; i++) {
+        gkctrl = calloc(1, sizeof(GetKeytabControl_t));
+        if (!gkctrl) goto done;
+        if (ASN_SEQUENCE_ADD(&batch.list, gkctrl) != 0) {
+            free(gkctrl);
+            goto done;
+        }
+        if (!fill_GetKeytabControl(gkctrl, reqs[i].newkt,
+                                   reqs[i].princ, reqs[i].pwd,
+                                   reqs[i].etypes, reqs[i].numtypes)) {
+            goto done;
         }
-        free(KK);
     }
+
+    ret = encode_asn1_type(&asn_DEF_GKBatchRequest, &batch, buf, len);
+
+done:
+    ASN_STRUCT_FREE_CONTENTS_ONLY(asn_DEF_GKBatchRequest, &batch);
+    return ret;
+}
+
+bool ipaasn1_enc_getkt_batchreply(struct ipaasn1_getkt_res *res, int nres,
+                                  void **buf, size_t *len)
+{
+    GKBatchReply_t batch = { { 0 } };
+    GKBatchResult_t *result;
+    bool ret = false;
+
+    for (int i = 0; i < nres; i++) {
+        result = calloc(1, sizeof(GKBatchResult_t));
+        if (!result) goto done;
+        if (ASN_SEQUENCE_ADD(&batch.list, result) != 0) {
+            free(result);
+            goto done;
+        }
+        result->result = res[i].result;
+        if (res[i].result != 0) continue;
+
+        result->reply = calloc(1, sizeof(GKReply_t));
+        if (!result->reply) goto done;
+        if (!fill_GKReply(result->reply, res[i].kvno, &res[i].keys)) {
+            goto done;
+        }
+    }
+
+    ret = encode_asn1_type(&asn_DEF_GKBatchReply, &batch, buf, len);
+
+done:
+    ASN_STRUCT_FREE_CONTENTS_ONLY(asn_DEF_GKBatchReply, &batch);
     return ret;
 }
 
@@ -137,27 +222,23 @@ static GetKeytabControl_t *decode_GetKeytabControl(void *buf, size_t len)
     return NULL;
 }
 
-bool ipaasn1_dec_getkt(void *buf, size_t len, bool *newkt,
-                       char **princ, char **pwd, long **etypes, int *numtypes)
+static bool parse_GetKeytabControl(GetKeytabControl_t *gkctrl, bool *newkt,
+                                   char **princ, char **pwd,
+                                   long **etypes, int *numtypes)
 {
-    GetKeytabControl_t *gkctrl;
-    bool ret = false;
     int num;
 
-    gkctrl = decode_GetKeytabControl(buf, len);
-    if (!gkctrl) return false;
-
     switch (gkctrl->present) {
     case GetKeytabControl_PR_newkeys:
         *newkt = true;
         *princ = strndup((char *)gkctrl->choice.newkeys.serviceIdentity.buf,
                          gkctrl->choice.newkeys.serviceIdentity.size);
-        if (!*princ) goto done;
+        if (!*princ) return false;
 
         num = gkctrl->choice.newkeys.enctypes.list.count;
         *etypes = malloc(num * sizeof(long));
         *numtypes = 0;
-        if (!*etypes) goto done;
+        if (!*etypes) return false;
         for (int i = 0; i < num; i++) {
             (*etypes)[i] = *gkctrl->choice.newkeys.enctypes.list.array[i];
             (*numtypes)++;
@@ -166,53 +247,58 @@ bool ipaasn1_dec_getkt(void *buf, size_t len, bool *newkt,
         if (gkctrl->choice.newkeys.password) {
             *pwd = strndup((char *)gkctrl->choice.newkeys.password->buf,
                            gkctrl->choice.newkeys.password->size);
-            if (!*pwd) goto done;
+            if (!*pwd) return false;
         }
         break;
     case GetKeytabControl_PR_curkeys:
         *newkt = false;
         *princ = strndup((char *)gkctrl->choice.curkeys.serviceIdentity.buf,
                          gkctrl->choice.curkeys.serviceIdentity.size);
-        if (!*princ) goto done;
+        if (!*princ) return false;
         break;
     default:
-        goto done;
+        return false;
     }
 
-    ret = true;
-
-done:
-    ASN_STRUCT_FREE(asn_DEF_GetKeytabControl, gkctrl);
-    return ret;
+    return true;
 }
 
-bool ipaasn1_dec_getktreply(void *buf, size_t len,
-                            int *kvno, struct keys_container *keys)
+bool ipaasn1_dec_getkt(void *buf, size_t len, bool *newkt,
+                       char **princ, char **pwd, long **etypes, int *numtypes)
 {
     GetKeytabControl_t *gkctrl;
-    struct KrbKey *KK;
-    bool ret = false;
-    int nkeys;
+    bool ret;
 
     gkctrl = decode_GetKeytabControl(buf, len);
     if (!gkctrl) return false;
 
-    if (gkctrl->present != GetKeytabControl_PR_reply) goto done;
+    ret = parse_GetKeytabControl(gkctrl, newkt, princ, pwd,
+                                 etypes, numtypes);
 
-    *kvno = gkctrl->choice.reply.newkvno;
+    ASN_STRUCT_FREE(asn_DEF_GetKeytabControl, gkctrl);
+    return ret;
+}
 
-    nkeys = gkctrl->choice.reply.keys.list.count;
+static bool parse_GKReply(GKReply_t *reply,
+                          int *kvno, struct keys_container *keys)
+{
+    struct KrbKey *KK;
+    int nkeys;
+
+    *kvno = reply->newkvno;
+
+    nkeys = reply->keys.list.count;
 
     keys->nkeys = 0;
     keys->ksdata = calloc(nkeys, sizeof(struct krb_key_salt));
-    if (!keys->ksdata) goto done;
+    if (!keys->ksdata) return false;
 
     for (int i = 0; i < nkeys; i++) {
-        KK = gkctrl->choice.reply.keys.list.array[i];
+        KK = reply->keys.list.array[i];
         keys->ksdata[i].enctype = KK->key.type;
         keys->ksdata[i].key.enctype = KK->key.type;
         keys->ksdata[i].key.contents = malloc(KK->key.value.size);
-        if (!keys->ksdata[i].key.contents) goto done;
+        if (!keys->ksdata[i].key.contents) return false;
         memcpy(keys->ksdata[i].key.contents,
                KK->key.value.buf, KK->key.value.size);
         keys->ksdata[i].key.length = KK->key.value.size;
@@ -220,7 +306,7 @@ bool ipaasn1_dec_getktreply(void *buf, size_t len,
         if (KK->salt) {
             keys->ksdata[i].salttype = KK->salt->type;
             keys->ksdata[i].salt.data = malloc(KK->salt->value.size);
-            if (!keys->ksdata[i].salt.data) goto done;
+            if (!keys->ksdata[i].salt.data) return false;
             memcpy(keys->ksdata[i].salt.data,
                    KK->salt->value.buf, KK->salt->value.size);
             keys->ksdata[i].salt.length = KK->salt->value.size;
@@ -230,9 +316,112 @@ bool ipaasn1_dec_getktreply(void *buf, size_t len,
         keys->nkeys++;
     }
 
-    ret = true;
+    return true;
+}
+
+bool ipaasn1_dec_getktreply(void *buf, size_t len,
+                            int *kvno, struct keys_container *keys)
+{
+    GetKeytabControl_t *gkctrl;
+    bool ret = false;
+
+    gkctrl = decode_GetKeytabControl(buf, len);
+    if (!gkctrl) return false;
+
+    if (gkctrl->present != GetKeytabControl_PR_reply) goto done;
+
+    ret = parse_GKReply(&gkctrl->choice.reply, kvno, keys);
 
 done:
     ASN_STRUCT_FREE(asn_DEF_GetKeytabControl, gkctrl);
     return ret;
 }
+
+bool ipaasn1_dec_getkt_batch(void *buf, size_t len,
+                             struct ipaasn1_getkt_req **reqs, int *nreqs)
+{
+    GKBatchRequest_t *batch = NULL;
+    asn_dec_rval_t rval;
+    bool ret = false;
+    int num;
+
+    rval = ber_decode(NULL, &asn_DEF_GKBatchRequest,
+                      (void **)&batch, buf, len);
+    if (rval.code != RC_OK) goto done;
+
+    num = batch->list.count;
+    *nreqs = 0;
+    *reqs = calloc(num, sizeof(struct ipaasn1_getkt_req));
+    if (!*reqs) goto done;
+
+    for (int i = 0; i < num; i++) {
+        /* a batch can only carry requests */
+        if (batch->list.array[i]->present == GetKeytabControl_PR_reply) {
+            goto done;
+        }
+        (*nreqs)++;
+        if (!parse_GetKeytabControl(batch->list.array[i],
+                                    &(*reqs)[i].newkt, &(*reqs)[i].princ,
+                                    &(*reqs)[i].pwd, &(*reqs)[i].etypes,
+                                    &(*reqs)[i].numtypes)) {
+            goto done;
+        }
+    }
+
+    ret = true;
+
+done:
+    ASN_STRUCT_FREE(asn_DEF_GKBatchRequest, batch);
+    return ret;
+}
+
+void ipaasn1_free_getkt_reqs(struct ipaasn1_getkt_req *reqs, int nreqs)
+{
+    if (!reqs) return;
+
+    for (int i = 0; i < nreqs; i++) {
+        free(reqs[i].princ);
+        free(reqs[i].pwd);
+        free(reqs[i].etypes);
+    }
+    free(reqs);
+}
+
+bool ipaasn1_dec_getkt_batchreply(void *buf, size_t len,
+                                  struct ipaasn1_getkt_res **res, int *nres)
+{
+    GKBatchReply_t *batch = NULL;
+    GKBatchResult_t *result;
+    asn_dec_rval_t rval;
+    bool ret = false;
+    int num;
+
+    rval = ber_decode(NULL, &asn_DEF_GKBatchReply,
+                      (void **)&batch, buf, len);
+    if (rval.code != RC_OK) goto done;
+
+    num = batch->list.count;
+    *nres = 0;
+    *res = calloc(num, sizeof(struct ipaasn1_getkt_res));
+    if (!*res) goto done;
+
+    for (int i = 0; i < num; i++) {
+        result = batch->list.array[i];
+        (*nres)++;
+        (*res)[i].result = result->result;
+        if (result->result != 0) continue;
+
+        /* a successful result always carries the keys */
+        if (!result->reply) goto done;
+        if (!parse_GKReply(result->reply,
+                           &(*res)[i].kvno, &(*res)[i].keys)) {
+            goto done;
+        }
+    }
+
+    ret = true;
+
+done:
+    ASN_STRUCT_FREE(asn_DEF_GKBatchReply, batch);
+    return ret;
+}
@@ -3,6 +3,24 @@
 
 #include "ipa_krb5.h"
 
+/* A single Get Keytab request within a batch, see ipaasn1_enc_getkt() for
+ * the meaning of the fields */
+struct ipaasn1_getkt_req {
+    bool newkt;
+    char *princ;
+    char *pwd;
+    long *etypes;
+    int numtypes;
+};
+
+/* The outcome of a single Get Keytab request within a batch. kvno and keys
+ * are only set when result is 0 (LDAP_SUCCESS) */
+struct ipaasn1_getkt_res {
+    int result;
+    int kvno;
+    struct keys_container keys;
+};
+
 /**
  * @brief Encodes a Get Keytab Request Control
  *
@@ -73,4 +91,72 @@ bool ipaasn1_dec_getkt(void *buf, size_t len, bool *newkt,
 bool ipaasn1_dec_getktreply(void *buf, size_t len,
                             int *kvno, struct keys_container *keys);
 
+/**
+ * @brief Encodes a batch of Get Keytab Requests
+ *
+ * @param reqs      The requests, one per principal
+ * @param nreqs     Number of requests in reqs
+ * @param buf       A void pointer will contain pointer to an allocated
+ *                  buffer with the serialized batch, must be freed
+ * @param len       Length of the returned buffer
+ *
+ * @return          True on success or False on failure
+ */
+bool ipaasn1_enc_getkt_batch(struct ipaasn1_getkt_req *reqs, int nreqs,
+                             void **buf, size_t *len);
+
+/**
+ * @brief Decodes a batch of Get Keytab Requests
+ *
+ * @param buf       A pointer to the serialized buffer
+ * @param len       The length of the buffer
+ * @param reqs      Returns an allocated array of requests
+ * @param nreqs     Returns the number of requests in reqs
+ *
+ * @return          True on success or False on failure
+ *
+ * NOTE: reqs should be freed with ipaasn1_free_getkt_reqs(), even in case
+ *       of failure.
+ */
+bool ipaasn1_dec_getkt_batch(void *buf, size_t len,
+                             struct ipaasn1_getkt_req **reqs, int *nreqs);
+
+/**
+ * @brief Frees an array of requests returned by ipaasn1_dec_getkt_batch()
+ *
+ * @param reqs      The requests
+ * @param nreqs     Number of requests in reqs
+ */
+void ipaasn1_free_getkt_reqs(struct ipaasn1_getkt_req *reqs, int nreqs);
+
+/**
+ * @brief Encodes the reply to a batch of Get Keytab Requests
+ *
+ * @param res       The results, in the same order as the requests
+ * @param nres      Number of results in res
+ * @param buf       A void pointer will contain pointer to an allocated
+ *                  buffer with the serialized reply, must be freed
+ * @param len       Length of the returned buffer
+ *
+ * @return          True on success or False on failure
+ */
+bool ipaasn1_enc_getkt_batchreply(struct ipaasn1_getkt_res *res, int nres,
+                                  void **buf, size_t *len);
+
+/**
+ * @brief Decodes the reply to a batch of Get Keytab Requests
+ *
+ * @param buf       A pointer to the serialized buffer
+ * @param len       The length of the buffer
+ * @param res       Returns an allocated array of results
+ * @param nres      Returns the number of results in res
+ *
+ * @return          True on success or False on failure
+ *
+ * NOTE: the caller must free the keys of each result and the array itself,
+ *       even in case of failure.
+ */
+bool ipaasn1_dec_getkt_batchreply(void *buf, size_t len,
+                                  struct ipaasn1_getkt_res **res, int *nres);
+
 #endif /* __IPA_ASN1_H_ */
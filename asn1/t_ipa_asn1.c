@@ -0,0 +1,183 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "ipa_asn1.h"
+
+static long etypes[] = { 18, 17 };
+
+/* The DER encodings of the batch types are fixed by ipa.asn1, a new
+ * version of the generated code must produce exactly these bytes */
+static const unsigned char batch_der[] = {
+    0x30, 0x1b,                                 /* GKBatchRequest */
+      0xa0, 0x10, 0x30, 0x0e,                   /*  newkeys */
+        0xa0, 0x03, 0x04, 0x01, 'a',            /*   serviceIdentity */
+        0xa1, 0x07, 0xa1, 0x05, 0x30, 0x03,     /*   enctypes, the [1] */
+          0x02, 0x01, 0x12,                     /*   tag appears twice */
+      0xa1, 0x07, 0x30, 0x05,                   /*  curkeys */
+        0xa0, 0x03, 0x04, 0x01, 'a',            /*   serviceIdentity */
+};
+
+static const unsigned char batchreply_der[] = {
+    0x30, 0x27,                                 /* GKBatchReply */
+      0x30, 0x1e,                               /*  GKBatchResult */
+        0xa0, 0x03, 0x02, 0x01, 0x00,           /*   result */
+        0xa1, 0x17, 0x30, 0x15,                 /*   reply */
+          0x02, 0x01, 0x02,                     /*    newkvno */
+          0x30, 0x10, 0x30, 0x0e,               /*    keys */
+            0xa0, 0x0c, 0x30, 0x0a,             /*     key */
+              0xa0, 0x03, 0x02, 0x01, 0x12,
+              0xa1, 0x03, 0x04, 0x01, 'k',
+      0x30, 0x05,                               /*  GKBatchResult */
+        0xa0, 0x03, 0x02, 0x01, 0x32,           /*   result */
+};
+
+static void test_der(void)
+{
+    struct ipaasn1_getkt_req reqs[] = {
+        { true, "a", NULL, etypes, 1 },
+        { false, "a", NULL, NULL, 0 },
+    };
+    struct krb_key_salt ks = { 0 };
+    struct ipaasn1_getkt_res res[2] = { { 0 } };
+    void *buf = NULL;
+    size_t len = 0;
+
+    assert(ipaasn1_enc_getkt_batch(reqs, 2, &buf, &len));
+    assert(len == sizeof(batch_der));
+    assert(memcmp(buf, batch_der, len) == 0);
+    free(buf);
+
+    ks.enctype = 18;
+    ks.key.enctype = 18;
+    ks.key.contents = (krb5_octet *)"k";
+    ks.key.length = 1;
+    res[0].result = 0;
+    res[0].kvno = 2;
+    res[0].keys.nkeys = 1;
+    res[0].keys.ksdata = &ks;
+    res[1].result = 50;
+
+    assert(ipaasn1_enc_getkt_batchreply(res, 2, &buf, &len));
+    assert(len == sizeof(batchreply_der));
+    assert(memcmp(buf, batchreply_der, len) == 0);
+    free(buf);
+}
+
+static void test_batch(void)
+{
+    struct ipaasn1_getkt_req in[] = {
+        { true, "host/a.example.com@EXAMPLE.COM", NULL, etypes, 2 },
+        { true, "host/b.example.com@EXAMPLE.COM", "Secret123", etypes, 1 },
+        { false, "host/c.example.com@EXAMPLE.COM", NULL, NULL, 0 },
+    };
+    struct ipaasn1_getkt_req *out = NULL;
+    int nout = 0;
+    void *buf = NULL;
+    size_t len = 0;
+
+    assert(ipaasn1_enc_getkt_batch(in, 3, &buf, &len));
+    assert(buf != NULL && len > 0);
+
+    assert(ipaasn1_dec_getkt_batch(buf, len, &out, &nout));
+    assert(nout == 3);
+    for (int i = 0; i < nout; i++) {
+        assert(out[i].newkt == in[i].newkt);
+        assert(strcmp(out[i].princ, in[i].princ) == 0);
+        if (in[i].pwd) {
+            assert(out[i].pwd != NULL);
+            assert(strcmp(out[i].pwd, in[i].pwd) == 0);
+        } else {
+            assert(out[i].pwd == NULL);
+        }
+        if (!in[i].newkt) continue;
+        assert(out[i].numtypes == in[i].numtypes);
+        for (int j = 0; j < in[i].numtypes; j++) {
+            assert(out[i].etypes[j] == in[i].etypes[j]);
+        }
+    }
+
+    /* a truncated buffer must be refused */
+    ipaasn1_free_getkt_reqs(out, nout);
+    out = NULL;
+    nout = 0;
+    assert(!ipaasn1_dec_getkt_batch(buf, len - 1, &out, &nout));
+    ipaasn1_free_getkt_reqs(out, nout);
+
+    free(buf);
+}
+
+static void test_batchreply(void)
+{
+    struct krb_key_salt ks[2] = { { 0 } };
+    struct ipaasn1_getkt_res in[2] = { { 0 } };
+    struct ipaasn1_getkt_res *out = NULL;
+    int nout = 0;
+    void *buf = NULL;
+    size_t len = 0;
+
+    ks[0].enctype = 18;
+    ks[0].key.enctype = 18;
+    ks[0].key.contents = (krb5_octet *)"0123456789abcdef0123456789abcdef";
+    ks[0].key.length = 32;
+    ks[0].salttype = 4;
+    ks[0].salt.data = "EXAMPLE.COMhostb.example.com";
+    ks[0].salt.length = strlen(ks[0].salt.data);
+    ks[1].enctype = 17;
+    ks[1].key.enctype = 17;
+    ks[1].key.contents = (krb5_octet *)"0123456789abcdef";
+    ks[1].key.length = 16;
+
+    /* one success carrying keys, one per-principal failure */
+    in[0].result = 0;
+    in[0].kvno = 3;
+    in[0].keys.nkeys = 2;
+    in[0].keys.ksdata = ks;
+    in[1].result = 50;
+
+    assert(ipaasn1_enc_getkt_batchreply(in, 2, &buf, &len));
+    assert(buf != NULL && len > 0);
+
+    assert(ipaasn1_dec_getkt_batchreply(buf, len, &out, &nout));
+    assert(nout == 2);
+
+    assert(out[0].result == 0);
+    assert(out[0].kvno == 3);
+    assert(out[0].keys.nkeys == 2);
+    for (int i = 0; i < 2; i++) {
+        struct krb_key_salt *k = &out[0].keys.ksdata[i];
+
+        assert(k->enctype == ks[i].enctype);
+        assert(k->key.length == ks[i].key.length);
+        assert(memcmp(k->key.contents,
+                      ks[i].key.contents, ks[i].key.length) == 0);
+        if (ks[i].salt.data) {
+            assert(k->salttype == ks[i].salttype);
+            assert(k->salt.length == ks[i].salt.length);
+            assert(memcmp(k->salt.data,
+                          ks[i].salt.data, ks[i].salt.length) == 0);
+        } else {
+            assert(k->salt.data == NULL);
+        }
+        free(k->key.contents);
+        free(k->salt.data);
+    }
+    free(out[0].keys.ksdata);
+
+    assert(out[1].result == 50);
+    assert(out[1].keys.nkeys == 0);
+    assert(out[1].keys.ksdata == NULL);
+
+    free(out);
+    free(buf);
+}
+
+int
+main(int argc, const char *argv[])
+{
+    test_batch();
+    test_batchreply();
+    test_der();
+    return 0;
+}
@@ -0,0 +1,1143 @@
+/*
+ * FreeIPA 2FA companion daemon
+ *
+ * Copyright (C) 2026  FreeIPA Contributors
+ * see file 'COPYING' for use and warranty information
+ *
+ * This program is free software you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This file implements a load generator for ipa-otpd. It starts ipa-otpd the
+ * same way systemd does for an accepted connection on the otpd socket (the
+ * connected Unix socket is handed over as STDIN/STDOUT) and replays a mix of
+ * RADIUS requests over it at a target rate:
+ *
+ *   native    - a user with a native OTP token, authenticated by LDAP bind
+ *   radius    - a user proxied to a third-party RADIUS server
+ *   unknown   - a principal which does not exist in the directory
+ *   duplicate - a native request immediately followed by a retransmission
+ *
+ * The directory is a minimal in-process LDAP stand-in listening on an ldapi
+ * socket. It serves synthetic users, tokens and a RADIUS proxy configuration
+ * without any storage. The proxied requests are answered by an in-process
+ * fake RADIUS server with optional artificial latency.
+ *
+ * At the end, throughput and latency percentiles per request class are
+ * printed. ipa-otpd's own logging is discarded unless -v is given, since in
+ * production it goes to the journal rather than a terminal.
+ */
+
+#define _GNU_SOURCE 1
+#include "internal.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_SUFFIX "dc=bench,dc=test"
+#define BENCH_REALM "BENCH.TEST"
+#define BENCH_RADIUS_DN "cn=bench,cn=radiusproxy," BENCH_SUFFIX
+#define BENCH_RADIUS_SECRET "benchsecret"
+#define BENCH_IDLE_TIMEOUT 5 /* seconds without a response before giving up */
+
+enum bench_class {
+    BENCH_NATIVE = 0,
+    BENCH_RADIUS,
+    BENCH_UNKNOWN,
+    BENCH_DUPLICATE,
+    BENCH_CLASSES
+};
+
+static const char *const class_names[BENCH_CLASSES] = {
+    "native", "radius", "unknown", "duplicate"
+};
+
+struct bench_slot {
+    krad_packet *req;
+    enum bench_class cls;
+    krad_code expect;
+    uint64_t sent;
+};
+
+struct bench_stats {
+    uint64_t *lat;
+    size_t nlat;
+    size_t sent;
+    size_t accept;
+    size_t reject;
+    size_t unexpected;
+};
+
+static struct {
+    const char *otpd;
+    size_t count;
+    double rate;
+    unsigned int window;
+    unsigned int users;
+    unsigned int mix[BENCH_CLASSES];
+    unsigned int mixtotal;
+    unsigned int radius_delay; /* milliseconds */
+    uint64_t seed;
+    bool verbose;
+} opts = {
+    .otpd = "./ipa-otpd",
+    .count = 10000,
+    .rate = 0,
+    .window = 64,
+    .users = 1000,
+    .mix = { 70, 20, 5, 5 },
+    .mixtotal = 100,
+    .radius_delay = 0,
+    .seed = 0x9e3779b97f4a7c15ULL,
+    .verbose = false,
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t xorshift(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/* The OTP value of the synthetic token belonging to user number n. */
+static unsigned int user_code(unsigned int n)
+{
+    return (n * 2654435761U) % 1000000;
+}
+
+static void user_password(unsigned int n, char *buf, size_t len)
+{
+    snprintf(buf, len, "password%u%06u", n, user_code(n));
+}
+
+/* Parse "<prefix><n>@<tail>" and check n against the user count. */
+static bool parse_user(const char *str, size_t len, const char *prefix,
+                       const char *tail, unsigned int *n)
+{
+    size_t plen = strlen(prefix), tlen = strlen(tail);
+    unsigned long l = 0;
+    size_t i;
+
+    if (len <= plen + tlen || strncasecmp(str, prefix, plen) != 0 ||
+        strncasecmp(str + len - tlen, tail, tlen) != 0)
+        return false;
+
+    for (i = plen; i < len - tlen; i++) {
+        if (str[i] < '0' || str[i] > '9' || l > UINT_MAX / 10)
+            return false;
+        l = l * 10 + str[i] - '0';
+    }
+
+    if (i == plen || l >= opts.users)
+        return false;
+
+    *n = l;
+    return true;
+}
+
+/*
+ * LDAP stand-in
+ */
+
+struct ldap_attr {
+    const char *name;
+    char value[256];
+};
+
+static int ldap_send_result(Sockbuf *sb, ber_int_t msgid, ber_tag_t type,
+                            ber_int_t rc)
+{
+    BerElement *ber;
+
+    ber = ber_alloc_t(LBER_USE_DER);
+    if (ber == NULL)
+        return ENOMEM;
+
+    if (ber_printf(ber, "{it{ess}}", msgid, type, rc, "", "") == -1) {
+        ber_free(ber, 1);
+        return EINVAL;
+    }
+
+    return ber_flush2(sb, ber, LBER_FLUSH_FREE_ALWAYS) == 0 ? 0 : EIO;
+}
+
+static int ldap_send_entry(Sockbuf *sb, ber_int_t msgid, const char *dn,
+                           const struct ldap_attr *attrs)
+{
+    BerElement *ber;
+    int i;
+
+    ber = ber_alloc_t(LBER_USE_DER);
+    if (ber == NULL)
+        return ENOMEM;
+
+    if (ber_printf(ber, "{it{s{", msgid, LDAP_RES_SEARCH_ENTRY, dn) == -1)
+        goto error;
+
+    for (i = 0; attrs[i].name != NULL; i++) {
+        if (ber_printf(ber, "{s[s]}", attrs[i].name, attrs[i].value) == -1)
+            goto error;
+    }
+
+    if (ber_printf(ber, "}}}") == -1)
+        goto error;
+
+    return ber_flush2(sb, ber, LBER_FLUSH_FREE_ALWAYS) == 0 ? 0 : EIO;
+
+error:
+    ber_free(ber, 1);
+    return EINVAL;
+}
+
+/* Walk a search filter and pick out the assertion value for attr. */
+static int find_filter_value(BerElement *ber, const char *attr,
+                             struct berval *out)
+{
+    struct berval a, v;
+    ber_tag_t tag;
+    ber_len_t len;
+    char *cookie;
+
+    tag = ber_peek_tag(ber, &len);
+    switch (tag) {
+    case LDAP_FILTER_EQUALITY:
+        if (ber_scanf(ber, "{mm}", &a, &v) == LBER_ERROR)
+            return EINVAL;
+        if (a.bv_len == strlen(attr) &&
+            strncasecmp(a.bv_val, attr, a.bv_len) == 0)
+            *out = v;
+        return 0;
+
+    case LDAP_FILTER_AND:
+    case LDAP_FILTER_OR:
+        for (tag = ber_first_element(ber, &len, &cookie);
+             tag != LBER_DEFAULT;
+             tag = ber_next_element(ber, &len, cookie)) {
+            if (find_filter_value(ber, attr, out) != 0)
+                return EINVAL;
+        }
+        return 0;
+
+    default:
+        return ber_scanf(ber, "x") == LBER_ERROR ? EINVAL : 0;
+    }
+}
+
+static int ldap_do_bind(Sockbuf *sb, BerElement *ber, ber_int_t msgid)
+{
+    char pw[64], expected[64];
+    struct berval dn, cred;
+    ber_int_t version;
+    ber_tag_t method;
+    unsigned int n;
+    char *uid;
+
+    if (ber_scanf(ber, "{imt", &version, &dn, &method) == LBER_ERROR)
+        return EINVAL;
+
+    /* SASL EXTERNAL for the query connection always succeeds. */
+    if (method != LDAP_AUTH_SIMPLE)
+        return ldap_send_result(sb, msgid, LDAP_RES_BIND, LDAP_SUCCESS);
+
+    if (ber_scanf(ber, "m}", &cred) == LBER_ERROR)
+        return EINVAL;
+
+    uid = strndupa(dn.bv_val, dn.bv_len);
+    if (!parse_user(uid, strlen(uid), "uid=otp",
+                    ",cn=users,cn=accounts," BENCH_SUFFIX, &n) ||
+        cred.bv_len >= sizeof(pw))
+        return ldap_send_result(sb, msgid, LDAP_RES_BIND,
+                                LDAP_INVALID_CREDENTIALS);
+
+    memcpy(pw, cred.bv_val, cred.bv_len);
+    pw[cred.bv_len] = '\0';
+    user_password(n, expected, sizeof(expected));
+
+    return ldap_send_result(sb, msgid, LDAP_RES_BIND,
+                            strcmp(pw, expected) == 0
+                                ? LDAP_SUCCESS
+                                : LDAP_INVALID_CREDENTIALS);
+}
+
+static int ldap_do_search(Sockbuf *sb, BerElement *ber, ber_int_t msgid,
+                          const char *radius_server)
+{
+    struct ldap_attr attrs[8] = { { NULL } };
+    struct berval base, princ = { 0, NULL };
+    ber_int_t scope, deref, sizelimit, timelimit, typesonly;
+    char dn[256], *str;
+    unsigned int n;
+    int retval;
+
+    if (ber_scanf(ber, "{meeiib", &base, &scope, &deref, &sizelimit,
+                  &timelimit, &typesonly) == LBER_ERROR)
+        return EINVAL;
+
+    if (find_filter_value(ber, "krbPrincipalName", &princ) != 0)
+        return EINVAL;
+
+    str = strndupa(base.bv_val, base.bv_len);
+
+    if (base.bv_len == 0 && scope == LDAP_SCOPE_BASE) {
+        /* Root DSE. */
+        attrs[0].name = "namingContexts";
+        strcpy(attrs[0].value, BENCH_SUFFIX);
+        retval = ldap_send_entry(sb, msgid, "", attrs);
+
+    } else if (scope == LDAP_SCOPE_SUBTREE && princ.bv_val != NULL) {
+        /* User lookup by principal. */
+        retval = 0;
+        if (parse_user(princ.bv_val, princ.bv_len, "otp",
+                       "@" BENCH_REALM, &n)) {
+            snprintf(dn, sizeof(dn),
+                     "uid=otp%u,cn=users,cn=accounts," BENCH_SUFFIX, n);
+            attrs[0].name = "uid";
+            snprintf(attrs[0].value, sizeof(attrs[0].value), "otp%u", n);
+            retval = ldap_send_entry(sb, msgid, dn, attrs);
+        } else if (parse_user(princ.bv_val, princ.bv_len, "rad",
+                              "@" BENCH_REALM, &n)) {
+            snprintf(dn, sizeof(dn),
+                     "uid=rad%u,cn=users,cn=accounts," BENCH_SUFFIX, n);
+            attrs[0].name = "uid";
+            snprintf(attrs[0].value, sizeof(attrs[0].value), "rad%u", n);
+            attrs[1].name = "ipatokenRadiusUserName";
+            snprintf(attrs[1].value, sizeof(attrs[1].value), "rad%u", n);
+            attrs[2].name = "ipatokenRadiusConfigLink";
+            strcpy(attrs[2].value, BENCH_RADIUS_DN);
+            retval = ldap_send_entry(sb, msgid, dn, attrs);
+        }
+
+    } else if (scope == LDAP_SCOPE_BASE &&
+               strcasecmp(str, BENCH_RADIUS_DN) == 0) {
+        /* RADIUS proxy configuration. */
+        attrs[0].name = "ipatokenRadiusServer";
+        strcpy(attrs[0].value, radius_server);
+        attrs[1].name = "ipatokenRadiusSecret";
+        strcpy(attrs[1].value, BENCH_RADIUS_SECRET);
+        attrs[2].name = "ipatokenRadiusTimeout";
+        strcpy(attrs[2].value, "5");
+        attrs[3].name = "ipatokenRadiusRetries";
+        strcpy(attrs[3].value, "1");
+        retval = ldap_send_entry(sb, msgid, BENCH_RADIUS_DN, attrs);
+
+    } else {
+        retval = ldap_send_result(sb, msgid, LDAP_RES_SEARCH_RESULT,
+                                  LDAP_NO_SUCH_OBJECT);
+        return retval;
+    }
+
+    if (retval != 0)
+        return retval;
+
+    return ldap_send_result(sb, msgid, LDAP_RES_SEARCH_RESULT, LDAP_SUCCESS);
+}
+
+struct ldap_conn {
+    int fd;
+    const char *radius_server;
+};
+
+/* Serve one LDAP connection from ipa-otpd until it is closed. */
+static void *ldap_conn_thread(void *arg)
+{
+    struct ldap_conn *conn = arg;
+    BerElement *ber = NULL;
+    ber_int_t msgid;
+    ber_tag_t tag;
+    ber_len_t len;
+    Sockbuf *sb;
+    int retval = 0;
+
+    sb = ber_sockbuf_alloc();
+    if (sb == NULL)
+        goto egress;
+    ber_sockbuf_add_io(sb, &ber_sockbuf_io_fd, LBER_SBIOD_LEVEL_PROVIDER,
+                       &conn->fd);
+
+    while (retval == 0) {
+        ber = ber_alloc_t(0);
+        if (ber == NULL)
+            break;
+
+        tag = ber_get_next(sb, &len, ber);
+        if (tag != LDAP_TAG_MESSAGE)
+            break;
+
+        if (ber_get_int(ber, &msgid) != LDAP_TAG_MSGID)
+            break;
+
+        switch (ber_peek_tag(ber, &len)) {
+        case LDAP_REQ_BIND:
+            retval = ldap_do_bind(sb, ber, msgid);
+            break;
+        case LDAP_REQ_SEARCH:
+            retval = ldap_do_search(sb, ber, msgid, conn->radius_server);
+            break;
+        case LDAP_REQ_ABANDON:
+            break;
+        default: /* LDAP_REQ_UNBIND and anything unexpected. */
+            retval = ECONNRESET;
+            break;
+        }
+
+        ber_free(ber, 1);
+        ber = NULL;
+    }
+
+egress:
+    ber_free(ber, 1);
+    if (sb != NULL)
+        ber_sockbuf_free(sb);
+    close(conn->fd);
+    free(conn);
+    return NULL;
+}
+
+struct ldap_server {
+    int fd;
+    const char *radius_server;
+};
+
+static void *ldap_accept_thread(void *arg)
+{
+    struct ldap_server *srv = arg;
+    struct ldap_conn *conn;
+    pthread_t tid;
+    int fd;
+
+    for (;;) {
+        fd = accept(srv->fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        conn = calloc(1, sizeof(*conn));
+        if (conn == NULL) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->radius_server = srv->radius_server;
+
+        if (pthread_create(&tid, NULL, ldap_conn_thread, conn) != 0) {
+            close(fd);
+            free(conn);
+            continue;
+        }
+        pthread_detach(tid);
+    }
+
+    return NULL;
+}
+
+/*
+ * Fake RADIUS upstream
+ */
+
+struct radius_reply {
+    uint64_t due;
+    struct sockaddr_storage ss;
+    socklen_t sslen;
+    krad_packet *rsp;
+};
+
+struct radius_server {
+    int fd;
+    krb5_context kctx;
+    struct radius_reply *replies;
+    size_t nreplies;
+    size_t areplies;
+};
+
+static void radius_flush(struct radius_server *srv, uint64_t now)
+{
+    const krb5_data *data;
+    size_t i, j;
+
+    for (i = 0, j = 0; i < srv->nreplies; i++) {
+        if (srv->replies[i].due > now) {
+            srv->replies[j++] = srv->replies[i];
+            continue;
+        }
+
+        data = krad_packet_encode(srv->replies[i].rsp);
+        sendto(srv->fd, data->data, data->length, 0,
+               (struct sockaddr *)&srv->replies[i].ss,
+               srv->replies[i].sslen);
+        krad_packet_free(srv->replies[i].rsp);
+    }
+    srv->nreplies = j;
+}
+
+static void radius_handle(struct radius_server *srv)
+{
+    char buf[KRAD_PACKET_SIZE_MAX], expected[64];
+    const krad_packet *dup;
+    const krb5_data *name, *pass;
+    struct radius_reply *r;
+    krad_packet *req = NULL;
+    krb5_data data;
+    unsigned int n;
+    krad_code code;
+    ssize_t len;
+
+    if (srv->nreplies == srv->areplies) {
+        r = realloc(srv->replies, (srv->areplies * 2 + 16) * sizeof(*r));
+        if (r == NULL)
+            return;
+        srv->replies = r;
+        srv->areplies = srv->areplies * 2 + 16;
+    }
+    r = &srv->replies[srv->nreplies];
+
+    r->sslen = sizeof(r->ss);
+    len = recvfrom(srv->fd, buf, sizeof(buf), 0,
+                   (struct sockaddr *)&r->ss, &r->sslen);
+    if (len <= 0)
+        return;
+
+    data.data = buf;
+    data.length = len;
+    if (krad_packet_decode_request(srv->kctx, BENCH_RADIUS_SECRET, &data,
+                                   NULL, NULL, &dup, &req) != 0)
+        return;
+
+    code = krad_code_name2num("Access-Reject");
+    name = krad_packet_get_attr(req, krad_attr_name2num("User-Name"), 0);
+    pass = krad_packet_get_attr(req, krad_attr_name2num("User-Password"), 0);
+    if (name != NULL && pass != NULL &&
+        parse_user(name->data, name->length, "rad", "", &n)) {
+        user_password(n, expected, sizeof(expected));
+        if (pass->length == strlen(expected) &&
+            memcmp(pass->data, expected, pass->length) == 0)
+            code = krad_code_name2num("Access-Accept");
+    }
+
+    if (krad_packet_new_response(srv->kctx, BENCH_RADIUS_SECRET, code,
+                                 NULL, req, &r->rsp) == 0) {
+        r->due = now_ns() + opts.radius_delay * 1000000ULL;
+        srv->nreplies++;
+    }
+
+    krad_packet_free(req);
+}
+
+static void *radius_thread(void *arg)
+{
+    struct radius_server *srv = arg;
+    struct pollfd pfd;
+    uint64_t now, next;
+    size_t i;
+    int timeout;
+
+    for (;;) {
+        now = now_ns();
+        radius_flush(srv, now);
+
+        timeout = -1;
+        for (i = 0, next = UINT64_MAX; i < srv->nreplies; i++) {
+            if (srv->replies[i].due < next)
+                next = srv->replies[i].due;
+        }
+        if (next != UINT64_MAX)
+            timeout = (next - now) / 1000000 + 1;
+
+        pfd.fd = srv->fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, timeout) > 0 && (pfd.revents & POLLIN))
+            radius_handle(srv);
+    }
+
+    return NULL;
+}
+
+/*
+ * Load generator
+ */
+
+struct bench_iter {
+    struct bench_slot *slots;
+    unsigned int pos;
+};
+
+/* Iterate over outstanding requests, for krad id allocation and matching. */
+static const krad_packet *bench_iter_func(void *data, krb5_boolean cancel)
+{
+    struct bench_iter *iter = data;
+
+    if (cancel) {
+        iter->pos = UCHAR_MAX + 1;
+        return NULL;
+    }
+
+    while (iter->pos <= UCHAR_MAX) {
+        if (iter->slots[iter->pos].req != NULL)
+            return iter->slots[iter->pos++].req;
+        iter->pos++;
+    }
+
+    return NULL;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+    ssize_t i;
+
+    while (len > 0) {
+        i = write(fd, buf, len);
+        if (i < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            return errno;
+        }
+        buf += i;
+        len -= i;
+    }
+
+    return 0;
+}
+
+static enum bench_class pick_class(uint64_t *rng)
+{
+    unsigned int r, i;
+
+    r = xorshift(rng) % opts.mixtotal;
+    for (i = 0; i < BENCH_CLASSES - 1; i++) {
+        if (r < opts.mix[i])
+            break;
+        r -= opts.mix[i];
+    }
+
+    return i;
+}
+
+static krb5_error_code send_request(krb5_context kctx, int fd,
+                                    struct bench_slot *slots,
+                                    krad_attrset *attrs, uint64_t *rng,
+                                    struct bench_stats *stats)
+{
+    char name[64], pass[64];
+    struct bench_iter iter = { slots, 0 };
+    krb5_error_code retval;
+    const krb5_data *data;
+    enum bench_class cls;
+    krad_packet *req;
+    krb5_data d;
+    unsigned int n;
+    krad_code expect;
+
+    cls = pick_class(rng);
+    n = xorshift(rng) % opts.users;
+    expect = krad_code_name2num("Access-Accept");
+
+    switch (cls) {
+    case BENCH_RADIUS:
+        snprintf(name, sizeof(name), "rad%u@" BENCH_REALM, n);
+        break;
+    case BENCH_UNKNOWN:
+        snprintf(name, sizeof(name), "nobody%u@" BENCH_REALM, n);
+        expect = krad_code_name2num("Access-Reject");
+        break;
+    default:
+        snprintf(name, sizeof(name), "otp%u@" BENCH_REALM, n);
+        break;
+    }
+    user_password(n, pass, sizeof(pass));
+
+    d.data = name;
+    d.length = strlen(name);
+    retval = krad_attrset_add(attrs, krad_attr_name2num("User-Name"), &d);
+    if (retval != 0)
+        return retval;
+
+    d.data = pass;
+    d.length = strlen(pass);
+    retval = krad_attrset_add(attrs, krad_attr_name2num("User-Password"), &d);
+    if (retval != 0) {
+        krad_attrset_del(attrs, krad_attr_name2num("User-Name"), 0);
+        return retval;
+    }
+
+    retval = krad_packet_new_request(kctx, SECRET,
+                                     krad_code_name2num("Access-Request"),
+                                     attrs, bench_iter_func, &iter, &req);
+    krad_attrset_del(attrs, krad_attr_name2num("User-Name"), 0);
+    krad_attrset_del(attrs, krad_attr_name2num("User-Password"), 0);
+    if (retval != 0)
+        return retval;
+
+    data = krad_packet_encode(req);
+    retval = write_all(fd, data->data, data->length);
+    if (retval == 0 && cls == BENCH_DUPLICATE)
+        retval = write_all(fd, data->data, data->length);
+    if (retval != 0) {
+        krad_packet_free(req);
+        return retval;
+    }
+
+    /* The second byte of a RADIUS packet is its identifier. */
+    n = (unsigned char)data->data[1];
+    slots[n].req = req;
+    slots[n].cls = cls;
+    slots[n].expect = expect;
+    slots[n].sent = now_ns();
+    stats[cls].sent++;
+    return 0;
+}
+
+/* Read from otpd and account for every complete response. */
+static krb5_error_code read_responses(krb5_context kctx, int fd,
+                                      struct bench_slot *slots,
+                                      unsigned int *outstanding,
+                                      size_t *unmatched,
+                                      struct bench_stats *stats)
+{
+    static char _buffer[KRAD_PACKET_SIZE_MAX];
+    static krb5_data buffer = { .data = _buffer, .length = 0 };
+    struct bench_iter iter = { slots, 0 };
+    const krad_packet *req;
+    krad_packet *rsp;
+    struct bench_slot *slot;
+    struct bench_stats *st;
+    krb5_error_code retval;
+    ssize_t pktlen, i;
+    uint64_t now;
+
+    pktlen = krad_packet_bytes_needed(&buffer);
+    if (pktlen < 0)
+        return EBADMSG;
+
+    i = read(fd, buffer.data + buffer.length, pktlen);
+    if (i == 0)
+        return ECONNRESET;
+    if (i < 0)
+        return errno == EAGAIN || errno == EINTR ? 0 : errno;
+
+    buffer.length += i;
+    if (krad_packet_bytes_needed(&buffer) > 0)
+        return 0;
+
+    now = now_ns();
+    retval = krad_packet_decode_response(kctx, SECRET, &buffer,
+                                         bench_iter_func, &iter, &req, &rsp);
+    buffer.length = 0;
+    if (retval != 0)
+        return retval;
+
+    if (req == NULL) {
+        (*unmatched)++;
+        krad_packet_free(rsp);
+        return 0;
+    }
+
+    for (slot = slots; slot->req != req; slot++)
+        continue;
+
+    st = &stats[slot->cls];
+    st->lat[st->nlat++] = now - slot->sent;
+    if (krad_packet_get_code(rsp) == krad_code_name2num("Access-Accept"))
+        st->accept++;
+    else
+        st->reject++;
+    if (krad_packet_get_code(rsp) != slot->expect)
+        st->unexpected++;
+
+    krad_packet_free(slot->req);
+    krad_packet_free(rsp);
+    slot->req = NULL;
+    (*outstanding)--;
+    return 0;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const uint64_t *lat, size_t n, double p)
+{
+    size_t i;
+
+    if (n == 0)
+        return 0;
+
+    i = (size_t)(p / 100.0 * (n - 1) + 0.5);
+    return lat[i] / 1000.0;
+}
+
+static void report(struct bench_stats *stats, uint64_t elapsed,
+                   size_t unmatched, unsigned int outstanding)
+{
+    struct bench_stats total = { NULL, 0, 0, 0, 0, 0 };
+    struct bench_stats *st;
+    size_t i;
+
+    total.lat = calloc(opts.count, sizeof(uint64_t));
+    if (total.lat == NULL)
+        return;
+
+    printf("%-10s %8s %8s %8s %6s %10s %10s %10s %10s %10s\n",
+           "class", "sent", "accept", "reject", "wrong",
+           "p50(us)", "p90(us)", "p99(us)", "p99.9(us)", "max(us)");
+
+    for (i = 0; i <= BENCH_CLASSES; i++) {
+        st = i < BENCH_CLASSES ? &stats[i] : &total;
+        if (i < BENCH_CLASSES) {
+            memcpy(total.lat + total.nlat, st->lat,
+                   st->nlat * sizeof(uint64_t));
+            total.nlat += st->nlat;
+            total.sent += st->sent;
+            total.accept += st->accept;
+            total.reject += st->reject;
+            total.unexpected += st->unexpected;
+        }
+
+        qsort(st->lat, st->nlat, sizeof(uint64_t), cmp_u64);
+        printf("%-10s %8zu %8zu %8zu %6zu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+               i < BENCH_CLASSES ? class_names[i] : "total",
+               st->sent, st->accept, st->reject, st->unexpected,
+               percentile(st->lat, st->nlat, 50),
+               percentile(st->lat, st->nlat, 90),
+               percentile(st->lat, st->nlat, 99),
+               percentile(st->lat, st->nlat, 99.9),
+               st->nlat > 0 ? st->lat[st->nlat - 1] / 1000.0 : 0);
+    }
+
+    printf("\nelapsed:     %.3f s\n", elapsed / 1e9);
+    printf("throughput:  %.1f responses/s\n",
+           elapsed > 0 ? total.nlat / (elapsed / 1e9) : 0);
+    printf("unanswered:  %u\n", outstanding);
+    printf("unmatched:   %zu\n", unmatched);
+    free(total.lat);
+}
+
+static int parse_mix(const char *str)
+{
+    unsigned int i;
+    char *end;
+
+    opts.mixtotal = 0;
+    for (i = 0; i < BENCH_CLASSES; i++) {
+        opts.mix[i] = strtoul(str, &end, 10);
+        opts.mixtotal += opts.mix[i];
+        if (i < BENCH_CLASSES - 1 ? *end != ':' : *end != '\0')
+            return EINVAL;
+        str = end + 1;
+    }
+
+    return opts.mixtotal > 0 ? 0 : EINVAL;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -d PATH   ipa-otpd binary to run (default: ./ipa-otpd)\n"
+            "  -n COUNT  number of requests to send (default: 10000)\n"
+            "  -r RATE   target requests per second (default: unlimited)\n"
+            "  -w COUNT  maximum outstanding requests, 1-255 (default: 64)\n"
+            "  -u COUNT  synthetic users per class (default: 1000)\n"
+            "  -m MIX    native:radius:unknown:duplicate weights "
+            "(default: 70:20:5:5)\n"
+            "  -l MSEC   fake RADIUS server response delay (default: 0)\n"
+            "  -S SEED   random seed\n"
+            "  -v        show ipa-otpd log output\n",
+            argv0);
+}
+
+static int setup_ldap_server(const char *path, struct ldap_server *srv)
+{
+    struct sockaddr_un sun;
+    pthread_t tid;
+
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(sun.sun_path))
+        return ENAMETOOLONG;
+    strcpy(sun.sun_path, path);
+
+    srv->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (srv->fd < 0)
+        return errno;
+
+    if (bind(srv->fd, (struct sockaddr *)&sun, sizeof(sun)) < 0 ||
+        listen(srv->fd, 16) < 0)
+        return errno;
+
+    if (pthread_create(&tid, NULL, ldap_accept_thread, srv) != 0)
+        return EAGAIN;
+    pthread_detach(tid);
+
+    return 0;
+}
+
+static int setup_radius_server(struct radius_server *srv, char *addr,
+                               size_t len)
+{
+    struct sockaddr_in sin;
+    socklen_t slen = sizeof(sin);
+    pthread_t tid;
+    int retval;
+
+    retval = krb5_init_context(&srv->kctx);
+    if (retval != 0)
+        return retval;
+
+    srv->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (srv->fd < 0)
+        return errno;
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(srv->fd, (struct sockaddr *)&sin, sizeof(sin)) < 0 ||
+        getsockname(srv->fd, (struct sockaddr *)&sin, &slen) < 0)
+        return errno;
+
+    snprintf(addr, len, "127.0.0.1:%u", ntohs(sin.sin_port));
+
+    if (pthread_create(&tid, NULL, radius_thread, srv) != 0)
+        return EAGAIN;
+    pthread_detach(tid);
+
+    return 0;
+}
+
+static pid_t spawn_otpd(const char *uri, int *fd)
+{
+    int sv[2], null;
+    pid_t pid;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+        return -1;
+
+    pid = fork();
+    if (pid < 0)
+        return -1;
+
+    if (pid == 0) {
+        dup2(sv[1], STDIN_FILENO);
+        dup2(sv[1], STDOUT_FILENO);
+        if (!opts.verbose) {
+            null = open("/dev/null", O_WRONLY);
+            if (null >= 0)
+                dup2(null, STDERR_FILENO);
+        }
+        close(sv[0]);
+        close(sv[1]);
+        execl(opts.otpd, opts.otpd, uri, (char *)NULL);
+        _exit(127);
+    }
+
+    close(sv[1]);
+    *fd = sv[0];
+    return pid;
+}
+
+int main(int argc, char **argv)
+{
+    char tmpdir[] = "/tmp/ipa-otpd-bench.XXXXXX";
+    char sockpath[PATH_MAX], uri[PATH_MAX * 3], radius_addr[64];
+    struct bench_stats stats[BENCH_CLASSES];
+    struct bench_slot slots[UCHAR_MAX + 1];
+    struct radius_server rsrv;
+    struct ldap_server lsrv;
+    unsigned int outstanding = 0;
+    size_t sent = 0, unmatched = 0, i;
+    uint64_t start, now, next, last;
+    krb5_context kctx = NULL;
+    krad_attrset *attrs = NULL;
+    krb5_error_code retval;
+    struct pollfd pfd;
+    int fd = -1, opt, timeout, status;
+    pid_t pid = -1;
+    char *c;
+
+    while ((opt = getopt(argc, argv, "d:n:r:w:u:m:l:S:vh")) != -1) {
+        switch (opt) {
+        case 'd': opts.otpd = optarg; break;
+        case 'n': opts.count = strtoul(optarg, NULL, 10); break;
+        case 'r': opts.rate = strtod(optarg, NULL); break;
+        case 'w': opts.window = strtoul(optarg, NULL, 10); break;
+        case 'u': opts.users = strtoul(optarg, NULL, 10); break;
+        case 'l': opts.radius_delay = strtoul(optarg, NULL, 10); break;
+        case 'S': opts.seed = strtoull(optarg, NULL, 0) | 1; break;
+        case 'v': opts.verbose = true; break;
+        case 'm':
+            if (parse_mix(optarg) == 0)
+                break;
+            /* fall through */
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (opts.window < 1 || opts.window > UCHAR_MAX || opts.users < 1 ||
+        opts.count < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    memset(slots, 0, sizeof(slots));
+    memset(stats, 0, sizeof(stats));
+    memset(&rsrv, 0, sizeof(rsrv));
+    for (i = 0; i < BENCH_CLASSES; i++) {
+        stats[i].lat = calloc(opts.count, sizeof(uint64_t));
+        if (stats[i].lat == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+    }
+
+    retval = krb5_init_context(&kctx);
+    if (retval == 0)
+        retval = krad_attrset_new(kctx, &attrs);
+    if (retval != 0) {
+        fprintf(stderr, "Unable to initialize krad: %s\n", strerror(retval));
+        return 1;
+    }
+
+    /* Fake RADIUS upstream. */
+    retval = setup_radius_server(&rsrv, radius_addr, sizeof(radius_addr));
+    if (retval != 0) {
+        fprintf(stderr, "Unable to start RADIUS server: %s\n",
+                strerror(retval));
+        return 1;
+    }
+
+    /* LDAP stand-in on an ldapi socket. */
+    if (mkdtemp(tmpdir) == NULL) {
+        fprintf(stderr, "Unable to create %s: %s\n", tmpdir, strerror(errno));
+        return 1;
+    }
+    snprintf(sockpath, sizeof(sockpath), "%s/ldapi", tmpdir);
+    lsrv.radius_server = radius_addr;
+    retval = setup_ldap_server(sockpath, &lsrv);
+    if (retval != 0) {
+        fprintf(stderr, "Unable to start LDAP server: %s\n",
+                strerror(retval));
+        goto egress;
+    }
+
+    strcpy(uri, "ldapi://");
+    for (c = sockpath; *c != '\0'; c++) {
+        if (*c == '/')
+            strcat(uri, "%2F");
+        else
+            strncat(uri, c, 1);
+    }
+
+    pid = spawn_otpd(uri, &fd);
+    if (pid < 0) {
+        fprintf(stderr, "Unable to start %s: %s\n", opts.otpd,
+                strerror(errno));
+        goto egress;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    start = next = last = now_ns();
+    while (sent < opts.count || outstanding > 0) {
+        now = now_ns();
+
+        /* Send as many requests as are due and fit in the window. */
+        while (sent < opts.count && outstanding < opts.window &&
+               (opts.rate <= 0 || next <= now)) {
+            retval = send_request(kctx, fd, slots, attrs, &opts.seed, stats);
+            if (retval != 0) {
+                fprintf(stderr, "Unable to send request: %s\n",
+                        strerror(retval));
+                goto report;
+            }
+            sent++;
+            outstanding++;
+            if (opts.rate > 0)
+                next += 1e9 / opts.rate;
+        }
+
+        timeout = BENCH_IDLE_TIMEOUT * 1000;
+        if (sent < opts.count && outstanding < opts.window && opts.rate > 0)
+            timeout = next > now ? (next - now) / 1000000 : 0;
+
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, timeout) < 0 && errno != EINTR)
+            break;
+
+        if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+            retval = read_responses(kctx, fd, slots, &outstanding,
+                                    &unmatched, stats);
+            if (retval != 0) {
+                fprintf(stderr, "Unable to read response: %s\n",
+                        strerror(retval));
+                break;
+            }
+            last = now_ns();
+        } else if (now_ns() - last > BENCH_IDLE_TIMEOUT * 1000000000ULL) {
+            fprintf(stderr, "Timed out waiting for responses\n");
+            break;
+        }
+    }
+
+report:
+    report(stats, last - start, unmatched, outstanding);
+
+egress:
+    if (fd >= 0)
+        close(fd);
+    if (pid > 0)
+        waitpid(pid, &status, 0);
+    unlink(sockpath);
+    rmdir(tmpdir);
+    for (i = 0; i <= UCHAR_MAX; i++)
+        krad_packet_free(slots[i].req);
+    for (i = 0; i < BENCH_CLASSES; i++)
+        free(stats[i].lat);
+    krad_attrset_free(attrs);
+    krb5_free_context(kctx);
+    return outstanding == 0 && unmatched == 0 ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+/** BEGIN COPYRIGHT BLOCK
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Additional permission under GPLv3 section 7:
+ *
+ * In the following paragraph, "GPL" means the GNU General Public
+ * License, version 3 or any later version, and "Non-GPL Code" means
+ * code that is governed neither by the GPL nor a license
+ * compatible with the GPL.
+ *
+ * You may link the code of this Program with Non-GPL Code and convey
+ * linked combinations including the two, provided that such Non-GPL
+ * Code only links to the code of this Program through those well
+ * defined interfaces identified in the file named EXCEPTION found in
+ * the source code files (the "Approved Interfaces"). The files of
+ * Non-GPL Code may instantiate templates or use macros or inline
+ * functions from the Approved Interfaces without causing the resulting
+ * work to be covered by the GPL. Only the copyright holders of this
+ * Program may make changes or additions to the list of Approved
+ * Interfaces.
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ * All rights reserved.
+ * END COPYRIGHT BLOCK **/
+
+#ifndef _IPA_BIND_CACHE_H_
+#define _IPA_BIND_CACHE_H_
+
+#include <dirsrv/slapi-plugin.h>
+
+/*
+ * Per-operation BIND target cache.
+ *
+ * The ipa-lockout plugin attaches the entry targeted by a BIND to the
+ * Slapi_Operation as an object extension and publishes an accessor through
+ * the slapi API broker, so every plugin taking part in the same BIND reads
+ * the entry from the database only once. The entry belongs to the operation
+ * and is released when the operation completes; callers must neither free
+ * nor modify it (slapi_entry_dup() it first if it needs changing).
+ */
+
+#define IPA_BIND_CACHE_API_GUID "9f2b6d4e-3c1a-4e8b-a1d7-5b0c2e7f8a93"
+
+enum ipa_bind_cache_api {
+    IPA_BIND_CACHE_API_RESERVED = 0, /* reserved for the API broker */
+    IPA_BIND_CACHE_API_GET_ENTRY,
+    IPA_BIND_CACHE_API_SIZE
+};
+
+typedef int (*ipa_bind_cache_get_entry_fn)(Slapi_PBlock *pb, const char *dn,
+                                           Slapi_Entry **entry);
+
+/* Returns LDAP_UNAVAILABLE if ipa-lockout is not loaded, in which case the
+ * caller has to read the entry itself. */
+static inline int ipa_bind_cache_get_entry(Slapi_PBlock *pb, const char *dn,
+                                           Slapi_Entry **entry)
+{
+    void **api = NULL;
+
+    if (slapi_apib_get_interface(IPA_BIND_CACHE_API_GUID, &api) != 0 ||
+        api == NULL || api[IPA_BIND_CACHE_API_GET_ENTRY] == NULL) {
+        return LDAP_UNAVAILABLE;
+    }
+
+    return ((ipa_bind_cache_get_entry_fn)
+            api[IPA_BIND_CACHE_API_GET_ENTRY])(pb, dn, entry);
+}
+
+#endif /* _IPA_BIND_CACHE_H_ */
@@ -40,6 +40,9 @@
 #include "ipa_cldap.h"
 #include "util.h"
 
+/* for the post-op callbacks, which have no access to the plugin private */
+static struct ipa_cldap_ctx *global_cldap_ctx;
+
 Slapi_PluginDesc ipa_cldap_desc = {
     IPA_CLDAP_PLUGIN_NAME,
     "FreeIPA project",
@@ -47,10 +50,76 @@ Slapi_PluginDesc ipa_cldap_desc = {
     IPA_CLDAP_PLUGIN_DESC
 };
 
+/* ipaCldapRateLimit is the sustained rate in requests per second and per
+ * source prefix, 0 disabling the limit. ipaCldapRateBurst is the number of
+ * requests a prefix may send at once, by default twice the rate. */
+static void ipa_cldap_ratelimit_config(struct ipa_cldap_ratelimit *rl,
+                                       Slapi_Entry *e)
+{
+    uint32_t rate = IPA_CLDAP_RL_RATE;
+    uint32_t burst = 0;
+
+    if (e && slapi_entry_attr_exists(e, "ipaCldapRateLimit")) {
+        rate = slapi_entry_attr_get_uint(e, "ipaCldapRateLimit");
+    }
+    if (e && slapi_entry_attr_exists(e, "ipaCldapRateBurst")) {
+        burst = slapi_entry_attr_get_uint(e, "ipaCldapRateBurst");
+    }
+
+    if (burst == 0) {
+        burst = rate == IPA_CLDAP_RL_RATE ? IPA_CLDAP_RL_BURST : rate * 2;
+    }
+    if (burst == 0) {
+        burst = 1;
+    }
+    if (burst > IPA_CLDAP_RL_BURST_MAX) {
+        LOG("CLDAP rate limit burst capped to %d\n", IPA_CLDAP_RL_BURST_MAX);
+        burst = IPA_CLDAP_RL_BURST_MAX;
+    }
+
+    __sync_lock_test_and_set(&rl->burst, burst);
+    __sync_lock_test_and_set(&rl->rate, rate);
+}
+
+
+/* Apply rate limit changes made to the plugin entry at runtime */
+static int ipa_cldap_config_modify(Slapi_PBlock *pb, Slapi_Entry *before,
+                                   Slapi_Entry *e, int *returncode,
+                                   char *returntext, void *arg)
+{
+    struct ipa_cldap_ctx *ctx = (struct ipa_cldap_ctx *)arg;
+
+    ipa_cldap_ratelimit_config(&ctx->ratelimit, e);
+
+    *returncode = LDAP_SUCCESS;
+    return SLAPI_DSE_CALLBACK_OK;
+}
+
+/* Report the rate limit counters when the plugin entry is read */
+static int ipa_cldap_config_search(Slapi_PBlock *pb, Slapi_Entry *before,
+                                   Slapi_Entry *e, int *returncode,
+                                   char *returntext, void *arg)
+{
+    struct ipa_cldap_ctx *ctx = (struct ipa_cldap_ctx *)arg;
+    struct ipa_cldap_ratelimit *rl = &ctx->ratelimit;
+    char buf[32];
+
+    snprintf(buf, sizeof(buf), "%llu", (unsigned long long)
+             __sync_fetch_and_add(&rl->answered, 0));
+    slapi_entry_attr_set_charptr(e, "ipaCldapAnsweredRequests", buf);
+    snprintf(buf, sizeof(buf), "%llu", (unsigned long long)
+             __sync_fetch_and_add(&rl->dropped, 0));
+    slapi_entry_attr_set_charptr(e, "ipaCldapDroppedRequests", buf);
+
+    *returncode = LDAP_SUCCESS;
+    return SLAPI_DSE_CALLBACK_OK;
+}
+
 static int ipa_cldap_start(Slapi_PBlock *pb)
 {
     struct ipa_cldap_ctx *ctx;
     int ret;
+    int i;
 
     ret = slapi_pblock_get(pb, SLAPI_PLUGIN_PRIVATE, &ctx);
     if (ret) {
@@ -58,12 +127,25 @@ static int ipa_cldap_start(Slapi_PBlock *pb)
         return -1;
     }
 
-    ret = pthread_create(&ctx->tid, NULL, ipa_cldap_worker, ctx);
-    if (ret) {
-        LOG_FATAL("Failed to create worker thread\n");
-        return -1;
+    for (i = 0; i < ctx->nworkers; i++) {
+        ret = pthread_create(&ctx->workers[i].tid, NULL,
+                             ipa_cldap_worker, &ctx->workers[i]);
+        if (ret) {
+            LOG_FATAL("Failed to create worker thread\n");
+            ctx->nworkers = i;
+            return -1;
+        }
     }
 
+    slapi_config_register_callback(SLAPI_OPERATION_MODIFY, DSE_FLAG_POSTOP,
+                                   ctx->config_dn, LDAP_SCOPE_BASE,
+                                   "(objectclass=*)",
+                                   ipa_cldap_config_modify, ctx);
+    slapi_config_register_callback(SLAPI_OPERATION_SEARCH, DSE_FLAG_PREOP,
+                                   ctx->config_dn, LDAP_SCOPE_BASE,
+                                   "(objectclass=*)",
+                                   ipa_cldap_config_search, ctx);
+
     LOG("Plugin statrup completed.\n");
 
     return 0;
@@ -74,6 +156,7 @@ static int ipa_cldap_stop(Slapi_PBlock *pb)
     struct ipa_cldap_ctx *ctx;
     void *retval;
     int ret;
+    int i;
 
     ret = slapi_pblock_get(pb, SLAPI_PLUGIN_PRIVATE, &ctx);
     if (ret) {
@@ -81,16 +164,26 @@ static int ipa_cldap_stop(Slapi_PBlock *pb)
         return -1;
     }
 
-    /* send stop signal to terminate worker thread */
+    slapi_config_remove_callback(SLAPI_OPERATION_MODIFY, DSE_FLAG_POSTOP,
+                                 ctx->config_dn, LDAP_SCOPE_BASE,
+                                 "(objectclass=*)", ipa_cldap_config_modify);
+    slapi_config_remove_callback(SLAPI_OPERATION_SEARCH, DSE_FLAG_PREOP,
+                                 ctx->config_dn, LDAP_SCOPE_BASE,
+                                 "(objectclass=*)", ipa_cldap_config_search);
+
+    /* send stop signal to terminate worker threads, the byte is never
+     * read so all the workers see it */
     do {
         ret = write(ctx->stopfd[1], "", 1);
     } while (ret == -1 && errno == EINTR);
     close(ctx->stopfd[1]);
 
-    ret = pthread_join(ctx->tid, &retval);
-    if (ret) {
-        LOG_FATAL("Failed to stop worker thread\n");
-        return -1;
+    for (i = 0; i < ctx->nworkers; i++) {
+        ret = pthread_join(ctx->workers[i].tid, &retval);
+        if (ret) {
+            LOG_FATAL("Failed to stop worker thread\n");
+            return -1;
+        }
     }
 
     LOG("Plugin shutdown completed.\n");
@@ -98,21 +191,158 @@ static int ipa_cldap_stop(Slapi_PBlock *pb)
     return 0;
 }
 
+static int ipa_cldap_open_socket(bool reuseport, int *sd)
+{
+    struct sockaddr_in6 addr;
+    int flags;
+    int val;
+    int ret;
+
+    *sd = socket(PF_INET6, SOCK_DGRAM, 0);
+    if (*sd == -1) {
+        LOG_FATAL("Failed to create IPv6 socket: IPv6 support in kernel "
+                  "is required\n");
+        return EIO;
+    }
+
+    val = 1;
+    ret = setsockopt(*sd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+    if (ret == -1) {
+        ret = errno;
+        LOG("Failed to make socket immediately reusable (%d, %s)\n",
+            ret, strerror(ret));
+    }
+
+    if (reuseport) {
+#ifdef SO_REUSEPORT
+        ret = setsockopt(*sd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof(val));
+#else
+        ret = -1;
+        errno = ENOTSUP;
+#endif
+        if (ret == -1) {
+            ret = errno;
+            LOG_TRACE("Failed to set SO_REUSEPORT (%d, %s)\n",
+                      ret, strerror(ret));
+            goto done;
+        }
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_port = htons(CLDAP_PORT);
+
+    ret = bind(*sd, (struct sockaddr *)&addr, sizeof(addr));
+    if (ret == -1) {
+        ret = errno;
+        LOG_FATAL("Failed to bind socket (%d, %s)\n", ret, strerror(ret));
+        goto done;
+    }
+
+    flags = fcntl(*sd, F_GETFL);
+    if ((flags & O_NONBLOCK) == 0) {
+        ret = fcntl(*sd, F_SETFL, flags | O_NONBLOCK);
+        if (ret == -1) {
+            ret = errno;
+            LOG_FATAL("Failed to set socket to non-blocking\n");
+            goto done;
+        }
+    }
+
+    ret = 0;
+
+done:
+    if (ret) {
+        close(*sd);
+        *sd = -1;
+    }
+    return ret;
+}
+
+/* One worker per online CPU, up to IPA_CLDAP_MAX_WORKERS. Each worker gets
+ * its own SO_REUSEPORT socket so the kernel spreads the load; if that is
+ * not possible they all share the first socket. */
+static int ipa_cldap_init_workers(struct ipa_cldap_ctx *ctx)
+{
+    bool reuseport = true;
+    long ncpus;
+    int ret;
+    int i;
+
+    ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpus < 1) {
+        ncpus = 1;
+    }
+    ctx->nworkers = ncpus < IPA_CLDAP_MAX_WORKERS ? ncpus
+                                                  : IPA_CLDAP_MAX_WORKERS;
+
+    ctx->workers = calloc(ctx->nworkers, sizeof(struct ipa_cldap_worker_ctx));
+    if (!ctx->workers) {
+        return ENOMEM;
+    }
+    for (i = 0; i < ctx->nworkers; i++) {
+        ctx->workers[i].ctx = ctx;
+        ctx->workers[i].sd = -1;
+    }
+
+    if (ctx->nworkers == 1) {
+        reuseport = false;
+    }
+
+    ret = ipa_cldap_open_socket(reuseport, &ctx->workers[0].sd);
+    if (ret && reuseport) {
+        reuseport = false;
+        ret = ipa_cldap_open_socket(reuseport, &ctx->workers[0].sd);
+    }
+    if (ret) {
+        return ret;
+    }
+
+    for (i = 1; i < ctx->nworkers; i++) {
+        if (reuseport) {
+            ret = ipa_cldap_open_socket(reuseport, &ctx->workers[i].sd);
+            if (ret == 0) {
+                continue;
+            }
+            LOG("Failed to open per-worker socket, sharing one instead\n");
+        }
+        ctx->workers[i].sd = ctx->workers[0].sd;
+    }
+
+    return 0;
+}
+
+static void ipa_cldap_free_workers(struct ipa_cldap_ctx *ctx)
+{
+    int i;
+
+    if (!ctx->workers) {
+        return;
+    }
+
+    for (i = 0; i < ctx->nworkers; i++) {
+        if (ctx->workers[i].sd == -1) {
+            continue;
+        }
+        if (i == 0 || ctx->workers[i].sd != ctx->workers[0].sd) {
+            close(ctx->workers[i].sd);
+        }
+    }
+    free(ctx->workers);
+    ctx->workers = NULL;
+}
+
 static int ipa_cldap_init_service(Slapi_PBlock *pb,
                                   struct ipa_cldap_ctx **cldap_ctx)
 {
     struct ipa_cldap_ctx *ctx;
-    struct sockaddr_in6 addr;
     Slapi_Entry *e;
-    int flags;
-    int val;
     int ret;
 
     ctx = calloc(1, sizeof(struct ipa_cldap_ctx));
     if (!ctx) {
         return ENOMEM;
     }
-    ctx->sd = -1;
 
     ret = slapi_pblock_get(pb, SLAPI_PLUGIN_IDENTITY, &ctx->plugin_id);
     if ((ret != 0) || (NULL == ctx->plugin_id)) {
@@ -137,6 +367,9 @@ static int ipa_cldap_init_service(Slapi_PBlock *pb,
         goto done;
     }
 
+    ctx->config_dn = slapi_ch_strdup(slapi_entry_get_dn_const(e));
+    ipa_cldap_ratelimit_config(&ctx->ratelimit, e);
+
     /* create a stop pipe so the main DS thread can interrupt the poll()
      * of the worker thread at any time and cause the worker thread to
      * immediately exit without waiting for timeouts or such */
@@ -147,48 +380,21 @@ static int ipa_cldap_init_service(Slapi_PBlock *pb,
         goto done;
     }
 
-    ctx->sd = socket(PF_INET6, SOCK_DGRAM, 0);
-    if (ctx->sd == -1) {
-        LOG_FATAL("Failed to create IPv6 socket: IPv6 support in kernel "
-                  "is required\n");
-        ret = EIO;
+    ret = ipa_cldap_init_workers(ctx);
+    if (ret) {
         goto done;
     }
 
-    val = 1;
-    ret = setsockopt(ctx->sd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
-    if (ret == -1) {
-        ret = errno;
-        LOG("Failed to make socket immediately reusable (%d, %s)\n",
-            ret, strerror(ret));
-    }
-
-    memset(&addr, 0, sizeof(addr));
-    addr.sin6_family = AF_INET6;
-    addr.sin6_port = htons(CLDAP_PORT);
-
-    ret = bind(ctx->sd, (struct sockaddr *)&addr, sizeof(addr));
-    if (ret == -1) {
-        ret = errno;
-        LOG_FATAL("Failed to bind socket (%d, %s)\n", ret, strerror(ret));
+    ret = pthread_rwlock_init(&ctx->cache.lock, NULL);
+    if (ret) {
+        LOG_FATAL("Failed to initialize cache lock\n");
         goto done;
     }
 
-    flags = fcntl(ctx->sd, F_GETFL);
-    if ((flags & O_NONBLOCK) == 0) {
-        ret = fcntl(ctx->sd, F_SETFL, flags | O_NONBLOCK);
-        if (ret == -1) {
-            ret = errno;
-            LOG_FATAL("Failed to set socket to non-blocking\n");
-            goto done;
-        }
-    }
-
 done:
     if (ret) {
-        if (ctx->sd != -1) {
-            close(ctx->sd);
-        }
+        ipa_cldap_free_workers(ctx);
+        slapi_ch_free_string(&ctx->config_dn);
         free(ctx);
     } else {
         *cldap_ctx = ctx;
@@ -196,11 +402,58 @@ done:
     return ret;
 }
 
-static int ipa_cldap_post_init(Slapi_PBlock *pb)
+/* Drop the cached NETLOGON replies when the domain entry changes */
+static int ipa_cldap_post_op(Slapi_PBlock *pb)
 {
+    Slapi_Entry *pre = NULL;
+    Slapi_Entry *post = NULL;
+    int oprc = 0;
+
+    if (slapi_pblock_get(pb, SLAPI_PLUGIN_OPRETURN, &oprc) != 0 ||
+        oprc != 0 || global_cldap_ctx == NULL) {
+        return 0;
+    }
+
+    /* Ignore the errors here, only some operations have either entry. */
+    (void) slapi_pblock_get(pb, SLAPI_ENTRY_PRE_OP, &pre);
+    (void) slapi_pblock_get(pb, SLAPI_ENTRY_POST_OP, &post);
+
+    if ((pre && slapi_entry_attr_hasvalue(pre, SLAPI_ATTR_OBJECTCLASS,
+                                          "ipaNTDomainAttrs")) ||
+        (post && slapi_entry_attr_hasvalue(post, SLAPI_ATTR_OBJECTCLASS,
+                                           "ipaNTDomainAttrs"))) {
+        LOG_TRACE("Domain entry changed, dropping cached replies\n");
+        ipa_cldap_cache_invalidate(global_cldap_ctx);
+    }
+
     return 0;
 }
 
+static int ipa_cldap_post_init(Slapi_PBlock *pb)
+{
+    int ret;
+
+    ret = slapi_pblock_set(pb, SLAPI_PLUGIN_VERSION, SLAPI_PLUGIN_VERSION_01);
+    if (!ret) {
+        ret = slapi_pblock_set(pb, SLAPI_PLUGIN_POST_ADD_FN,
+                               (void *)ipa_cldap_post_op);
+    }
+    if (!ret) {
+        ret = slapi_pblock_set(pb, SLAPI_PLUGIN_POST_DELETE_FN,
+                               (void *)ipa_cldap_post_op);
+    }
+    if (!ret) {
+        ret = slapi_pblock_set(pb, SLAPI_PLUGIN_POST_MODIFY_FN,
+                               (void *)ipa_cldap_post_op);
+    }
+    if (!ret) {
+        ret = slapi_pblock_set(pb, SLAPI_PLUGIN_POST_MODRDN_FN,
+                               (void *)ipa_cldap_post_op);
+    }
+
+    return ret;
+}
+
 /* Initialization function */
 int ipa_cldap_init(Slapi_PBlock *pb)
 {
@@ -233,6 +486,8 @@ int ipa_cldap_init(Slapi_PBlock *pb)
         return -1;
     }
 
+    global_cldap_ctx = cldap_ctx;
+
     slapi_register_plugin("postoperation", 1,
                           "ipa_cldap_post_init",
                           ipa_cldap_post_init,
@@ -40,6 +40,10 @@
 #ifndef _IPA_CLDAP_H_
 #define _IPA_CLDAP_H_
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1 /* for recvmmsg() and sendmmsg() */
+#endif
+
 #ifdef HAVE_CONFIG_H
 #  include <config.h>
 #endif
@@ -50,6 +54,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <time.h>
 #include <dirsrv/slapi-plugin.h>
 #include <talloc.h>
 #include "util.h"
@@ -62,17 +67,31 @@
 #define MAX_DG_SIZE 4096
 #define NETBIOS_NAME_MAX 15
 
+/* Upper bound on worker threads, the actual count follows the online CPUs */
+#define IPA_CLDAP_MAX_WORKERS 4
+/* Datagrams received and answered per recvmmsg()/sendmmsg() call */
+#define IPA_CLDAP_BATCH 16
+/* Encoded replies are cached for the NTver 5EX and 5EX_WITH_IP flavors */
+#define IPA_CLDAP_CACHE_OPS 2
+#define IPA_CLDAP_CACHE_TTL 300
+
+/* Per source prefix token bucket: default sustained rate and burst in
+ * requests, overridden by ipaCldapRateLimit and ipaCldapRateBurst in the
+ * plugin entry. A rate of 0 disables the limit. */
+#define IPA_CLDAP_RL_RATE 200
+#define IPA_CLDAP_RL_BURST 400
+#define IPA_CLDAP_RL_UNIT 64
+/* Tokens are kept in 16 bits, in 1/IPA_CLDAP_RL_UNIT */
+#define IPA_CLDAP_RL_BURST_MAX (0xffff / IPA_CLDAP_RL_UNIT)
+#define IPA_CLDAP_RL_BUCKETS 4096
+#define IPA_CLDAP_RL_REPORT 60
+
 #ifndef MAXHOSTNAMELEN
 #define MAXHOSTNAMELEN 64
 #endif
 
-struct ipa_cldap_ctx {
-    Slapi_ComponentId *plugin_id;
-    pthread_t tid;
-    char *base_dn;
-    int stopfd[2];
-    int sd;
-};
+struct ipa_cldap_ctx;
+
 
 struct kvp {
     struct berval attr;
@@ -98,14 +117,77 @@ struct ipa_cldap_req {
 
     /* filter members */
     struct kvp_list kvps;
+
+    /* encoded searchResEntry, copied from the cache */
+    char entry[MAX_DG_SIZE];
+
+    /* encoded reply, sent with the rest of the batch */
+    char out[MAX_DG_SIZE];
+    struct berval reply;
 };
 
-/*void *ipa_cldap_worker(struct ipa_cldap_ctx *ctx);*/
+/* Each worker owns its requests, so nothing is allocated per datagram.
+ * Workers either have their own SO_REUSEPORT socket or share one. */
+struct ipa_cldap_worker_ctx {
+    struct ipa_cldap_ctx *ctx;
+    pthread_t tid;
+    int sd;
+    struct ipa_cldap_req reqs[IPA_CLDAP_BATCH];
+};
+
+/* The domain name and the NETLOGON replies encoded as searchResEntry
+ * protocolOps, without message ID. Empty when expires is 0. */
+struct ipa_cldap_cache {
+    pthread_rwlock_t lock;
+    time_t expires;
+    char *domain;
+    struct berval *ops[IPA_CLDAP_CACHE_OPS];
+};
+
+struct ipa_cldap_ratelimit {
+    uint64_t buckets[IPA_CLDAP_RL_BUCKETS];
+    uint32_t rate;
+    uint32_t burst;
+    uint64_t answered;
+    uint64_t dropped;
+    uint64_t last_dropped;
+    uint32_t reported;
+};
+
+struct ipa_cldap_ctx {
+    Slapi_ComponentId *plugin_id;
+    char *config_dn;
+    char *base_dn;
+    int stopfd[2];
+    int nworkers;
+    struct ipa_cldap_worker_ctx *workers;
+    struct ipa_cldap_cache cache;
+    struct ipa_cldap_ratelimit ratelimit;
+};
+
+/*void *ipa_cldap_worker(struct ipa_cldap_worker_ctx *w);*/
 void *ipa_cldap_worker(void *arg);
 
+/* Decode a datagram into req, be is reset and reused */
+int ipa_cldap_decode(BerElement *be, struct ipa_cldap_req *req);
+
+/* Decode and answer a datagram, leaving the reply in req->reply */
+void ipa_cldap_process(struct ipa_cldap_ctx *ctx, BerElement *be,
+                       struct ipa_cldap_req *req);
+
+/* On success reply points to req->entry, holding the searchResEntry */
 int ipa_cldap_netlogon(struct ipa_cldap_ctx *ctx,
                        struct ipa_cldap_req *req,
                        struct berval *reply);
 
+void ipa_cldap_cache_invalidate(struct ipa_cldap_ctx *ctx);
+
+/* Returns false if the source exceeded its rate and must not be answered */
+bool ipa_cldap_ratelimit(struct ipa_cldap_ratelimit *rl,
+                         const struct sockaddr_storage *ss,
+                         uint32_t now_ms);
+void ipa_cldap_ratelimit_report(struct ipa_cldap_ratelimit *rl,
+                                uint32_t now_ms);
+
 char *make_netbios_name(TALLOC_CTX *mem_ctx, const char *s);
 #endif /* _IPA_CLDAP_H_ */
@@ -0,0 +1,698 @@
+/** BEGIN COPYRIGHT BLOCK
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Additional permission under GPLv3 section 7:
+ *
+ * In the following paragraph, "GPL" means the GNU General Public
+ * License, version 3 or any later version, and "Non-GPL Code" means
+ * code that is governed neither by the GPL nor a license
+ * compatible with the GPL.
+ *
+ * You may link the code of this Program with Non-GPL Code and convey
+ * linked combinations including the two, provided that such Non-GPL
+ * Code only links to the code of this Program through those well
+ * defined interfaces identified in the file named EXCEPTION found in
+ * the source code files (the "Approved Interfaces"). The files of
+ * Non-GPL Code may instantiate templates or use macros or inline
+ * functions from the Approved Interfaces without causing the resulting
+ * work to be covered by the GPL. Only the copyright holders of this
+ * Program may make changes or additions to the list of Approved
+ * Interfaces.
+ *
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ * All rights reserved.
+ * END COPYRIGHT BLOCK **/
+
+/*
+ * CLDAP replay benchmark and fuzzing harness.
+ *
+ * Feeds NETLOGON ping datagrams through ipa_cldap_decode() and
+ * ipa_cldap_process() (netlogon lookup, encoding and reply assembly)
+ * without sockets or a directory server: the slapi search for the domain
+ * entry is replaced by a stub returning a fixed entry, and gethostname()
+ * returns a fixed FQDN.
+ *
+ * The corpus is a set of synthetic datagrams (various NtVer values, filter
+ * shapes and malformed packets) plus any captured datagrams given as
+ * arguments, one raw UDP payload per file.
+ *
+ *   ipa_cldap_bench [-n ITERATIONS] [-t THREADS] [FILE...]
+ *       measure packets/s per corpus entry single threaded, then the whole
+ *       corpus with 1 to THREADS threads sharing one plugin context
+ *
+ *   ipa_cldap_bench -o DIR
+ *       write the synthetic corpus to DIR, as seeds for a fuzzer
+ *
+ *   ipa_cldap_bench -f FILE
+ *       process FILE once and exit, e.g. afl-fuzz ... -- ipa_cldap_bench -f @@
+ *
+ * Building with -DIPA_CLDAP_LIBFUZZER provides LLVMFuzzerTestOneInput()
+ * instead of main().
+ */
+
+#include "ipa_cldap.h"
+#include <lber.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+
+#define BENCH_HOSTNAME "dc1.ipa.test"
+#define BENCH_DOMAIN "ipa.test"
+#define BENCH_MAX_CORPUS 64
+
+/*
+ * slapi emulation
+ */
+
+struct slapi_pblock {
+    int result;
+};
+
+struct slapi_entry {
+    const char *dn;
+};
+
+static struct slapi_entry domain_entry = { "cn=" BENCH_DOMAIN ",cn=ad,cn=etc" };
+static Slapi_Entry *search_entries[] = { &domain_entry, NULL };
+static uint64_t searches;
+
+int slapi_log_error(int severity, char *subsystem, char *fmt, ...)
+{
+    return 0;
+}
+
+Slapi_PBlock *slapi_pblock_new(void)
+{
+    return calloc(1, sizeof(Slapi_PBlock));
+}
+
+void slapi_pblock_destroy(Slapi_PBlock *pb)
+{
+    free(pb);
+}
+
+int slapi_pblock_get(Slapi_PBlock *pb, int arg, void *value)
+{
+    switch (arg) {
+    case SLAPI_PLUGIN_INTOP_RESULT:
+        *(int *)value = pb->result;
+        return 0;
+    case SLAPI_PLUGIN_INTOP_SEARCH_ENTRIES:
+        *(Slapi_Entry ***)value = search_entries;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+void slapi_search_internal_set_pb(Slapi_PBlock *pb, const char *base,
+                                  int scope, const char *filter, char **attrs,
+                                  int attrsonly, LDAPControl **controls,
+                                  const char *uniqueid,
+                                  Slapi_ComponentId *plugin_identity,
+                                  int operation_flags)
+{
+}
+
+int slapi_search_internal_pb(Slapi_PBlock *pb)
+{
+    __sync_fetch_and_add(&searches, 1);
+    pb->result = LDAP_SUCCESS;
+    return 0;
+}
+
+void slapi_free_search_results_internal(Slapi_PBlock *pb)
+{
+}
+
+char *slapi_entry_attr_get_charptr(const Slapi_Entry *e, const char *type)
+{
+    if (strcasecmp(type, "ipaNTDomainGUID") == 0) {
+        return strdup("0f5e3ba2-7c4c-4a5b-9f1d-3c2b1a0e9d8c");
+    }
+    if (strcasecmp(type, "ipaNTSecurityIdentifier") == 0) {
+        return strdup("S-1-5-21-1111111111-2222222222-3333333333");
+    }
+    if (strcasecmp(type, "ipaNTFlatName") == 0) {
+        return strdup("IPA");
+    }
+    if (strcasecmp(type, "cn") == 0) {
+        return strdup(BENCH_DOMAIN);
+    }
+    return NULL;
+}
+
+void slapi_ch_free_string(char **s)
+{
+    free(*s);
+    *s = NULL;
+}
+
+int gethostname(char *name, size_t len)
+{
+    snprintf(name, len, "%s", BENCH_HOSTNAME);
+    return 0;
+}
+
+/*
+ * Corpus
+ */
+
+struct datagram {
+    char name[64];
+    char data[MAX_DG_SIZE];
+    size_t len;
+};
+
+struct pair {
+    const char *attr;
+    const char *value;
+    size_t len;
+};
+
+#define NTVER(v) { "NtVer", v, 4 }
+#define DNSDOMAIN(v) { "DnsDomain", v, sizeof(v) - 1 }
+
+enum shape {
+    SHAPE_AND,      /* (&(a=x)(b=y)...) as sent by Windows and SSSD */
+    SHAPE_SINGLE,   /* (a=x), the first pair only */
+    SHAPE_NESTED,   /* (&(&(a=x))(b=y)...) */
+    SHAPE_OR,       /* (|(a=x)(b=y)...), not supported */
+};
+
+static struct datagram corpus[BENCH_MAX_CORPUS];
+static size_t corpus_len;
+
+static int put_pairs(BerElement *be, const struct pair *pairs, size_t n)
+{
+    size_t i;
+    int ret;
+
+    for (i = 0; i < n; i++) {
+        ret = ber_printf(be, "t{oo}", LDAP_FILTER_EQUALITY,
+                         pairs[i].attr, strlen(pairs[i].attr),
+                         pairs[i].value, pairs[i].len);
+        if (ret == -1) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+static int add_search(const char *name, ber_int_t id, enum shape shape,
+                      const struct pair *pairs, size_t n, const char *attr)
+{
+    struct datagram *dg;
+    struct berval *bv = NULL;
+    BerElement *be;
+    int ret = -1;
+
+    if (corpus_len >= BENCH_MAX_CORPUS) {
+        return -1;
+    }
+    dg = &corpus[corpus_len];
+
+    be = ber_alloc_t(0);
+    if (!be) {
+        return -1;
+    }
+
+    if (ber_printf(be, "{it{seeiib", id, LDAP_REQ_SEARCH,
+                   "", 0, 0, 0, 0, 0) == -1) {
+        goto done;
+    }
+
+    switch (shape) {
+    case SHAPE_AND:
+    case SHAPE_OR:
+        ret = ber_printf(be, "t{", shape == SHAPE_AND ? LDAP_FILTER_AND
+                                                      : LDAP_FILTER_OR);
+        if (ret != -1) {
+            ret = put_pairs(be, pairs, n);
+        }
+        if (ret != -1) {
+            ret = ber_printf(be, "}");
+        }
+        break;
+    case SHAPE_SINGLE:
+        ret = put_pairs(be, pairs, 1);
+        break;
+    case SHAPE_NESTED:
+        ret = ber_printf(be, "t{t{", LDAP_FILTER_AND, LDAP_FILTER_AND);
+        if (ret != -1) {
+            ret = put_pairs(be, pairs, 1);
+        }
+        if (ret != -1) {
+            ret = ber_printf(be, "}");
+        }
+        if (ret != -1) {
+            ret = put_pairs(be, pairs + 1, n - 1);
+        }
+        if (ret != -1) {
+            ret = ber_printf(be, "}");
+        }
+        break;
+    }
+    if (ret == -1 || ber_printf(be, "{s}}}", attr) == -1) {
+        ret = -1;
+        goto done;
+    }
+
+    if (ber_flatten(be, &bv) == -1 || bv->bv_len > sizeof(dg->data)) {
+        ret = -1;
+        goto done;
+    }
+
+    snprintf(dg->name, sizeof(dg->name), "%s", name);
+    memcpy(dg->data, bv->bv_val, bv->bv_len);
+    dg->len = bv->bv_len;
+    corpus_len++;
+    ret = 0;
+
+done:
+    ber_bvfree(bv);
+    ber_free(be, 1);
+    return ret;
+}
+
+static int add_raw(const char *name, const char *data, size_t len)
+{
+    struct datagram *dg;
+
+    if (corpus_len >= BENCH_MAX_CORPUS || len > sizeof(dg->data)) {
+        return -1;
+    }
+    dg = &corpus[corpus_len++];
+
+    snprintf(dg->name, sizeof(dg->name), "%s", name);
+    memcpy(dg->data, data, len);
+    dg->len = len;
+    return 0;
+}
+
+static int build_corpus(void)
+{
+    const struct pair windows[] = {
+        DNSDOMAIN(BENCH_DOMAIN "."),
+        { "Host", "WIN10-CLIENT", 12 },
+        { "AAC", "\x00\x00\x00\x80", 4 },
+        NTVER("\x16\x00\x00\x20"),
+    };
+    const struct pair sssd[] = {
+        DNSDOMAIN(BENCH_DOMAIN),
+        NTVER("\x06\x00\x00\x00"),
+    };
+    const struct pair ntver_only[] = {
+        NTVER("\x06\x00\x00\x00"),
+    };
+    const struct pair with_ip[] = {
+        NTVER("\x0e\x00\x00\x00"),
+        DNSDOMAIN(BENCH_DOMAIN),
+    };
+    const struct pair nt5[] = {
+        DNSDOMAIN(BENCH_DOMAIN),
+        NTVER("\x02\x00\x00\x00"),
+    };
+    const struct pair other_domain[] = {
+        DNSDOMAIN("other.test"),
+        NTVER("\x06\x00\x00\x00"),
+    };
+    const struct pair short_ntver[] = {
+        DNSDOMAIN(BENCH_DOMAIN),
+        { "NtVer", "\x06\x00\x00", 3 },
+    };
+    const struct pair unknown[] = {
+        DNSDOMAIN(BENCH_DOMAIN),
+        { "DomainGuid", "0123456789abcdef", 16 },
+        { "Unknown", "x", 1 },
+        NTVER("\x06\x00\x00\x00"),
+    };
+    char garbage[512];
+    uint32_t seed = 0x12345678;
+    struct datagram *dg;
+    size_t i;
+    int ret = 0;
+
+#define N(a) (sizeof(a) / sizeof(*(a)))
+    ret |= add_search("windows/ntver16+ip", 1, SHAPE_AND,
+                      windows, N(windows), "Netlogon");
+    ret |= add_search("sssd/ntver6", 2, SHAPE_AND, sssd, N(sssd), "netlogon");
+    ret |= add_search("ntver6/single-clause", 127, SHAPE_SINGLE,
+                      ntver_only, N(ntver_only), "Netlogon");
+    ret |= add_search("ntver14/with-ip", 128, SHAPE_AND,
+                      with_ip, N(with_ip), "Netlogon");
+    ret |= add_search("ntver6/nested-and", 65536, SHAPE_NESTED,
+                      sssd, N(sssd), "Netlogon");
+    ret |= add_search("ntver6/unknown-attrs", 0x7fffffff, SHAPE_AND,
+                      unknown, N(unknown), "Netlogon");
+    ret |= add_search("bad/ntver2-unsupported", 3, SHAPE_AND,
+                      nt5, N(nt5), "Netlogon");
+    ret |= add_search("bad/other-domain", 4, SHAPE_AND,
+                      other_domain, N(other_domain), "Netlogon");
+    ret |= add_search("bad/short-ntver", 5, SHAPE_AND,
+                      short_ntver, N(short_ntver), "Netlogon");
+    ret |= add_search("bad/or-filter", 6, SHAPE_OR,
+                      sssd, N(sssd), "Netlogon");
+    ret |= add_search("bad/other-attribute", 7, SHAPE_AND,
+                      sssd, N(sssd), "objectClass");
+#undef N
+    if (ret) {
+        return ret;
+    }
+
+    /* truncated copies of the first datagram */
+    dg = &corpus[0];
+    ret |= add_raw("bad/truncated-half", dg->data, dg->len / 2);
+    ret |= add_raw("bad/truncated-1", dg->data, dg->len - 1);
+    ret |= add_raw("bad/empty", dg->data, 0);
+
+    for (i = 0; i < sizeof(garbage); i++) {
+        seed = seed * 1103515245 + 12345;
+        garbage[i] = seed >> 16;
+    }
+    ret |= add_raw("bad/garbage", garbage, sizeof(garbage));
+    garbage[0] = LDAP_TAG_MESSAGE;
+    garbage[1] = 0x84; /* 4 byte length, way past the end */
+    ret |= add_raw("bad/garbage-sequence", garbage, sizeof(garbage));
+
+    return ret;
+}
+
+static int load_file(const char *path, char *data, size_t *len)
+{
+    FILE *f;
+
+    f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    *len = fread(data, 1, MAX_DG_SIZE, f);
+    fclose(f);
+    return 0;
+}
+
+static int write_corpus(const char *dir)
+{
+    char path[PATH_MAX];
+    size_t i;
+    char *p;
+    FILE *f;
+
+    for (i = 0; i < corpus_len; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, corpus[i].name);
+        for (p = path + strlen(dir) + 1; *p; p++) {
+            if (*p == '/') {
+                *p = '_';
+            }
+        }
+
+        f = fopen(path, "wb");
+        if (!f) {
+            fprintf(stderr, "Cannot write %s: %s\n", path, strerror(errno));
+            return 1;
+        }
+        fwrite(corpus[i].data, 1, corpus[i].len, f);
+        fclose(f);
+    }
+
+    return 0;
+}
+
+/*
+ * Benchmarks
+ */
+
+static struct ipa_cldap_ctx ctx;
+
+struct worker {
+    pthread_t tid;
+    const struct datagram *dgs;
+    size_t ndgs;
+    unsigned int iterations;
+    bool decode_only;
+    bool uncached;
+    uint64_t answered;
+    uint64_t failed;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void *run_worker(void *arg)
+{
+    struct worker *w = arg;
+    struct ipa_cldap_req *req;
+    BerElement *be;
+    unsigned int i;
+    size_t j;
+
+    req = calloc(1, sizeof(*req));
+    be = ber_alloc_t(0);
+    if (!req || !be) {
+        w->failed++;
+        goto done;
+    }
+
+    for (i = 0; i < w->iterations; i++) {
+        for (j = 0; j < w->ndgs; j++) {
+            memcpy(req->dgram, w->dgs[j].data, w->dgs[j].len);
+            req->dgsize = w->dgs[j].len;
+
+            if (w->decode_only) {
+                if (ipa_cldap_decode(be, req) != 0) {
+                    w->failed++;
+                }
+                req->kvps.top = 0;
+                continue;
+            }
+
+            if (w->uncached) {
+                ipa_cldap_cache_invalidate(&ctx);
+            }
+            ipa_cldap_process(&ctx, be, req);
+            if (req->reply.bv_len == 0) {
+                w->failed++;
+            }
+            w->answered++;
+            req->reply.bv_len = 0;
+        }
+    }
+
+done:
+    if (req) {
+        free(req->kvps.pairs);
+    }
+    free(req);
+    if (be) {
+        ber_free(be, 0);
+    }
+    return NULL;
+}
+
+static void print_header(void)
+{
+    printf("%-36s %8s %10s %12s %10s %8s\n",
+           "benchmark", "threads", "packets", "packets/s", "ns/packet",
+           "fail");
+}
+
+static void run(const char *name, const struct datagram *dgs, size_t ndgs,
+                int threads, unsigned int iterations,
+                bool decode_only, bool uncached)
+{
+    struct worker w[IPA_CLDAP_MAX_WORKERS * 4];
+    uint64_t packets = 0;
+    uint64_t failed = 0;
+    uint64_t start;
+    uint64_t ns;
+    int i;
+
+    for (i = 0; i < threads; i++) {
+        memset(&w[i], 0, sizeof(w[i]));
+        w[i].dgs = dgs;
+        w[i].ndgs = ndgs;
+        w[i].iterations = iterations;
+        w[i].decode_only = decode_only;
+        w[i].uncached = uncached;
+    }
+
+    start = now_ns();
+    for (i = 0; i < threads; i++) {
+        pthread_create(&w[i].tid, NULL, run_worker, &w[i]);
+    }
+    for (i = 0; i < threads; i++) {
+        pthread_join(w[i].tid, NULL);
+        packets += (uint64_t)iterations * ndgs;
+        failed += w[i].failed;
+    }
+    ns = now_ns() - start;
+
+    printf("%-36s %8d %10llu %12.0f %10.0f %8llu\n", name, threads,
+           (unsigned long long)packets,
+           packets * 1e9 / (ns ? ns : 1),
+           (double)ns * threads / (packets ? packets : 1),
+           (unsigned long long)failed);
+}
+
+static int fuzz_one(const char *data, size_t len)
+{
+    static BerElement *be;
+    static struct ipa_cldap_req req;
+
+    if (!be) {
+        be = ber_alloc_t(0);
+        if (!be) {
+            return 0;
+        }
+    }
+
+    if (len > sizeof(req.dgram)) {
+        len = sizeof(req.dgram);
+    }
+    memcpy(req.dgram, data, len);
+    req.dgsize = len;
+
+    ipa_cldap_process(&ctx, be, &req);
+    req.reply.bv_len = 0;
+    return 0;
+}
+
+static int init_ctx(void)
+{
+    ctx.base_dn = "dc=ipa,dc=test";
+    return pthread_rwlock_init(&ctx.cache.lock, NULL);
+}
+
+#ifdef IPA_CLDAP_LIBFUZZER
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static bool initialized;
+
+    if (!initialized) {
+        init_ctx();
+        initialized = true;
+    }
+
+    return fuzz_one((const char *)data, size);
+}
+#else
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-n ITERATIONS] [-t THREADS] [FILE...]\n"
+                    "       %s -o DIR\n"
+                    "       %s -f FILE\n", prog, prog, prog);
+}
+
+int main(int argc, char *argv[])
+{
+    char data[MAX_DG_SIZE];
+    unsigned int iterations = 10000;
+    int max_threads = IPA_CLDAP_MAX_WORKERS;
+    const char *outdir = NULL;
+    const char *fuzzfile = NULL;
+    size_t len;
+    size_t i;
+    int opt;
+    int t;
+
+    while ((opt = getopt(argc, argv, "n:t:o:f:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'o':
+            outdir = optarg;
+            break;
+        case 'f':
+            fuzzfile = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (iterations == 0) {
+        iterations = 1;
+    }
+    if (max_threads < 1 || max_threads > IPA_CLDAP_MAX_WORKERS * 4) {
+        max_threads = IPA_CLDAP_MAX_WORKERS;
+    }
+
+    if (init_ctx() != 0) {
+        fprintf(stderr, "Cannot initialize the plugin context\n");
+        return 1;
+    }
+
+    if (fuzzfile) {
+        if (load_file(fuzzfile, data, &len) != 0) {
+            return 1;
+        }
+        return fuzz_one(data, len);
+    }
+
+    if (build_corpus() != 0) {
+        fprintf(stderr, "Cannot build the corpus\n");
+        return 1;
+    }
+
+    if (outdir) {
+        return write_corpus(outdir);
+    }
+
+    for (; optind < argc; optind++) {
+        if (load_file(argv[optind], data, &len) != 0 ||
+            add_raw(argv[optind], data, len) != 0) {
+            fprintf(stderr, "Cannot add %s to the corpus\n", argv[optind]);
+            return 1;
+        }
+    }
+
+    /* "fail" counts datagrams that did not decode, or got no reply */
+    print_header();
+    for (i = 0; i < corpus_len; i++) {
+        char name[128];
+
+        snprintf(name, sizeof(name), "decode/%s", corpus[i].name);
+        run(name, &corpus[i], 1, 1, iterations, true, false);
+        snprintf(name, sizeof(name), "process/%s", corpus[i].name);
+        run(name, &corpus[i], 1, 1, iterations, false, false);
+    }
+
+    /* the cost of a reply without the cache: search stub and encoding */
+    run("process-uncached/sssd/ntver6", &corpus[1], 1, 1,
+        iterations / 10 ? iterations / 10 : 1, false, true);
+
+    for (t = 1; t <= max_threads; t *= 2) {
+        run("process/all", corpus, corpus_len, t,
+            iterations / corpus_len ? iterations / corpus_len : 1,
+            false, false);
+    }
+
+    printf("\nslapi searches: %llu\n", (unsigned long long)searches);
+    return 0;
+}
+#endif
@@ -232,19 +232,130 @@ done:
     return ret;
 }
 
-int ipa_cldap_netlogon(struct ipa_cldap_ctx *ctx,
-                       struct ipa_cldap_req *req,
-                       struct berval *reply)
+/* Wrap the NETLOGON blob in a searchResEntry protocolOp. The message ID
+ * is added per reply by ipa_cldap_respond(). */
+static int ipa_cldap_encode_entry(struct berval *nbtblob, struct berval **op)
+{
+    BerElement *be;
+    int ret;
+
+    be = ber_alloc_t(0);
+    if (!be) {
+        return ENOMEM;
+    }
+
+    ret = ber_printf(be, "t{s{{s[O]}}}", LDAP_RES_SEARCH_ENTRY,
+                     "", "netlogon", nbtblob);
+    if (ret == LBER_ERROR) {
+        ret = EFAULT;
+        goto done;
+    }
+
+    ret = ber_flatten(be, op);
+    ret = ret == LBER_ERROR ? EFAULT : 0;
+
+done:
+    ber_free(be, 1);
+    return ret;
+}
+
+static void ipa_cldap_cache_clear(struct ipa_cldap_cache *cache)
+{
+    int i;
+
+    slapi_ch_free_string(&cache->domain);
+    for (i = 0; i < IPA_CLDAP_CACHE_OPS; i++) {
+        ber_bvfree(cache->ops[i]);
+        cache->ops[i] = NULL;
+    }
+    cache->expires = 0;
+}
+
+/* Load the domain entry and encode the replies for both NTver flavors.
+ * Must be called with the write lock held. */
+static int ipa_cldap_cache_load(struct ipa_cldap_ctx *ctx,
+                                struct ipa_cldap_cache *cache)
 {
+    static const uint32_t ntvers[IPA_CLDAP_CACHE_OPS] = {
+        NETLOGON_NT_VERSION_5EX,
+        NETLOGON_NT_VERSION_5EX | NETLOGON_NT_VERSION_5EX_WITH_IP,
+    };
     char hostname[MAXHOSTNAMELEN + 1]; /* NOTE: lenght hardcoded in kernel */
-    char *domain = NULL;
-    char *our_domain = NULL;
+    struct berval nbtblob = { 0, NULL };
     char *guid = NULL;
     char *sid = NULL;
     char *name = NULL;
+    char *dot;
+    int ret;
+    int i;
+
+    ipa_cldap_cache_clear(cache);
+
+    ret = gethostname(hostname, MAXHOSTNAMELEN);
+    if (ret == -1) {
+        ret = errno;
+        goto done;
+    }
+    /* Make double sure it is terminated */
+    hostname[MAXHOSTNAMELEN] = '\0';
+    dot = strchr(hostname, '.');
+    if (!dot) {
+        /* this name is not fully qualified, therefore invalid */
+        ret = EINVAL;
+        goto done;
+    }
+
+    ret = ipa_cldap_get_domain_entry(ctx, &cache->domain, &guid, &sid, &name);
+    if (ret) {
+        goto done;
+    }
+
+    for (i = 0; i < IPA_CLDAP_CACHE_OPS; i++) {
+        ret = ipa_cldap_encode_netlogon(hostname, cache->domain,
+                                        guid, sid, name,
+                                        ntvers[i], &nbtblob);
+        if (ret) {
+            goto done;
+        }
+
+        ret = ipa_cldap_encode_entry(&nbtblob, &cache->ops[i]);
+        free(nbtblob.bv_val);
+        nbtblob.bv_val = NULL;
+        if (ret) {
+            goto done;
+        }
+    }
+
+    cache->expires = time(NULL) + IPA_CLDAP_CACHE_TTL;
+
+done:
+    if (ret) {
+        ipa_cldap_cache_clear(cache);
+    }
+    slapi_ch_free_string(&guid);
+    slapi_ch_free_string(&sid);
+    slapi_ch_free_string(&name);
+    return ret;
+}
+
+void ipa_cldap_cache_invalidate(struct ipa_cldap_ctx *ctx)
+{
+    pthread_rwlock_wrlock(&ctx->cache.lock);
+    ipa_cldap_cache_clear(&ctx->cache);
+    pthread_rwlock_unlock(&ctx->cache.lock);
+}
+
+int ipa_cldap_netlogon(struct ipa_cldap_ctx *ctx,
+                       struct ipa_cldap_req *req,
+                       struct berval *reply)
+{
+    struct ipa_cldap_cache *cache = &ctx->cache;
+    struct berval *op;
+    char *domain = NULL;
+    size_t domain_len = 0;
     uint32_t ntver = 0;
     uint32_t t;
-    char *dot;
+    time_t now;
     int ret;
     int len;
     int i;
@@ -257,14 +368,11 @@ int ipa_cldap_netlogon(struct ipa_cldap_ctx *ctx,
                         req->kvps.pairs[i].attr.bv_len) == 0) {
             /* remove trailing dot if any */
             len = req->kvps.pairs[i].value.bv_len;
-            if (req->kvps.pairs[i].value.bv_val[len-1] == '.') {
+            if (len > 0 && req->kvps.pairs[i].value.bv_val[len-1] == '.') {
                 len--;
             }
-            domain = strndup(req->kvps.pairs[i].value.bv_val, len);
-            if (!domain) {
-                ret = ENOMEM;
-                goto done;
-            }
+            domain = req->kvps.pairs[i].value.bv_val;
+            domain_len = len;
             continue;
         }
         if (strncasecmp("Host",
@@ -301,66 +409,63 @@ int ipa_cldap_netlogon(struct ipa_cldap_ctx *ctx,
                         req->kvps.pairs[i].attr.bv_val,
                         req->kvps.pairs[i].attr.bv_len) == 0) {
             if (req->kvps.pairs[i].value.bv_len != 4) {
-                ret = EINVAL;
-                goto done;
+                return EINVAL;
             }
             memcpy(&t, req->kvps.pairs[i].value.bv_val, 4);
             ntver = le32toh(t);
             continue;
         }
-        LOG_TRACE("Unknown filter attribute: %s\n",
+        LOG_TRACE("Unknown filter attribute: %.*s\n",
+                  (int)req->kvps.pairs[i].attr.bv_len,
                   req->kvps.pairs[i].attr.bv_val);
     }
 
     if (!ntver) {
-        ret = EINVAL;
-        goto done;
-    }
-
-    ret = gethostname(hostname, MAXHOSTNAMELEN);
-    if (ret == -1) {
-        ret = errno;
-        goto done;
-    }
-    /* Make double sure it is terminated */
-    hostname[MAXHOSTNAMELEN] = '\0';
-    dot = strchr(hostname, '.');
-    if (!dot) {
-        /* this name is not fully qualified, therefore invalid */
-        ret = EINVAL;
-        goto done;
+        return EINVAL;
     }
 
     /* FIXME: we support only NETLOGON_NT_VERSION_5EX for now */
     if (!(ntver & NETLOGON_NT_VERSION_5EX)) {
-        ret = EINVAL;
-        goto done;
+        return EINVAL;
     }
 
-    ret = ipa_cldap_get_domain_entry(ctx, &our_domain, &guid, &sid, &name);
-    if (ret) {
-        goto done;
+    /* The domain entry and the hostname almost never change, so the
+     * encoded replies are cached until a post-op sees the domain entry
+     * change, or IPA_CLDAP_CACHE_TTL expires. */
+    now = time(NULL);
+    pthread_rwlock_rdlock(&cache->lock);
+    if (now >= cache->expires) {
+        pthread_rwlock_unlock(&cache->lock);
+        pthread_rwlock_wrlock(&cache->lock);
+        if (now >= cache->expires) {
+            ret = ipa_cldap_cache_load(ctx, cache);
+            if (ret) {
+                goto done;
+            }
+        }
     }
 
     /* If a domain is provided, check it is our own.
      * If no domain is provided the client is asking for our own domain. */
     if (domain) {
-        ret = strcasecmp(domain, our_domain);
-        if (ret != 0) {
+        if (domain_len != strlen(cache->domain) ||
+            strncasecmp(domain, cache->domain, domain_len) != 0) {
             ret = EINVAL;
             goto done;
         }
     }
 
-    ret = ipa_cldap_encode_netlogon(hostname, our_domain,
-                                    guid, sid, name,
-                                    ntver, reply);
+    op = cache->ops[(ntver & NETLOGON_NT_VERSION_5EX_WITH_IP) ? 1 : 0];
+    if (op->bv_len > sizeof(req->entry)) {
+        ret = EFAULT;
+        goto done;
+    }
+    memcpy(req->entry, op->bv_val, op->bv_len);
+    reply->bv_val = req->entry;
+    reply->bv_len = op->bv_len;
+    ret = 0;
 
 done:
-    free(domain);
-    slapi_ch_free_string(&our_domain);
-    slapi_ch_free_string(&guid);
-    slapi_ch_free_string(&sid);
-    slapi_ch_free_string(&name);
+    pthread_rwlock_unlock(&cache->lock);
     return ret;
 }
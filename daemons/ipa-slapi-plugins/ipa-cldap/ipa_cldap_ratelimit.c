@@ -0,0 +1,190 @@
+/** BEGIN COPYRIGHT BLOCK
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Additional permission under GPLv3 section 7:
+ *
+ * In the following paragraph, "GPL" means the GNU General Public
+ * License, version 3 or any later version, and "Non-GPL Code" means
+ * code that is governed neither by the GPL nor a license
+ * compatible with the GPL.
+ *
+ * You may link the code of this Program with Non-GPL Code and convey
+ * linked combinations including the two, provided that such Non-GPL
+ * Code only links to the code of this Program through those well
+ * defined interfaces identified in the file named EXCEPTION found in
+ * the source code files (the "Approved Interfaces"). The files of
+ * Non-GPL Code may instantiate templates or use macros or inline
+ * functions from the Approved Interfaces without causing the resulting
+ * work to be covered by the GPL. Only the copyright holders of this
+ * Program may make changes or additions to the list of Approved
+ * Interfaces.
+ *
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ * All rights reserved.
+ * END COPYRIGHT BLOCK **/
+
+#include "ipa_cldap.h"
+
+/*
+ * Token buckets keyed by source prefix (/24 for IPv4, /64 for IPv6).
+ *
+ * Each bucket is a single 64 bit word updated with compare and swap, so
+ * workers never lock. The table is not chained: a prefix landing on a
+ * bucket tagged for another prefix takes it over with a full bucket, which
+ * makes the limit more lenient for both. Two prefixes whose hashes also
+ * agree on the 16 bit tag are indistinguishable, though, and share one
+ * bucket: a noisy prefix can then get the other one dropped. For a given
+ * pair of prefixes the odds are about 1 in 2^28.
+ *
+ *   bits 63-48  tag, the high bits of the prefix hash
+ *   bits 47-32  tokens, in 1/IPA_CLDAP_RL_UNIT
+ *   bits 31-0   time of the last refill, in milliseconds
+ */
+
+#define RL_TAG(b) ((uint32_t)((b) >> 48))
+#define RL_TOKENS(b) ((uint32_t)(((b) >> 32) & 0xffff))
+#define RL_STAMP(b) ((uint32_t)(b))
+#define RL_BUCKET(tag, tokens, stamp) \
+    (((uint64_t)(tag) << 48) | ((uint64_t)(tokens) << 32) | (stamp))
+
+static uint32_t ipa_cldap_prefix_hash(const struct sockaddr_storage *ss)
+{
+    const struct sockaddr_in6 *sin6;
+    const struct sockaddr_in *sin;
+    const uint8_t *p;
+    uint32_t hash = 2166136261U; /* FNV-1a */
+    size_t len;
+    size_t i;
+
+    switch (ss->ss_family) {
+    case AF_INET:
+        sin = (const struct sockaddr_in *)ss;
+        p = (const uint8_t *)&sin->sin_addr;
+        len = 3;
+        break;
+    case AF_INET6:
+        sin6 = (const struct sockaddr_in6 *)ss;
+        p = sin6->sin6_addr.s6_addr;
+        if (IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr)) {
+            p += 12;
+            len = 3;
+        } else {
+            len = 8;
+        }
+        break;
+    default:
+        return 0;
+    }
+
+    /* keep the address families apart */
+    hash = (hash ^ len) * 16777619U;
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 16777619U;
+    }
+
+    return hash;
+}
+
+bool ipa_cldap_ratelimit(struct ipa_cldap_ratelimit *rl,
+                         const struct sockaddr_storage *ss,
+                         uint32_t now_ms)
+{
+    uint64_t *bucket;
+    uint64_t old;
+    uint64_t new;
+    uint32_t hash;
+    uint32_t tokens;
+    uint32_t elapsed;
+    uint32_t stamp;
+    uint32_t tag;
+    uint32_t rate;
+    uint32_t full;
+
+    rate = __sync_fetch_and_add(&rl->rate, 0);
+    full = __sync_fetch_and_add(&rl->burst, 0) * IPA_CLDAP_RL_UNIT;
+    if (rate == 0) {
+        __sync_fetch_and_add(&rl->answered, 1);
+        return true;
+    }
+
+    hash = ipa_cldap_prefix_hash(ss);
+    bucket = &rl->buckets[hash & (IPA_CLDAP_RL_BUCKETS - 1)];
+    tag = hash >> 16;
+
+    do {
+        old = *bucket;
+        stamp = now_ms;
+
+        if (old == 0 || RL_TAG(old) != tag) {
+            /* new prefix, starts with a full bucket */
+            tokens = full;
+        } else {
+            tokens = RL_TOKENS(old);
+            elapsed = now_ms - RL_STAMP(old);
+            if ((int32_t)elapsed < 0) {
+                /* another worker got a later clock reading */
+                elapsed = 0;
+                stamp = RL_STAMP(old);
+            }
+            if ((uint64_t)elapsed * rate >= (uint64_t)full * 1000 /
+                                            IPA_CLDAP_RL_UNIT) {
+                tokens = full;
+            } else {
+                tokens += (uint64_t)elapsed * rate *
+                          IPA_CLDAP_RL_UNIT / 1000;
+                if (tokens > full) {
+                    tokens = full;
+                }
+            }
+        }
+
+        if (tokens < IPA_CLDAP_RL_UNIT) {
+            __sync_fetch_and_add(&rl->dropped, 1);
+            return false;
+        }
+        tokens -= IPA_CLDAP_RL_UNIT;
+
+        new = RL_BUCKET(tag, tokens, stamp);
+    } while (!__sync_bool_compare_and_swap(bucket, old, new));
+
+    __sync_fetch_and_add(&rl->answered, 1);
+    return true;
+}
+
+/* Log the counters at most once per IPA_CLDAP_RL_REPORT seconds, and only
+ * if something was dropped, so the errors log is quiet in normal use. */
+void ipa_cldap_ratelimit_report(struct ipa_cldap_ratelimit *rl,
+                                uint32_t now_ms)
+{
+    uint32_t last = rl->reported;
+    uint64_t dropped;
+
+    if (now_ms - last < IPA_CLDAP_RL_REPORT * 1000) {
+        return;
+    }
+    if (!__sync_bool_compare_and_swap(&rl->reported, last, now_ms)) {
+        /* another worker is reporting */
+        return;
+    }
+
+    dropped = rl->dropped;
+    if (dropped == rl->last_dropped) {
+        return;
+    }
+    rl->last_dropped = dropped;
+
+    LOG("Rate limited CLDAP requests: %llu dropped, %llu answered\n",
+        (unsigned long long)dropped, (unsigned long long)rl->answered);
+}
@@ -24,6 +24,8 @@
 #include <stddef.h>
 #include <setjmp.h>
 #include <cmocka.h>
+#include <string.h>
+#include <arpa/inet.h>
 
 #include "ipa_cldap.h"
 
@@ -56,11 +58,66 @@ void test_make_netbios_name(void **state)
     }
 }
 
+static void set_ipv4(struct sockaddr_storage *ss, const char *addr)
+{
+    struct sockaddr_in *sin = (struct sockaddr_in *)ss;
+
+    memset(ss, 0, sizeof(*ss));
+    sin->sin_family = AF_INET;
+    assert_int_equal(inet_pton(AF_INET, addr, &sin->sin_addr), 1);
+}
+
+void test_ratelimit(void **state)
+{
+    static struct ipa_cldap_ratelimit rl;
+    struct sockaddr_storage a;
+    struct sockaddr_storage b;
+    struct sockaddr_storage c;
+    int i;
+
+    set_ipv4(&a, "192.0.2.1");
+    set_ipv4(&b, "192.0.2.200");
+    set_ipv4(&c, "198.51.100.1");
+
+    /* a rate of 0 disables the limit */
+    for (i = 0; i < 1000; i++) {
+        assert_true(ipa_cldap_ratelimit(&rl, &a, 1000));
+    }
+    assert_int_equal(rl.dropped, 0);
+
+    rl.rate = 2;
+    rl.burst = 4;
+
+    /* a burst, then the rest of the /24 is dropped too */
+    for (i = 0; i < 4; i++) {
+        assert_true(ipa_cldap_ratelimit(&rl, &a, 1000));
+    }
+    assert_false(ipa_cldap_ratelimit(&rl, &a, 1000));
+    assert_false(ipa_cldap_ratelimit(&rl, &b, 1000));
+
+    /* other prefixes have their own bucket */
+    assert_true(ipa_cldap_ratelimit(&rl, &c, 1000));
+
+    /* one request every 500 ms refills */
+    assert_false(ipa_cldap_ratelimit(&rl, &a, 1400));
+    assert_true(ipa_cldap_ratelimit(&rl, &a, 1500));
+    assert_false(ipa_cldap_ratelimit(&rl, &a, 1500));
+
+    /* a long pause refills up to the burst only */
+    for (i = 0; i < 4; i++) {
+        assert_true(ipa_cldap_ratelimit(&rl, &a, 60000));
+    }
+    assert_false(ipa_cldap_ratelimit(&rl, &a, 60000));
+
+    assert_int_equal(rl.dropped, 5);
+}
+
 int main(int argc, const char *argv[])
 {
 
     const UnitTest tests[] = {
         unit_test(test_make_netbios_name),
+        unit_test(test_ratelimit),
     };
 
     return run_tests(tests);
@@ -133,10 +133,9 @@ static int ipa_cldap_get_tree(BerElement *be, struct kvp_list *kvps)
     return 0;
 }
 
-static int ipa_cldap_decode(struct ipa_cldap_req *req)
+int ipa_cldap_decode(BerElement *be, struct ipa_cldap_req *req)
 {
     struct berval bv;
-    BerElement *be;
     ber_tag_t tag;
     ber_len_t len;
     ber_int_t scope;
@@ -148,15 +147,13 @@ static int ipa_cldap_decode(struct ipa_cldap_req *req)
     struct berval attr;
     int ret = EINVAL;
 
+    /* the request is reused, do not answer with a stale id */
+    req->id = 0;
+
     bv.bv_val = req->dgram;
     bv.bv_len = req->dgsize;
 
-    be = ber_alloc_t(0);
-    if (!be) {
-        LOG_FATAL("Out of memory!\n");
-        goto done;
-    }
-
+    /* be is reused for every datagram, ber_init2() resets it entirely */
     ber_init2(be, &bv, 0);
 
     tag = ber_skip_tag(be, &len);
@@ -209,66 +206,106 @@ static int ipa_cldap_decode(struct ipa_cldap_req *req)
     }
 
 done:
-    ber_free(be, 0);
     return ret;
 }
 
+/* searchResDone, resultCode success, empty matchedDN and message */
+static const char ipa_cldap_done_op[] = {
+    LDAP_RES_SEARCH_RESULT, 0x07, 0x0a, 0x01, 0x00, 0x04, 0x00, 0x04, 0x00
+};
+
+static size_t ipa_cldap_put_len(unsigned char *p, size_t len)
+{
+    if (len < 0x80) {
+        p[0] = len;
+        return 1;
+    }
+    if (len < 0x100) {
+        p[0] = 0x81;
+        p[1] = len;
+        return 2;
+    }
+    p[0] = 0x82;
+    p[1] = len >> 8;
+    p[2] = len;
+    return 3;
+}
+
+/* Append an LDAPMessage made of the message ID and the pre-encoded
+ * protocolOp, so replies need no BER encoding per datagram. */
+static int ipa_cldap_put_msg(struct ipa_cldap_req *req, size_t *off,
+                             const char *op, size_t oplen)
+{
+    unsigned char *p = (unsigned char *)req->out + *off;
+    uint32_t id = req->id;
+    size_t idlen;
+    size_t n;
+    int i;
+
+    /* minimal two's complement encoding of the INTEGER */
+    for (idlen = 4; idlen > 1; idlen--) {
+        uint32_t top = (id >> ((idlen - 1) * 8 - 1)) & 0x1ff;
+        if (top != 0 && top != 0x1ff) {
+            break;
+        }
+    }
+
+    /* tag, length (at most 3 bytes), msgid, op */
+    if (*off + 4 + 2 + idlen + oplen > sizeof(req->out) ||
+        2 + idlen + oplen > 0xffff) {
+        return EMSGSIZE;
+    }
+
+    n = 0;
+    p[n++] = LDAP_TAG_MESSAGE;
+    n += ipa_cldap_put_len(p + n, 2 + idlen + oplen);
+    p[n++] = LDAP_TAG_MSGID;
+    p[n++] = idlen;
+    for (i = idlen - 1; i >= 0; i--) {
+        p[n++] = id >> (i * 8);
+    }
+    memcpy(p + n, op, oplen);
+
+    *off += n + oplen;
+    return 0;
+}
+
 static void ipa_cldap_respond(struct ipa_cldap_ctx *ctx,
                               struct ipa_cldap_req *req,
                               struct berval *nbtblob)
 {
-    struct berval *bv = NULL;
-    BerElement *be;
+    size_t off = 0;
     int ret;
 
-    be = ber_alloc_t(0);
-    if (!be) {
-        LOG_OOM();
-        return;
-    }
-
     if (nbtblob->bv_len != 0) {
         /* result */
-        ret = ber_printf(be, "{it{s{{s[O]}}}}", req->id,
-                         LDAP_RES_SEARCH_ENTRY, "", "netlogon", nbtblob);
-        if (ret == LBER_ERROR) {
+        ret = ipa_cldap_put_msg(req, &off, nbtblob->bv_val, nbtblob->bv_len);
+        if (ret) {
             LOG("Failed to encode CLDAP reply\n");
-            goto done;
+            return;
         }
     }
     /* done */
     /* As per MS-ADTS 6.3.3.3 always return SUCCESS even for invalid filters */
-    ret = ber_printf(be, "{it{ess}}", req->id,
-                         LDAP_RES_SEARCH_RESULT, 0, "", "");
-    if (ret == LBER_ERROR) {
-        LOG("Failed to encode CLDAP reply\n");
-        goto done;
-    }
-    /* get data blob */
-    ret = ber_flatten(be, &bv);
-    if (ret == LBER_ERROR) {
+    ret = ipa_cldap_put_msg(req, &off, ipa_cldap_done_op,
+                            sizeof(ipa_cldap_done_op));
+    if (ret) {
         LOG("Failed to encode CLDAP reply\n");
-        goto done;
-    }
-
-    ret = sendto(ctx->sd, bv->bv_val, bv->bv_len, 0,
-                 (struct sockaddr *)&req->ss, req->ss_len);
-    if (ret == -1) {
-        LOG("Failed to send CLDAP reply (%d, %s)\n", errno, strerror(errno));
+        return;
     }
 
-done:
-    ber_bvfree(bv);
-    ber_free(be, 1);
+    /* sent by ipa_cldap_send_batch() */
+    req->reply.bv_val = req->out;
+    req->reply.bv_len = off;
 }
 
-static void ipa_cldap_process(struct ipa_cldap_ctx *ctx,
-                              struct ipa_cldap_req *req)
+void ipa_cldap_process(struct ipa_cldap_ctx *ctx, BerElement *be,
+                       struct ipa_cldap_req *req)
 {
     struct berval reply;
     int ret;
 
-    ret = ipa_cldap_decode(req);
+    ret = ipa_cldap_decode(be, req);
     if (ret) {
         goto done;
     }
@@ -286,49 +323,114 @@ done:
 
     ipa_cldap_respond(ctx, req, &reply);
 
-    ipa_cldap_free_kvps(&req->kvps);
-    free(req);
+    /* keep the pairs allocated for the next datagram */
+    req->kvps.top = 0;
     return;
 }
 
-static struct ipa_cldap_req *ipa_cldap_recv_dgram(struct ipa_cldap_ctx *ctx)
+/* receive up to IPA_CLDAP_BATCH datagrams into the worker requests */
+static int ipa_cldap_recv_batch(struct ipa_cldap_worker_ctx *w)
 {
-    struct ipa_cldap_req *req;
+    struct mmsghdr msgs[IPA_CLDAP_BATCH];
+    struct iovec iovs[IPA_CLDAP_BATCH];
+    int ret;
+    int i;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < IPA_CLDAP_BATCH; i++) {
+        iovs[i].iov_base = w->reqs[i].dgram;
+        iovs[i].iov_len = MAX_DG_SIZE;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &w->reqs[i].ss;
+        msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+    }
 
-    req = calloc(1, sizeof(struct ipa_cldap_req));
-    if (!req) {
-        LOG("Failed to allocate memory for req");
-        return NULL;
+    ret = recvmmsg(w->sd, msgs, IPA_CLDAP_BATCH, MSG_DONTWAIT, NULL);
+    if (ret == -1) {
+        /* another worker sharing the socket may have been faster */
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            LOG_TRACE("Failed to get datagrams\n");
+        }
+        return 0;
     }
 
-    req->fd = ctx->sd;
-    req->ss_len = sizeof(struct sockaddr_storage);
+    for (i = 0; i < ret; i++) {
+        w->reqs[i].fd = w->sd;
+        w->reqs[i].ss_len = msgs[i].msg_hdr.msg_namelen;
+        w->reqs[i].dgsize = msgs[i].msg_len;
+    }
 
-    req->dgsize = recvfrom(req->fd, req->dgram, MAX_DG_SIZE, 0,
-                           (struct sockaddr *)&req->ss, &req->ss_len);
-    if (req->dgsize == -1) {
-        LOG_TRACE("Failed to get datagram\n");
-        free(req);
-        return NULL;
+    return ret;
+}
+
+static void ipa_cldap_send_batch(struct ipa_cldap_worker_ctx *w, int count)
+{
+    struct mmsghdr msgs[IPA_CLDAP_BATCH];
+    struct iovec iovs[IPA_CLDAP_BATCH];
+    int sent;
+    int ret;
+    int n;
+    int i;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0, n = 0; i < count; i++) {
+        if (w->reqs[i].reply.bv_len == 0) {
+            continue;
+        }
+        iovs[n].iov_base = w->reqs[i].reply.bv_val;
+        iovs[n].iov_len = w->reqs[i].reply.bv_len;
+        msgs[n].msg_hdr.msg_iov = &iovs[n];
+        msgs[n].msg_hdr.msg_iovlen = 1;
+        msgs[n].msg_hdr.msg_name = &w->reqs[i].ss;
+        msgs[n].msg_hdr.msg_namelen = w->reqs[i].ss_len;
+        n++;
+    }
+
+    for (sent = 0; sent < n; sent += ret) {
+        ret = sendmmsg(w->sd, &msgs[sent], n - sent, 0);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                ret = 0;
+                continue;
+            }
+            LOG("Failed to send CLDAP reply (%d, %s)\n",
+                errno, strerror(errno));
+            /* skip the reply that failed and try the rest */
+            ret = 1;
+        }
     }
 
-    return req;
+    for (i = 0; i < count; i++) {
+        w->reqs[i].reply.bv_len = 0;
+    }
 }
 
 void *ipa_cldap_worker(void *arg)
 {
-    struct ipa_cldap_req *req;
+    struct ipa_cldap_worker_ctx *w = (struct ipa_cldap_worker_ctx *) arg;
+    struct ipa_cldap_ratelimit *rl = &w->ctx->ratelimit;
     struct pollfd fds[2];
+    struct timespec ts;
+    uint32_t now_ms;
     bool stop = false;
-    struct ipa_cldap_ctx *ctx = (struct ipa_cldap_ctx *) arg;
+    BerElement *be;
     int ret;
+    int n;
+    int i;
+
+    be = ber_alloc_t(0);
+    if (!be) {
+        LOG_OOM();
+        return NULL;
+    }
 
     while (!stop) {
 
-        fds[0].fd = ctx->stopfd[0];
+        fds[0].fd = w->ctx->stopfd[0];
         fds[0].events = POLLIN;
         fds[0].revents = 0;
-        fds[1].fd = ctx->sd;
+        fds[1].fd = w->sd;
         fds[1].events = POLLIN;
         fds[1].revents = 0;
 
@@ -351,13 +453,28 @@ void *ipa_cldap_worker(void *arg)
             continue;
         }
 
-        /* got a CLDAP packet, handle it */
+        /* got CLDAP packets, handle them */
         if (fds[1].revents & POLLIN) {
-            req = ipa_cldap_recv_dgram(ctx);
-            if (req) {
-                ipa_cldap_process(ctx, req);
+            n = ipa_cldap_recv_batch(w);
+
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            now_ms = ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+
+            for (i = 0; i < n; i++) {
+                /* drop abusive sources before spending time decoding */
+                if (!ipa_cldap_ratelimit(rl, &w->reqs[i].ss, now_ms)) {
+                    continue;
+                }
+                ipa_cldap_process(w->ctx, be, &w->reqs[i]);
             }
+            ipa_cldap_send_batch(w, n);
+            ipa_cldap_ratelimit_report(rl, now_ms);
         }
     }
+
+    for (i = 0; i < IPA_CLDAP_BATCH; i++) {
+        ipa_cldap_free_kvps(&w->reqs[i].kvps);
+    }
+    ber_free(be, 0);
     return NULL;
 }
@@ -64,6 +64,10 @@
 
 #define EXOP_EXTDOM_OID "2.16.840.1.113730.3.8.10.4"
 #define EXOP_EXTDOM_V1_OID "2.16.840.1.113730.3.8.10.4.1"
+#define EXOP_EXTDOM_V2_OID "2.16.840.1.113730.3.8.10.4.2"
+
+/* Maximum number of objects in a single V2 request */
+#define EXTDOM_BULK_MAX 1024
 
 #define IPA_EXTDOM_PLUGIN_NAME   "ipa-extdom-extop"
 #define IPA_EXTDOM_FEATURE_DESC  "IPA trusted domain ID mapper"
@@ -71,9 +75,19 @@
 
 #define IPA_PLUGIN_NAME IPA_EXTDOM_PLUGIN_NAME
 
+#define SSSD_DOMAIN_SEPARATOR '@'
+
+/* Response cache defaults, matching SSSD's entry_cache_timeout and
+ * entry_negative_timeout so a cached reply is never older than what the
+ * SSSD instance on the server would hand out itself. */
+#define IPA_EXTDOM_CACHE_SIZE 4096
+#define IPA_EXTDOM_CACHE_TTL 5400
+#define IPA_EXTDOM_CACHE_NEG_TTL 15
+
 enum extdom_version {
     EXTDOM_V0 = 0,
-    EXTDOM_V1
+    EXTDOM_V1,
+    EXTDOM_V2
 };
 
 enum input_types {
@@ -147,9 +161,12 @@ struct extdom_res {
     } data;
 };
 
+struct ipa_extdom_cache;
+
 struct ipa_extdom_ctx {
     Slapi_ComponentId *plugin_id;
     char *base_dn;
+    struct ipa_extdom_cache *cache;
 };
 
 struct domain_info {
@@ -170,8 +187,27 @@ struct pwd_grp {
 
 int parse_request_data(struct berval *req_val, struct extdom_req **_req);
 void free_req_data(struct extdom_req *req);
+int parse_bulk_request_data(struct berval *req_val,
+                            struct extdom_req ***_reqs, size_t *_count);
+void free_bulk_req_data(struct extdom_req **reqs, size_t count);
 int check_request(struct extdom_req *req, enum extdom_version version);
 int handle_request(struct ipa_extdom_ctx *ctx, struct extdom_req *req,
                    struct berval **berval);
+int handle_bulk_request(struct ipa_extdom_ctx *ctx, struct extdom_req **reqs,
+                        size_t count, struct berval **berval);
 int pack_response(struct extdom_res *res, struct berval **ret_val);
+
+int ipa_extdom_cache_init(size_t max_entries, time_t ttl, time_t neg_ttl,
+                          struct ipa_extdom_cache **_cache);
+void ipa_extdom_cache_free(struct ipa_extdom_cache *cache);
+bool ipa_extdom_cache_get(struct ipa_extdom_cache *cache,
+                          struct extdom_req *req,
+                          int *_ret, struct berval **berval);
+void ipa_extdom_cache_put(struct ipa_extdom_cache *cache,
+                          struct extdom_req *req,
+                          int ret, struct berval *berval);
+bool ipa_extdom_cache_get_group_name(struct ipa_extdom_cache *cache,
+                                     gid_t gid, struct berval **name);
+void ipa_extdom_cache_put_group_name(struct ipa_extdom_cache *cache,
+                                     gid_t gid, const char *name);
 #endif /* _IPA_EXTDOM_H_ */
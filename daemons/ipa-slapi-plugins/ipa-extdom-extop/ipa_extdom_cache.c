@@ -0,0 +1,440 @@
+/** BEGIN COPYRIGHT BLOCK
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Additional permission under GPLv3 section 7:
+ *
+ * In the following paragraph, "GPL" means the GNU General Public
+ * License, version 3 or any later version, and "Non-GPL Code" means
+ * code that is governed neither by the GPL nor a license
+ * compatible with the GPL.
+ *
+ * You may link the code of this Program with Non-GPL Code and convey
+ * linked combinations including the two, provided that such Non-GPL
+ * Code only links to the code of this Program through those well
+ * defined interfaces identified in the file named EXCEPTION found in
+ * the source code files (the "Approved Interfaces"). The files of
+ * Non-GPL Code may instantiate templates or use macros or inline
+ * functions from the Approved Interfaces without causing the resulting
+ * work to be covered by the GPL. Only the copyright holders of this
+ * Program may make changes or additions to the list of Approved
+ * Interfaces.
+ *
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ * All rights reserved.
+ * END COPYRIGHT BLOCK **/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1 /* for asprintf() */
+#endif
+
+#include <pthread.h>
+
+#include "ipa_extdom.h"
+#include "util.h"
+
+/* Size-bounded LRU cache of packed responses. Entries are keyed on the
+ * input type, the request type and the looked up SID, name or id. Failed
+ * lookups (LDAP_NO_SUCH_OBJECT) are cached for neg_ttl seconds, everything
+ * else that is not LDAP_SUCCESS is never cached. */
+
+struct extdom_cache_entry {
+    struct extdom_cache_entry *next;   /* hash chain */
+    struct extdom_cache_entry *prev_lru;
+    struct extdom_cache_entry *next_lru;
+    uint32_t hash;
+    char *key;
+    int ret;
+    struct berval *val;
+    time_t expires;
+};
+
+struct ipa_extdom_cache {
+    pthread_mutex_t lock;
+    struct extdom_cache_entry **table;
+    uint32_t mask;
+    size_t count;
+    size_t max_entries;
+    time_t ttl;
+    time_t neg_ttl;
+    struct extdom_cache_entry *head; /* most recently used */
+    struct extdom_cache_entry *tail; /* least recently used */
+};
+
+static char *cache_key(struct extdom_req *req)
+{
+    char *key = NULL;
+    int ret;
+
+    switch (req->input_type) {
+    case INP_SID:
+        ret = asprintf(&key, "%d:%d:%s", req->input_type, req->request_type,
+                       req->data.sid);
+        break;
+    case INP_NAME:
+        ret = asprintf(&key, "%d:%d:%s%c%s", req->input_type,
+                       req->request_type, req->data.name.object_name,
+                       SSSD_DOMAIN_SEPARATOR, req->data.name.domain_name);
+        break;
+    case INP_POSIX_UID:
+        ret = asprintf(&key, "%d:%d:%lu%c%s", req->input_type,
+                       req->request_type,
+                       (unsigned long) req->data.posix_uid.uid,
+                       SSSD_DOMAIN_SEPARATOR, req->data.posix_uid.domain_name);
+        break;
+    case INP_POSIX_GID:
+        ret = asprintf(&key, "%d:%d:%lu%c%s", req->input_type,
+                       req->request_type,
+                       (unsigned long) req->data.posix_gid.gid,
+                       SSSD_DOMAIN_SEPARATOR, req->data.posix_gid.domain_name);
+        break;
+    default:
+        return NULL;
+    }
+
+    if (ret == -1) {
+        return NULL;
+    }
+
+    return key;
+}
+
+static uint32_t cache_hash(const char *key)
+{
+    uint32_t hash = 2166136261U;
+
+    for (; *key != '\0'; key++) {
+        hash ^= (unsigned char) *key;
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+static void lru_unlink(struct ipa_extdom_cache *cache,
+                       struct extdom_cache_entry *e)
+{
+    if (e->prev_lru != NULL) {
+        e->prev_lru->next_lru = e->next_lru;
+    } else {
+        cache->head = e->next_lru;
+    }
+
+    if (e->next_lru != NULL) {
+        e->next_lru->prev_lru = e->prev_lru;
+    } else {
+        cache->tail = e->prev_lru;
+    }
+
+    e->prev_lru = NULL;
+    e->next_lru = NULL;
+}
+
+static void lru_push(struct ipa_extdom_cache *cache,
+                     struct extdom_cache_entry *e)
+{
+    e->prev_lru = NULL;
+    e->next_lru = cache->head;
+    if (cache->head != NULL) {
+        cache->head->prev_lru = e;
+    }
+    cache->head = e;
+    if (cache->tail == NULL) {
+        cache->tail = e;
+    }
+}
+
+static void entry_remove(struct ipa_extdom_cache *cache,
+                         struct extdom_cache_entry *e)
+{
+    struct extdom_cache_entry **p;
+
+    for (p = &cache->table[e->hash & cache->mask]; *p != NULL;
+         p = &(*p)->next) {
+        if (*p == e) {
+            *p = e->next;
+            break;
+        }
+    }
+
+    lru_unlink(cache, e);
+    cache->count--;
+
+    ber_bvfree(e->val);
+    free(e->key);
+    free(e);
+}
+
+static struct extdom_cache_entry *entry_find(struct ipa_extdom_cache *cache,
+                                             uint32_t hash, const char *key)
+{
+    struct extdom_cache_entry *e;
+
+    for (e = cache->table[hash & cache->mask]; e != NULL; e = e->next) {
+        if (e->hash == hash && strcmp(e->key, key) == 0) {
+            return e;
+        }
+    }
+
+    return NULL;
+}
+
+int ipa_extdom_cache_init(size_t max_entries, time_t ttl, time_t neg_ttl,
+                          struct ipa_extdom_cache **_cache)
+{
+    struct ipa_extdom_cache *cache;
+    uint32_t size;
+
+    if (max_entries == 0 || ttl <= 0) {
+        *_cache = NULL;
+        return LDAP_SUCCESS;
+    }
+
+    cache = calloc(1, sizeof(struct ipa_extdom_cache));
+    if (cache == NULL) {
+        return LDAP_OPERATIONS_ERROR;
+    }
+
+    /* keep the load factor of the hash table at or below 1 */
+    for (size = 16; size < max_entries && size < (1U << 30); size <<= 1);
+
+    cache->table = calloc(size, sizeof(struct extdom_cache_entry *));
+    if (cache->table == NULL) {
+        free(cache);
+        return LDAP_OPERATIONS_ERROR;
+    }
+
+    if (pthread_mutex_init(&cache->lock, NULL) != 0) {
+        free(cache->table);
+        free(cache);
+        return LDAP_OPERATIONS_ERROR;
+    }
+
+    cache->mask = size - 1;
+    cache->max_entries = max_entries;
+    cache->ttl = ttl;
+    cache->neg_ttl = neg_ttl;
+
+    *_cache = cache;
+    return LDAP_SUCCESS;
+}
+
+void ipa_extdom_cache_free(struct ipa_extdom_cache *cache)
+{
+    if (cache == NULL) {
+        return;
+    }
+
+    while (cache->head != NULL) {
+        entry_remove(cache, cache->head);
+    }
+
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->table);
+    free(cache);
+}
+
+static bool cache_lookup(struct ipa_extdom_cache *cache, const char *key,
+                         int *_ret, struct berval **berval)
+{
+    struct extdom_cache_entry *e;
+    struct berval *val = NULL;
+    uint32_t hash;
+    bool found = false;
+    int ret = LDAP_SUCCESS;
+
+    hash = cache_hash(key);
+
+    pthread_mutex_lock(&cache->lock);
+
+    e = entry_find(cache, hash, key);
+    if (e != NULL) {
+        if (e->expires <= time(NULL)) {
+            entry_remove(cache, e);
+        } else {
+            if (e->val != NULL) {
+                val = ber_bvdup(e->val);
+            }
+            if (e->val == NULL || val != NULL) {
+                ret = e->ret;
+                found = true;
+                lru_unlink(cache, e);
+                lru_push(cache, e);
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+
+    if (found) {
+        *_ret = ret;
+        *berval = val;
+    }
+    return found;
+}
+
+/* Takes ownership of key */
+static void cache_store(struct ipa_extdom_cache *cache, char *key,
+                        int ret, struct berval *berval)
+{
+    struct extdom_cache_entry *e;
+    struct berval *val = NULL;
+    time_t ttl;
+    uint32_t hash;
+
+    switch (ret) {
+    case LDAP_SUCCESS:
+        ttl = berval != NULL ? cache->ttl : 0;
+        break;
+    case LDAP_NO_SUCH_OBJECT:
+        ttl = cache->neg_ttl;
+        break;
+    default:
+        ttl = 0;
+        break;
+    }
+
+    if (ttl <= 0) {
+        free(key);
+        return;
+    }
+
+    hash = cache_hash(key);
+
+    if (ret == LDAP_SUCCESS) {
+        val = ber_bvdup(berval);
+        if (val == NULL) {
+            free(key);
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&cache->lock);
+
+    e = entry_find(cache, hash, key);
+    if (e != NULL) {
+        /* another thread resolved the same object concurrently */
+        entry_remove(cache, e);
+    }
+
+    e = calloc(1, sizeof(struct extdom_cache_entry));
+    if (e == NULL) {
+        pthread_mutex_unlock(&cache->lock);
+        ber_bvfree(val);
+        free(key);
+        return;
+    }
+
+    while (cache->count >= cache->max_entries && cache->tail != NULL) {
+        entry_remove(cache, cache->tail);
+    }
+
+    e->hash = hash;
+    e->key = key;
+    e->ret = ret;
+    e->val = val;
+    e->expires = time(NULL) + ttl;
+    e->next = cache->table[hash & cache->mask];
+    cache->table[hash & cache->mask] = e;
+    lru_push(cache, e);
+    cache->count++;
+
+    pthread_mutex_unlock(&cache->lock);
+}
+
+bool ipa_extdom_cache_get(struct ipa_extdom_cache *cache,
+                          struct extdom_req *req,
+                          int *_ret, struct berval **berval)
+{
+    char *key;
+    bool found;
+
+    if (cache == NULL) {
+        return false;
+    }
+
+    key = cache_key(req);
+    if (key == NULL) {
+        return false;
+    }
+
+    found = cache_lookup(cache, key, _ret, berval);
+    free(key);
+
+    return found;
+}
+
+void ipa_extdom_cache_put(struct ipa_extdom_cache *cache,
+                          struct extdom_req *req,
+                          int ret, struct berval *berval)
+{
+    char *key;
+
+    if (cache == NULL) {
+        return;
+    }
+
+    key = cache_key(req);
+    if (key == NULL) {
+        return;
+    }
+
+    cache_store(cache, key, ret, berval);
+}
+
+/* Group names are kept in the same cache so that packing the group list
+ * of a user only has to go to NSS for groups not seen recently. The
+ * returned name has to be freed with ber_bvfree(). */
+bool ipa_extdom_cache_get_group_name(struct ipa_extdom_cache *cache,
+                                     gid_t gid, struct berval **name)
+{
+    char key[sizeof("gid:") + 3 * sizeof(unsigned long)];
+    int ret;
+
+    if (cache == NULL) {
+        return false;
+    }
+
+    snprintf(key, sizeof(key), "gid:%lu", (unsigned long) gid);
+
+    if (!cache_lookup(cache, key, &ret, name)) {
+        return false;
+    }
+
+    if (ret != LDAP_SUCCESS) {
+        return false;
+    }
+
+    return true;
+}
+
+void ipa_extdom_cache_put_group_name(struct ipa_extdom_cache *cache,
+                                     gid_t gid, const char *name)
+{
+    struct berval val;
+    char *key;
+
+    if (cache == NULL) {
+        return;
+    }
+
+    if (asprintf(&key, "gid:%lu", (unsigned long) gid) == -1) {
+        return;
+    }
+
+    val.bv_val = (char *) name;
+    val.bv_len = strlen(name);
+
+    cache_store(cache, key, LDAP_SUCCESS, &val);
+}
@@ -48,11 +48,11 @@
 #include "util.h"
 
 #define MAX(a,b) (((a)>(b))?(a):(b))
-#define SSSD_DOMAIN_SEPARATOR '@'
 
-int parse_request_data(struct berval *req_val, struct extdom_req **_req)
+/* Parses the fields of an ExtdomRequestValue, the SEQUENCE tag itself must
+ * already be consumed from ber. */
+static int parse_request_ber(BerElement *ber, struct extdom_req **_req)
 {
-    BerElement *ber = NULL;
     ber_tag_t tag;
     ber_int_t input_type;
     ber_int_t request_type;
@@ -98,18 +98,8 @@ int parse_request_data(struct berval *req_val, struct extdom_req **_req)
  * }
  */
 
-    if (req_val == NULL || req_val->bv_val == NULL || req_val->bv_len == 0) {
-        return LDAP_PROTOCOL_ERROR;
-    }
-
-    ber = ber_init(req_val);
-    if (ber == NULL) {
-        return LDAP_PROTOCOL_ERROR;
-    }
-
-    tag = ber_scanf(ber, "{ee", &input_type, &request_type);
+    tag = ber_scanf(ber, "ee", &input_type, &request_type);
     if (tag == LBER_ERROR) {
-        ber_free(ber, 1);
         return LDAP_PROTOCOL_ERROR;
     }
 
@@ -140,11 +130,9 @@ int parse_request_data(struct berval *req_val, struct extdom_req **_req)
             req->data.posix_gid.gid = (gid_t) id;
             break;
         default:
-            ber_free(ber, 1);
             free(req);
             return LDAP_PROTOCOL_ERROR;
     }
-    ber_free(ber, 1);
     if (tag == LBER_ERROR) {
         free(req);
         return LDAP_PROTOCOL_ERROR;
@@ -155,6 +143,128 @@ int parse_request_data(struct berval *req_val, struct extdom_req **_req)
     return LDAP_SUCCESS;
 }
 
+int parse_request_data(struct berval *req_val, struct extdom_req **_req)
+{
+    BerElement *ber = NULL;
+    ber_len_t len;
+    int ret;
+
+    if (req_val == NULL || req_val->bv_val == NULL || req_val->bv_len == 0) {
+        return LDAP_PROTOCOL_ERROR;
+    }
+
+    ber = ber_init(req_val);
+    if (ber == NULL) {
+        return LDAP_PROTOCOL_ERROR;
+    }
+
+    if (ber_skip_tag(ber, &len) == LBER_ERROR) {
+        ret = LDAP_PROTOCOL_ERROR;
+    } else {
+        ret = parse_request_ber(ber, _req);
+    }
+    ber_free(ber, 1);
+
+    return ret;
+}
+
+int parse_bulk_request_data(struct berval *req_val,
+                            struct extdom_req ***_reqs, size_t *_count)
+{
+    BerElement *ber = NULL;
+    ber_tag_t tag;
+    ber_len_t len;
+    char *last;
+    struct berval elem;
+    BerElement *elem_ber;
+    struct extdom_req **reqs = NULL;
+    struct extdom_req **new_reqs;
+    size_t count = 0;
+    size_t size = 0;
+    int ret;
+
+/* A V2 request carries a list of V1 requests:
+ * ExtdomBulkRequestValue ::= SEQUENCE OF ExtdomRequestValue
+ *
+ * Each element is parsed on its own, so that an element which is not a
+ * valid ExtdomRequestValue only gets a per-entry error: its slot in the
+ * returned list is NULL. Only a value that is not a SEQUENCE OF SEQUENCE
+ * fails as a whole.
+ */
+
+    if (req_val == NULL || req_val->bv_val == NULL || req_val->bv_len == 0) {
+        return LDAP_PROTOCOL_ERROR;
+    }
+
+    ber = ber_init(req_val);
+    if (ber == NULL) {
+        return LDAP_PROTOCOL_ERROR;
+    }
+
+    for (tag = ber_first_element(ber, &len, &last);
+         tag != LBER_DEFAULT;
+         tag = ber_next_element(ber, &len, last)) {
+
+        if (count == EXTDOM_BULK_MAX) {
+            ret = LDAP_ADMINLIMIT_EXCEEDED;
+            goto done;
+        }
+
+        if (count == size) {
+            size = size ? size * 2 : 16;
+            new_reqs = realloc(reqs, size * sizeof(struct extdom_req *));
+            if (new_reqs == NULL) {
+                ret = LDAP_OPERATIONS_ERROR;
+                goto done;
+            }
+            reqs = new_reqs;
+        }
+
+        if (tag != LBER_SEQUENCE ||
+            ber_skip_element(ber, &elem) == LBER_DEFAULT) {
+            ret = LDAP_PROTOCOL_ERROR;
+            goto done;
+        }
+
+        /* elem holds the contents of the SEQUENCE only */
+        reqs[count] = NULL;
+        if (elem.bv_len != 0) {
+            elem_ber = ber_init(&elem);
+            if (elem_ber == NULL) {
+                ret = LDAP_OPERATIONS_ERROR;
+                goto done;
+            }
+            ret = parse_request_ber(elem_ber, &reqs[count]);
+            ber_free(elem_ber, 1);
+            if (ret == LDAP_OPERATIONS_ERROR) {
+                goto done;
+            }
+            if (ret != LDAP_SUCCESS) {
+                reqs[count] = NULL;
+            }
+        }
+        count++;
+    }
+
+    if (count == 0) {
+        ret = LDAP_PROTOCOL_ERROR;
+        goto done;
+    }
+
+    ret = LDAP_SUCCESS;
+
+done:
+    ber_free(ber, 1);
+    if (ret != LDAP_SUCCESS) {
+        free_bulk_req_data(reqs, count);
+    } else {
+        *_reqs = reqs;
+        *_count = count;
+    }
+
+    return ret;
+}
+
 void free_req_data(struct extdom_req *req)
 {
     if (req == NULL) {
@@ -180,6 +290,21 @@ void free_req_data(struct extdom_req *req)
     free(req);
 }
 
+void free_bulk_req_data(struct extdom_req **reqs, size_t count)
+{
+    size_t c;
+
+    if (reqs == NULL) {
+        return;
+    }
+
+    for (c = 0; c < count; c++) {
+        free_req_data(reqs[c]);
+    }
+
+    free(reqs);
+}
+
 int check_request(struct extdom_req *req, enum extdom_version version)
 {
     if (version == EXTDOM_V0) {
@@ -218,6 +343,31 @@ static int get_buffer(size_t *_buf_len, char **_buf)
     return LDAP_SUCCESS;
 }
 
+/* sysconf() only gives a hint, entries of groups with many members can be
+ * much larger. */
+#define MAX_BUF (16 * 1024 * 1024)
+
+static int inc_buffer(size_t *_buf_len, char **_buf)
+{
+    size_t buf_len;
+    char *buf;
+
+    if (*_buf_len >= MAX_BUF) {
+        return LDAP_OPERATIONS_ERROR;
+    }
+
+    buf_len = *_buf_len * 2;
+    buf = realloc(*_buf, buf_len);
+    if (buf == NULL) {
+        return LDAP_OPERATIONS_ERROR;
+    }
+
+    *_buf_len = buf_len;
+    *_buf = buf;
+
+    return LDAP_SUCCESS;
+}
+
 static int get_user_grouplist(const char *name, gid_t gid,
                               size_t *_ngroups, gid_t **_groups )
 {
@@ -234,7 +384,7 @@ static int get_user_grouplist(const char *name, gid_t gid,
 
     ret = getgrouplist(name, gid, groups, &ngroups);
     if (ret == -1) {
-        new_groups = realloc(groups, ngroups);
+        new_groups = realloc(groups, ngroups * sizeof(gid_t));
         if (new_groups == NULL) {
             free(groups);
             return LDAP_OPERATIONS_ERROR;
@@ -282,6 +432,51 @@ static int add_kv_list(BerElement *ber, struct sss_nss_kv *kv_list)
     return LDAP_SUCCESS;
 }
 
+/* Adds the name of the group to the BER element. The name is taken from
+ * the response cache if possible, otherwise buf is allocated on first use
+ * and reused for all following lookups of the same request. */
+static int add_group_name(struct ipa_extdom_ctx *ctx, BerElement *ber,
+                          gid_t gid, size_t *buf_len, char **buf)
+{
+    struct group grp;
+    struct group *grp_result;
+    struct berval *name = NULL;
+    int ret;
+
+    if (ipa_extdom_cache_get_group_name(ctx->cache, gid, &name)) {
+        ret = ber_printf(ber, "o", name->bv_val, name->bv_len);
+        ber_bvfree(name);
+        return (ret == -1) ? LDAP_OPERATIONS_ERROR : LDAP_SUCCESS;
+    }
+
+    if (*buf == NULL) {
+        ret = get_buffer(buf_len, buf);
+        if (ret != LDAP_SUCCESS) {
+            return ret;
+        }
+    }
+
+    while ((ret = getgrgid_r(gid, &grp, *buf, *buf_len,
+                             &grp_result)) == ERANGE) {
+        ret = inc_buffer(buf_len, buf);
+        if (ret != LDAP_SUCCESS) {
+            return ret;
+        }
+    }
+    if (ret != 0 || grp_result == NULL) {
+        return LDAP_NO_SUCH_OBJECT;
+    }
+
+    ipa_extdom_cache_put_group_name(ctx->cache, gid, grp.gr_name);
+
+    ret = ber_printf(ber, "s", grp.gr_name);
+    if (ret == -1) {
+        return LDAP_OPERATIONS_ERROR;
+    }
+
+    return LDAP_SUCCESS;
+}
+
 static int pack_ber_sid(const char *sid, struct berval **berval)
 {
     BerElement *ber = NULL;
@@ -309,7 +504,8 @@ static int pack_ber_sid(const char *sid, struct berval **berval)
 
 #define SSSD_SYSDB_SID_STR "objectSIDString"
 
-static int pack_ber_user(enum response_types response_type,
+static int pack_ber_user(struct ipa_extdom_ctx *ctx,
+                         enum response_types response_type,
                          const char *domain_name, const char *user_name,
                          uid_t uid, gid_t gid,
                          const char *gecos, const char *homedir,
@@ -320,10 +516,8 @@ static int pack_ber_user(enum response_types response_type,
     int ret;
     size_t ngroups;
     gid_t *groups = NULL;
-    size_t buf_len;
+    size_t buf_len = 0;
     char *buf = NULL;
-    struct group grp;
-    struct group *grp_result;
     size_t c;
     char *locat;
     char *short_user_name = NULL;
@@ -357,11 +551,6 @@ static int pack_ber_user(enum response_types response_type,
             goto done;
         }
 
-        ret = get_buffer(&buf_len, &buf);
-        if (ret != LDAP_SUCCESS) {
-            goto done;
-        }
-
         ret = ber_printf(ber,"sss", gecos, homedir, shell);
         if (ret == -1) {
             ret = LDAP_OPERATIONS_ERROR;
@@ -375,19 +564,8 @@ static int pack_ber_user(enum response_types response_type,
         }
 
         for (c = 0; c < ngroups; c++) {
-            ret = getgrgid_r(groups[c], &grp, buf, buf_len, &grp_result);
-            if (ret != 0) {
-                ret = LDAP_NO_SUCH_OBJECT;
-                goto done;
-            }
-            if (grp_result == NULL) {
-                ret = LDAP_NO_SUCH_OBJECT;
-                goto done;
-            }
-
-            ret = ber_printf(ber, "s", grp.gr_name);
-            if (ret == -1) {
-                ret = LDAP_OPERATIONS_ERROR;
+            ret = add_group_name(ctx, ber, groups[c], &buf_len, &buf);
+            if (ret != LDAP_SUCCESS) {
                 goto done;
             }
         }
@@ -537,7 +715,8 @@ static int pack_ber_name(const char *domain_name, const char *name,
     return LDAP_SUCCESS;
 }
 
-static int handle_uid_request(enum request_types request_type, uid_t uid,
+static int handle_uid_request(struct ipa_extdom_ctx *ctx,
+                              enum request_types request_type, uid_t uid,
                               const char *domain_name, struct berval **berval)
 {
     int ret;
@@ -591,7 +770,7 @@ static int handle_uid_request(enum request_types request_type, uid_t uid,
             }
         }
 
-        ret = pack_ber_user((request_type == REQ_FULL ? RESP_USER
+        ret = pack_ber_user(ctx, (request_type == REQ_FULL ? RESP_USER
                                                       : RESP_USER_GROUPLIST),
                             domain_name, pwd.pw_name, pwd.pw_uid,
                             pwd.pw_gid, pwd.pw_gecos, pwd.pw_dir,
@@ -605,7 +784,8 @@ done:
     return ret;
 }
 
-static int handle_gid_request(enum request_types request_type, gid_t gid,
+static int handle_gid_request(struct ipa_extdom_ctx *ctx,
+                              enum request_types request_type, gid_t gid,
                               const char *domain_name, struct berval **berval)
 {
     int ret;
@@ -671,7 +851,8 @@ done:
     return ret;
 }
 
-static int handle_sid_request(enum request_types request_type, const char *sid,
+static int handle_sid_request(struct ipa_extdom_ctx *ctx,
+                              enum request_types request_type, const char *sid,
                               struct berval **berval)
 {
     int ret;
@@ -748,7 +929,7 @@ static int handle_sid_request(enum request_types request_type, const char *sid,
             }
         }
 
-        ret = pack_ber_user((request_type == REQ_FULL ? RESP_USER
+        ret = pack_ber_user(ctx, (request_type == REQ_FULL ? RESP_USER
                                                       : RESP_USER_GROUPLIST),
                             domain_name, pwd.pw_name, pwd.pw_uid,
                             pwd.pw_gid, pwd.pw_gecos, pwd.pw_dir,
@@ -799,7 +980,8 @@ done:
     return ret;
 }
 
-static int handle_name_request(enum request_types request_type,
+static int handle_name_request(struct ipa_extdom_ctx *ctx,
+                               enum request_types request_type,
                                const char *name, const char *domain_name,
                                struct berval **berval)
 {
@@ -863,7 +1045,7 @@ static int handle_name_request(enum request_types request_type,
                     goto done;
                 }
             }
-            ret = pack_ber_user((request_type == REQ_FULL ? RESP_USER
+            ret = pack_ber_user(ctx, (request_type == REQ_FULL ? RESP_USER
                                                           : RESP_USER_GROUPLIST),
                                 domain_name, pwd.pw_name, pwd.pw_uid,
                                 pwd.pw_gid, pwd.pw_gecos, pwd.pw_dir,
@@ -914,22 +1096,27 @@ int handle_request(struct ipa_extdom_ctx *ctx, struct extdom_req *req,
 {
     int ret;
 
+    if (ipa_extdom_cache_get(ctx->cache, req, &ret, berval)) {
+        return ret;
+    }
+
     switch (req->input_type) {
     case INP_POSIX_UID:
-        ret = handle_uid_request(req->request_type, req->data.posix_uid.uid,
+        ret = handle_uid_request(ctx, req->request_type, req->data.posix_uid.uid,
                                  req->data.posix_uid.domain_name, berval);
 
         break;
     case INP_POSIX_GID:
-        ret = handle_gid_request(req->request_type, req->data.posix_gid.gid,
+        ret = handle_gid_request(ctx, req->request_type, req->data.posix_gid.gid,
                                  req->data.posix_uid.domain_name, berval);
 
         break;
     case INP_SID:
-        ret = handle_sid_request(req->request_type, req->data.sid, berval);
+        ret = handle_sid_request(ctx, req->request_type, req->data.sid,
+                                 berval);
         break;
     case INP_NAME:
-        ret = handle_name_request(req->request_type, req->data.name.object_name,
+        ret = handle_name_request(ctx, req->request_type, req->data.name.object_name,
                                   req->data.name.domain_name, berval);
 
         break;
@@ -938,12 +1125,87 @@ int handle_request(struct ipa_extdom_ctx *ctx, struct extdom_req *req,
         goto done;
     }
 
+    ipa_extdom_cache_put(ctx->cache, req, ret,
+                         ret == LDAP_SUCCESS ? *berval : NULL);
 
 done:
 
     return ret;
 }
 
+int handle_bulk_request(struct ipa_extdom_ctx *ctx, struct extdom_req **reqs,
+                        size_t count, struct berval **berval)
+{
+    BerElement *ber = NULL;
+    struct berval *val;
+    size_t c;
+    int ret;
+
+/* Each request of the list gets its own result, invalid requests and
+ * failures of single objects do not fail the whole operation:
+ * ExtdomBulkResponseValue ::= SEQUENCE OF SEQUENCE {
+ *    result ENUMERATED (LDAP result code),
+ *    response OCTET STRING OPTIONAL -- ExtdomResponseValue
+ * }
+ */
+
+    ber = ber_alloc_t( LBER_USE_DER );
+    if (ber == NULL) {
+        return LDAP_OPERATIONS_ERROR;
+    }
+
+    ret = ber_printf(ber, "{");
+    if (ret == -1) {
+        ret = LDAP_OPERATIONS_ERROR;
+        goto done;
+    }
+
+    for (c = 0; c < count; c++) {
+        val = NULL;
+        if (reqs[c] == NULL) {
+            ret = LDAP_PROTOCOL_ERROR;
+        } else {
+            ret = check_request(reqs[c], EXTDOM_V2);
+        }
+        if (ret == LDAP_SUCCESS) {
+            ret = handle_request(ctx, reqs[c], &val);
+        }
+        if (ret != LDAP_SUCCESS) {
+            ber_bvfree(val);
+            val = NULL;
+        }
+
+        if (val != NULL) {
+            ret = ber_printf(ber, "{eO}", ret, val);
+        } else {
+            ret = ber_printf(ber, "{e}", ret);
+        }
+        ber_bvfree(val);
+        if (ret == -1) {
+            ret = LDAP_OPERATIONS_ERROR;
+            goto done;
+        }
+    }
+
+    ret = ber_printf(ber, "}");
+    if (ret == -1) {
+        ret = LDAP_OPERATIONS_ERROR;
+        goto done;
+    }
+
+    ret = ber_flatten(ber, berval);
+    if (ret == -1) {
+        ret = LDAP_OPERATIONS_ERROR;
+        goto done;
+    }
+
+    ret = LDAP_SUCCESS;
+
+done:
+    ber_free(ber, 1);
+    return ret;
+}
+
 int pack_response(struct extdom_res *res, struct berval **ret_val)
 {
     BerElement *ber = NULL;
@@ -50,6 +50,7 @@ Slapi_PluginDesc ipa_extdom_plugin_desc = {
 static char *ipa_extdom_oid_list[] = {
     EXOP_EXTDOM_OID,
     EXOP_EXTDOM_V1_OID,
+    EXOP_EXTDOM_V2_OID,
     NULL
 };
 
@@ -72,6 +73,8 @@ static int ipa_extdom_extop(Slapi_PBlock *pb)
     struct berval *req_val = NULL;
     struct berval *ret_val = NULL;
     struct extdom_req *req = NULL;
+    struct extdom_req **reqs = NULL;
+    size_t count = 0;
     struct ipa_extdom_ctx *ctx;
     enum extdom_version version;
 
@@ -87,6 +90,8 @@ static int ipa_extdom_extop(Slapi_PBlock *pb)
         version = EXTDOM_V0;
     } else if (strcasecmp(oid, EXOP_EXTDOM_V1_OID) == 0) {
         version = EXTDOM_V1;
+    } else if (strcasecmp(oid, EXOP_EXTDOM_V2_OID) == 0) {
+        version = EXTDOM_V2;
     } else {
         return SLAPI_PLUGIN_EXTENDED_NOT_HANDLED;
     }
@@ -105,25 +110,42 @@ static int ipa_extdom_extop(Slapi_PBlock *pb)
         goto done;
     }
 
-    ret = parse_request_data(req_val, &req);
-    if (ret != LDAP_SUCCESS) {
-        rc = LDAP_UNWILLING_TO_PERFORM;
-        err_msg = "Cannot parse request data.\n";
-        goto done;
-    }
+    if (version == EXTDOM_V2) {
+        ret = parse_bulk_request_data(req_val, &reqs, &count);
+        if (ret != LDAP_SUCCESS) {
+            rc = (ret == LDAP_ADMINLIMIT_EXCEEDED) ? ret
+                                                   : LDAP_UNWILLING_TO_PERFORM;
+            err_msg = "Cannot parse request data.\n";
+            goto done;
+        }
 
-    ret = check_request(req, version);
-    if (ret != LDAP_SUCCESS) {
-        rc = LDAP_UNWILLING_TO_PERFORM;
-        err_msg = "Error in request data.\n";
-        goto done;
-    }
+        ret = handle_bulk_request(ctx, reqs, count, &ret_val);
+        if (ret != LDAP_SUCCESS) {
+            rc = LDAP_OPERATIONS_ERROR;
+            err_msg = "Failed to handle the request.\n";
+            goto done;
+        }
+    } else {
+        ret = parse_request_data(req_val, &req);
+        if (ret != LDAP_SUCCESS) {
+            rc = LDAP_UNWILLING_TO_PERFORM;
+            err_msg = "Cannot parse request data.\n";
+            goto done;
+        }
 
-    ret = handle_request(ctx, req, &ret_val);
-    if (ret != LDAP_SUCCESS) {
-        rc = LDAP_OPERATIONS_ERROR;
-        err_msg = "Failed to handle the request.\n";
-        goto done;
+        ret = check_request(req, version);
+        if (ret != LDAP_SUCCESS) {
+            rc = LDAP_UNWILLING_TO_PERFORM;
+            err_msg = "Error in request data.\n";
+            goto done;
+        }
+
+        ret = handle_request(ctx, req, &ret_val);
+        if (ret != LDAP_SUCCESS) {
+            rc = LDAP_OPERATIONS_ERROR;
+            err_msg = "Failed to handle the request.\n";
+            goto done;
+        }
     }
 
     ret = slapi_pblock_set(pb, SLAPI_EXT_OP_RET_OID, oid);
@@ -144,6 +166,7 @@ static int ipa_extdom_extop(Slapi_PBlock *pb)
 
 done:
     free_req_data(req);
+    free_bulk_req_data(reqs, count);
     if (err_msg != NULL) {
         LOG("%s", err_msg);
     }
@@ -155,6 +178,9 @@ static int ipa_extdom_init_ctx(Slapi_PBlock *pb, struct ipa_extdom_ctx **_ctx)
 {
     struct ipa_extdom_ctx *ctx;
     Slapi_Entry *e;
+    unsigned int cache_size;
+    unsigned int cache_ttl;
+    unsigned int cache_neg_ttl;
     int ret;
 
     ctx = calloc(1, sizeof(struct ipa_extdom_ctx));
@@ -185,6 +211,27 @@ static int ipa_extdom_init_ctx(Slapi_PBlock *pb, struct ipa_extdom_ctx **_ctx)
         goto done;
     }
 
+    cache_size = IPA_EXTDOM_CACHE_SIZE;
+    cache_ttl = IPA_EXTDOM_CACHE_TTL;
+    cache_neg_ttl = IPA_EXTDOM_CACHE_NEG_TTL;
+    if (slapi_entry_attr_exists(e, "ipaExtdomCacheSize")) {
+        cache_size = slapi_entry_attr_get_uint(e, "ipaExtdomCacheSize");
+    }
+    if (slapi_entry_attr_exists(e, "ipaExtdomCacheTimeout")) {
+        cache_ttl = slapi_entry_attr_get_uint(e, "ipaExtdomCacheTimeout");
+    }
+    if (slapi_entry_attr_exists(e, "ipaExtdomNegativeCacheTimeout")) {
+        cache_neg_ttl = slapi_entry_attr_get_uint(e,
+                                            "ipaExtdomNegativeCacheTimeout");
+    }
+
+    ret = ipa_extdom_cache_init(cache_size, cache_ttl, cache_neg_ttl,
+                                &ctx->cache);
+    if (ret) {
+        LOG_FATAL("Failed to initialize the response cache.\n");
+        ret = -1;
+        goto done;
+    }
 
 done:
     if (ret) {
@@ -54,6 +54,21 @@ char req_gid[] = {0x30, 0x15, 0x0a, 0x01, 0x04, 0x0a, 0x01, 0x01, 0x30, 0x0d, \
                   0x04, 0x06, 0x44, 0x4f, 0x4d, 0x41, 0x49, 0x4e, 0x02, 0x03, \
                   0x00, 0xd4, 0x31};
 
+char req_bulk[] = {0x30, 0x2b, \
+                   0x30, 0x11, 0x0a, 0x01, 0x01, 0x0a, 0x01, 0x01, 0x04, 0x09, \
+                   0x53, 0x2d, 0x31, 0x2d, 0x32, 0x2d, 0x33, 0x2d, 0x34, \
+                   0x30, 0x16, 0x0a, 0x01, 0x02, 0x0a, 0x01, 0x01, 0x30, 0x0e, \
+                   0x04, 0x06, 0x44, 0x4f, 0x4d, 0x41, 0x49, 0x4e, 0x04, 0x04, \
+                   0x74, 0x65, 0x73, 0x74};
+/* same as req_bulk but the first request has an unknown input type */
+char req_bulk_bad[] = {0x30, 0x2b, \
+                       0x30, 0x11, 0x0a, 0x01, 0x09, 0x0a, 0x01, 0x01, 0x04, \
+                       0x09, 0x53, 0x2d, 0x31, 0x2d, 0x32, 0x2d, 0x33, 0x2d, \
+                       0x34, \
+                       0x30, 0x16, 0x0a, 0x01, 0x02, 0x0a, 0x01, 0x01, 0x30, \
+                       0x0e, 0x04, 0x06, 0x44, 0x4f, 0x4d, 0x41, 0x49, 0x4e, \
+                       0x04, 0x04, 0x74, 0x65, 0x73, 0x74};
+
 char res_sid[] = {0x30, 0x0e, 0x0a, 0x01, 0x01, 0x04, 0x09, 0x53, 0x2d, 0x31, \
                   0x2d, 0x32, 0x2d, 0x33, 0x2d, 0x34};
 char res_nam[] = {0x30, 0x13, 0x0a, 0x01, 0x02, 0x30, 0x0e, 0x04, 0x06, 0x44, \
@@ -176,13 +191,150 @@ START_TEST(test_decode)
 }
 END_TEST
 
+START_TEST(test_cache)
+{
+    struct ipa_extdom_cache *cache;
+    struct extdom_req req;
+    struct berval val;
+    struct berval *cached;
+    int ret;
+
+    ret = ipa_extdom_cache_init(1, 60, 0, &cache);
+    fail_unless(ret == LDAP_SUCCESS && cache != NULL,
+                "ipa_extdom_cache_init() failed.");
+
+    req.input_type = INP_SID;
+    req.request_type = REQ_SIMPLE;
+    req.data.sid = TEST_SID;
+
+    fail_unless(!ipa_extdom_cache_get(cache, &req, &ret, &cached),
+                "Unexpected cache hit.");
+
+    val.bv_val = res_nam;
+    val.bv_len = sizeof(res_nam);
+    ipa_extdom_cache_put(cache, &req, LDAP_SUCCESS, &val);
+
+    fail_unless(ipa_extdom_cache_get(cache, &req, &ret, &cached),
+                "Expected cache hit.");
+    fail_unless(ret == LDAP_SUCCESS && cached != NULL &&
+                cached->bv_len == sizeof(res_nam) &&
+                memcmp(cached->bv_val, res_nam, sizeof(res_nam)) == 0,
+                "Unexpected cached BER blob.");
+    ber_bvfree(cached);
+
+    /* a different request type is a different object */
+    req.request_type = REQ_FULL;
+    fail_unless(!ipa_extdom_cache_get(cache, &req, &ret, &cached),
+                "Unexpected cache hit for different request type.");
+
+    /* negative caching is disabled with a zero timeout */
+    ipa_extdom_cache_put(cache, &req, LDAP_NO_SUCH_OBJECT, NULL);
+    fail_unless(!ipa_extdom_cache_get(cache, &req, &ret, &cached),
+                "Unexpected negative cache hit.");
+
+    /* the cache holds a single entry, the next one evicts the first */
+    req.input_type = INP_NAME;
+    req.data.name.domain_name = TEST_DOMAIN_NAME;
+    req.data.name.object_name = "test";
+    ipa_extdom_cache_put(cache, &req, LDAP_SUCCESS, &val);
+    fail_unless(ipa_extdom_cache_get(cache, &req, &ret, &cached),
+                "Expected cache hit.");
+    ber_bvfree(cached);
+
+    req.input_type = INP_SID;
+    req.request_type = REQ_SIMPLE;
+    req.data.sid = TEST_SID;
+    fail_unless(!ipa_extdom_cache_get(cache, &req, &ret, &cached),
+                "Entry was not evicted.");
+
+    ipa_extdom_cache_free(cache);
+
+    ret = ipa_extdom_cache_init(16, 60, 60, &cache);
+    fail_unless(ret == LDAP_SUCCESS && cache != NULL,
+                "ipa_extdom_cache_init() failed.");
+
+    ipa_extdom_cache_put(cache, &req, LDAP_NO_SUCH_OBJECT, NULL);
+    fail_unless(ipa_extdom_cache_get(cache, &req, &ret, &cached),
+                "Expected negative cache hit.");
+    fail_unless(ret == LDAP_NO_SUCH_OBJECT && cached == NULL,
+                "Unexpected negative cache entry.");
+
+    fail_unless(!ipa_extdom_cache_get_group_name(cache, 54321, &cached),
+                "Unexpected group name cache hit.");
+    ipa_extdom_cache_put_group_name(cache, 54321, "test_group");
+    fail_unless(ipa_extdom_cache_get_group_name(cache, 54321, &cached),
+                "Expected group name cache hit.");
+    fail_unless(cached->bv_len == sizeof("test_group") - 1 &&
+                strcmp(cached->bv_val, "test_group") == 0,
+                "Unexpected cached group name.");
+    ber_bvfree(cached);
+
+    ipa_extdom_cache_free(cache);
+}
+END_TEST
+
+START_TEST(test_decode_bulk)
+{
+    struct berval req_val;
+    struct extdom_req **reqs;
+    size_t count;
+    int ret;
+
+    req_val.bv_val = req_bulk;
+    req_val.bv_len = sizeof(req_bulk);
+
+    ret = parse_bulk_request_data(&req_val, &reqs, &count);
+
+    fail_unless(ret == LDAP_SUCCESS, "parse_bulk_request_data() failed.");
+    fail_unless(count == 2,
+                "parse_bulk_request_data() returned unexpected count [%zu]",
+                count);
+    fail_unless(reqs[0]->input_type == INP_SID &&
+                strcmp(reqs[0]->data.sid, "S-1-2-3-4") == 0,
+                "parse_bulk_request_data() returned unexpected sid request");
+    fail_unless(reqs[1]->input_type == INP_NAME &&
+                strcmp(reqs[1]->data.name.domain_name, "DOMAIN") == 0 &&
+                strcmp(reqs[1]->data.name.object_name, "test") == 0,
+                "parse_bulk_request_data() returned unexpected name request");
+    free_bulk_req_data(reqs, count);
+
+    /* a single V1 request is not a valid V2 request */
+    req_val.bv_val = req_sid;
+    req_val.bv_len = sizeof(req_sid);
+
+    ret = parse_bulk_request_data(&req_val, &reqs, &count);
+    fail_unless(ret != LDAP_SUCCESS,
+                "parse_bulk_request_data() accepted a V1 request.");
+
+    /* an invalid request only fails its own entry */
+    req_val.bv_val = req_bulk_bad;
+    req_val.bv_len = sizeof(req_bulk_bad);
+
+    ret = parse_bulk_request_data(&req_val, &reqs, &count);
+
+    fail_unless(ret == LDAP_SUCCESS,
+                "parse_bulk_request_data() failed on a single bad request.");
+    fail_unless(count == 2,
+                "parse_bulk_request_data() returned unexpected count [%zu]",
+                count);
+    fail_unless(reqs[0] == NULL,
+                "parse_bulk_request_data() accepted an invalid request");
+    fail_unless(reqs[1] != NULL && reqs[1]->input_type == INP_NAME &&
+                strcmp(reqs[1]->data.name.object_name, "test") == 0,
+                "parse_bulk_request_data() returned unexpected name request");
+    free_bulk_req_data(reqs, count);
+}
+END_TEST
+
 Suite * ipa_extdom_suite(void)
 {
     Suite *s = suite_create("IPA extdom");
 
     TCase *tc_core = tcase_create("Core");
     tcase_add_test(tc_core, test_decode);
+    tcase_add_test(tc_core, test_decode_bulk);
     tcase_add_test(tc_core, test_encode);
+    tcase_add_test(tc_core, test_cache);
     /* TODO: add test for create_response() */
     suite_add_tcase(s, tc_core);
 
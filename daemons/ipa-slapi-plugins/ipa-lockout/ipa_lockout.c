@@ -47,11 +47,15 @@
 #include <string.h>
 #include <stdbool.h>
 #include <time.h>
+#include <errno.h>
+#include <pthread.h>
 #include "slapi-plugin.h"
 #include "nspr.h"
 #include <krb5.h>
 
 #include "util.h"
+#include "ipa_bind_cache.h"
+#include "ipa_lockout.h"
 
 #define IPALOCKOUT_PLUGIN_NAME "ipa-lockout-plugin"
 #define IPALOCKOUT_PLUGIN_VERSION 0x00010000
@@ -62,6 +66,7 @@
 #define IPALOCKOUT_PLUGIN_DESC       "IPA Lockout plugin"
 #define IPALOCKOUT_POSTOP_DESC       "IPA Lockout postop plugin"
 #define IPALOCKOUT_PREOP_DESC        "IPA Lockout preop plugin"
+#define IPALOCKOUT_INT_POSTOP_DESC   "IPA Lockout internal postop plugin"
 
 static Slapi_PluginDesc pdesc = {
     IPALOCKOUT_FEATURE_DESC,
@@ -84,6 +89,37 @@ static struct ipa_context *global_ipactx = NULL;
 
 static char *ipa_global_policy = NULL;
 
+/* BIND target cached on the operation, see ipa_bind_cache.h */
+struct ipalockout_op {
+    Slapi_DN *sdn;
+    Slapi_Entry *entry;
+};
+
+static struct {
+    int object_type;
+    int handle;
+} ipalockout_op_ext;
+
+static void *ipalockout_bind_cache_api[IPA_BIND_CACHE_API_SIZE];
+
+/* Lockout parameters of the password policies used so far, keyed on the
+ * normalized policy DN. A policy is dropped whenever its entry is written
+ * to; the generation counter keeps a lookup that raced with such a write
+ * from caching what it read. */
+struct ipalockout_policy {
+    struct ipalockout_policy *next;
+    char *ndn;
+    unsigned int max_fail;
+    unsigned int lockout_duration;
+    unsigned int failcnt_interval;
+};
+
+static struct {
+    pthread_rwlock_t lock;
+    struct ipalockout_policy *head;
+    unsigned int generation;
+} ipalockout_policies = { PTHREAD_RWLOCK_INITIALIZER, NULL, 0 };
+
 #define GENERALIZED_TIME_LENGTH 15
 
 /**
@@ -96,6 +132,7 @@ static int ipalockout_start(Slapi_PBlock * pb);
 static int ipalockout_close(Slapi_PBlock * pb);
 static int ipalockout_postop_init(Slapi_PBlock * pb);
 static int ipalockout_preop_init(Slapi_PBlock * pb);
+static int ipalockout_internal_postop_init(Slapi_PBlock * pb);
 
 /**
  *
@@ -104,6 +141,7 @@ static int ipalockout_preop_init(Slapi_PBlock * pb);
  */
 static int ipalockout_postop(Slapi_PBlock *pb);
 static int ipalockout_preop(Slapi_PBlock *pb);
+static int ipalockout_policy_postop(Slapi_PBlock *pb);
 
 /**
  *
@@ -256,48 +294,517 @@ done:
     return ret;
 }
 
-int ipalockout_getpolicy(Slapi_Entry *target_entry, Slapi_Entry **policy_entry,
-                         Slapi_ValueSet** values, char **actual_type_name,
-                         const char **policy_dn, int *attr_free_flags,
-                         char **errstr)
+static void *ipalockout_op_ext_constructor(void *object, void *parent)
+{
+    return slapi_ch_calloc(1, sizeof(struct ipalockout_op));
+}
+
+static void ipalockout_op_ext_destructor(void *ext, void *object,
+                                         void *parent)
+{
+    struct ipalockout_op *lop = (struct ipalockout_op *)ext;
+
+    if (!lop)
+        return;
+
+    slapi_entry_free(lop->entry);
+    slapi_sdn_free(&lop->sdn);
+    slapi_ch_free((void **)&lop);
+}
+
+static struct ipalockout_op *ipalockout_get_op(Slapi_PBlock *pb)
+{
+    Slapi_Operation *op = NULL;
+
+    slapi_pblock_get(pb, SLAPI_OPERATION, &op);
+    if (op == NULL) {
+        return NULL;
+    }
+
+    return slapi_get_object_extension(ipalockout_op_ext.object_type, op,
+                                      ipalockout_op_ext.handle);
+}
+
+/*
+ * Return the entry of dn, reading it only the first time it is asked for
+ * within the current operation. The entry is owned by the operation.
+ */
+static int ipalockout_get_bind_entry(Slapi_PBlock *pb, const char *dn,
+                                     Slapi_Entry **entry)
+{
+    struct ipalockout_op *lop;
+    Slapi_Entry *e = NULL;
+    Slapi_DN *sdn;
+    int ret;
+
+    *entry = NULL;
+
+    lop = ipalockout_get_op(pb);
+    if (lop == NULL) {
+        LOG_FATAL("Internal error, couldn't find operation extension\n");
+        return LDAP_OPERATIONS_ERROR;
+    }
+
+    sdn = slapi_sdn_new_dn_byval(dn);
+    if (sdn == NULL) {
+        LOG_OOM();
+        return LDAP_OPERATIONS_ERROR;
+    }
+
+    if (lop->entry != NULL && slapi_sdn_compare(lop->sdn, sdn) == 0) {
+        slapi_sdn_free(&sdn);
+        *entry = lop->entry;
+        return LDAP_SUCCESS;
+    }
+
+    ret = slapi_search_internal_get_entry(sdn, NULL, &e, getPluginID());
+    if (ret == LDAP_SUCCESS && e == NULL) {
+        ret = LDAP_NO_SUCH_OBJECT;
+    }
+    if (ret != LDAP_SUCCESS) {
+        slapi_sdn_free(&sdn);
+        return ret;
+    }
+
+    slapi_entry_free(lop->entry);
+    slapi_sdn_free(&lop->sdn);
+    lop->entry = e;
+    lop->sdn = sdn;
+
+    *entry = e;
+    return LDAP_SUCCESS;
+}
+
+static void ipalockout_policy_free(struct ipalockout_policy **policy)
+{
+    slapi_ch_free_string(&(*policy)->ndn);
+    slapi_ch_free((void **)policy);
+}
+
+static void ipalockout_policy_forget(const char *ndn)
+{
+    struct ipalockout_policy **p;
+    struct ipalockout_policy *victim;
+    bool found = false;
+
+    __sync_fetch_and_add(&ipalockout_policies.generation, 1);
+
+    /* Nearly all writes are to entries that are not policies. */
+    pthread_rwlock_rdlock(&ipalockout_policies.lock);
+    for (victim = ipalockout_policies.head; victim; victim = victim->next) {
+        if (strcmp(victim->ndn, ndn) == 0) {
+            found = true;
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&ipalockout_policies.lock);
+
+    if (!found) {
+        return;
+    }
+
+    pthread_rwlock_wrlock(&ipalockout_policies.lock);
+    for (p = &ipalockout_policies.head; *p; p = &(*p)->next) {
+        if (strcmp((*p)->ndn, ndn) == 0) {
+            victim = *p;
+            *p = victim->next;
+            ipalockout_policy_free(&victim);
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&ipalockout_policies.lock);
+}
+
+static void ipalockout_policy_clear(void)
+{
+    struct ipalockout_policy *policy;
+
+    pthread_rwlock_wrlock(&ipalockout_policies.lock);
+    while ((policy = ipalockout_policies.head) != NULL) {
+        ipalockout_policies.head = policy->next;
+        ipalockout_policy_free(&policy);
+    }
+    pthread_rwlock_unlock(&ipalockout_policies.lock);
+}
+
+/*
+ * Look up the lockout parameters of the password policy that applies to
+ * target_entry. *has_policy is set to false if there is none.
+ */
+static int ipalockout_getpolicy(Slapi_Entry *target_entry,
+                                struct ipalockout_policy *policy,
+                                bool *has_policy, char **errstr)
 {
     int ldrc = 0;
+    int ret = LDAP_SUCCESS;
     int type_name_disposition = 0;
+    char *actual_type_name = NULL;
+    int attr_free_flags = 0;
+    Slapi_ValueSet *values = NULL;
+    const char *policy_dn = NULL;
     Slapi_DN *pdn = NULL;
+    Slapi_Entry *policy_entry = NULL;
+    struct ipalockout_policy *p;
+    unsigned int generation;
+    const char *ndn;
+
+    *has_policy = false;
 
     /* Only continue if there is a password policy */
     ldrc = slapi_vattr_values_get(target_entry, "krbPwdPolicyReference",
-                                values,
-                                &type_name_disposition, actual_type_name,
+                                &values,
+                                &type_name_disposition, &actual_type_name,
                                 SLAPI_VIRTUALATTRS_REQUEST_POINTERS,
-                                attr_free_flags);
+                                &attr_free_flags);
     if (ldrc == 0) {
         Slapi_Value *sv = NULL;
 
         if (values != NULL) {
-            slapi_valueset_first_value(*values, &sv);
-            *policy_dn = slapi_value_get_string(sv);
+            slapi_valueset_first_value(values, &sv);
+            policy_dn = slapi_value_get_string(sv);
         }
     } else {
-        *policy_dn = ipa_global_policy;
+        policy_dn = ipa_global_policy;
     }
 
-    if (*policy_dn == NULL) {
+    if (policy_dn == NULL) {
         LOG_TRACE("No kerberos password policy\n");
-        return LDAP_SUCCESS;
-    } else {
-        pdn = slapi_sdn_new_dn_byref(*policy_dn);
-        ldrc = slapi_search_internal_get_entry(pdn, NULL, policy_entry,
+        goto done;
+    }
+
+    pdn = slapi_sdn_new_dn_byref(policy_dn);
+    ndn = slapi_sdn_get_ndn(pdn);
+
+    pthread_rwlock_rdlock(&ipalockout_policies.lock);
+    generation = __sync_fetch_and_add(&ipalockout_policies.generation, 0);
+    for (p = ipalockout_policies.head; p; p = p->next) {
+        if (strcmp(p->ndn, ndn) == 0) {
+            *policy = *p;
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&ipalockout_policies.lock);
+
+    if (p == NULL) {
+        ldrc = slapi_search_internal_get_entry(pdn, NULL, &policy_entry,
                 getPluginID());
-        slapi_sdn_free(&pdn);
-        if (ldrc != LDAP_SUCCESS) {
-            LOG_FATAL("Failed to retrieve entry \"%s\": %d\n", *policy_dn, ldrc);
+        if (ldrc != LDAP_SUCCESS || policy_entry == NULL) {
+            LOG_FATAL("Failed to retrieve entry \"%s\": %d\n", policy_dn, ldrc);
             *errstr = "Failed to retrieve account policy.";
-            return LDAP_OPERATIONS_ERROR;
+            ret = LDAP_OPERATIONS_ERROR;
+            goto done;
+        }
+
+        p = (struct ipalockout_policy *)slapi_ch_calloc(1, sizeof(*p));
+        p->ndn = slapi_ch_strdup(ndn);
+        p->max_fail = slapi_entry_attr_get_uint(policy_entry,
+                                                "krbPwdMaxFailure");
+        p->lockout_duration = slapi_entry_attr_get_uint(policy_entry,
+                                                "krbPwdLockoutDuration");
+        p->failcnt_interval = slapi_entry_attr_get_uint(policy_entry,
+                                                "krbPwdFailureCountInterval");
+        *policy = *p;
+
+        pthread_rwlock_wrlock(&ipalockout_policies.lock);
+        if (generation ==
+            __sync_fetch_and_add(&ipalockout_policies.generation, 0)) {
+            p->next = ipalockout_policies.head;
+            ipalockout_policies.head = p;
+            p = NULL;
+        }
+        pthread_rwlock_unlock(&ipalockout_policies.lock);
+
+        if (p != NULL) {
+            ipalockout_policy_free(&p);
         }
     }
 
-    return LDAP_SUCCESS;
+    policy->next = NULL;
+    policy->ndn = NULL;
+    *has_policy = true;
+
+done:
+    slapi_entry_free(policy_entry);
+    slapi_sdn_free(&pdn);
+    if (values != NULL) {
+        slapi_vattr_values_free(&values, &actual_type_name, attr_free_flags);
+    }
+    return ret;
+}
+
+static int ipalockout_parse_time(const char *str, time_t *t)
+{
+    struct tm tm;
+    int res;
+
+    memset(&tm, 0, sizeof(struct tm));
+    res = sscanf(str,
+                 "%04u%02u%02u%02u%02u%02u",
+                 &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                 &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+    if (res != 6) {
+        return EINVAL;
+    }
+
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    *t = timegm(&tm);
+
+    return 0;
+}
+
+static time_t ipalockout_entry_time(Slapi_Entry *e, const char *attr)
+{
+    char *str;
+    time_t t = 0;
+
+    str = slapi_entry_attr_get_charptr(e, attr);
+    if (str != NULL) {
+        if (ipalockout_parse_time(str, &t) != 0) {
+            t = 0;
+        }
+        slapi_ch_free_string(&str);
+    }
+
+    return t;
+}
+
+static int ipalockout_format_time(time_t t, char *timestr)
+{
+    struct tm utctime;
+
+    if (!gmtime_r(&t, &utctime)) {
+        LOG_FATAL("failed to parse current date (buggy gmtime_r ?)\n");
+        return EINVAL;
+    }
+    strftime(timestr, GENERALIZED_TIME_LENGTH+1,
+             "%Y%m%d%H%M%SZ", &utctime);
+
+    return 0;
+}
+
+/*
+ * Current failure counter and time of the last failure of the principal
+ * in e, including the failures that have not been written out yet.
+ */
+static void ipalockout_counters(Slapi_Entry *e, unsigned long *failedcount,
+                                time_t *last_failed)
+{
+    ipalockout_state_counters(slapi_entry_get_ndn(e),
+                              slapi_entry_attr_get_ulong(e, "krbLoginFailedCount"),
+                              ipalockout_entry_time(e, "krbLastFailedAuth"),
+                              ipalockout_entry_time(e, "krbLastAdminUnlock"),
+                              failedcount, last_failed);
+}
+
+static void ipalockout_record_failure(Slapi_Entry *e,
+                                      struct ipalockout_policy *policy,
+                                      bool restart, time_t now)
+{
+    ipalockout_state_failure(slapi_entry_get_ndn(e),
+                             slapi_entry_get_dn_const(e), policy->max_fail,
+                             ipalockout_entry_time(e, "krbLastAdminUnlock"),
+                             restart, now);
+}
+
+static void ipalockout_record_success(Slapi_Entry *e, bool reset,
+                                      bool track_success, time_t now)
+{
+    bool stamp = false;
+
+    /* Coalesce: one krbLastSuccessfulAuth write per interval. */
+    if (track_success) {
+        stamp = now - ipalockout_entry_time(e, "krbLastSuccessfulAuth") >=
+                IPALOCKOUT_LAST_SUCCESS_INTERVAL;
+    }
+
+    ipalockout_state_success(slapi_entry_get_ndn(e),
+                             slapi_entry_get_dn_const(e), reset, stamp,
+                             track_success, now);
+}
+
+/*
+ * Write the pending changes of one DN. Called from the flush thread (or
+ * at shutdown) with ipalockout_wb.lock held, the lock is dropped around
+ * the internal operations.
+ */
+static void ipalockout_state_flush(struct ipalockout_state *st)
+{
+    struct ipalockout_state snap;
+    Slapi_Entry *target_entry = NULL;
+    Slapi_PBlock *pbtm = NULL;
+    Slapi_Mods *smods = NULL;
+    Slapi_DN *sdn = NULL;
+    char failedcountstr[32];
+    char timestr[GENERALIZED_TIME_LENGTH+1];
+    char *failedstr = NULL;
+    unsigned long failedcount;
+    unsigned long written = 0;
+    time_t unlock;
+    int tries = 0;
+    int rc = LDAP_SUCCESS;
+
+    ipalockout_state_write_begin(st, &snap);
+    pthread_mutex_unlock(&ipalockout_wb.lock);
+
+    sdn = slapi_sdn_new_dn_byval(snap.dn);
+
+    while (tries < 5) {
+        smods = slapi_mods_new();
+
+        if (snap.failures != 0) {
+            rc = slapi_search_internal_get_entry(sdn, NULL, &target_entry,
+                                                 getPluginID());
+            if (rc == LDAP_SUCCESS && target_entry == NULL) {
+                rc = LDAP_NO_SUCH_OBJECT;
+            }
+            if (rc != LDAP_SUCCESS) {
+                LOG_FATAL("Failed to retrieve entry \"%s\": %d\n", snap.dn, rc);
+                break;
+            }
+
+            /* Failures counted before an administrative unlock must not
+             * be written back to the cleared counter. */
+            unlock = ipalockout_entry_time(target_entry, "krbLastAdminUnlock");
+            if (unlock > snap.unlock) {
+                pthread_mutex_lock(&ipalockout_wb.lock);
+                ipalockout_state_unlock(st, unlock);
+                pthread_mutex_unlock(&ipalockout_wb.lock);
+                snap.failures = 0;
+            }
+        }
+
+        /* After a reset the counter is known, so a plain replace
+         * will do. Otherwise the failures are added to the stored value
+         * doing a DELETE of the value we expect and an ADD of the new
+         * one in the same update. If the record has changed in the
+         * meantime (e.g. the KDC counted a failure as well) our update
+         * fails and we try again. */
+        if (snap.reset) {
+            written = snap.failures;
+            PR_snprintf(failedcountstr, sizeof(failedcountstr), "%lu", written);
+            slapi_mods_add_string(smods, LDAP_MOD_REPLACE, "krbLoginFailedCount", failedcountstr);
+        } else if (snap.failures != 0) {
+            failedcount = slapi_entry_attr_get_ulong(target_entry, "krbLoginFailedCount");
+            failedstr = slapi_entry_attr_get_charptr(target_entry, "krbLoginFailedCount");
+            if (failedstr != NULL) {
+                PR_snprintf(failedcountstr, sizeof(failedcountstr), "%lu", failedcount);
+                slapi_mods_add_string(smods, LDAP_MOD_DELETE, "krbLoginFailedCount", failedcountstr);
+            }
+            written = ipalockout_state_new_count(failedcount, snap.failures,
+                                                 snap.max_fail);
+            PR_snprintf(failedcountstr, sizeof(failedcountstr), "%lu", written);
+            slapi_mods_add_string(smods, LDAP_MOD_ADD, "krbLoginFailedCount", failedcountstr);
+        }
+        if (snap.failures != 0 &&
+            ipalockout_format_time(snap.last_failed, timestr) == 0) {
+            slapi_mods_add_string(smods, LDAP_MOD_REPLACE, "krbLastFailedAuth", timestr);
+        }
+        if (snap.last_success != 0 &&
+            ipalockout_format_time(snap.last_success, timestr) == 0) {
+            slapi_mods_add_string(smods, LDAP_MOD_REPLACE, "krbLastSuccessfulAuth", timestr);
+        }
+
+        if (slapi_mods_get_num_mods(smods) == 0) {
+            LOG_TRACE("No account modification required\n");
+            break;
+        }
+
+        pbtm = slapi_pblock_new();
+        slapi_modify_internal_set_pb (pbtm, snap.dn,
+        slapi_mods_get_ldapmods_byref(smods),
+        NULL, /* Controls */
+        NULL, /* UniqueID */
+        getPluginID(), /* PluginID */
+        0); /* Flags */
+
+        slapi_modify_internal_pb (pbtm);
+        slapi_pblock_get(pbtm, SLAPI_PLUGIN_INTOP_RESULT, &rc);
+
+        slapi_pblock_destroy(pbtm);
+        slapi_mods_free(&smods);
+        slapi_entry_free(target_entry);
+        slapi_ch_free_string(&failedstr);
+        pbtm = NULL;
+        target_entry = NULL;
+
+        /* Only a concurrent change of the counter (our DELETE of the
+         * stored value failed) is worth retrying right away, anything
+         * else is retried on a later flush. */
+        if (rc != LDAP_NO_SUCH_ATTRIBUTE) {
+            break;
+        }
+
+        LOG_TRACE("WARNING: modify error %d on entry '%s'\n", rc, snap.dn);
+        tries += 1;
+    }
+
+    if (rc != LDAP_SUCCESS && rc != LDAP_NO_SUCH_OBJECT) {
+        LOG("Unable to change lockout attributes of \"%s\" (%d), "
+            "will retry\n", snap.dn, rc);
+    }
+
+    slapi_mods_free(&smods);
+    slapi_entry_free(target_entry);
+    slapi_ch_free_string(&failedstr);
+
+    pthread_mutex_lock(&ipalockout_wb.lock);
+    if (!ipalockout_state_write_end(st, &snap,
+                                    rc == LDAP_SUCCESS ||
+                                    rc == LDAP_NO_SUCH_OBJECT,
+                                    time(NULL))) {
+        LOG_FATAL("Giving up on the lockout attributes of \"%s\" after %d "
+                  "failed writes, the last one failed with %d\n",
+                  slapi_sdn_get_dn(sdn), IPALOCKOUT_WRITE_RETRIES, rc);
+    }
+    slapi_sdn_free(&sdn);
+}
+
+/*
+ * Write out the entries that are due, or all of them. Every entry is
+ * written at most once per call. Call with ipalockout_wb.lock held.
+ */
+static void ipalockout_flush(bool all)
+{
+    struct ipalockout_state *st;
+    time_t now = time(NULL);
+    unsigned int pass;
+    bool batch;
+    int i;
+
+    batch = ipalockout_wb.pending >= IPALOCKOUT_FLUSH_BATCH;
+    pass = ++ipalockout_wb.pass;
+
+    for (i = 0; i < IPALOCKOUT_STATE_BUCKETS; i++) {
+restart:
+        for (st = ipalockout_wb.table[i]; st; st = st->next) {
+            if (st->due != 0 && !st->busy && st->pass != pass &&
+                (all || batch || st->due <= now)) {
+                st->pass = pass;
+                /* drops the lock, the chain may change */
+                ipalockout_state_flush(st);
+                goto restart;
+            }
+        }
+    }
+}
+
+static void *ipalockout_flush_thread(void *arg)
+{
+    struct timespec ts;
+
+    pthread_mutex_lock(&ipalockout_wb.lock);
+    while (!ipalockout_wb.stop) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += 1;
+        pthread_cond_timedwait(&ipalockout_wb.cond, &ipalockout_wb.lock, &ts);
+        if (!ipalockout_wb.stop) {
+            ipalockout_flush(false);
+        }
+    }
+    pthread_mutex_unlock(&ipalockout_wb.lock);
+
+    return NULL;
 }
 
 int
@@ -312,6 +819,16 @@ ipalockout_init(Slapi_PBlock *pb)
     PR_ASSERT(plugin_identity);
     setPluginID(plugin_identity);
 
+    if (slapi_register_object_extension(IPALOCKOUT_PLUGIN_NAME,
+                                        SLAPI_EXT_OPERATION,
+                                        ipalockout_op_ext_constructor,
+                                        ipalockout_op_ext_destructor,
+                                        &ipalockout_op_ext.object_type,
+                                        &ipalockout_op_ext.handle) != 0) {
+        LOG_FATAL("failed to register operation extension\n");
+        return EFAIL;
+    }
+
     if (slapi_pblock_set(pb, SLAPI_PLUGIN_VERSION,
                          SLAPI_PLUGIN_VERSION_01) != 0 ||
         slapi_pblock_set(pb, SLAPI_PLUGIN_START_FN,
@@ -335,6 +852,14 @@ ipalockout_init(Slapi_PBlock *pb)
                               IPALOCKOUT_PREOP_DESC,
                               NULL,
                               plugin_identity
+        ) ||
+        slapi_register_plugin("internalpostoperation",
+                              1,
+                              "ipalockout_init",
+                              ipalockout_internal_postop_init,
+                              IPALOCKOUT_INT_POSTOP_DESC,
+                              NULL,
+                              plugin_identity
         )
         ) {
         LOG_FATAL("failed to register plugin\n");
@@ -355,7 +880,34 @@ ipalockout_postop_init(Slapi_PBlock *pb)
         slapi_pblock_set(pb, SLAPI_PLUGIN_DESCRIPTION,
                          (void *) &pdesc) != 0 ||
         slapi_pblock_set(pb, SLAPI_PLUGIN_POST_BIND_FN,
-                         (void *) ipalockout_postop) != 0) {
+                         (void *) ipalockout_postop) != 0 ||
+        slapi_pblock_set(pb, SLAPI_PLUGIN_POST_MODIFY_FN,
+                         (void *) ipalockout_policy_postop) != 0 ||
+        slapi_pblock_set(pb, SLAPI_PLUGIN_POST_MODRDN_FN,
+                         (void *) ipalockout_policy_postop) != 0 ||
+        slapi_pblock_set(pb, SLAPI_PLUGIN_POST_DELETE_FN,
+                         (void *) ipalockout_policy_postop) != 0) {
+        status = EFAIL;
+    }
+
+    return status;
+}
+
+static int
+ipalockout_internal_postop_init(Slapi_PBlock *pb)
+{
+    int status = EOK;
+
+    if (slapi_pblock_set(pb, SLAPI_PLUGIN_VERSION,
+                         SLAPI_PLUGIN_VERSION_01) != 0 ||
+        slapi_pblock_set(pb, SLAPI_PLUGIN_DESCRIPTION,
+                         (void *) &pdesc) != 0 ||
+        slapi_pblock_set(pb, SLAPI_PLUGIN_INTERNAL_POST_MODIFY_FN,
+                         (void *) ipalockout_policy_postop) != 0 ||
+        slapi_pblock_set(pb, SLAPI_PLUGIN_INTERNAL_POST_MODRDN_FN,
+                         (void *) ipalockout_policy_postop) != 0 ||
+        slapi_pblock_set(pb, SLAPI_PLUGIN_INTERNAL_POST_DELETE_FN,
+                         (void *) ipalockout_policy_postop) != 0) {
         status = EFAIL;
     }
 
@@ -396,6 +948,22 @@ ipalockout_start(Slapi_PBlock * pb)
     global_ipactx->disable_lockout = false;
     ipalockout_get_global_config(global_ipactx);
 
+    ipalockout_bind_cache_api[IPA_BIND_CACHE_API_GET_ENTRY] =
+        (void *) ipalockout_get_bind_entry;
+    if (slapi_apib_register(IPA_BIND_CACHE_API_GUID,
+                            ipalockout_bind_cache_api) != 0) {
+        LOG_FATAL("failed to register the bind cache API\n");
+    }
+
+    ipalockout_wb.stop = false;
+    if (pthread_create(&ipalockout_wb.tid, NULL,
+                       ipalockout_flush_thread, NULL) != 0) {
+        LOG_FATAL("failed to start the flush thread, "
+                  "lockout attributes will be written synchronously\n");
+    } else {
+        ipalockout_wb.running = true;
+    }
+
     LOG("ready for service\n");
     LOG_TRACE("<--out--\n");
 
@@ -408,6 +976,22 @@ ipalockout_close(Slapi_PBlock * pb)
 {
     LOG_TRACE( "--in-->\n");
 
+    if (ipalockout_wb.running) {
+        pthread_mutex_lock(&ipalockout_wb.lock);
+        ipalockout_wb.stop = true;
+        pthread_cond_signal(&ipalockout_wb.cond);
+        pthread_mutex_unlock(&ipalockout_wb.lock);
+        pthread_join(ipalockout_wb.tid, NULL);
+        ipalockout_wb.running = false;
+    }
+
+    /* write out whatever is still pending */
+    pthread_mutex_lock(&ipalockout_wb.lock);
+    ipalockout_flush(true);
+    pthread_mutex_unlock(&ipalockout_wb.lock);
+
+    slapi_apib_unregister(IPA_BIND_CACHE_API_GUID);
+    ipalockout_policy_clear();
     slapi_ch_free_string(&ipa_global_policy);
 
     LOG_TRACE("<--out--\n");
@@ -415,40 +999,50 @@ ipalockout_close(Slapi_PBlock * pb)
     return EOK;
 }
 
+/*
+ * Writes to a password policy entry invalidate its cached parameters.
+ */
+static int ipalockout_policy_postop(Slapi_PBlock *pb)
+{
+    Slapi_DN *sdn = NULL;
+
+    if (!g_plugin_started) {
+        return EOK;
+    }
+
+    slapi_pblock_get(pb, SLAPI_TARGET_SDN, &sdn);
+    if (sdn != NULL) {
+        ipalockout_policy_forget(slapi_sdn_get_ndn(sdn));
+    }
+
+    return EOK;
+}
+
 /*
  * In the post-operation we know whether the bind was successful or not
  * so here we handle updating the Kerberos lockout policy attributes.
+ * The changes take effect immediately but are written to the entry by
+ * the flush thread.
  */
 static int ipalockout_postop(Slapi_PBlock *pb)
 {
     char *dn = NULL;
-    const char *policy_dn = NULL;
+    struct ipalockout_policy policy;
+    bool has_policy = false;
     Slapi_Entry *target_entry = NULL;
-    Slapi_Entry *policy_entry = NULL;
-    Slapi_DN *sdn = NULL;
-    Slapi_PBlock *pbtm = NULL;
-    Slapi_Mods *smods = NULL;
     Slapi_Value *objectclass = NULL;
     char *errstr = NULL;
     int ldrc, rc = 0;
     int ret = LDAP_SUCCESS;
     unsigned long failedcount = 0;
-    long old_failedcount;
-    char failedcountstr[32];
-    char *failedstr = NULL;
+    unsigned long old_failedcount;
     int failed_bind = 0;
     unsigned int lockout_duration = 0;
     unsigned int max_fail = 0;
-    struct tm utctime;
     time_t time_now;
-    char timestr[GENERALIZED_TIME_LENGTH+1];
+    time_t lastfail;
     unsigned int failcnt_interval = 0;
-    char *lastfail = NULL;
-    int tries = 0;
-    int failure = 1;
-    char *actual_type_name = NULL;
-    int attr_free_flags = 0;
-    Slapi_ValueSet *values = NULL;
+    bool restart = false;
 
     LOG_TRACE("--in-->\n");
 
@@ -487,18 +1081,8 @@ static int ipalockout_postop(Slapi_PBlock *pb)
         goto done;
     }
 
-    /* Get the entry */
-    sdn = slapi_sdn_new_dn_byref(dn);
-    if (sdn == NULL) {
-        LOG_OOM();
-        errstr = "Out of memory.\n";
-        ret = LDAP_OPERATIONS_ERROR;
-        goto done;
-    }
-
-    ldrc = slapi_search_internal_get_entry(sdn, NULL, &target_entry,
-            getPluginID());
-
+    /* Get the entry, usually already read by the pre-operation */
+    ldrc = ipalockout_get_bind_entry(pb, dn, &target_entry);
     if (ldrc != LDAP_SUCCESS) {
             LOG_FATAL("Failed to retrieve entry \"%s\": %d\n", dn, ldrc);
             goto done;
@@ -513,165 +1097,52 @@ static int ipalockout_postop(Slapi_PBlock *pb)
     }
     slapi_value_free(&objectclass);
 
-    ldrc = ipalockout_getpolicy(target_entry, &policy_entry,
-                                &values, &actual_type_name,
-                                &policy_dn, &attr_free_flags,
-                                &errstr);
-    if (ldrc != LDAP_SUCCESS || policy_dn == NULL) {
+    ldrc = ipalockout_getpolicy(target_entry, &policy, &has_policy, &errstr);
+    if (ldrc != LDAP_SUCCESS || !has_policy) {
         goto done;
     }
 
-    max_fail = slapi_entry_attr_get_uint(policy_entry, "krbPwdMaxFailure");
-    lockout_duration = slapi_entry_attr_get_uint(policy_entry, "krbPwdLockoutDuration");
-    failedcount = slapi_entry_attr_get_ulong(target_entry, "krbLoginFailedCount");
+    max_fail = policy.max_fail;
+    lockout_duration = policy.lockout_duration;
+    failcnt_interval = policy.failcnt_interval;
+    ipalockout_counters(target_entry, &failedcount, &lastfail);
     old_failedcount = failedcount;
 
-    /* Fetch the string value for krbLoginFailedCount to see if the attribute
-     * exists in LDAP at all. We get a 0 if it doesn't exist as a long so we
-     * don't know whether to try delete the existing value later
-     */
-    failedstr = slapi_entry_attr_get_charptr(target_entry, "krbLoginFailedCount");
-    failcnt_interval = slapi_entry_attr_get_uint(policy_entry, "krbPwdFailureCountInterval");
-    lastfail = slapi_entry_attr_get_charptr(target_entry, "krbLastFailedAuth");
     time_now = time(NULL);
-    if (lastfail != NULL) {
-        struct tm tm;
-        int res = 0;
-
-        memset(&tm, 0, sizeof(struct tm));
-        res = sscanf(lastfail,
-                     "%04u%02u%02u%02u%02u%02u",
-                     &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
-                     &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
-
-        if (res == 6) {
-            tm.tm_year -= 1900;
-            tm.tm_mon -= 1;
-
-            if (failedcount >= max_fail) {
-                if ((lockout_duration == 0) ||
-                    (time_now < timegm(&tm) + lockout_duration)) {
-                    /* Within lockout duration */
-                    goto done;
-                }
-            }
-            if (time_now > timegm(&tm) + failcnt_interval) {
-                /* Not within lockout duration, outside of fail interval */
-                failedcount = 0;
-            }
-        }
-    }
-
-    while (tries < 5) {
-        smods = slapi_mods_new();
-
-        /* On failures try very hard to update the entry so that failures
-         * are counted properly. This involves doing a DELETE of the value
-         * we expect and an ADD of the new one in the same update. If the
-         * record has changed while we were handling the request our
-         * update will fail and we will try again.
-         *
-         * On a successful bind just do a replace and set failurecount to 0.
-         */
-        if (failed_bind) {
-            if (failedcount < max_fail) {
-                PR_snprintf(failedcountstr, sizeof(failedcountstr), "%lu", old_failedcount);
-                if (failedstr != NULL) {
-                    slapi_mods_add_string(smods, LDAP_MOD_DELETE, "krbLoginFailedCount", failedcountstr);
-                }
-                failedcount += 1;
-                PR_snprintf(failedcountstr, sizeof(failedcountstr), "%lu", failedcount);
-                slapi_mods_add_string(smods, LDAP_MOD_ADD, "krbLoginFailedCount", failedcountstr);
-                if (lastfail) {
-                    slapi_mods_add_string(smods, LDAP_MOD_DELETE, "krbLastFailedAuth", lastfail);
-                }
-                if (!gmtime_r(&(time_now), &utctime)) {
-                    errstr = "failed to parse current date (buggy gmtime_r ?)\n";
-                    LOG_FATAL("%s", errstr);
-                    ret = LDAP_OPERATIONS_ERROR;
-                    goto done;
-                }
-                strftime(timestr, GENERALIZED_TIME_LENGTH+1,
-                     "%Y%m%d%H%M%SZ", &utctime);
-                slapi_mods_add_string(smods, LDAP_MOD_ADD, "krbLastFailedAuth", timestr);
-            }
-        } else {
-            if (old_failedcount != 0) {
-                PR_snprintf(failedcountstr, sizeof(failedcountstr), "%lu", 0L);
-                slapi_mods_add_string(smods, LDAP_MOD_REPLACE, "krbLoginFailedCount", failedcountstr);
-            }
-            if (!global_ipactx->disable_last_success) {
-                time_now = time(NULL);
-                if (!gmtime_r(&(time_now), &utctime)) {
-                    errstr = "failed to parse current date (buggy gmtime_r ?)\n";
-                    LOG_FATAL("%s", errstr);
-                    ret = LDAP_OPERATIONS_ERROR;
-                    goto done;
-                }
-                strftime(timestr, GENERALIZED_TIME_LENGTH+1,
-                     "%Y%m%d%H%M%SZ", &utctime);
-                slapi_mods_add_string(smods, LDAP_MOD_REPLACE, "krbLastSuccessfulAuth", timestr);
+    if (lastfail != 0) {
+        if (failedcount >= max_fail) {
+            if ((lockout_duration == 0) ||
+                (time_now < lastfail + lockout_duration)) {
+                /* Within lockout duration */
+                goto done;
             }
         }
-
-        if (slapi_mods_get_num_mods(smods) == 0) {
-            LOG_TRACE("No account modification required\n");
-            goto done;
+        if (time_now > lastfail + failcnt_interval) {
+            /* Not within lockout duration, outside of fail interval */
+            failedcount = 0;
+            restart = true;
         }
+    }
 
-        pbtm = slapi_pblock_new();
-        slapi_modify_internal_set_pb (pbtm, slapi_entry_get_dn_const(target_entry),
-        slapi_mods_get_ldapmods_byref(smods),
-        NULL, /* Controls */
-        NULL, /* UniqueID */
-        getPluginID(), /* PluginID */
-        0); /* Flags */
-
-        slapi_modify_internal_pb (pbtm);
-        slapi_pblock_get(pb, SLAPI_PLUGIN_INTOP_RESULT, &rc);
-
-        if (rc != LDAP_SUCCESS) {
-            LOG_TRACE("WARNING: modify error %d on entry '%s'\n",
-                      rc, slapi_entry_get_dn_const(target_entry));
-
-            ldrc = slapi_search_internal_get_entry(sdn, NULL, &target_entry,
-                    getPluginID());
-
-            if (ldrc != LDAP_SUCCESS) {
-                LOG_FATAL("Failed to retrieve entry \"%s\": %d\n", dn, ldrc);
-                goto done;
-            }
-            slapi_mods_free(&smods);
-            slapi_pblock_destroy(pbtm);
-            if (lastfail) slapi_ch_free_string(&lastfail);
-            smods = NULL;
-            pbtm = NULL;
-            lastfail = NULL;
-            tries += 1;
-        } else {
-            LOG_TRACE("<= apply mods: Successful\n");
-            failure = 0;
-            break;
+    if (failed_bind) {
+        if (failedcount < max_fail) {
+            ipalockout_record_failure(target_entry, &policy, restart,
+                                      time_now);
         }
-    } /* while */
+    } else {
+        ipalockout_record_success(target_entry, old_failedcount != 0,
+                                  !global_ipactx->disable_last_success,
+                                  time_now);
+    }
 
-    if (failure) {
-        LOG_FATAL("Unable to change lockout attributes\n");
-        ret = LDAP_OPERATIONS_ERROR;
+    if (!ipalockout_wb.running) {
+        pthread_mutex_lock(&ipalockout_wb.lock);
+        ipalockout_flush(true);
+        pthread_mutex_unlock(&ipalockout_wb.lock);
     }
 
 done:
     if (!failed_bind && dn != NULL) slapi_ch_free_string(&dn);
-    slapi_entry_free(target_entry);
-    slapi_entry_free(policy_entry);
-    if (values != NULL) {
-        slapi_vattr_values_free(&values, &actual_type_name, attr_free_flags);
-    }
-    if (sdn) slapi_sdn_free(&sdn);
-    if (lastfail) slapi_ch_free_string(&lastfail);
-    if (pbtm) slapi_pblock_destroy(pbtm);
-    if (smods) slapi_mods_free(&smods);
-    if (failedstr) slapi_ch_free_string(&failedstr);
 
     LOG("postop returning %d: %s\n", ret, errstr ? errstr : "success\n");
 
@@ -691,10 +1162,9 @@ done:
 static int ipalockout_preop(Slapi_PBlock *pb)
 {
     char *dn = NULL;
-    const char *policy_dn = NULL;
+    struct ipalockout_policy policy;
+    bool has_policy = false;
     Slapi_Entry *target_entry = NULL;
-    Slapi_Entry *policy_entry = NULL;
-    Slapi_DN *sdn = NULL;
     Slapi_Value *objectclass = NULL;
     char *errstr = NULL;
     int ldrc = 0;
@@ -704,11 +1174,7 @@ static int ipalockout_preop(Slapi_PBlock *pb)
     unsigned int max_fail = 0;
     unsigned int lockout_duration = 0;
     time_t last_failed = 0;
-    char *lastfail = NULL;
-    char *unlock_time = NULL;
-    char *actual_type_name = NULL;
-    int attr_free_flags = 0;
-    Slapi_ValueSet *values = NULL;
+    time_t unlock;
 
     LOG_TRACE("--in-->\n");
 
@@ -733,18 +1199,8 @@ static int ipalockout_preop(Slapi_PBlock *pb)
         goto done;
     }
 
-    /* Get the entry */
-    sdn = slapi_sdn_new_dn_byref(dn);
-    if (sdn == NULL) {
-        LOG_OOM();
-        errstr = "Out of memory.\n";
-        ret = LDAP_OPERATIONS_ERROR;
-        goto done;
-    }
-
-    ldrc = slapi_search_internal_get_entry(sdn, NULL, &target_entry,
-            getPluginID());
-
+    /* Get the entry, it is kept on the operation for the later plugins */
+    ldrc = ipalockout_get_bind_entry(pb, dn, &target_entry);
     if (ldrc != LDAP_SUCCESS) {
         LOG_FATAL("Failed to retrieve entry \"%s\": %d\n", dn, ldrc);
         goto done;
@@ -759,63 +1215,24 @@ static int ipalockout_preop(Slapi_PBlock *pb)
     }
     slapi_value_free(&objectclass);
 
-    ldrc = ipalockout_getpolicy(target_entry, &policy_entry,
-                                &values, &actual_type_name,
-                                &policy_dn, &attr_free_flags,
-                                &errstr);
-    if (ldrc != LDAP_SUCCESS || policy_dn == NULL) {
+    ldrc = ipalockout_getpolicy(target_entry, &policy, &has_policy, &errstr);
+    if (ldrc != LDAP_SUCCESS || !has_policy) {
         goto done;
     }
 
-    failedcount = slapi_entry_attr_get_ulong(target_entry, "krbLoginFailedCount");
+    ipalockout_counters(target_entry, &failedcount, &last_failed);
     time_now = time(NULL);
-    lockout_duration = slapi_entry_attr_get_uint(policy_entry, "krbPwdLockoutDuration");
-
-    lastfail = slapi_entry_attr_get_charptr(target_entry, "krbLastFailedAuth");
-    unlock_time = slapi_entry_attr_get_charptr(target_entry, "krbLastAdminUnlock");
-    if (lastfail != NULL) {
-        struct tm tm;
-        int res = 0;
-
-        memset(&tm, 0, sizeof(struct tm));
-        res = sscanf(lastfail,
-                     "%04u%02u%02u%02u%02u%02u",
-                     &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
-                     &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
-
-        if (res == 6) {
-            tm.tm_year -= 1900;
-            tm.tm_mon -= 1;
-
-            last_failed = timegm(&tm);
-        }
-    }
-
-    if (lastfail != NULL && unlock_time != NULL) {
-        time_t unlock;
-        struct tm tm;
-        int res = 0;
-
-        memset(&tm, 0, sizeof(struct tm));
-        res = sscanf(unlock_time,
-                     "%04u%02u%02u%02u%02u%02u",
-                     &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
-                     &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+    lockout_duration = policy.lockout_duration;
 
-        if (res == 6) {
-            tm.tm_year -= 1900;
-            tm.tm_mon -= 1;
-
-            unlock = timegm(&tm);
-            if (last_failed <= unlock) {
-                /* Administratively unlocked */
-                goto done;
-            }
+    if (last_failed != 0) {
+        unlock = ipalockout_entry_time(target_entry, "krbLastAdminUnlock");
+        if (unlock != 0 && last_failed <= unlock) {
+            /* Administratively unlocked */
+            goto done;
         }
-        slapi_ch_free_string(&unlock_time);
     }
 
-    max_fail = slapi_entry_attr_get_uint(policy_entry, "krbPwdMaxFailure");
+    max_fail = policy.max_fail;
     if (max_fail == 0) {
         goto done;
     }
@@ -836,14 +1253,6 @@ static int ipalockout_preop(Slapi_PBlock *pb)
     }
 
 done:
-    if (lastfail) slapi_ch_free_string(&lastfail);
-    slapi_entry_free(target_entry);
-    slapi_entry_free(policy_entry);
-    if (values != NULL) {
-        slapi_vattr_values_free(&values, &actual_type_name, attr_free_flags);
-    }
-    if (sdn) slapi_sdn_free(&sdn);
-
     LOG("preop returning %d: %s\n", ret, errstr ? errstr : "success\n");
 
     if (ret) {
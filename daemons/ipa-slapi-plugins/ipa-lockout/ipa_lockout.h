@@ -0,0 +1,139 @@
+/** BEGIN COPYRIGHT BLOCK
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Additional permission under GPLv3 section 7:
+ *
+ * In the following paragraph, "GPL" means the GNU General Public
+ * License, version 3 or any later version, and "Non-GPL Code" means
+ * code that is governed neither by the GPL nor a license
+ * compatible with the GPL.
+ *
+ * You may link the code of this Program with Non-GPL Code and convey
+ * linked combinations including the two, provided that such Non-GPL
+ * Code only links to the code of this Program through those well
+ * defined interfaces identified in the file named EXCEPTION found in
+ * the source code files (the "Approved Interfaces"). The files of
+ * Non-GPL Code may instantiate templates or use macros or inline
+ * functions from the Approved Interfaces without causing the resulting
+ * work to be covered by the GPL. Only the copyright holders of this
+ * Program may make changes or additions to the list of Approved
+ * Interfaces.
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ * All rights reserved.
+ * END COPYRIGHT BLOCK **/
+
+#ifndef _IPA_LOCKOUT_H_
+#define _IPA_LOCKOUT_H_
+
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+/*
+ * Write-behind of the lockout attributes.
+ *
+ * Binds only update the per-DN state below; the flush thread writes it
+ * back to the entry at most IPALOCKOUT_FLUSH_DELAY seconds later, or
+ * sooner once IPALOCKOUT_FLUSH_BATCH entries are pending, so a burst of
+ * binds costs one replicated modify per DN instead of one per bind.
+ * Enforcement always combines the entry with the pending state, see
+ * ipalockout_state_counters().
+ */
+#define IPALOCKOUT_FLUSH_DELAY 2
+#define IPALOCKOUT_FLUSH_BATCH 128
+#define IPALOCKOUT_LAST_SUCCESS_INTERVAL 60
+#define IPALOCKOUT_STATE_BUCKETS 1024
+
+/*
+ * A DN whose changes cannot be written (e.g. the modify is rejected by an
+ * ACI, the schema or the backend) is retried after an exponentially
+ * growing delay, IPALOCKOUT_FLUSH_DELAY << n seconds after the nth failed
+ * flush. Its pending changes are dropped after IPALOCKOUT_WRITE_RETRIES
+ * failed flushes in a row.
+ */
+#define IPALOCKOUT_WRITE_RETRIES 5
+
+struct ipalockout_state {
+    struct ipalockout_state *next;
+    char *ndn;
+    char *dn;
+    time_t due;
+
+    /* Failed binds not yet in krbLoginFailedCount, added to the stored
+     * value unless reset is set (a successful bind or an expired fail
+     * interval), in which case they replace it. */
+    unsigned long failures;
+    time_t last_failed;
+    unsigned int max_fail;
+
+    /* krbLastAdminUnlock of the entry the failures were counted on, a
+     * newer unlock drops them */
+    time_t unlock;
+
+    bool reset;
+    /* bumped whenever the pending failures are reset or dropped */
+    unsigned int reset_seq;
+
+    time_t last_success;
+
+    /* set while being written by the flush thread */
+    bool busy;
+    unsigned int pass;
+    /* flushes that failed in a row */
+    unsigned int write_failures;
+};
+
+struct ipalockout_wb {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct ipalockout_state *table[IPALOCKOUT_STATE_BUCKETS];
+    size_t pending;
+    unsigned int pass;
+    bool running;
+    bool stop;
+    pthread_t tid;
+};
+
+extern struct ipalockout_wb ipalockout_wb;
+
+/* Call with ipalockout_wb.lock held. */
+struct ipalockout_state *ipalockout_state_find(const char *ndn, bool create,
+                                               const char *dn);
+bool ipalockout_state_dirty(struct ipalockout_state *st);
+void ipalockout_state_remove(struct ipalockout_state *st);
+void ipalockout_state_queue(struct ipalockout_state *st, time_t now);
+void ipalockout_state_unlock(struct ipalockout_state *st, time_t unlock);
+void ipalockout_state_write_begin(struct ipalockout_state *st,
+                                  struct ipalockout_state *snap);
+bool ipalockout_state_write_end(struct ipalockout_state *st,
+                                const struct ipalockout_state *snap,
+                                bool written, time_t now);
+
+/* These take ipalockout_wb.lock. */
+void ipalockout_state_counters(const char *ndn, unsigned long count,
+                               time_t last, time_t unlock,
+                               unsigned long *failedcount,
+                               time_t *last_failed);
+void ipalockout_state_failure(const char *ndn, const char *dn,
+                              unsigned int max_fail, time_t unlock,
+                              bool restart, time_t now);
+void ipalockout_state_success(const char *ndn, const char *dn, bool reset,
+                              bool stamp, bool track_success, time_t now);
+
+unsigned long ipalockout_state_new_count(unsigned long stored,
+                                         unsigned long failures,
+                                         unsigned int max_fail);
+
+#endif /* _IPA_LOCKOUT_H_ */
@@ -0,0 +1,289 @@
+/** BEGIN COPYRIGHT BLOCK
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Additional permission under GPLv3 section 7:
+ *
+ * In the following paragraph, "GPL" means the GNU General Public
+ * License, version 3 or any later version, and "Non-GPL Code" means
+ * code that is governed neither by the GPL nor a license
+ * compatible with the GPL.
+ *
+ * You may link the code of this Program with Non-GPL Code and convey
+ * linked combinations including the two, provided that such Non-GPL
+ * Code only links to the code of this Program through those well
+ * defined interfaces identified in the file named EXCEPTION found in
+ * the source code files (the "Approved Interfaces"). The files of
+ * Non-GPL Code may instantiate templates or use macros or inline
+ * functions from the Approved Interfaces without causing the resulting
+ * work to be covered by the GPL. Only the copyright holders of this
+ * Program may make changes or additions to the list of Approved
+ * Interfaces.
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ * All rights reserved.
+ * END COPYRIGHT BLOCK **/
+
+#include <stdint.h>
+#include <string.h>
+#include "slapi-plugin.h"
+
+#include "ipa_lockout.h"
+
+struct ipalockout_wb ipalockout_wb = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static uint32_t ipalockout_state_hash(const char *ndn)
+{
+    uint32_t hash = 2166136261U;
+
+    for (; *ndn != '\0'; ndn++) {
+        hash ^= (unsigned char) *ndn;
+        hash *= 16777619U;
+    }
+
+    return hash % IPALOCKOUT_STATE_BUCKETS;
+}
+
+struct ipalockout_state *ipalockout_state_find(const char *ndn, bool create,
+                                               const char *dn)
+{
+    struct ipalockout_state *st;
+    uint32_t hash;
+
+    hash = ipalockout_state_hash(ndn);
+    for (st = ipalockout_wb.table[hash]; st; st = st->next) {
+        if (strcmp(st->ndn, ndn) == 0) {
+            return st;
+        }
+    }
+
+    if (!create) {
+        return NULL;
+    }
+
+    st = (struct ipalockout_state *)slapi_ch_calloc(1, sizeof(*st));
+    st->ndn = slapi_ch_strdup(ndn);
+    st->dn = slapi_ch_strdup(dn);
+    st->next = ipalockout_wb.table[hash];
+    ipalockout_wb.table[hash] = st;
+
+    return st;
+}
+
+bool ipalockout_state_dirty(struct ipalockout_state *st)
+{
+    return st->failures != 0 || st->reset || st->last_success != 0;
+}
+
+void ipalockout_state_remove(struct ipalockout_state *st)
+{
+    struct ipalockout_state **p;
+
+    p = &ipalockout_wb.table[ipalockout_state_hash(st->ndn)];
+    while (*p != st) {
+        p = &(*p)->next;
+    }
+    *p = st->next;
+
+    slapi_ch_free_string(&st->ndn);
+    slapi_ch_free_string(&st->dn);
+    slapi_ch_free((void **)&st);
+}
+
+/* Call after making st dirty. */
+void ipalockout_state_queue(struct ipalockout_state *st, time_t now)
+{
+    if (st->due != 0) {
+        return;
+    }
+
+    st->due = now + IPALOCKOUT_FLUSH_DELAY;
+    if (++ipalockout_wb.pending >= IPALOCKOUT_FLUSH_BATCH) {
+        pthread_cond_signal(&ipalockout_wb.cond);
+    }
+}
+
+/*
+ * An administrative unlock sets krbLastAdminUnlock and clears
+ * krbLoginFailedCount. Failures still pending from before the unlock must
+ * not be added to the cleared counter, they are dropped.
+ */
+void ipalockout_state_unlock(struct ipalockout_state *st, time_t unlock)
+{
+    if (unlock <= st->unlock) {
+        return;
+    }
+
+    st->unlock = unlock;
+    if (st->failures != 0) {
+        st->failures = 0;
+        st->reset_seq++;
+    }
+}
+
+/* Take a snapshot of the changes to write. */
+void ipalockout_state_write_begin(struct ipalockout_state *st,
+                                  struct ipalockout_state *snap)
+{
+    *snap = *st;
+    st->busy = true;
+    st->due = 0;
+    ipalockout_wb.pending--;
+}
+
+/*
+ * Account for a finished write of snap, keeping whatever happened while
+ * it was written. st is freed if nothing is left to write, otherwise it
+ * is queued again, later for every failed write in a row. Returns false
+ * if the write failed IPALOCKOUT_WRITE_RETRIES times in a row, the
+ * pending changes are then dropped and st is freed.
+ */
+bool ipalockout_state_write_end(struct ipalockout_state *st,
+                                const struct ipalockout_state *snap,
+                                bool written, time_t now)
+{
+    st->busy = false;
+    if (written) {
+        st->write_failures = 0;
+        if (st->reset_seq == snap->reset_seq) {
+            st->reset = false;
+            st->failures -= snap->failures;
+        }
+        if (st->last_success == snap->last_success) {
+            st->last_success = 0;
+        }
+    } else if (++st->write_failures >= IPALOCKOUT_WRITE_RETRIES) {
+        if (st->due != 0) {
+            ipalockout_wb.pending--;
+        }
+        ipalockout_state_remove(st);
+        return false;
+    }
+
+    if (!ipalockout_state_dirty(st)) {
+        ipalockout_state_remove(st);
+    } else if (st->write_failures != 0) {
+        /* binds may have queued it meanwhile, the backoff still wins */
+        if (st->due == 0) {
+            ipalockout_wb.pending++;
+        }
+        st->due = now + (IPALOCKOUT_FLUSH_DELAY << st->write_failures);
+    } else if (st->due == 0) {
+        ipalockout_state_queue(st, now);
+    }
+
+    return true;
+}
+
+/*
+ * Current failure counter and time of the last failure of the principal
+ * ndn, including the failures that have not been written out yet. count,
+ * last and unlock are the krbLoginFailedCount, krbLastFailedAuth and
+ * krbLastAdminUnlock values of the entry.
+ */
+void ipalockout_state_counters(const char *ndn, unsigned long count,
+                               time_t last, time_t unlock,
+                               unsigned long *failedcount,
+                               time_t *last_failed)
+{
+    struct ipalockout_state *st;
+
+    pthread_mutex_lock(&ipalockout_wb.lock);
+    st = ipalockout_state_find(ndn, false, NULL);
+    if (st != NULL) {
+        ipalockout_state_unlock(st, unlock);
+        if (st->reset) {
+            count = 0;
+        }
+        /* Once a write has landed its failures are counted twice until
+         * the flush thread has seen the result. The stored value cannot
+         * tell whether it has landed, the KDC may have stored the same
+         * value, so this errs on the side of counting too many. */
+        count += st->failures;
+        if (st->failures != 0 && st->last_failed > last) {
+            last = st->last_failed;
+        }
+    }
+    pthread_mutex_unlock(&ipalockout_wb.lock);
+
+    *failedcount = count;
+    *last_failed = last;
+}
+
+void ipalockout_state_failure(const char *ndn, const char *dn,
+                              unsigned int max_fail, time_t unlock,
+                              bool restart, time_t now)
+{
+    struct ipalockout_state *st;
+
+    pthread_mutex_lock(&ipalockout_wb.lock);
+    st = ipalockout_state_find(ndn, true, dn);
+    ipalockout_state_unlock(st, unlock);
+    if (restart) {
+        /* outside of fail interval, start counting from scratch */
+        st->reset = true;
+        st->reset_seq++;
+        st->failures = 0;
+    }
+    st->failures++;
+    st->last_failed = now;
+    st->max_fail = max_fail;
+    ipalockout_state_queue(st, now);
+    pthread_mutex_unlock(&ipalockout_wb.lock);
+}
+
+/*
+ * reset clears the failure counter, stamp asks for krbLastSuccessfulAuth
+ * to be written and track_success keeps a pending one current.
+ */
+void ipalockout_state_success(const char *ndn, const char *dn, bool reset,
+                              bool stamp, bool track_success, time_t now)
+{
+    struct ipalockout_state *st;
+
+    pthread_mutex_lock(&ipalockout_wb.lock);
+    st = ipalockout_state_find(ndn, reset || stamp, dn);
+    if (st != NULL) {
+        if (reset) {
+            st->reset = true;
+            st->reset_seq++;
+            st->failures = 0;
+        }
+        if (stamp || (track_success && st->last_success != 0)) {
+            st->last_success = now;
+        }
+        if (ipalockout_state_dirty(st)) {
+            ipalockout_state_queue(st, now);
+        }
+    }
+    pthread_mutex_unlock(&ipalockout_wb.lock);
+}
+
+/* The krbLoginFailedCount to store when adding failures to the stored
+ * value, never above max_fail unless it already is. */
+unsigned long ipalockout_state_new_count(unsigned long stored,
+                                         unsigned long failures,
+                                         unsigned int max_fail)
+{
+    unsigned long count;
+
+    count = stored + failures;
+    if (count > max_fail && max_fail != 0) {
+        count = max_fail > stored ? max_fail : stored;
+    }
+
+    return count;
+}
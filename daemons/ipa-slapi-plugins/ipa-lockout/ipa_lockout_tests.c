@@ -0,0 +1,214 @@
+/*
+    Copyright (C) 2026 Red Hat
+
+    Tests for the write-behind state of the FreeIPA lockout plugin
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include "slapi-plugin.h"
+
+#include "ipa_lockout.h"
+
+#define NDN "uid=user,cn=users,cn=accounts,dc=example,dc=test"
+
+static unsigned long counter(unsigned long stored, time_t unlock)
+{
+    unsigned long count;
+    time_t last;
+
+    ipalockout_state_counters(NDN, stored, 0, unlock, &count, &last);
+
+    return count;
+}
+
+/* Simulates the flush thread writing the pending state of NDN, on_write
+ * runs while the write is in flight. */
+static bool flush_result(void (*on_write)(void), bool written, time_t now)
+{
+    struct ipalockout_state snap;
+    struct ipalockout_state *st;
+    bool ret;
+
+    pthread_mutex_lock(&ipalockout_wb.lock);
+    st = ipalockout_state_find(NDN, false, NULL);
+    assert_non_null(st);
+    ipalockout_state_write_begin(st, &snap);
+    pthread_mutex_unlock(&ipalockout_wb.lock);
+
+    if (on_write != NULL) {
+        on_write();
+    }
+
+    pthread_mutex_lock(&ipalockout_wb.lock);
+    ret = ipalockout_state_write_end(st, &snap, written, now);
+    pthread_mutex_unlock(&ipalockout_wb.lock);
+
+    return ret;
+}
+
+static void flush(void (*on_write)(void))
+{
+    assert_true(flush_result(on_write, true, 1000));
+}
+
+static void unlock_and_fail(void)
+{
+    /* admin unlock at 400, then a new failure */
+    assert_int_equal(counter(0, 400), 0);
+    ipalockout_state_failure(NDN, NDN, 5, 400, false, 410);
+}
+
+void test_admin_unlock(void **state)
+{
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        ipalockout_state_failure(NDN, NDN, 5, 100, false, 200 + i);
+    }
+    assert_int_equal(counter(1, 100), 4);
+
+    /* the unlock clears krbLoginFailedCount and voids pending failures */
+    assert_int_equal(counter(0, 300), 0);
+    ipalockout_state_failure(NDN, NDN, 5, 300, false, 310);
+    assert_int_equal(counter(0, 300), 1);
+    flush(NULL);
+    assert_int_equal(counter(1, 300), 1);
+
+    /* an unlock while a write is in flight, the failure counted after the
+     * unlock is still pending afterwards */
+    ipalockout_state_failure(NDN, NDN, 5, 300, false, 320);
+    ipalockout_state_failure(NDN, NDN, 5, 300, false, 321);
+    flush(unlock_and_fail);
+    assert_int_equal(counter(0, 400), 1);
+    flush(NULL);
+    assert_null(ipalockout_state_find(NDN, false, NULL));
+}
+
+static unsigned long stored;
+
+static void check_inflight(void)
+{
+    /* not landed yet: 3 stored plus 2 pending */
+    assert_int_equal(counter(stored, 0), 5);
+    /* landed, or the KDC counted two failures and stored the same value:
+     * never less than the true count */
+    assert_true(counter(stored + 2, 0) >= stored + 2 + 2);
+    /* the KDC counted one failure */
+    assert_int_equal(counter(stored + 1, 0), 6);
+}
+
+void test_inflight(void **state)
+{
+    stored = 3;
+    ipalockout_state_failure(NDN, NDN, 10, 0, false, 100);
+    ipalockout_state_failure(NDN, NDN, 10, 0, false, 101);
+    flush(check_inflight);
+
+    /* written out */
+    assert_null(ipalockout_state_find(NDN, false, NULL));
+    assert_int_equal(counter(5, 0), 5);
+}
+
+void test_reset(void **state)
+{
+    ipalockout_state_failure(NDN, NDN, 5, 0, false, 100);
+    assert_int_equal(counter(2, 0), 3);
+
+    /* a successful bind resets the counter */
+    ipalockout_state_success(NDN, NDN, true, false, false, 110);
+    assert_int_equal(counter(2, 0), 0);
+
+    /* an expired fail interval restarts counting */
+    ipalockout_state_failure(NDN, NDN, 5, 0, true, 120);
+    assert_int_equal(counter(4, 0), 1);
+
+    flush(NULL);
+    assert_null(ipalockout_state_find(NDN, false, NULL));
+}
+
+static void fail_later(void)
+{
+    ipalockout_state_failure(NDN, NDN, 5, 0, false, 3005);
+}
+
+void test_write_retries(void **state)
+{
+    struct ipalockout_state *st;
+    unsigned int n;
+
+    ipalockout_state_failure(NDN, NDN, 5, 0, false, 100);
+    assert_int_equal(ipalockout_wb.pending, 1);
+
+    /* a rejected modify is retried later and later */
+    for (n = 1; n < IPALOCKOUT_WRITE_RETRIES; n++) {
+        assert_true(flush_result(NULL, false, 1000));
+        st = ipalockout_state_find(NDN, false, NULL);
+        assert_non_null(st);
+        assert_int_equal(st->due, 1000 + (IPALOCKOUT_FLUSH_DELAY << n));
+        assert_int_equal(ipalockout_wb.pending, 1);
+        /* the failures still count meanwhile */
+        assert_int_equal(counter(0, 0), 1);
+    }
+
+    /* a bind does not cut the backoff short */
+    ipalockout_state_failure(NDN, NDN, 5, 0, false, 1001);
+    assert_int_equal(st->due,
+                     1000 + (IPALOCKOUT_FLUSH_DELAY <<
+                             (IPALOCKOUT_WRITE_RETRIES - 1)));
+
+    /* then the changes are dropped */
+    assert_false(flush_result(NULL, false, 2000));
+    assert_null(ipalockout_state_find(NDN, false, NULL));
+    assert_int_equal(ipalockout_wb.pending, 0);
+
+    /* a successful write starts over */
+    ipalockout_state_failure(NDN, NDN, 5, 0, false, 3000);
+    assert_true(flush_result(NULL, false, 3000));
+    assert_true(flush_result(fail_later, true, 3010));
+    st = ipalockout_state_find(NDN, false, NULL);
+    assert_non_null(st);
+    assert_int_equal(st->write_failures, 0);
+    assert_int_equal(st->due, 3005 + IPALOCKOUT_FLUSH_DELAY);
+
+    flush(NULL);
+    assert_null(ipalockout_state_find(NDN, false, NULL));
+    assert_int_equal(ipalockout_wb.pending, 0);
+}
+
+void test_new_count(void **state)
+{
+    assert_int_equal(ipalockout_state_new_count(1, 2, 5), 3);
+    assert_int_equal(ipalockout_state_new_count(4, 3, 5), 5);
+    assert_int_equal(ipalockout_state_new_count(7, 1, 5), 7);
+    assert_int_equal(ipalockout_state_new_count(7, 1, 0), 8);
+}
+
+int main(int argc, const char *argv[])
+{
+
+    const UnitTest tests[] = {
+        unit_test(test_admin_unlock),
+        unit_test(test_inflight),
+        unit_test(test_reset),
+        unit_test(test_write_retries),
+        unit_test(test_new_count),
+    };
+
+    return run_tests(tests);
+}
@@ -39,9 +39,9 @@
  */
 #include <string.h>
 #include <stdbool.h>
+#include <sched.h>
 #include "slapi-plugin.h"
 #include "nspr.h"
-#include "prclist.h"
 #include <pthread.h>
 
 #include "util.h"
@@ -73,11 +73,10 @@ static Slapi_PluginDesc pdesc = {
 };
 
 /**
- * linked list of config entries
+ * config entries
  */
 
 struct configEntry {
-    PRCList list;
     char *dn;
     char *sattr;
     char *tattr;
@@ -85,11 +84,30 @@ struct configEntry {
     char *suffix;
     char *filter;
     Slapi_Filter *slapi_filter;
+    char **objectclasses;   /* entry needs one of them to match filter */
     char *scope;
 };
 
-static PRCList *ipamodrdn_global_config = NULL;
-static pthread_rwlock_t g_ipamodrdn_cache_lock;
+/**
+ * Immutable snapshot of all config entries, sorted by scope with the
+ * longest scope first. A reload builds a new snapshot and swaps it in.
+ */
+struct ipamodrdn_config {
+    struct configEntry **entries;
+    size_t count;
+};
+
+/**
+ * Readers pin the current slot by counting themselves in it and never
+ * block. A reload waits for the readers of the other slot, which holds the
+ * snapshot replaced by the previous reload, to go away before reusing it.
+ */
+static struct {
+    struct ipamodrdn_config *config;
+    int readers;
+} ipamodrdn_snapshots[2];
+static int ipamodrdn_current_snapshot;
+static pthread_mutex_t g_ipamodrdn_config_lock;
 
 static void *_PluginID = NULL;
 static char *_PluginDN = NULL;
@@ -112,8 +130,9 @@ static int ipamodrdn_close(Slapi_PBlock * pb);
  *
  */
 static int ipamodrdn_load_plugin_config(void);
-static int ipamodrdn_parse_config_entry(Slapi_Entry * e, bool apply);
-static void ipamodrdn_delete_config(void);
+static int ipamodrdn_parse_config_entry(Slapi_Entry * e,
+                                        struct ipamodrdn_config *config);
+static void ipamodrdn_free_config(struct ipamodrdn_config **config);
 static void ipamodrdn_free_config_entry(struct configEntry ** entry);
 
 /**
@@ -140,22 +159,45 @@ void ipamodrdn_dump_config_entry(struct configEntry *);
 
 /**
  *
- * Deal with cache locking
+ * Deal with config snapshots
  *
  */
-void ipamodrdn_read_lock(void)
+static struct ipamodrdn_config *ipamodrdn_config_get(int *slot)
 {
-    pthread_rwlock_rdlock(&g_ipamodrdn_cache_lock);
+    int cur;
+
+    for (;;) {
+        cur = __sync_fetch_and_add(&ipamodrdn_current_snapshot, 0);
+        __sync_fetch_and_add(&ipamodrdn_snapshots[cur].readers, 1);
+
+        /* make sure a reload did not move on before we were counted */
+        if (cur == __sync_fetch_and_add(&ipamodrdn_current_snapshot, 0)) {
+            break;
+        }
+        __sync_fetch_and_sub(&ipamodrdn_snapshots[cur].readers, 1);
+    }
+
+    *slot = cur;
+    return ipamodrdn_snapshots[cur].config;
 }
 
-void ipamodrdn_write_lock(void)
+static void ipamodrdn_config_put(int slot)
 {
-    pthread_rwlock_wrlock(&g_ipamodrdn_cache_lock);
+    __sync_fetch_and_sub(&ipamodrdn_snapshots[slot].readers, 1);
 }
 
-void ipamodrdn_unlock(void)
+/* Call with g_ipamodrdn_config_lock held */
+static void ipamodrdn_config_swap(struct ipamodrdn_config *config)
 {
-    pthread_rwlock_unlock(&g_ipamodrdn_cache_lock);
+    int next = 1 - __sync_fetch_and_add(&ipamodrdn_current_snapshot, 0);
+
+    while (__sync_fetch_and_add(&ipamodrdn_snapshots[next].readers, 0) != 0) {
+        sched_yield();
+    }
+
+    ipamodrdn_free_config(&ipamodrdn_snapshots[next].config);
+    ipamodrdn_snapshots[next].config = config;
+    __sync_bool_compare_and_swap(&ipamodrdn_current_snapshot, 1 - next, next);
 }
 
 /**
@@ -274,7 +316,7 @@ ipamodrdn_start(Slapi_PBlock * pb)
         goto done;
     }
 
-    if (pthread_rwlock_init(&g_ipamodrdn_cache_lock, NULL) != 0) {
+    if (pthread_mutex_init(&g_ipamodrdn_config_lock, NULL) != 0) {
         LOG_FATAL("lock creation failed\n");
 
         return EFAIL;
@@ -299,9 +341,9 @@ ipamodrdn_start(Slapi_PBlock * pb)
     /*
      * Load the config for our plug-in
      */
-    ipamodrdn_global_config = (PRCList *)
-        slapi_ch_calloc(1, sizeof(struct configEntry));
-    PR_INIT_CLIST(ipamodrdn_global_config);
+    ipamodrdn_snapshots[0].config = (struct ipamodrdn_config *)
+        slapi_ch_calloc(1, sizeof(struct ipamodrdn_config));
+    ipamodrdn_current_snapshot = 0;
 
     if (ipamodrdn_load_plugin_config() != EOK) {
         LOG_FATAL("unable to load plug-in configuration\n");
@@ -326,9 +368,8 @@ ipamodrdn_close(Slapi_PBlock * pb)
 {
     LOG_TRACE( "--in-->\n");
 
-    ipamodrdn_delete_config();
-
-    slapi_ch_free((void **)&ipamodrdn_global_config);
+    ipamodrdn_free_config(&ipamodrdn_snapshots[0].config);
+    ipamodrdn_free_config(&ipamodrdn_snapshots[1].config);
 
     LOG_TRACE("<--out--\n");
 
@@ -353,11 +394,14 @@ ipamodrdn_load_plugin_config(void)
     int i;
     Slapi_PBlock *search_pb;
     Slapi_Entry **entries = NULL;
+    struct ipamodrdn_config *config;
 
     LOG_TRACE("--in-->\n");
 
-    ipamodrdn_write_lock();
-    ipamodrdn_delete_config();
+    pthread_mutex_lock(&g_ipamodrdn_config_lock);
+
+    config = (struct ipamodrdn_config *)
+        slapi_ch_calloc(1, sizeof(struct ipamodrdn_config));
 
     search_pb = slapi_pblock_new();
 
@@ -383,36 +427,115 @@ ipamodrdn_load_plugin_config(void)
         /* We don't care about the status here because we may have
          * some invalid config entries, but we just want to continue
          * looking for valid ones. */
-        ipamodrdn_parse_config_entry(entries[i], true);
+        ipamodrdn_parse_config_entry(entries[i], config);
     }
 
   cleanup:
+    /* On failure readers are left with an empty config, as before */
+    ipamodrdn_config_swap(config);
     slapi_free_search_results_internal(search_pb);
     slapi_pblock_destroy(search_pb);
-    ipamodrdn_unlock();
+    pthread_mutex_unlock(&g_ipamodrdn_config_lock);
     LOG_TRACE("<--out--\n");
 
     return status;
 }
 
+/*
+ * ipamodrdn_filter_objectclasses()
+ *
+ * Collects the objectclasses an entry must have one of in order to
+ * match the filter, so most entries can be rejected without evaluating
+ * it. Returns NULL if the filter does not allow such a shortcut.
+ */
+static char **
+ipamodrdn_filter_objectclasses(Slapi_Filter *filter)
+{
+    Slapi_Filter *f;
+    char **ocs = NULL;
+    char **sub;
+    char *type;
+    struct berval *bval;
+    int i;
+
+    switch (slapi_filter_get_choice(filter)) {
+    case LDAP_FILTER_EQUALITY:
+        if (slapi_filter_get_ava(filter, &type, &bval) == 0 &&
+            strcasecmp(type, SLAPI_ATTR_OBJECTCLASS) == 0) {
+            slapi_ch_array_add(&ocs, slapi_ch_smprintf("%.*s",
+                                                       (int)bval->bv_len,
+                                                       bval->bv_val));
+        }
+        break;
+
+    case LDAP_FILTER_OR:
+        /* every branch has to be restricted */
+        for (f = slapi_filter_list_first(filter); f != NULL;
+             f = slapi_filter_list_next(filter, f)) {
+            sub = ipamodrdn_filter_objectclasses(f);
+            if (sub == NULL) {
+                slapi_ch_array_free(ocs);
+                return NULL;
+            }
+            for (i = 0; sub[i]; i++) {
+                slapi_ch_array_add(&ocs, sub[i]);
+            }
+            slapi_ch_free((void **)&sub);
+        }
+        break;
+
+    case LDAP_FILTER_AND:
+        /* a single restricted branch is enough */
+        for (f = slapi_filter_list_first(filter); f != NULL;
+             f = slapi_filter_list_next(filter, f)) {
+            ocs = ipamodrdn_filter_objectclasses(f);
+            if (ocs != NULL) {
+                break;
+            }
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return ocs;
+}
+
+static bool
+ipamodrdn_entry_has_objectclass(Slapi_Entry *e, char **ocs)
+{
+    int i;
+
+    if (ocs == NULL) {
+        return true;
+    }
+
+    for (i = 0; ocs[i]; i++) {
+        if (slapi_entry_attr_hasvalue(e, SLAPI_ATTR_OBJECTCLASS, ocs[i])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 /*
  * ipamodrdn_parse_config_entry()
  *
- * Parses a single config entry.  If apply is non-zero, then
- * we will load and start using the new config.  You can simply
- * validate config without making any changes by setting apply
- * to 0.
+ * Parses a single config entry.  If config is not NULL, then the
+ * entry is added to it.  You can simply validate config without
+ * making any changes by passing NULL.
  *
  * Returns EOK if the entry is valid and EFAIL
  * if it is invalid.
  */
 static int
-ipamodrdn_parse_config_entry(Slapi_Entry * e, bool apply)
+ipamodrdn_parse_config_entry(Slapi_Entry * e, struct ipamodrdn_config *config)
 {
     char *value;
     struct configEntry *entry = NULL;
-    struct configEntry *config_entry;
-    PRCList *list;
+    size_t i;
     int entry_added = 0;
     int ret = EOK;
 
@@ -481,6 +604,8 @@ ipamodrdn_parse_config_entry(Slapi_Entry * e, bool apply)
             ret = EFAIL;
             goto bail;
         }
+        entry->objectclasses =
+            ipamodrdn_filter_objectclasses(entry->slapi_filter);
     } else {
         LOG_FATAL("The %s config setting is required for %s.\n",
                   IPAMODRDN_FILTER, entry->dn);
@@ -502,51 +627,41 @@ ipamodrdn_parse_config_entry(Slapi_Entry * e, bool apply)
 
     /* If we were only called to validate config, we can
      * just bail out before applying the config changes */
-    if (!apply) {
+    if (config == NULL) {
         goto bail;
     }
 
     /**
-     * Finally add the entry to the list.
+     * Finally add the entry to the snapshot.
      * We sort by scope dn length with longer
      * dn's first - this allows the scope
      * checking code to be simple and quick and
      * cunningly linear.
      */
-    if (!PR_CLIST_IS_EMPTY(ipamodrdn_global_config)) {
-        list = PR_LIST_HEAD(ipamodrdn_global_config);
-        while (list != ipamodrdn_global_config) {
-            config_entry = (struct configEntry *) list;
-
-            if (slapi_dn_issuffix(entry->scope, config_entry->scope)) {
-                PR_INSERT_BEFORE(&(entry->list), list);
-                LOG_CONFIG("store [%s] before [%s] \n",
-                           entry->scope, config_entry->scope);
-                entry_added = 1;
-                break;
-            }
-
-            list = PR_NEXT_LINK(list);
-
-            if (ipamodrdn_global_config == list) {
-                /* add to tail */
-                PR_INSERT_BEFORE(&(entry->list), list);
-                LOG_CONFIG("store [%s] at tail\n", entry->scope);
-                entry_added = 1;
-                break;
-            }
+    for (i = 0; i < config->count; i++) {
+        if (slapi_dn_issuffix(entry->scope, config->entries[i]->scope)) {
+            LOG_CONFIG("store [%s] before [%s] \n",
+                       entry->scope, config->entries[i]->scope);
+            break;
         }
-    } else {
-        /* first entry */
-        PR_INSERT_LINK(&(entry->list), ipamodrdn_global_config);
-        LOG_CONFIG("store [%s] at head \n", entry->scope);
-        entry_added = 1;
+    }
+    if (i == config->count) {
+        LOG_CONFIG("store [%s] at tail\n", entry->scope);
     }
 
+    config->entries = (struct configEntry **)
+        slapi_ch_realloc((char *)config->entries,
+                         (config->count + 1) * sizeof(struct configEntry *));
+    memmove(&config->entries[i + 1], &config->entries[i],
+            (config->count - i) * sizeof(struct configEntry *));
+    config->entries[i] = entry;
+    config->count++;
+    entry_added = 1;
+
 bail:
     if (0 == entry_added) {
         /* Don't log error if we weren't asked to apply config */
-        if (apply && (entry != NULL)) {
+        if ((config != NULL) && (entry != NULL)) {
             LOG_FATAL("Invalid config entry [%s] skipped\n", entry->dn);
         }
         ipamodrdn_free_config_entry(&entry);
@@ -580,28 +695,26 @@ ipamodrdn_free_config_entry(struct configEntry **entry)
     slapi_ch_free_string(&e->suffix);
     slapi_ch_free_string(&e->filter);
     slapi_filter_free(e->slapi_filter, 1);
+    slapi_ch_array_free(e->objectclasses);
     slapi_ch_free_string(&e->scope);
     slapi_ch_free((void **)entry);
 }
 
 static void
-ipamodrdn_delete_configEntry(PRCList *entry)
+ipamodrdn_free_config(struct ipamodrdn_config **config)
 {
-    PR_REMOVE_LINK(entry);
-    ipamodrdn_free_config_entry((struct configEntry **) &entry);
-}
+    size_t i;
 
-static void
-ipamodrdn_delete_config(void)
-{
-    PRCList *list;
+    if (!config || !*config) {
+        return;
+    }
 
-    while (!PR_CLIST_IS_EMPTY(ipamodrdn_global_config)) {
-        list = PR_LIST_HEAD(ipamodrdn_global_config);
-        ipamodrdn_delete_configEntry(list);
+    for (i = 0; i < (*config)->count; i++) {
+        ipamodrdn_free_config_entry(&(*config)->entries[i]);
     }
 
-    return;
+    slapi_ch_free((void **)&(*config)->entries);
+    slapi_ch_free((void **)config);
 }
 
 /****************************************************
@@ -703,7 +816,9 @@ done:
 static int ipamodrdn_post_op(Slapi_PBlock *pb)
 {
     char *dn = NULL;
-    PRCList *list = NULL;
+    struct ipamodrdn_config *config;
+    int slot;
+    size_t i;
     struct configEntry *cfgentry = NULL;
     struct slapi_entry *e = NULL;
     Slapi_Attr *sattr = NULL;
@@ -727,61 +842,60 @@ static int ipamodrdn_post_op(Slapi_PBlock *pb)
         goto done;
     }
 
-    ipamodrdn_read_lock();
+    config = ipamodrdn_config_get(&slot);
 
-    if (!PR_CLIST_IS_EMPTY(ipamodrdn_global_config)) {
-        list = PR_LIST_HEAD(ipamodrdn_global_config);
+    for (i = 0; i < config->count; i++) {
+        cfgentry = config->entries[i];
 
-        for(list = PR_LIST_HEAD(ipamodrdn_global_config);
-            list != ipamodrdn_global_config;
-            list = PR_NEXT_LINK(list)) {
-            cfgentry = (struct configEntry *) list;
+        /* is the entry in scope? */
+        if (cfgentry->scope) {
+            if (!slapi_dn_issuffix(dn, cfgentry->scope)) {
+                continue;
+            }
+        }
 
-            /* is the entry in scope? */
-            if (cfgentry->scope) {
-                if (!slapi_dn_issuffix(dn, cfgentry->scope)) {
-                    continue;
-                }
+        /* does the entry match the filter? */
+        if (cfgentry->slapi_filter) {
+            if (!ipamodrdn_entry_has_objectclass(e,
+                                                 cfgentry->objectclasses)) {
+                continue;
             }
 
-            /* does the entry match the filter? */
-            if (cfgentry->slapi_filter) {
-                ret = slapi_vattr_filter_test(pb, e,
-                                              cfgentry->slapi_filter, 0);
-                if (ret != LDAP_SUCCESS) {
-                    continue;
-                }
+            ret = slapi_vattr_filter_test(pb, e,
+                                          cfgentry->slapi_filter, 0);
+            if (ret != LDAP_SUCCESS) {
+                continue;
             }
+        }
 
-            if (slapi_entry_attr_find(e, cfgentry->sattr, &sattr) != 0) {
-                LOG_TRACE("Source attr %s not found for %s\n",
-                          cfgentry->sattr, dn);
+        if (slapi_entry_attr_find(e, cfgentry->sattr, &sattr) != 0) {
+            LOG_TRACE("Source attr %s not found for %s\n",
+                      cfgentry->sattr, dn);
+            continue;
+        }
+        if (slapi_entry_attr_find(e, cfgentry->tattr, &tattr) != 0) {
+            LOG_TRACE("Target attr %s not found for %s\n",
+                      cfgentry->tattr, dn);
+        } else {
+            Slapi_Value *val;
+            const char *strval;
+
+            ret = slapi_attr_first_value(sattr, &val);
+            if (ret == -1 || !val) {
+                LOG_FATAL("Source attr %s is empty\n", cfgentry->sattr);
                 continue;
             }
-            if (slapi_entry_attr_find(e, cfgentry->tattr, &tattr) != 0) {
-                LOG_TRACE("Target attr %s not found for %s\n",
+            strval = slapi_value_get_string(val);
+
+            ret = ipamodrdn_change_attr(cfgentry, dn, strval);
+            if (ret != EOK) {
+                LOG_FATAL("Failed to set target attr %s for %s\n",
                           cfgentry->tattr, dn);
-            } else {
-                Slapi_Value *val;
-                const char *strval;
-
-                ret = slapi_attr_first_value(sattr, &val);
-                if (ret == -1 || !val) {
-                    LOG_FATAL("Source attr %s is empty\n", cfgentry->sattr);
-                    continue;
-                }
-                strval = slapi_value_get_string(val);
-
-                ret = ipamodrdn_change_attr(cfgentry, dn, strval);
-                if (ret != EOK) {
-                    LOG_FATAL("Failed to set target attr %s for %s\n",
-                              cfgentry->tattr, dn);
-                }
             }
         }
     }
 
-    ipamodrdn_unlock();
+    ipamodrdn_config_put(slot);
 
     ret = LDAP_SUCCESS;
 
@@ -37,6 +37,8 @@
  * All rights reserved.
  * END COPYRIGHT BLOCK **/
 
+#include <pthread.h>
+
 #include "ipapwd.h"
 #include "util.h"
 
@@ -70,6 +72,73 @@ static const char *ipapwd_def_encsalts[] = {
     NULL
 };
 
+/* The Kerberos configuration is built once and shared by all operations,
+ * each of which holds a reference on it through a private view carrying
+ * a per-thread krb5 context (contexts must not be shared across threads).
+ * ipapwd_krbcfg_update() drops the cached copy whenever one of the entries
+ * it is built from changes, the next user builds a fresh one. */
+static struct ipapwd_krbcfg *ipapwd_krbcfg_cache = NULL;
+static pthread_mutex_t ipapwd_krbcfg_lock = PTHREAD_MUTEX_INITIALIZER;
+static Slapi_DN *ipapwd_krbcfg_sdns[3];
+
+static pthread_key_t ipapwd_krbctx_key;
+static pthread_once_t ipapwd_krbctx_once = PTHREAD_ONCE_INIT;
+
+static void ipapwd_krbctx_free(void *krbctx)
+{
+    krb5_free_context((krb5_context)krbctx);
+}
+
+static void ipapwd_krbctx_key_init(void)
+{
+    if (pthread_key_create(&ipapwd_krbctx_key, ipapwd_krbctx_free) != 0) {
+        LOG_FATAL("pthread_key_create failed\n");
+    }
+}
+
+static krb5_context ipapwd_thread_krbctx(void)
+{
+    krb5_context krbctx;
+    krb5_error_code krberr;
+
+    pthread_once(&ipapwd_krbctx_once, ipapwd_krbctx_key_init);
+
+    krbctx = pthread_getspecific(ipapwd_krbctx_key);
+    if (krbctx == NULL) {
+        krberr = krb5_init_context(&krbctx);
+        if (krberr) {
+            LOG_FATAL("krb5_init_context failed\n");
+            return NULL;
+        }
+        if (pthread_setspecific(ipapwd_krbctx_key, krbctx) != 0) {
+            LOG_FATAL("pthread_setspecific failed\n");
+            krb5_free_context(krbctx);
+            return NULL;
+        }
+    }
+
+    return krbctx;
+}
+
+static void ipapwd_krbcfg_destroy(struct ipapwd_krbcfg *c)
+{
+    krb5_free_default_realm(c->krbctx, c->realm);
+    krb5_free_context(c->krbctx);
+    free(c->kmkey->contents);
+    free(c->kmkey);
+    free(c->supp_encsalts);
+    free(c->pref_encsalts);
+    slapi_ch_array_free(c->passsync_mgrs);
+    free(c);
+}
+
+static void ipapwd_krbcfg_unref(struct ipapwd_krbcfg *c)
+{
+    if (__sync_sub_and_fetch(&c->refcount, 1) == 0) {
+        ipapwd_krbcfg_destroy(c);
+    }
+}
+
 static struct ipapwd_krbcfg *ipapwd_getConfig(void)
 {
     krb5_error_code krberr;
@@ -94,6 +163,7 @@ static struct ipapwd_krbcfg *ipapwd_getConfig(void)
         LOG_OOM();
         goto free_and_error;
     }
+    config->refcount = 1;
     kmkey = calloc(1, sizeof(krb5_keyblock));
     if (!kmkey) {
         LOG_OOM();
@@ -283,6 +353,113 @@ free_and_error:
     return NULL;
 }
 
+/* Build the shared configuration ahead of the first operation, once the
+ * configuration DNs are known. */
+void ipapwd_krbcfg_init(void)
+{
+    const char *dns[3] = { ipa_realm_dn, ipa_pwd_config_dn, ipa_etc_config_dn };
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        if (dns[i] != NULL && ipapwd_krbcfg_sdns[i] == NULL) {
+            ipapwd_krbcfg_sdns[i] = slapi_sdn_new_dn_byval(dns[i]);
+        }
+    }
+
+    pthread_mutex_lock(&ipapwd_krbcfg_lock);
+    if (ipapwd_krbcfg_cache == NULL) {
+        ipapwd_krbcfg_cache = ipapwd_getConfig();
+    }
+    pthread_mutex_unlock(&ipapwd_krbcfg_lock);
+}
+
+/* Called from the post-operations: forget the shared configuration if
+ * the operation touched one of the entries it was built from. */
+void ipapwd_krbcfg_update(Slapi_PBlock *pb)
+{
+    struct ipapwd_krbcfg *old = NULL;
+    Slapi_DN *sdn = NULL;
+    int oprc = 0;
+    int i;
+
+    if (slapi_pblock_get(pb, SLAPI_PLUGIN_OPRETURN, &oprc) != 0 || oprc != 0)
+        return;
+
+    if (slapi_pblock_get(pb, SLAPI_TARGET_SDN, &sdn) != 0 || sdn == NULL)
+        return;
+
+    for (i = 0; i < 3; i++) {
+        if (ipapwd_krbcfg_sdns[i] != NULL &&
+            slapi_sdn_compare(ipapwd_krbcfg_sdns[i], sdn) == 0) {
+            break;
+        }
+    }
+    if (i == 3)
+        return;
+
+    LOG("Kerberos configuration changed, reloading\n");
+
+    pthread_mutex_lock(&ipapwd_krbcfg_lock);
+    old = ipapwd_krbcfg_cache;
+    ipapwd_krbcfg_cache = NULL;
+    pthread_mutex_unlock(&ipapwd_krbcfg_lock);
+
+    if (old != NULL) {
+        ipapwd_krbcfg_unref(old);
+    }
+}
+
+/* Returns a private view of the shared configuration, to be released with
+ * free_ipapwd_krbcfg(). */
+static struct ipapwd_krbcfg *ipapwd_get_krbcfg(void)
+{
+    struct ipapwd_krbcfg *shared;
+    struct ipapwd_krbcfg *view;
+    krb5_context krbctx;
+
+    krbctx = ipapwd_thread_krbctx();
+    if (krbctx == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&ipapwd_krbcfg_lock);
+    if (ipapwd_krbcfg_cache == NULL) {
+        ipapwd_krbcfg_cache = ipapwd_getConfig();
+    }
+    shared = ipapwd_krbcfg_cache;
+    if (shared != NULL) {
+        __sync_add_and_fetch(&shared->refcount, 1);
+    }
+    pthread_mutex_unlock(&ipapwd_krbcfg_lock);
+
+    if (shared == NULL) {
+        return NULL;
+    }
+
+    view = calloc(1, sizeof(struct ipapwd_krbcfg));
+    if (!view) {
+        LOG_OOM();
+        ipapwd_krbcfg_unref(shared);
+        return NULL;
+    }
+
+    /* everything but the reference count, which keeps changing */
+    view->krbctx = krbctx;
+    view->realm = shared->realm;
+    view->mkvno = shared->mkvno;
+    view->kmkey = shared->kmkey;
+    view->num_supp_encsalts = shared->num_supp_encsalts;
+    view->supp_encsalts = shared->supp_encsalts;
+    view->num_pref_encsalts = shared->num_pref_encsalts;
+    view->pref_encsalts = shared->pref_encsalts;
+    view->passsync_mgrs = shared->passsync_mgrs;
+    view->num_passsync_mgrs = shared->num_passsync_mgrs;
+    view->allow_nt_hash = shared->allow_nt_hash;
+    view->shared = shared;
+
+    return view;
+}
+
 /* Easier handling for virtual attributes. You must call pwd_values_free()
  * to free memory allocated here. It must be called before
  * slapi_free_search_results_internal(entries) or
@@ -536,7 +713,7 @@ int ipapwd_gen_checks(Slapi_PBlock *pb, char **errMesg,
     }
 
     /* get the kerberos context and master key */
-    *config = ipapwd_getConfig();
+    *config = ipapwd_get_krbcfg();
     if (NULL == *config) {
         LOG_FATAL("Error Retrieving Master Key");
         *errMesg = "Fatal Internal Error";
@@ -1027,13 +1204,7 @@ void free_ipapwd_krbcfg(struct ipapwd_krbcfg **cfg)
 
     if (!c) return;
 
-    krb5_free_default_realm(c->krbctx, c->realm);
-    krb5_free_context(c->krbctx);
-    free(c->kmkey->contents);
-    free(c->kmkey);
-    free(c->supp_encsalts);
-    free(c->pref_encsalts);
-    slapi_ch_array_free(c->passsync_mgrs);
+    ipapwd_krbcfg_unref(c->shared);
     free(c);
     *cfg = NULL;
 };
@@ -1160,8 +1160,7 @@ static int ipapwd_setkeytab(Slapi_PBlock *pb, struct ipapwd_krbcfg *krbcfg)
 	Slapi_Entry *targetEntry=NULL;
 	struct berval *bval = NULL;
 	Slapi_Value **svals = NULL;
-	krb5_context krbctx = NULL;
-	krb5_error_code krberr;
+	krb5_context krbctx = krbcfg->krbctx;
 	struct ipapwd_keyset *kset = NULL;
     int rc;
     int kvno;
@@ -1170,13 +1169,6 @@ static int ipapwd_setkeytab(Slapi_PBlock *pb, struct ipapwd_krbcfg *krbcfg)
     struct berval *bvp = NULL;
     LDAPControl new_ctrl;
 
-	krberr = krb5_init_context(&krbctx);
-	if (krberr) {
-		LOG_FATAL("krb5_init_context failed\n");
-		rc = LDAP_OPERATIONS_ERROR;
-		goto free_and_return;
-	}
-
 	/* Get Bind DN */
 	slapi_pblock_get(pb, SLAPI_CONN_DN, &bindDN);
 
@@ -1303,8 +1295,6 @@ free_and_return:
 		free(svals);
 	}
 
-	if (krbctx) krb5_free_context(krbctx);
-
         if (rc == LDAP_SUCCESS)
             errMesg = NULL;
 	LOG("%s", errMesg ? errMesg : "success");
@@ -1313,6 +1303,34 @@ free_and_return:
 	return SLAPI_PLUGIN_EXTENDED_SENT_RESULT;
 }
 
+/* convert the enctypes of a getkeytab request in key/salt tuples */
+static int getkeytab_enctypes(long *etypes, int numtypes,
+                              krb5_key_salt_tuple **_enctypes,
+                              char **_err_msg)
+{
+    krb5_key_salt_tuple *enctypes;
+
+    *_enctypes = NULL;
+    if (numtypes == 0) {
+        return LDAP_SUCCESS;
+    }
+
+    enctypes = malloc(numtypes * sizeof(krb5_key_salt_tuple));
+    if (!enctypes) {
+        LOG_FATAL("allocation failed\n");
+        *_err_msg = "Internal error\n";
+        return LDAP_OPERATIONS_ERROR;
+    }
+
+    for (int i = 0; i < numtypes; i++) {
+        enctypes[i].ks_enctype = etypes[i];
+        enctypes[i].ks_salttype = KRB5_KDB_SALTTYPE_NORMAL;
+    }
+
+    *_enctypes = enctypes;
+    return LDAP_SUCCESS;
+}
+
 /* decode a getkeytab control request using libipaasn1 helpers */
 static int decode_getkeytab_request(struct berval *extop, bool *wantold,
                                     char **_svcname, char **_password,
@@ -1328,7 +1346,6 @@ static int decode_getkeytab_request(struct berval *extop, bool *wantold,
     krb5_key_salt_tuple *enctypes = NULL;
     bool newkt;
     bool ret;
-    int i;
 
     ret = ipaasn1_dec_getkt(extop->bv_val, extop->bv_len, &newkt,
                             &svcname, &password, &etypes, &numtypes);
@@ -1339,19 +1356,9 @@ static int decode_getkeytab_request(struct berval *extop, bool *wantold,
     }
 
     if (newkt) {
-        if (numtypes) {
-            enctypes = malloc(numtypes * sizeof(krb5_key_salt_tuple));
-            if (!enctypes) {
-                LOG_FATAL("allocation failed\n");
-                err_msg = "Internal error\n";
-                rc = LDAP_OPERATIONS_ERROR;
-                goto done;
-            }
-
-            for (i = 0; i < numtypes; i++) {
-                enctypes[i].ks_enctype = etypes[i];
-                enctypes[i].ks_salttype = KRB5_KDB_SALTTYPE_NORMAL;
-            }
+        rc = getkeytab_enctypes(etypes, numtypes, &enctypes, &err_msg);
+        if (rc != LDAP_SUCCESS) {
+            goto done;
         }
     }
 
@@ -1374,28 +1381,33 @@ done:
     return rc;
 }
 
-static int encode_getkeytab_reply(krb5_context krbctx,
-                                  krb5_keyblock *kmkey, int mkvno,
-                                  krb5_key_data *keys, int num_keys,
-                                  struct berval **_bvp)
+/* decrypt a set of stored keys with the master key, ksc will hold copies of
+ * the plain keys and their salts and must be freed with free_keys_contents */
+static int decrypt_key_data(krb5_context krbctx,
+                            krb5_keyblock *kmkey, int mkvno,
+                            krb5_key_data *keys, int num_keys,
+                            int *_kvno, struct keys_container *ksc)
 {
     int rc = LDAP_OPERATIONS_ERROR;
-    struct krb_key_salt ksdata[num_keys];
-    struct keys_container ksc = { num_keys, ksdata };
-    struct berval *bvp = NULL;
-    int kvno;
-    bool ret;
 
-    memset(ksdata, '\0', num_keys * sizeof(struct krb_key_salt));
+    ksc->nkeys = 0;
+    ksc->ksdata = calloc(num_keys, sizeof(struct krb_key_salt));
+    if (!ksc->ksdata) {
+        LOG_OOM();
+        return LDAP_OPERATIONS_ERROR;
+    }
 
     /* uses last key kvno */
-    kvno = keys[num_keys-1].key_data_kvno;
+    *_kvno = keys[num_keys-1].key_data_kvno;
 
     for (int i = 0; i < num_keys; i++) {
         krb5_enc_data cipher = { 0 };
         krb5_data plain = { 0 };
         krb5_int16 plen;
 
+        /* count it now so that a partial set gets freed too */
+        ksc->nkeys++;
+
         /* retrieve plain key */
         memcpy(&plen, keys[i].key_data_contents[0], 2);
         cipher.ciphertext.data = (char *)keys[i].key_data_contents[0] + 2;
@@ -1414,23 +1426,58 @@ static int encode_getkeytab_reply(krb5_context krbctx,
         rc = krb5_c_decrypt(krbctx, kmkey, 0, 0, &cipher, &plain);
         if (rc) {
             LOG_FATAL("Failed to decrypt keys\n");
+            free(plain.data);
             rc = LDAP_OPERATIONS_ERROR;
             goto done;
         }
 
-        ksc.ksdata[i].enctype = keys[i].key_data_type[0];
-        ksc.ksdata[i].key.enctype = keys[i].key_data_type[0];
-        ksc.ksdata[i].key.contents = (void *)plain.data;
-        ksc.ksdata[i].key.length = plain.length;
+        ksc->ksdata[i].enctype = keys[i].key_data_type[0];
+        ksc->ksdata[i].key.enctype = keys[i].key_data_type[0];
+        ksc->ksdata[i].key.contents = (void *)plain.data;
+        ksc->ksdata[i].key.length = plain.length;
 
         /* if salt available, add it */
         if (keys[i].key_data_length[1] != 0) {
-            ksc.ksdata[i].salttype = keys[i].key_data_type[1];
-            ksc.ksdata[i].salt.data = (void *)keys[i].key_data_contents[1];
-            ksc.ksdata[i].salt.length = keys[i].key_data_length[1];
+            ksc->ksdata[i].salttype = keys[i].key_data_type[1];
+            ksc->ksdata[i].salt.data = malloc(keys[i].key_data_length[1]);
+            if (!ksc->ksdata[i].salt.data) {
+                LOG_OOM();
+                rc = LDAP_OPERATIONS_ERROR;
+                goto done;
+            }
+            memcpy(ksc->ksdata[i].salt.data, keys[i].key_data_contents[1],
+                   keys[i].key_data_length[1]);
+            ksc->ksdata[i].salt.length = keys[i].key_data_length[1];
         }
     }
 
+    rc = LDAP_SUCCESS;
+
+done:
+    if (rc != LDAP_SUCCESS) {
+        free_keys_contents(krbctx, ksc);
+    }
+    return rc;
+}
+
+static int encode_getkeytab_reply(krb5_context krbctx,
+                                  krb5_keyblock *kmkey, int mkvno,
+                                  krb5_key_data *keys, int num_keys,
+                                  struct berval **_bvp)
+{
+    int rc;
+    struct keys_container ksc = { 0 };
+    struct berval *bvp = NULL;
+    int kvno;
+    bool ret;
+
+    rc = decrypt_key_data(krbctx, kmkey, mkvno, keys, num_keys, &kvno, &ksc);
+    if (rc != LDAP_SUCCESS) {
+        return rc;
+    }
+
+    rc = LDAP_OPERATIONS_ERROR;
+
     bvp = calloc(1, sizeof(struct berval));
     if (!bvp) goto done;
 
@@ -1441,9 +1488,7 @@ static int encode_getkeytab_reply(krb5_context krbctx,
     rc = LDAP_SUCCESS;
 
 done:
-    for (int i = 0; i < ksc.nkeys; i ++) {
-        free(ksc.ksdata[i].key.contents);
-    }
+    free_keys_contents(krbctx, &ksc);
     if (rc != LDAP_SUCCESS) {
         if (bvp) ber_bvfree(bvp);
     } else {
@@ -1524,74 +1569,33 @@ done:
 #define WRITEKEYS_OP_CHECK "ipaProtectedOperation;write_keys"
 #define READKEYS_OP_CHECK "ipaProtectedOperation;read_keys"
 
-/* Password Modify Extended operation plugin function */
-static int ipapwd_getkeytab(Slapi_PBlock *pb, struct ipapwd_krbcfg *krbcfg)
+/* Retrieve, or create and then retrieve, the keys of a single principal.
+ * On success the stored (master key encrypted) keys are returned. */
+static int ipapwd_getkeytab_keys(Slapi_PBlock *pb,
+                                 struct ipapwd_krbcfg *krbcfg,
+                                 char *bind_dn, bool wantold,
+                                 char **_service_name, char *password,
+                                 krb5_key_salt_tuple *kenctypes,
+                                 int num_kenctypes,
+                                 krb5_key_data **_keys, int *_num_keys,
+                                 int *_mkvno, char **_err_msg)
 {
-    char *bind_dn = NULL;
     char *err_msg = NULL;
-    int rc = 0;
-    krb5_context krbctx = NULL;
-    krb5_error_code krberr;
-    struct berval *extop_value = NULL;
-    char *service_name = NULL;
-    char *svcname;
+    int rc;
+    char *service_name;
     Slapi_Entry *target_entry = NULL;
     bool acl_ok = false;
-    char *password = NULL;
-    int num_kenctypes = 0;
-    krb5_key_salt_tuple *kenctypes = NULL;
-    int mkvno = 0;
-    int num_keys = 0;
-    krb5_key_data *keys = NULL;
     struct ipapwd_data data = { 0 };
     Slapi_Value **svals = NULL;
-    struct berval *bvp = NULL;
-    LDAPControl new_ctrl;
-    bool wantold = false;
-
-    /* Get Bind DN */
-    slapi_pblock_get(pb, SLAPI_CONN_DN, &bind_dn);
-
-    /* If the connection is bound anonymously, we must refuse to process
-    * this operation. */
-    if (bind_dn == NULL || *bind_dn == '\0') {
-        /* Refuse the operation because they're bound anonymously */
-        err_msg = "Anonymous Binds are not allowed.\n";
-        rc = LDAP_INSUFFICIENT_ACCESS;
-        goto free_and_return;
-    }
-
-    krberr = krb5_init_context(&krbctx);
-    if (krberr) {
-        LOG_FATAL("krb5_init_context failed\n");
-        rc = LDAP_OPERATIONS_ERROR;
-        goto free_and_return;
-    }
-
-    /* Get the ber value of the extended operation */
-    slapi_pblock_get(pb, SLAPI_EXT_OP_REQ_VALUE, &extop_value);
-    if (!extop_value) {
-        LOG_FATAL("Failed to retrieve extended op value from pblock\n");
-        err_msg = "Failed to retrieve extended operation value\n";
-        rc = LDAP_OPERATIONS_ERROR;
-        goto free_and_return;
-    }
-
-    rc = decode_getkeytab_request(extop_value, &wantold, &service_name,
-                                  &password, &kenctypes, &num_kenctypes,
-                                  &err_msg);
-    if (rc != LDAP_SUCCESS) {
-        goto free_and_return;
-    }
 
     /* make sure it is a valid name */
-    svcname = check_service_name(krbctx, service_name);
-    if (!svcname) {
+    service_name = check_service_name(krbcfg->krbctx, *_service_name);
+    if (!service_name) {
         rc = LDAP_OPERATIONS_ERROR;
-        goto free_and_return;
+        goto done;
     }
-    slapi_ch_free_string(&service_name);
-    service_name = svcname;
+    slapi_ch_free_string(_service_name);
+    *_service_name = service_name;
 
     /* check entry */
 
@@ -1600,7 +1604,7 @@ static int ipapwd_getkeytab(Slapi_PBlock *pb, struct ipapwd_krbcfg *krbcfg)
     if (!target_entry) {
         err_msg = "PrincipalName not found.\n";
         rc = LDAP_NO_SUCH_OBJECT;
-        goto free_and_return;
+        goto done;
     }
 
     /* ok access allowed */
@@ -1616,7 +1620,7 @@ static int ipapwd_getkeytab(Slapi_PBlock *pb, struct ipapwd_krbcfg *krbcfg)
                       service_name);
             err_msg = "Insufficient access rights\n";
             rc = LDAP_INSUFFICIENT_ACCESS;
-            goto free_and_return;
+            goto done;
         }
 
     } else {
@@ -1630,7 +1634,7 @@ static int ipapwd_getkeytab(Slapi_PBlock *pb, struct ipapwd_krbcfg *krbcfg)
                       service_name);
             err_msg = "Insufficient access rights\n";
             rc = LDAP_INSUFFICIENT_ACCESS;
-            goto free_and_return;
+            goto done;
         }
 
         filter_enctypes(krbcfg, kenctypes, &num_kenctypes);
@@ -1640,7 +1644,7 @@ static int ipapwd_getkeytab(Slapi_PBlock *pb, struct ipapwd_krbcfg *krbcfg)
             LOG_FATAL("keyset filtering rejected all proposed keys\n");
             err_msg = "All enctypes provided are unsupported";
             rc = LDAP_UNWILLING_TO_PERFORM;
-            goto free_and_return;
+            goto done;
         }
 
         /* only target is used, leave everything else NULL,
@@ -1658,18 +1662,84 @@ static int ipapwd_getkeytab(Slapi_PBlock *pb, struct ipapwd_krbcfg *krbcfg)
             rc = LDAP_OPERATIONS_ERROR;
             LOG_FATAL("encrypt_encode_keys failed!\n");
             err_msg = "Internal error while encrypting keys\n";
-            goto free_and_return;
+            goto done;
         }
 
         rc = store_new_keys(target_entry, service_name, bind_dn, svals,
                             &err_msg);
         if (rc != LDAP_SUCCESS) {
-            goto free_and_return;
+            goto done;
         }
     }
 
     rc = get_decoded_key_data(service_name,
-                              &keys, &num_keys, &mkvno, &err_msg);
+                              _keys, _num_keys, _mkvno, &err_msg);
+
+done:
+    if (rc != LDAP_SUCCESS) {
+        *_err_msg = err_msg;
+    }
+    if (target_entry) slapi_entry_free(target_entry);
+    if (svals) {
+        for (int i = 0; svals[i]; i++) {
+            slapi_value_free(&svals[i]);
+        }
+        free(svals);
+    }
+    return rc;
+}
+
+/* Password Modify Extended operation plugin function */
+static int ipapwd_getkeytab(Slapi_PBlock *pb, struct ipapwd_krbcfg *krbcfg)
+{
+    char *bind_dn = NULL;
+    char *err_msg = NULL;
+    int rc = 0;
+    krb5_context krbctx = krbcfg->krbctx;
+    struct berval *extop_value = NULL;
+    char *service_name = NULL;
+    char *password = NULL;
+    int num_kenctypes = 0;
+    krb5_key_salt_tuple *kenctypes = NULL;
+    int mkvno = 0;
+    int num_keys = 0;
+    krb5_key_data *keys = NULL;
+    struct berval *bvp = NULL;
+    LDAPControl new_ctrl;
+    bool wantold = false;
+
+    /* Get Bind DN */
+    slapi_pblock_get(pb, SLAPI_CONN_DN, &bind_dn);
+
+    /* If the connection is bound anonymously, we must refuse to process
+    * this operation. */
+    if (bind_dn == NULL || *bind_dn == '\0') {
+        /* Refuse the operation because they're bound anonymously */
+        err_msg = "Anonymous Binds are not allowed.\n";
+        rc = LDAP_INSUFFICIENT_ACCESS;
+        goto free_and_return;
+    }
+
+    /* Get the ber value of the extended operation */
+    slapi_pblock_get(pb, SLAPI_EXT_OP_REQ_VALUE, &extop_value);
+    if (!extop_value) {
+        LOG_FATAL("Failed to retrieve extended op value from pblock\n");
+        err_msg = "Failed to retrieve extended operation value\n";
+        rc = LDAP_OPERATIONS_ERROR;
+        goto free_and_return;
+    }
+
+    rc = decode_getkeytab_request(extop_value, &wantold, &service_name,
+                                  &password, &kenctypes, &num_kenctypes,
+                                  &err_msg);
+    if (rc != LDAP_SUCCESS) {
+        goto free_and_return;
+    }
+
+    rc = ipapwd_getkeytab_keys(pb, krbcfg, bind_dn, wantold,
+                               &service_name, password,
+                               kenctypes, num_kenctypes,
+                               &keys, &num_keys, &mkvno, &err_msg);
     if (rc != LDAP_SUCCESS) {
         goto free_and_return;
     }
@@ -1692,19 +1762,148 @@ free_and_return:
     slapi_send_ldap_result(pb, rc, NULL, err_msg, 0, NULL);
 
     /* Free anything that we allocated above */
-    if (krbctx) krb5_free_context(krbctx);
     free(kenctypes);
     free(service_name);
     free(password);
-    if (target_entry) slapi_entry_free(target_entry);
     if (keys) ipa_krb5_free_key_data(keys, num_keys);
-    if (svals) {
-        for (int i = 0; svals[i]; i++) {
-            slapi_value_free(&svals[i]);
+    if (bvp) ber_bvfree(bvp);
+
+    return SLAPI_PLUGIN_EXTENDED_SENT_RESULT;
+}
+
+/* Upper bound on the principals handled by a single batch. All the results,
+ * keys included, are held in memory and returned in one GKBatchReply rather
+ * than streamed with slapi_send_ldap_intermediate(), so the limit bounds
+ * both the memory kept per operation and the time a worker thread is busy.
+ * Clients split larger sets into several batches. */
+#define GETKEYTAB_BATCH_MAX 100
+
+/* Keytab retrieval for many principals at once. Each principal is handled
+ * exactly as a single getkeytab request would, and gets its own result in
+ * the reply; a failure for one principal does not affect the others. */
+static int ipapwd_getkeytab_batch(Slapi_PBlock *pb,
+                                  struct ipapwd_krbcfg *krbcfg)
+{
+    char *bind_dn = NULL;
+    char *err_msg = NULL;
+    int rc = 0;
+    krb5_context krbctx = krbcfg->krbctx;
+    struct berval *extop_value = NULL;
+    struct ipaasn1_getkt_req *reqs = NULL;
+    int nreqs = 0;
+    struct ipaasn1_getkt_res *res = NULL;
+    struct berval bv = { 0 };
+    LDAPControl new_ctrl;
+    int nok = 0;
+    bool ret;
+
+    /* Get Bind DN */
+    slapi_pblock_get(pb, SLAPI_CONN_DN, &bind_dn);
+
+    /* If the connection is bound anonymously, we must refuse to process
+    * this operation. */
+    if (bind_dn == NULL || *bind_dn == '\0') {
+        /* Refuse the operation because they're bound anonymously */
+        err_msg = "Anonymous Binds are not allowed.\n";
+        rc = LDAP_INSUFFICIENT_ACCESS;
+        goto free_and_return;
+    }
+
+    /* Get the ber value of the extended operation */
+    slapi_pblock_get(pb, SLAPI_EXT_OP_REQ_VALUE, &extop_value);
+    if (!extop_value) {
+        LOG_FATAL("Failed to retrieve extended op value from pblock\n");
+        err_msg = "Failed to retrieve extended operation value\n";
+        rc = LDAP_OPERATIONS_ERROR;
+        goto free_and_return;
+    }
+
+    ret = ipaasn1_dec_getkt_batch(extop_value->bv_val, extop_value->bv_len,
+                                  &reqs, &nreqs);
+    if (!ret) {
+        err_msg = "Failed to decode GetKeytab Batch.\n";
+        rc = LDAP_PROTOCOL_ERROR;
+        goto free_and_return;
+    }
+
+    if (nreqs == 0 || nreqs > GETKEYTAB_BATCH_MAX) {
+        err_msg = "Invalid number of principals in GetKeytab Batch.\n";
+        rc = LDAP_UNWILLING_TO_PERFORM;
+        goto free_and_return;
+    }
+
+    res = calloc(nreqs, sizeof(struct ipaasn1_getkt_res));
+    if (!res) {
+        LOG_OOM();
+        err_msg = "Internal Error.\n";
+        rc = LDAP_OPERATIONS_ERROR;
+        goto free_and_return;
+    }
+
+    for (int i = 0; i < nreqs; i++) {
+        krb5_key_salt_tuple *kenctypes = NULL;
+        krb5_key_data *keys = NULL;
+        int num_keys = 0;
+        int mkvno = 0;
+
+        err_msg = NULL;
+
+        if (reqs[i].newkt) {
+            rc = getkeytab_enctypes(reqs[i].etypes, reqs[i].numtypes,
+                                    &kenctypes, &err_msg);
         }
-        free(svals);
+        if (rc == LDAP_SUCCESS) {
+            rc = ipapwd_getkeytab_keys(pb, krbcfg, bind_dn, !reqs[i].newkt,
+                                       &reqs[i].princ, reqs[i].pwd,
+                                       kenctypes, reqs[i].numtypes,
+                                       &keys, &num_keys, &mkvno, &err_msg);
+        }
+        if (rc == LDAP_SUCCESS) {
+            rc = decrypt_key_data(krbctx, krbcfg->kmkey, mkvno,
+                                  keys, num_keys,
+                                  &res[i].kvno, &res[i].keys);
+        }
+
+        LOG("[%s] %s", reqs[i].princ ? reqs[i].princ : "",
+            err_msg ? err_msg : (rc == LDAP_SUCCESS ? "success\n" :
+                                                      "failed\n"));
+        res[i].result = rc;
+        if (rc == LDAP_SUCCESS) nok++;
+
+        free(kenctypes);
+        if (keys) ipa_krb5_free_key_data(keys, num_keys);
+        rc = LDAP_SUCCESS;
     }
-    if (bvp) ber_bvfree(bvp);
+
+    ret = ipaasn1_enc_getkt_batchreply(res, nreqs,
+                                       (void **)&bv.bv_val, &bv.bv_len);
+    if (!ret) {
+        err_msg = "Internal Error.\n";
+        rc = LDAP_OPERATIONS_ERROR;
+        goto free_and_return;
+    }
+
+    new_ctrl.ldctl_oid = KEYTAB_BATCH_OID;
+    new_ctrl.ldctl_value = bv;
+    new_ctrl.ldctl_iscritical = 0;
+    rc = slapi_pblock_set(pb, SLAPI_ADD_RESCONTROL, &new_ctrl);
+
+free_and_return:
+    if (rc == LDAP_SUCCESS) {
+        err_msg = NULL;
+        LOG("batch of %d principals, %d succeeded\n", nreqs, nok);
+    } else {
+        LOG("%s", err_msg ? err_msg : "failed\n");
+    }
+    slapi_send_ldap_result(pb, rc, NULL, err_msg, 0, NULL);
+
+    /* Free anything that we allocated above */
+    for (int i = 0; res && i < nreqs; i++) {
+        free_keys_contents(krbctx, &res[i].keys);
+    }
+    free(res);
+    ipaasn1_free_getkt_reqs(reqs, nreqs);
+    free(bv.bv_val);
 
     return SLAPI_PLUGIN_EXTENDED_SENT_RESULT;
 }
@@ -1751,6 +1950,11 @@ static int ipapwd_extop(Slapi_PBlock *pb)
 		free_ipapwd_krbcfg(&krbcfg);
 		return ret;
 	}
+	if (strcasecmp(oid, KEYTAB_BATCH_OID) == 0) {
+		ret = ipapwd_getkeytab_batch(pb, krbcfg);
+		free_ipapwd_krbcfg(&krbcfg);
+		return ret;
+	}
 
 	errMesg = "Request OID does not match supported OIDs.\n";
 	rc = LDAP_OPERATIONS_ERROR;
@@ -1863,12 +2067,22 @@ static int ipapwd_start( Slapi_PBlock *pb )
 
     ret = LDAP_SUCCESS;
 
+    ipapwd_krbcfg_init();
+
     /* NOTE: We never call otp_config_fini() from a destructor. This is because
      *       it may race with threaded requests at shutdown. This leak should
      *       only occur when the DS is exiting, so it isn't a big deal.
      */
     otp_config = otp_config_init(ipapwd_plugin_id);
 
+    /* Many connections derive key sets at once here, so opt in to the
+     * string-to-key workers. Like otp_config, they are never stopped. */
+    krberr = ipa_krb5_s2k_pool_start(IPA_S2K_MAX_THREADS);
+    if (krberr) {
+        LOG("Could not start all the string-to-key workers [%s]\n",
+            krb5_get_error_message(krbctx, krberr));
+    }
+
 done:
     free(realm);
     krb5_free_context(krbctx);
@@ -1880,6 +2094,7 @@ static char *ipapwd_oid_list[] = {
 	EXOP_PASSWD_OID,
 	KEYTAB_SET_OID,
 	KEYTAB_GET_OID,
+	KEYTAB_BATCH_OID,
 	NULL
 };
 
@@ -1887,6 +2102,7 @@ static char *ipapwd_oid_list[] = {
 static char *ipapwd_name_list[] = {
 	"Password Change Extended Operation",
 	"Keytab Retrieval Extended Operation",
+	"Keytab Batch Retrieval Extended Operation",
 	NULL
 };
 
@@ -0,0 +1,250 @@
+/** BEGIN COPYRIGHT BLOCK
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Additional permission under GPLv3 section 7:
+ *
+ * In the following paragraph, "GPL" means the GNU General Public
+ * License, version 3 or any later version, and "Non-GPL Code" means
+ * code that is governed neither by the GPL nor a license
+ * compatible with the GPL.
+ *
+ * You may link the code of this Program with Non-GPL Code and convey
+ * linked combinations including the two, provided that such Non-GPL
+ * Code only links to the code of this Program through those well
+ * defined interfaces identified in the file named EXCEPTION found in
+ * the source code files (the "Approved Interfaces"). The files of
+ * Non-GPL Code may instantiate templates or use macros or inline
+ * functions from the Approved Interfaces without causing the resulting
+ * work to be covered by the GPL. Only the copyright holders of this
+ * Program may make changes or additions to the list of Approved
+ * Interfaces.
+ *
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ * All rights reserved.
+ * END COPYRIGHT BLOCK **/
+
+/*
+ * String-to-key benchmark.
+ *
+ * Times ipa_krb5_generate_key_data() for a password and the first 1 to 6
+ * enctypes of the default IPA list, once with every key derived in the
+ * calling thread (as in the KDC and ipa-sam) and once with the
+ * string-to-key workers that ipa-pwd-extop starts. CALLERS threads call it
+ * at the same time, like concurrent password changes or keytab requests.
+ *
+ *   ipa_s2k_bench [-n ITERATIONS] [-c CALLERS] [-w WORKERS]
+ *
+ * Prints the wall clock time per key set and the speedup of the workers
+ * for each number of keys. Note that the workers are capped at one less
+ * than the number of online CPUs, so on a single CPU both columns time the
+ * serial path.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ipa_krb5.h"
+
+#define BENCH_PRINC "host/bench.ipa.test@IPA.TEST"
+#define BENCH_PWD "Secret123-Secret123"
+
+/* The default enctypes of an IPA realm, most expensive first. */
+static krb5_key_salt_tuple bench_encsalts[] = {
+    { ENCTYPE_AES256_CTS_HMAC_SHA1_96, KRB5_KDB_SALTTYPE_SPECIAL },
+    { ENCTYPE_AES128_CTS_HMAC_SHA1_96, KRB5_KDB_SALTTYPE_SPECIAL },
+    { ENCTYPE_CAMELLIA256_CTS_CMAC, KRB5_KDB_SALTTYPE_SPECIAL },
+    { ENCTYPE_CAMELLIA128_CTS_CMAC, KRB5_KDB_SALTTYPE_SPECIAL },
+    { ENCTYPE_DES3_CBC_SHA1, KRB5_KDB_SALTTYPE_SPECIAL },
+    { ENCTYPE_ARCFOUR_HMAC, KRB5_KDB_SALTTYPE_SPECIAL },
+};
+
+#define BENCH_MAX_KEYS \
+    (int)(sizeof(bench_encsalts) / sizeof(bench_encsalts[0]))
+
+struct bench_caller {
+    pthread_t tid;
+    int num_keys;
+    int iterations;
+    krb5_keyblock *kmkey;
+    krb5_error_code kerr;
+};
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void *bench_call(void *arg)
+{
+    struct bench_caller *c = arg;
+    krb5_context krbctx;
+    krb5_principal princ;
+    krb5_key_data *keys;
+    krb5_data pwd;
+    int num_keys;
+    int i;
+
+    c->kerr = krb5_init_context(&krbctx);
+    if (c->kerr) {
+        return NULL;
+    }
+
+    c->kerr = krb5_parse_name(krbctx, BENCH_PRINC, &princ);
+    if (c->kerr) {
+        krb5_free_context(krbctx);
+        return NULL;
+    }
+
+    pwd.data = BENCH_PWD;
+    pwd.length = strlen(BENCH_PWD);
+
+    for (i = 0; i < c->iterations && !c->kerr; i++) {
+        c->kerr = ipa_krb5_generate_key_data(krbctx, princ, pwd, 1,
+                                             c->kmkey, c->num_keys,
+                                             bench_encsalts,
+                                             &num_keys, &keys);
+        if (!c->kerr) {
+            ipa_krb5_free_key_data(keys, num_keys);
+        }
+    }
+
+    krb5_free_principal(krbctx, princ);
+    krb5_free_context(krbctx);
+    return NULL;
+}
+
+/* Returns the wall clock time per key set in ms, or -1 on error. */
+static double bench_run(int num_keys, int num_callers, int iterations,
+                        krb5_keyblock *kmkey)
+{
+    struct bench_caller *callers;
+    double start, ms;
+    int i;
+
+    callers = calloc(num_callers, sizeof(struct bench_caller));
+    if (!callers) {
+        return -1;
+    }
+
+    start = now_ms();
+    for (i = 0; i < num_callers; i++) {
+        callers[i].num_keys = num_keys;
+        callers[i].iterations = iterations;
+        callers[i].kmkey = kmkey;
+        if (pthread_create(&callers[i].tid, NULL,
+                           bench_call, &callers[i]) != 0) {
+            callers[i].kerr = errno;
+            num_callers = i;
+            break;
+        }
+    }
+    for (i = 0; i < num_callers; i++) {
+        pthread_join(callers[i].tid, NULL);
+    }
+    ms = (now_ms() - start) / ((double)iterations * num_callers);
+
+    for (i = 0; i < num_callers; i++) {
+        if (callers[i].kerr) {
+            fprintf(stderr, "key generation failed: %d\n", callers[i].kerr);
+            ms = -1;
+        }
+    }
+
+    free(callers);
+    return ms;
+}
+
+int main(int argc, char *argv[])
+{
+    krb5_context krbctx;
+    krb5_keyblock kmkey;
+    krb5_error_code kerr;
+    int iterations = 20;
+    int num_callers = 1;
+    int num_workers = IPA_S2K_MAX_THREADS;
+    double serial = 0, pooled = 0;
+    int opt;
+    int k;
+
+    while ((opt = getopt(argc, argv, "n:c:w:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 'c':
+            num_callers = atoi(optarg);
+            break;
+        case 'w':
+            num_workers = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n ITERATIONS] [-c CALLERS] "
+                            "[-w WORKERS]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (iterations < 1 || num_callers < 1 || num_workers < 1) {
+        fprintf(stderr, "ITERATIONS, CALLERS and WORKERS must be > 0\n");
+        return 1;
+    }
+
+    kerr = krb5_init_context(&krbctx);
+    if (kerr) {
+        fprintf(stderr, "krb5_init_context failed: %d\n", kerr);
+        return 1;
+    }
+    kerr = krb5_c_make_random_key(krbctx, ENCTYPE_AES256_CTS_HMAC_SHA1_96,
+                                  &kmkey);
+    if (kerr) {
+        fprintf(stderr, "krb5_c_make_random_key failed: %d\n", kerr);
+        krb5_free_context(krbctx);
+        return 1;
+    }
+
+    printf("%ld CPUs, %d callers, %d workers requested, %d iterations\n",
+           sysconf(_SC_NPROCESSORS_ONLN), num_callers, num_workers,
+           iterations);
+    printf("%4s %14s %14s %8s\n", "keys", "serial ms/set", "pool ms/set",
+           "speedup");
+
+    for (k = 1; k <= BENCH_MAX_KEYS; k++) {
+        serial = bench_run(k, num_callers, iterations, &kmkey);
+
+        kerr = ipa_krb5_s2k_pool_start(num_workers);
+        if (kerr) {
+            fprintf(stderr, "ipa_krb5_s2k_pool_start failed: %d\n", kerr);
+        }
+        pooled = bench_run(k, num_callers, iterations, &kmkey);
+        ipa_krb5_s2k_pool_stop();
+
+        if (serial < 0 || pooled < 0) {
+            break;
+        }
+        printf("%4d %14.3f %14.3f %7.2fx\n", k, serial, pooled,
+               serial / pooled);
+    }
+
+    krb5_free_keyblock_contents(krbctx, &kmkey);
+    krb5_free_context(krbctx);
+    return (serial < 0 || pooled < 0) ? 1 : 0;
+}
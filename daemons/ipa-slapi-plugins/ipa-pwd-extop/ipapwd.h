@@ -109,6 +109,9 @@ struct ipapwd_krbcfg {
     char **passsync_mgrs;
     int num_passsync_mgrs;
     bool allow_nt_hash;
+    /* private: the shared instance this view refers to */
+    struct ipapwd_krbcfg *shared;
+    int refcount;
 };
 
 int ipapwd_entry_checks(Slapi_PBlock *pb, struct slapi_entry *e,
@@ -129,6 +132,8 @@ int ipapwd_set_extradata(const char *dn,
                          time_t unixtime);
 void ipapwd_free_slapi_value_array(Slapi_Value ***svals);
 void free_ipapwd_krbcfg(struct ipapwd_krbcfg **cfg);
+void ipapwd_krbcfg_init(void);
+void ipapwd_krbcfg_update(Slapi_PBlock *pb);
 
 /* from encoding.c */
 struct ipapwd_keyset {
@@ -62,6 +62,7 @@
 
 #include "ipapwd.h"
 #include "util.h"
+#include "ipa_bind_cache.h"
 #include "syncreq.h"
 
 #define IPAPWD_OP_NULL 0
@@ -971,10 +972,11 @@ static int ipapwd_regen_nthash(Slapi_PBlock *pb, Slapi_Mods *smods,
 static int ipapwd_post_updatecfg(Slapi_PBlock *pb)
 {
     otp_config_update(otp_config, pb);
+    ipapwd_krbcfg_update(pb);
     return 0;
 }
 
-static int ipapwd_post_modadd(Slapi_PBlock *pb)
+static int ipapwd_post_modadd_common(Slapi_PBlock *pb, bool betxn)
 {
     void *op;
     struct ipapwd_operation *pwdop = NULL;
@@ -990,7 +992,13 @@ static int ipapwd_post_modadd(Slapi_PBlock *pb)
 
     LOG_TRACE("=>\n");
 
-    otp_config_update(otp_config, pb);
+    /* The token index must only see committed changes, so within the
+     * transaction it is left to the regular post-op. */
+    if (betxn)
+        otp_config_update_betxn(otp_config, pb);
+    else
+        otp_config_update(otp_config, pb);
+    ipapwd_krbcfg_update(pb);
 
     /* time to get the operation handler */
     ret = slapi_pblock_get(pb, SLAPI_OPERATION, &op);
@@ -1229,6 +1237,7 @@ static void ipapwd_write_krb_keys(Slapi_PBlock *pb, char *dn,
     struct ipapwd_data pwdata;
     Slapi_Value *objectclass;
     Slapi_Attr *attr = NULL;
+    Slapi_Entry *copy = NULL;
     char *principal = NULL;
     struct tm expire_tm;
     char *expire = NULL;
@@ -1264,11 +1273,14 @@ static void ipapwd_write_krb_keys(Slapi_PBlock *pb, char *dn,
         goto done;
     }
 
+    /* the entry may be shared with other plugins, work on a copy */
+    copy = slapi_entry_dup(entry);
+
     /* delete userPassword - a new one will be generated later */
     /* this is needed, otherwise ipapwd_CheckPolicy will think
      * we're changing the password to its previous value
      * and force a password change on next login  */
-    ret = slapi_entry_attr_delete(entry, SLAPI_USERPWD_ATTR);
+    ret = slapi_entry_attr_delete(copy, SLAPI_USERPWD_ATTR);
     if (ret) {
         LOG_FATAL("failed to delete " SLAPI_USERPWD_ATTR "\n");
         goto done;
@@ -1277,7 +1289,7 @@ static void ipapwd_write_krb_keys(Slapi_PBlock *pb, char *dn,
     /* prepare data for kerberos key generation */
     memset(&pwdata, 0, sizeof (pwdata));
     pwdata.dn = dn;
-    pwdata.target = entry;
+    pwdata.target = copy;
     pwdata.password = credentials->bv_val;
     pwdata.timeNow = time(NULL);
     pwdata.changetype = IPA_CHANGETYPE_NORMAL;
@@ -1321,6 +1333,7 @@ static void ipapwd_write_krb_keys(Slapi_PBlock *pb, char *dn,
 done:
     slapi_ch_free_string(&principal);
     slapi_ch_free_string(&expire);
+    slapi_entry_free(copy);
     free_ipapwd_krbcfg(&krbcfg);
 }
 
@@ -1343,6 +1356,7 @@ static int ipapwd_pre_bind(Slapi_PBlock *pb)
     };
     struct berval *credentials = NULL;
     Slapi_Entry *entry = NULL;
+    bool shared = false;
     char *dn = NULL;
     int method = 0;
     bool syncreq;
@@ -1365,8 +1379,13 @@ static int ipapwd_pre_bind(Slapi_PBlock *pb)
     if (method != LDAP_AUTH_SIMPLE || credentials->bv_len == 0)
         return 0;
 
-    /* Retrieve the user's entry. */
-    ret = ipapwd_getEntry(dn, &entry, (char **) attrs_list);
+    /* Retrieve the user's entry, reusing the one read for ipa-lockout. */
+    ret = ipa_bind_cache_get_entry(pb, dn, &entry);
+    if (ret == LDAP_SUCCESS) {
+        shared = true;
+    } else if (ret == LDAP_UNAVAILABLE) {
+        ret = ipapwd_getEntry(dn, &entry, (char **) attrs_list);
+    }
     if (ret) {
         LOG("failed to retrieve user entry: %s\n", dn);
         return 0;
@@ -1392,7 +1411,7 @@ static int ipapwd_pre_bind(Slapi_PBlock *pb)
 
             if (current_time > expire_time && expire_time > 0) {
                 LOG_FATAL("kerberos principal in %s is expired\n", dn);
-                slapi_entry_free(entry);
+                if (!shared) slapi_entry_free(entry);
                 slapi_send_ldap_result(pb, LDAP_UNWILLING_TO_PERFORM, NULL,
                                        "Account (Kerberos principal) is expired",
                                         0, NULL);
@@ -1413,7 +1432,7 @@ static int ipapwd_pre_bind(Slapi_PBlock *pb)
     /* Authenticate the user. */
     ret = ipapwd_authenticate(dn, entry, credentials);
     if (ret) {
-        slapi_entry_free(entry);
+        if (!shared) slapi_entry_free(entry);
         return 0;
     }
 
@@ -1424,11 +1443,11 @@ static int ipapwd_pre_bind(Slapi_PBlock *pb)
     /* Attempt to write out kerberos keys for the user. */
     ipapwd_write_krb_keys(pb, dn, entry, credentials);
 
-    slapi_entry_free(entry);
+    if (!shared) slapi_entry_free(entry);
     return 0;
 
 invalid_creds:
-    slapi_entry_free(entry);
+    if (!shared) slapi_entry_free(entry);
     slapi_send_ldap_result(pb, LDAP_INVALID_CREDENTIALS,
                            NULL, NULL, 0, NULL);
     return 1;
@@ -1462,6 +1481,16 @@ int ipapwd_pre_init_betxn(Slapi_PBlock *pb)
     return ret;
 }
 
+static int ipapwd_post_modadd(Slapi_PBlock *pb)
+{
+    return ipapwd_post_modadd_common(pb, false);
+}
+
+static int ipapwd_post_modadd_betxn(Slapi_PBlock *pb)
+{
+    return ipapwd_post_modadd_common(pb, true);
+}
+
 /* Init post ops */
 int ipapwd_post_init(Slapi_PBlock *pb)
 {
@@ -1496,8 +1525,8 @@ int ipapwd_post_init_betxn(Slapi_PBlock *pb)
 
     ret = slapi_pblock_set(pb, SLAPI_PLUGIN_VERSION, SLAPI_PLUGIN_VERSION_01);
     if (!ret) ret = slapi_pblock_set(pb, SLAPI_PLUGIN_DESCRIPTION, (void *)&ipapwd_plugin_desc);
-    if (!ret) ret = slapi_pblock_set(pb, SLAPI_PLUGIN_BE_TXN_POST_ADD_FN, (void *)ipapwd_post_modadd);
-    if (!ret) ret = slapi_pblock_set(pb, SLAPI_PLUGIN_BE_TXN_POST_MODIFY_FN, (void *)ipapwd_post_modadd);
+    if (!ret) ret = slapi_pblock_set(pb, SLAPI_PLUGIN_BE_TXN_POST_ADD_FN, (void *)ipapwd_post_modadd_betxn);
+    if (!ret) ret = slapi_pblock_set(pb, SLAPI_PLUGIN_BE_TXN_POST_MODIFY_FN, (void *)ipapwd_post_modadd_betxn);
 
     return ret;
 }
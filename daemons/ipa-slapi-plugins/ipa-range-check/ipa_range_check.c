@@ -43,6 +43,8 @@
 #include <stdio.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
 #include <dirsrv/slapi-plugin.h>
 
 #include "util.h"
@@ -74,11 +76,18 @@ Slapi_PluginDesc ipa_range_check_plugin_desc = {
     IPA_RANGE_CHECK_PLUGIN_DESC
 };
 
+struct range_cache;
+
 struct ipa_range_check_ctx {
     Slapi_ComponentId *plugin_id;
     const char *base_dn;
+    struct range_cache *cache;
 };
 
+/* The post-op callbacks are registered as separate plugins and do not get
+ * our SLAPI_PLUGIN_PRIVATE. */
+static struct ipa_range_check_ctx *global_range_check_ctx;
+
 typedef enum {
     RANGE_CHECK_OK,
     RANGE_CHECK_BASE_OVERLAP,
@@ -462,6 +471,533 @@ static range_check_result_t check_ranges(struct range_info *r1, struct range_inf
     return RANGE_CHECK_OK;
 }
 
+/*
+ * Augmented interval tree: a treap ordered by the start of the intervals in
+ * which every node also carries the largest end found in its subtree. This
+ * allows to find all intervals overlapping a given one in O(log n + k)
+ * instead of comparing against every known range. Intervals are half-open
+ * [start, end) and 64bit wide so that base + size cannot wrap around.
+ */
+struct interval_node {
+    uint64_t start;
+    uint64_t end;
+    uint64_t max_end;
+    long prio;
+    struct range_info *range;
+    struct interval_node *left;
+    struct interval_node *right;
+};
+
+typedef range_check_result_t (interval_cb)(struct range_info *range,
+                                           void *data);
+
+static uint64_t interval_max_end(struct interval_node *node)
+{
+    return node == NULL ? 0 : node->max_end;
+}
+
+static void interval_update(struct interval_node *node)
+{
+    node->max_end = node->end;
+    if (interval_max_end(node->left) > node->max_end) {
+        node->max_end = node->left->max_end;
+    }
+    if (interval_max_end(node->right) > node->max_end) {
+        node->max_end = node->right->max_end;
+    }
+}
+
+static struct interval_node *interval_rotate_right(struct interval_node *node)
+{
+    struct interval_node *left = node->left;
+
+    node->left = left->right;
+    left->right = node;
+    interval_update(node);
+    interval_update(left);
+
+    return left;
+}
+
+static struct interval_node *interval_rotate_left(struct interval_node *node)
+{
+    struct interval_node *right = node->right;
+
+    node->right = right->left;
+    right->left = node;
+    interval_update(node);
+    interval_update(right);
+
+    return right;
+}
+
+/* Nodes are ordered by start, ties are broken by the range they belong to */
+static int interval_cmp(uint64_t start, struct range_info *range,
+                        struct interval_node *node)
+{
+    if (start != node->start) {
+        return start < node->start ? -1 : 1;
+    }
+
+    if (range != node->range) {
+        return (uintptr_t) range < (uintptr_t) node->range ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static struct interval_node *interval_new(uint32_t base, uint32_t size,
+                                          struct range_info *range)
+{
+    struct interval_node *node;
+
+    node = calloc(1, sizeof(struct interval_node));
+    if (node == NULL) {
+        return NULL;
+    }
+
+    node->start = base;
+    node->end = (uint64_t) base + size;
+    node->max_end = node->end;
+    node->prio = random();
+    node->range = range;
+
+    return node;
+}
+
+static struct interval_node *interval_insert(struct interval_node *root,
+                                             struct interval_node *node)
+{
+    if (root == NULL) {
+        return node;
+    }
+
+    if (interval_cmp(node->start, node->range, root) < 0) {
+        root->left = interval_insert(root->left, node);
+        if (root->left->prio > root->prio) {
+            return interval_rotate_right(root);
+        }
+    } else {
+        root->right = interval_insert(root->right, node);
+        if (root->right->prio > root->prio) {
+            return interval_rotate_left(root);
+        }
+    }
+
+    interval_update(root);
+    return root;
+}
+
+static struct interval_node *interval_remove(struct interval_node *root,
+                                             uint64_t start,
+                                             struct range_info *range)
+{
+    struct interval_node *child;
+    int cmp;
+
+    if (root == NULL) {
+        return NULL;
+    }
+
+    cmp = interval_cmp(start, range, root);
+    if (cmp < 0) {
+        root->left = interval_remove(root->left, start, range);
+    } else if (cmp > 0) {
+        root->right = interval_remove(root->right, start, range);
+    } else if (root->left == NULL || root->right == NULL) {
+        child = root->left != NULL ? root->left : root->right;
+        free(root);
+        return child;
+    } else if (root->left->prio > root->right->prio) {
+        root = interval_rotate_right(root);
+        root->right = interval_remove(root->right, start, range);
+    } else {
+        root = interval_rotate_left(root);
+        root->left = interval_remove(root->left, start, range);
+    }
+
+    interval_update(root);
+    return root;
+}
+
+/* Calls cb for every interval overlapping [start, end) and stops at the
+ * first result which is not RANGE_CHECK_OK. */
+static range_check_result_t interval_query(struct interval_node *root,
+                                           uint64_t start, uint64_t end,
+                                           interval_cb *cb, void *data)
+{
+    range_check_result_t res;
+
+    /* nothing in this subtree ends after the start of the query */
+    if (root == NULL || root->max_end <= start) {
+        return RANGE_CHECK_OK;
+    }
+
+    res = interval_query(root->left, start, end, cb, data);
+    if (res != RANGE_CHECK_OK) {
+        return res;
+    }
+
+    /* this node and everything right of it starts after the query */
+    if (root->start >= end) {
+        return RANGE_CHECK_OK;
+    }
+
+    if (root->end > start) {
+        res = cb(root->range, data);
+        if (res != RANGE_CHECK_OK) {
+            return res;
+        }
+    }
+
+    return interval_query(root->right, start, end, cb, data);
+}
+
+static void interval_free(struct interval_node *root)
+{
+    if (root != NULL) {
+        interval_free(root->left);
+        interval_free(root->right);
+        free(root);
+    }
+}
+
+/*
+ * In-memory copy of all ID ranges and of the domain to forest root map. It
+ * is loaded by the first check and afterwards kept current by the post-op
+ * callbacks, so checking a new range does not need any searches. Base IDs
+ * must not overlap globally while RID and type constraints only apply
+ * within a domain, hence the ranges are grouped per domain with a RID tree
+ * for each group.
+ */
+struct range_group {
+    char *domain_id;                /* NULL for local ranges */
+    struct range_info **ranges;
+    size_t count;
+    struct interval_node *rids;     /* primary and secondary RID intervals */
+    struct range_group *next;
+};
+
+struct range_cache {
+    pthread_rwlock_t lock;
+    bool loaded;
+    struct domain_info *domains;
+    struct interval_node *bases;
+    struct range_group *groups;
+};
+
+static bool same_domain(const char *d1, const char *d2)
+{
+    return (d1 == NULL && d2 == NULL) ||
+           (d1 != NULL && d2 != NULL && strcasecmp(d1, d2) == 0);
+}
+
+static struct range_group *range_cache_group(struct range_cache *cache,
+                                             const char *domain_id,
+                                             bool create)
+{
+    struct range_group *group;
+
+    for (group = cache->groups; group != NULL; group = group->next) {
+        if (same_domain(group->domain_id, domain_id)) {
+            return group;
+        }
+    }
+
+    if (!create) {
+        return NULL;
+    }
+
+    group = calloc(1, sizeof(struct range_group));
+    if (group == NULL) {
+        return NULL;
+    }
+    group->domain_id = slapi_ch_strdup(domain_id);
+    group->next = cache->groups;
+    cache->groups = group;
+
+    return group;
+}
+
+static void range_cache_clear(struct range_cache *cache)
+{
+    struct range_group *group;
+    struct domain_info *domain;
+    size_t c;
+
+    while (cache->groups != NULL) {
+        group = cache->groups;
+        cache->groups = group->next;
+
+        for (c = 0; c < group->count; c++) {
+            free_range_info(group->ranges[c]);
+        }
+        free(group->ranges);
+        interval_free(group->rids);
+        slapi_ch_free_string(&group->domain_id);
+        free(group);
+    }
+
+    while (cache->domains != NULL) {
+        domain = cache->domains;
+        cache->domains = domain->next;
+        free_domain_info(domain);
+    }
+
+    interval_free(cache->bases);
+    cache->bases = NULL;
+    cache->loaded = false;
+}
+
+/* Takes ownership of range on success */
+static int range_cache_add(struct range_cache *cache, struct range_info *range)
+{
+    struct range_group *group;
+    struct range_info **ranges;
+    struct interval_node *base = NULL;
+    struct interval_node *rid = NULL;
+    struct interval_node *secondary_rid = NULL;
+
+    group = range_cache_group(cache, range->domain_id, true);
+    if (group == NULL) {
+        return ENOMEM;
+    }
+
+    ranges = realloc(group->ranges,
+                     (group->count + 1) * sizeof(struct range_info *));
+    if (ranges == NULL) {
+        return ENOMEM;
+    }
+    group->ranges = ranges;
+
+    base = interval_new(range->base_id, range->id_range_size, range);
+    if (range->base_rid_set) {
+        rid = interval_new(range->base_rid, range->id_range_size, range);
+    }
+    if (range->secondary_base_rid_set) {
+        secondary_rid = interval_new(range->secondary_base_rid,
+                                     range->id_range_size, range);
+    }
+    if (base == NULL || (range->base_rid_set && rid == NULL) ||
+        (range->secondary_base_rid_set && secondary_rid == NULL)) {
+        free(base);
+        free(rid);
+        free(secondary_rid);
+        return ENOMEM;
+    }
+
+    cache->bases = interval_insert(cache->bases, base);
+    if (rid != NULL) {
+        group->rids = interval_insert(group->rids, rid);
+    }
+    if (secondary_rid != NULL) {
+        group->rids = interval_insert(group->rids, secondary_rid);
+    }
+    group->ranges[group->count++] = range;
+
+    return 0;
+}
+
+static int range_cache_remove(struct range_cache *cache,
+                              const char *domain_id, const char *name)
+{
+    struct range_group *group;
+    struct range_info *range;
+    size_t c;
+
+    group = range_cache_group(cache, domain_id, false);
+    if (group == NULL) {
+        return ENOENT;
+    }
+
+    for (c = 0; c < group->count; c++) {
+        if (strcasecmp(group->ranges[c]->name, name) == 0) {
+            break;
+        }
+    }
+    if (c == group->count) {
+        return ENOENT;
+    }
+    range = group->ranges[c];
+
+    cache->bases = interval_remove(cache->bases, range->base_id, range);
+    if (range->base_rid_set) {
+        group->rids = interval_remove(group->rids, range->base_rid, range);
+    }
+    if (range->secondary_base_rid_set) {
+        group->rids = interval_remove(group->rids,
+                                      range->secondary_base_rid, range);
+    }
+
+    group->ranges[c] = group->ranges[--group->count];
+    free_range_info(range);
+
+    return 0;
+}
+
+/* Must be called with the write lock held */
+static int range_cache_load(struct ipa_range_check_ctx *ctx)
+{
+    struct range_cache *cache = ctx->cache;
+    Slapi_PBlock *search_pb = NULL;
+    Slapi_Entry **search_entries = NULL;
+    struct range_info *range;
+    int search_result;
+    size_t c;
+    int ret;
+
+    LOG("Loading ID ranges\n");
+
+    /* build a linked list of domain_info structs */
+    ret = build_domain_to_forest_root_map(&cache->domains, ctx);
+    if (ret != 0) {
+        LOG_FATAL("Building of domain forest root domain map failed.\n");
+        goto done;
+    }
+
+    search_pb = slapi_pblock_new();
+    if (search_pb == NULL) {
+        LOG_FATAL("Failed to create new pblock.\n");
+        ret = LDAP_OPERATIONS_ERROR;
+        goto done;
+    }
+
+    slapi_search_internal_set_pb(search_pb, ctx->base_dn,
+                                 LDAP_SCOPE_SUBTREE, RANGES_FILTER,
+                                 NULL, 0, NULL, NULL, ctx->plugin_id, 0);
+
+    ret = slapi_search_internal_pb(search_pb);
+    if (ret != 0) {
+        LOG_FATAL("Starting internal search failed.\n");
+        goto done;
+    }
+
+    ret = slapi_pblock_get(search_pb, SLAPI_PLUGIN_INTOP_RESULT, &search_result);
+    if (ret != 0 || search_result != LDAP_SUCCESS) {
+        LOG_FATAL("Internal search failed.\n");
+        ret = LDAP_OPERATIONS_ERROR;
+        goto done;
+    }
+
+    ret = slapi_pblock_get(search_pb, SLAPI_PLUGIN_INTOP_SEARCH_ENTRIES,
+                           &search_entries);
+    if (ret != 0) {
+        LOG_FATAL("Failed to read searched entries.\n");
+        goto done;
+    }
+
+    for (c = 0; search_entries != NULL && search_entries[c] != NULL; c++) {
+        ret = slapi_entry_to_range_info(cache->domains, search_entries[c],
+                                        &range);
+        if (ret != 0) {
+            LOG_FATAL("Failed to convert LDAP entry to range struct.\n");
+            goto done;
+        }
+
+        ret = range_cache_add(cache, range);
+        if (ret != 0) {
+            LOG_FATAL("Failed to add range to cache.\n");
+            free_range_info(range);
+            goto done;
+        }
+    }
+
+    cache->loaded = true;
+    ret = 0;
+
+done:
+    slapi_free_search_results_internal(search_pb);
+    slapi_pblock_destroy(search_pb);
+    if (ret != 0) {
+        range_cache_clear(cache);
+    }
+
+    return ret;
+}
+
+/* Returns with the read lock held if the cache could be loaded */
+static int range_cache_rdlock(struct ipa_range_check_ctx *ctx)
+{
+    struct range_cache *cache = ctx->cache;
+    int ret = 0;
+
+    pthread_rwlock_rdlock(&cache->lock);
+    while (!cache->loaded) {
+        pthread_rwlock_unlock(&cache->lock);
+
+        pthread_rwlock_wrlock(&cache->lock);
+        if (!cache->loaded) {
+            ret = range_cache_load(ctx);
+        }
+        pthread_rwlock_unlock(&cache->lock);
+        if (ret != 0) {
+            return ret;
+        }
+
+        pthread_rwlock_rdlock(&cache->lock);
+    }
+
+    return 0;
+}
+
+static range_check_result_t check_candidate(struct range_info *range,
+                                            void *data)
+{
+    return check_ranges(data, range);
+}
+
+/* Only ranges which share an interval with the new range or belong to the
+ * same domain can violate one of the constraints of check_ranges(). */
+static range_check_result_t range_cache_check(struct range_cache *cache,
+                                              struct range_info *new_range)
+{
+    struct range_group *group;
+    range_check_result_t res;
+    size_t c;
+
+    res = interval_query(cache->bases, new_range->base_id,
+                         (uint64_t) new_range->base_id +
+                                    new_range->id_range_size,
+                         check_candidate, new_range);
+    if (res != RANGE_CHECK_OK) {
+        return res;
+    }
+
+    group = range_cache_group(cache, new_range->domain_id, false);
+    if (group == NULL) {
+        return RANGE_CHECK_OK;
+    }
+
+    for (c = 0; c < group->count; c++) {
+        if (strcasecmp(new_range->id_range_type,
+                       group->ranges[c]->id_range_type) != 0) {
+            res = check_ranges(new_range, group->ranges[c]);
+            if (res != RANGE_CHECK_OK) {
+                return res;
+            }
+        }
+    }
+
+    if (new_range->base_rid_set) {
+        res = interval_query(group->rids, new_range->base_rid,
+                             (uint64_t) new_range->base_rid +
+                                        new_range->id_range_size,
+                             check_candidate, new_range);
+        if (res != RANGE_CHECK_OK) {
+            return res;
+        }
+    }
+
+    if (new_range->secondary_base_rid_set) {
+        res = interval_query(group->rids, new_range->secondary_base_rid,
+                             (uint64_t) new_range->secondary_base_rid +
+                                        new_range->id_range_size,
+                             check_candidate, new_range);
+    }
+
+    return res;
+}
+
 static int ipa_range_check_start(Slapi_PBlock *pb)
 {
     return 0;
@@ -469,6 +1005,14 @@ static int ipa_range_check_start(Slapi_PBlock *pb)
 
 static int ipa_range_check_close(Slapi_PBlock *pb)
 {
+    struct ipa_range_check_ctx *ctx = global_range_check_ctx;
+
+    if (ctx != NULL) {
+        pthread_rwlock_wrlock(&ctx->cache->lock);
+        range_cache_clear(ctx->cache);
+        pthread_rwlock_unlock(&ctx->cache->lock);
+    }
+
     return 0;
 }
 
@@ -479,19 +1023,13 @@ static int ipa_range_check_pre_op(Slapi_PBlock *pb, int modtype)
     struct slapi_entry *entry = NULL;
     bool free_entry = false;
     struct range_info *new_range = NULL;
-    struct range_info *old_range = NULL;
     const char *dn_str;
     Slapi_DN *dn = NULL;
     struct ipa_range_check_ctx *ctx;
     LDAPMod **mods = NULL;
-    Slapi_PBlock *search_pb = NULL;
-    int search_result;
-    Slapi_Entry **search_entries = NULL;
-    size_t c;
-    int ranges_valid = 0;
+    range_check_result_t ranges_valid = RANGE_CHECK_OK;
     const char *check_attr;
     char *errmsg = NULL;
-    struct domain_info *domain_info_head = NULL;
 
     ret = slapi_pblock_get(pb, SLAPI_IS_REPLICATED_OPERATION, &is_repl_op);
     if (ret != 0) {
@@ -579,120 +1117,63 @@ static int ipa_range_check_pre_op(Slapi_PBlock *pb, int modtype)
             goto done;
     }
 
-    /* build a linked list of domain_info structs */
-    ret = build_domain_to_forest_root_map(&domain_info_head, ctx);
+    ret = range_cache_rdlock(ctx);
     if (ret != 0) {
-        LOG_FATAL("Building of domain forest root domain map failed.\n");
+        LOG_FATAL("Failed to load existing ID ranges.\n");
         goto done;
     }
 
-    ret = slapi_entry_to_range_info(domain_info_head, entry, &new_range);
-    if (ret != 0) {
-        LOG_FATAL("Failed to convert LDAP entry to range struct.\n");
-        goto done;
+    ret = slapi_entry_to_range_info(ctx->cache->domains, entry, &new_range);
+    if (ret == 0) {
+        ranges_valid = range_cache_check(ctx->cache, new_range);
     }
-
-    search_pb = slapi_pblock_new();
-    if (search_pb == NULL) {
-        LOG_FATAL("Failed to create new pblock.\n");
-        ret = LDAP_OPERATIONS_ERROR;
-        goto done;
-    }
-
-    slapi_search_internal_set_pb(search_pb, ctx->base_dn,
-                                 LDAP_SCOPE_SUBTREE, RANGES_FILTER,
-                                 NULL, 0, NULL, NULL, ctx->plugin_id, 0);
-
-    ret = slapi_search_internal_pb(search_pb);
+    pthread_rwlock_unlock(&ctx->cache->lock);
     if (ret != 0) {
-        LOG_FATAL("Starting internal search failed.\n");
-        goto done;
-    }
-
-    ret = slapi_pblock_get(search_pb, SLAPI_PLUGIN_INTOP_RESULT, &search_result);
-    if (ret != 0 || search_result != LDAP_SUCCESS) {
-        LOG_FATAL("Internal search failed.\n");
-        ret = LDAP_OPERATIONS_ERROR;
-        goto done;
-    }
-
-    ret = slapi_pblock_get(search_pb, SLAPI_PLUGIN_INTOP_SEARCH_ENTRIES,
-                           &search_entries);
-    if (ret != 0) {
-        LOG_FATAL("Failed to read searched entries.\n");
+        LOG_FATAL("Failed to convert LDAP entry to range struct.\n");
         goto done;
     }
 
-    if (search_entries == NULL || search_entries[0] == NULL) {
-        LOG("No existing entries.\n");
-        ret = 0;
-        goto done;
-    }
+    if (ranges_valid != RANGE_CHECK_OK) {
+        ret = LDAP_CONSTRAINT_VIOLATION;
 
-    for (c = 0; search_entries[c] != NULL; c++) {
-        ret = slapi_entry_to_range_info(domain_info_head, search_entries[c],
-                                        &old_range);
-        if (ret != 0) {
-            LOG_FATAL("Failed to convert LDAP entry to range struct.\n");
-            goto done;
+        switch (ranges_valid){
+        case RANGE_CHECK_BASE_OVERLAP:
+            errmsg = "New base range overlaps with existing base range.";
+            break;
+        case RANGE_CHECK_PRIMARY_PRIMARY_RID_OVERLAP:
+            errmsg = "New primary rid range overlaps with existing primary rid range.";
+            break;
+        case RANGE_CHECK_SECONDARY_SECONDARY_RID_OVERLAP:
+            errmsg = "New secondary rid range overlaps with existing secondary rid range.";
+            break;
+        case RANGE_CHECK_PRIMARY_SECONDARY_RID_OVERLAP:
+            errmsg = "New primary rid range overlaps with existing secondary rid range.";
+            break;
+        case RANGE_CHECK_SECONDARY_PRIMARY_RID_OVERLAP:
+            errmsg = "New secondary rid range overlaps with existing primary rid range.";
+            break;
+        case RANGE_CHECK_DIFFERENT_TYPE_IN_DOMAIN:
+            errmsg = "New ID range has invalid type. All ranges in the same domain must be of the same type.";
+            break;
+        default:
+            errmsg = "New range overlaps with existing one.";
+            break;
         }
 
-        ranges_valid = check_ranges(new_range, old_range);
-        free_range_info(old_range);
-        old_range = NULL;
-        if (ranges_valid != RANGE_CHECK_OK) {
-            ret = LDAP_CONSTRAINT_VIOLATION;
-
-            switch (ranges_valid){
-            case RANGE_CHECK_BASE_OVERLAP:
-                errmsg = "New base range overlaps with existing base range.";
-                break;
-            case RANGE_CHECK_PRIMARY_PRIMARY_RID_OVERLAP:
-                errmsg = "New primary rid range overlaps with existing primary rid range.";
-                break;
-            case RANGE_CHECK_SECONDARY_SECONDARY_RID_OVERLAP:
-                errmsg = "New secondary rid range overlaps with existing secondary rid range.";
-                break;
-            case RANGE_CHECK_PRIMARY_SECONDARY_RID_OVERLAP:
-                errmsg = "New primary rid range overlaps with existing secondary rid range.";
-                break;
-            case RANGE_CHECK_SECONDARY_PRIMARY_RID_OVERLAP:
-                errmsg = "New secondary rid range overlaps with existing primary rid range.";
-                break;
-            case RANGE_CHECK_DIFFERENT_TYPE_IN_DOMAIN:
-                errmsg = "New ID range has invalid type. All ranges in the same domain must be of the same type.";
-                break;
-            default:
-                errmsg = "New range overlaps with existing one.";
-                break;
-            }
-
-            LOG_FATAL("%s\n",errmsg);
-            goto done;
-        }
+        LOG_FATAL("%s\n",errmsg);
+        goto done;
     }
     LOG("No overlaps found.\n");
 
     ret = 0;
 
 done:
-    slapi_free_search_results_internal(search_pb);
-    slapi_pblock_destroy(search_pb);
     slapi_sdn_free(&dn);
-    free_range_info(old_range);
     free_range_info(new_range);
     if (free_entry) {
         slapi_entry_free(entry);
     }
 
-    /* Remove the domain info linked list from memory */
-    struct domain_info *next;
-    while(domain_info_head) {
-        next = domain_info_head->next;
-        free_domain_info(domain_info_head);
-        domain_info_head = next;
-    }
-
     if (ret != 0) {
         if (errmsg == NULL) {
             errmsg = "Range Check error";
@@ -713,6 +1194,105 @@ static int ipa_range_check_add_pre_op(Slapi_PBlock *pb)
     return ipa_range_check_pre_op(pb, LDAP_CHANGETYPE_ADD);
 }
 
+static bool is_range_entry(Slapi_Entry *entry)
+{
+    return entry != NULL &&
+           slapi_entry_attr_hasvalue(entry, "objectclass", "ipaIDRange");
+}
+
+/* Trusted domains define the forest root of the ranges of their domain */
+static bool is_trusted_domain_entry(Slapi_Entry *entry)
+{
+    Slapi_Attr *attr;
+
+    return entry != NULL && !is_range_entry(entry) &&
+           slapi_entry_attr_find(entry, IPA_DOMAIN_ID, &attr) == 0;
+}
+
+/*
+ * Keeps the cached ranges in sync with the directory. This runs for regular,
+ * replicated and internal operations alike, replicated changes are not
+ * checked but must still be known to later checks.
+ */
+static int ipa_range_check_post_op(Slapi_PBlock *pb)
+{
+    struct ipa_range_check_ctx *ctx = global_range_check_ctx;
+    struct range_cache *cache;
+    Slapi_Entry *old_entry = NULL;
+    Slapi_Entry *new_entry = NULL;
+    struct range_info *range = NULL;
+    char *domain_id;
+    char *name;
+    int oprc;
+    int ret = 0;
+
+    if (ctx == NULL) {
+        return 0;
+    }
+
+    if (slapi_pblock_get(pb, SLAPI_PLUGIN_OPRETURN, &oprc) != 0 || oprc != 0) {
+        return 0;
+    }
+
+    slapi_pblock_get(pb, SLAPI_ENTRY_PRE_OP, &old_entry);
+    slapi_pblock_get(pb, SLAPI_ENTRY_POST_OP, &new_entry);
+
+    if (!is_range_entry(old_entry) && !is_range_entry(new_entry) &&
+        !is_trusted_domain_entry(old_entry) &&
+        !is_trusted_domain_entry(new_entry)) {
+        return 0;
+    }
+
+    cache = ctx->cache;
+    pthread_rwlock_wrlock(&cache->lock);
+
+    /* The next check will load the current state */
+    if (!cache->loaded) {
+        goto done;
+    }
+
+    if (is_trusted_domain_entry(old_entry) ||
+        is_trusted_domain_entry(new_entry)) {
+        LOG("Trusted domain changed, dropping cached ID ranges.\n");
+        range_cache_clear(cache);
+        goto done;
+    }
+
+    if (is_range_entry(old_entry)) {
+        domain_id = slapi_entry_attr_get_charptr(old_entry, IPA_DOMAIN_ID);
+        name = slapi_entry_attr_get_charptr(old_entry, IPA_CN);
+        ret = name == NULL ? EINVAL
+                           : range_cache_remove(cache, domain_id, name);
+        slapi_ch_free_string(&domain_id);
+        slapi_ch_free_string(&name);
+        if (ret != 0) {
+            goto done;
+        }
+    }
+
+    if (is_range_entry(new_entry)) {
+        ret = slapi_entry_to_range_info(cache->domains, new_entry, &range);
+        if (ret != 0) {
+            goto done;
+        }
+
+        ret = range_cache_add(cache, range);
+        if (ret != 0) {
+            free_range_info(range);
+            goto done;
+        }
+    }
+
+done:
+    if (ret != 0) {
+        LOG_FATAL("Failed to update cached ID ranges, dropping them.\n");
+        range_cache_clear(cache);
+    }
+    pthread_rwlock_unlock(&cache->lock);
+
+    return 0;
+}
+
 static int ipa_range_check_init_ctx(Slapi_PBlock *pb,
                                     struct ipa_range_check_ctx **_ctx)
 {
@@ -725,6 +1305,19 @@ static int ipa_range_check_init_ctx(Slapi_PBlock *pb,
         return LDAP_OPERATIONS_ERROR;
     }
 
+    ctx->cache = calloc(1, sizeof(struct range_cache));
+    if (ctx->cache == NULL) {
+        free(ctx);
+        return LDAP_OPERATIONS_ERROR;
+    }
+
+    ret = pthread_rwlock_init(&ctx->cache->lock, NULL);
+    if (ret != 0) {
+        free(ctx->cache);
+        free(ctx);
+        return LDAP_OPERATIONS_ERROR;
+    }
+
     ret = slapi_pblock_get(pb, SLAPI_PLUGIN_IDENTITY, &ctx->plugin_id);
     if ((ret != 0) || (ctx->plugin_id == NULL)) {
         LOG_FATAL("Could not get identity or identity was NULL\n");
@@ -752,6 +1345,8 @@ static int ipa_range_check_init_ctx(Slapi_PBlock *pb,
 
 done:
     if (ret != 0) {
+        pthread_rwlock_destroy(&ctx->cache->lock);
+        free(ctx->cache);
         free(ctx);
     } else {
         *_ctx = ctx;
@@ -760,6 +1355,46 @@ done:
     return ret;
 }
 
+static int ipa_range_check_postop_init(Slapi_PBlock *pb)
+{
+    int ret = 0;
+
+    ret |= slapi_pblock_set(pb, SLAPI_PLUGIN_VERSION,
+                            SLAPI_PLUGIN_VERSION_01);
+    ret |= slapi_pblock_set(pb, SLAPI_PLUGIN_DESCRIPTION,
+                            (void *) &ipa_range_check_plugin_desc);
+    ret |= slapi_pblock_set(pb, SLAPI_PLUGIN_POST_ADD_FN,
+                            (void *) ipa_range_check_post_op);
+    ret |= slapi_pblock_set(pb, SLAPI_PLUGIN_POST_MODIFY_FN,
+                            (void *) ipa_range_check_post_op);
+    ret |= slapi_pblock_set(pb, SLAPI_PLUGIN_POST_MODRDN_FN,
+                            (void *) ipa_range_check_post_op);
+    ret |= slapi_pblock_set(pb, SLAPI_PLUGIN_POST_DELETE_FN,
+                            (void *) ipa_range_check_post_op);
+
+    return ret;
+}
+
+static int ipa_range_check_internal_postop_init(Slapi_PBlock *pb)
+{
+    int ret = 0;
+
+    ret |= slapi_pblock_set(pb, SLAPI_PLUGIN_VERSION,
+                            SLAPI_PLUGIN_VERSION_01);
+    ret |= slapi_pblock_set(pb, SLAPI_PLUGIN_DESCRIPTION,
+                            (void *) &ipa_range_check_plugin_desc);
+    ret |= slapi_pblock_set(pb, SLAPI_PLUGIN_INTERNAL_POST_ADD_FN,
+                            (void *) ipa_range_check_post_op);
+    ret |= slapi_pblock_set(pb, SLAPI_PLUGIN_INTERNAL_POST_MODIFY_FN,
+                            (void *) ipa_range_check_post_op);
+    ret |= slapi_pblock_set(pb, SLAPI_PLUGIN_INTERNAL_POST_MODRDN_FN,
+                            (void *) ipa_range_check_post_op);
+    ret |= slapi_pblock_set(pb, SLAPI_PLUGIN_INTERNAL_POST_DELETE_FN,
+                            (void *) ipa_range_check_post_op);
+
+    return ret;
+}
+
 int ipa_range_check_init(Slapi_PBlock *pb)
 {
     int ret;
@@ -790,5 +1425,22 @@ int ipa_range_check_init(Slapi_PBlock *pb)
         ret = EFAIL;
     }
 
+    if (ret == 0) {
+        global_range_check_ctx = rc_ctx;
+        if (slapi_register_plugin("postoperation", 1,
+                                  "ipa_range_check_init",
+                                  ipa_range_check_postop_init,
+                                  "IPA Range-Check postop", NULL,
+                                  rc_ctx->plugin_id) != 0 ||
+            slapi_register_plugin("internalpostoperation", 1,
+                                  "ipa_range_check_init",
+                                  ipa_range_check_internal_postop_init,
+                                  "IPA Range-Check internal postop", NULL,
+                                  rc_ctx->plugin_id) != 0) {
+            LOG_FATAL("failed to register postop plugins\n");
+            ret = EFAIL;
+        }
+    }
+
     return ret;
 }
@@ -40,6 +40,8 @@
 #ifndef _IPA_SIDGEN_H_
 #define _IPA_SIDGEN_H_
 
+#include <pthread.h>
+
 #define OBJECTCLASS "objectclass"
 #define IPA_OBJECT "ipaobject"
 #define MEP_MANAGED_ENTRY "mepmanagedentry"
@@ -71,6 +73,30 @@ struct range_info {
     uint32_t secondary_base_rid;
 };
 
+#define NSEC_PER_SEC 1000000000UL
+
+#define SIDGEN_QUEUE_SIZE 64
+#define SIDGEN_LATENCY_FACTOR 4
+#define SIDGEN_BASELINE_DECAY 128
+#define SIDGEN_MIN_BACKOFF 1000000UL /* 1ms */
+#define SIDGEN_MAX_BACKOFF NSEC_PER_SEC
+
+struct sidgen_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    Slapi_Entry *entries[SIDGEN_QUEUE_SIZE];
+    size_t head;
+    size_t count;
+    bool done;
+};
+
+struct sidgen_throttle {
+    uint64_t avg_latency;
+    uint64_t baseline;
+    uint64_t backoff;
+};
+
 struct ipa_sidgen_ctx {
     Slapi_ComponentId *plugin_id;
     const char *base_dn;
@@ -105,4 +131,15 @@ int find_sid_for_ldap_entry(struct slapi_entry *entry,
                             const char *base_dn,
                             const char *dom_sid,
                             struct range_info **ranges);
+
+int sidgen_queue_init(struct sidgen_queue *q);
+void sidgen_queue_destroy(struct sidgen_queue *q);
+void sidgen_queue_push(struct sidgen_queue *q, Slapi_Entry *e);
+Slapi_Entry *sidgen_queue_pop(struct sidgen_queue *q);
+void sidgen_queue_done(struct sidgen_queue *q);
+
+uint32_t sidgen_posix_id(bool has_posix_account, bool has_posix_group,
+                         unsigned long uid_number, unsigned long gid_number);
+
+uint64_t sidgen_throttle(struct sidgen_throttle *t, uint64_t latency);
 #endif /* _IPA_SIDGEN_H_ */
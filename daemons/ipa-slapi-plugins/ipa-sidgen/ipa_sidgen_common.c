@@ -294,6 +294,7 @@ done:
 static int find_sid(const char *sid, Slapi_ComponentId *plugin_id,
                     const char *base_dn)
 {
+    char *attrs[] = { LDAP_NO_ATTRS, NULL };
     Slapi_PBlock *search_pb = NULL;
     Slapi_Entry **search_entries = NULL;
     int search_result;
@@ -316,7 +317,7 @@ static int find_sid(const char *sid, Slapi_ComponentId *plugin_id,
 
     slapi_search_internal_set_pb(search_pb, base_dn,
                                  LDAP_SCOPE_SUBTREE, filter,
-                                 NULL, 0, NULL, NULL, plugin_id, 0);
+                                 attrs, 0, NULL, NULL, plugin_id, 0);
 
     ret = slapi_search_internal_pb(search_pb);
     if (ret != 0) {
@@ -0,0 +1,175 @@
+/** BEGIN COPYRIGHT BLOCK
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Additional permission under GPLv3 section 7:
+ *
+ * In the following paragraph, "GPL" means the GNU General Public
+ * License, version 3 or any later version, and "Non-GPL Code" means
+ * code that is governed neither by the GPL nor a license
+ * compatible with the GPL.
+ *
+ * You may link the code of this Program with Non-GPL Code and convey
+ * linked combinations including the two, provided that such Non-GPL
+ * Code only links to the code of this Program through those well
+ * defined interfaces identified in the file named EXCEPTION found in
+ * the source code files (the "Approved Interfaces"). The files of
+ * Non-GPL Code may instantiate templates or use macros or inline
+ * functions from the Approved Interfaces without causing the resulting
+ * work to be covered by the GPL. Only the copyright holders of this
+ * Program may make changes or additions to the list of Approved
+ * Interfaces.
+ *
+ * Copyright (C) 2026 Red Hat, Inc.
+ * All rights reserved.
+ * END COPYRIGHT BLOCK **/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pthread.h>
+#include <dirsrv/slapi-plugin.h>
+
+#include "ipa_sidgen.h"
+
+/* Work distribution of the sidgen task: the search result is streamed into
+ * one bounded queue per worker, entries are assigned to a worker by the
+ * POSIX ID their SID is built from and each worker throttles itself. */
+
+int sidgen_queue_init(struct sidgen_queue *q)
+{
+    int ret;
+
+    q->head = 0;
+    q->count = 0;
+    q->done = false;
+
+    ret = pthread_mutex_init(&q->lock, NULL);
+    if (ret != 0) {
+        return ret;
+    }
+
+    ret = pthread_cond_init(&q->not_empty, NULL);
+    if (ret != 0) {
+        pthread_mutex_destroy(&q->lock);
+        return ret;
+    }
+
+    ret = pthread_cond_init(&q->not_full, NULL);
+    if (ret != 0) {
+        pthread_cond_destroy(&q->not_empty);
+        pthread_mutex_destroy(&q->lock);
+        return ret;
+    }
+
+    return 0;
+}
+
+void sidgen_queue_destroy(struct sidgen_queue *q)
+{
+    pthread_cond_destroy(&q->not_full);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_mutex_destroy(&q->lock);
+}
+
+void sidgen_queue_push(struct sidgen_queue *q, Slapi_Entry *e)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->count == SIDGEN_QUEUE_SIZE) {
+        pthread_cond_wait(&q->not_full, &q->lock);
+    }
+    q->entries[(q->head + q->count) % SIDGEN_QUEUE_SIZE] = e;
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* Returns NULL once the queue is empty and no more entries will come */
+Slapi_Entry *sidgen_queue_pop(struct sidgen_queue *q)
+{
+    Slapi_Entry *e = NULL;
+
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && !q->done) {
+        pthread_cond_wait(&q->not_empty, &q->lock);
+    }
+    if (q->count != 0) {
+        e = q->entries[q->head];
+        q->head = (q->head + 1) % SIDGEN_QUEUE_SIZE;
+        q->count--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return e;
+}
+
+void sidgen_queue_done(struct sidgen_queue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->done = true;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* Returns the POSIX ID find_sid_for_ldap_entry() will build the SID from.
+ * Entries mapping to the same ID, e.g. a user and its user private group,
+ * must be handled by the same worker, otherwise both might pass the
+ * uniqueness check for the primary RID at the same time. */
+uint32_t sidgen_posix_id(bool has_posix_account, bool has_posix_group,
+                         unsigned long uid_number, unsigned long gid_number)
+{
+    if (has_posix_account && uid_number != 0 && gid_number != 0) {
+        return uid_number;
+    } else if (has_posix_group && gid_number != 0) {
+        return gid_number;
+    }
+
+    return (uid_number != 0) ? uid_number : gid_number;
+}
+
+/* Adaptive throttling: the average time needed to add a SID is compared
+ * with a baseline. If the server is getting slower (e.g. replication or
+ * other clients compete for the backend) the worker backs off
+ * exponentially, when it recovers the extra delay is halved again. The
+ * baseline follows a faster average at once and a slower one only
+ * gradually, so a lasting change in latency (a cold cache warming up,
+ * replication catching up) becomes the new baseline after a few dozen
+ * SIDs instead of keeping the worker at the maximum delay for good.
+ * Returns the extra delay in nanoseconds. */
+uint64_t sidgen_throttle(struct sidgen_throttle *t, uint64_t latency)
+{
+    if (t->avg_latency == 0) {
+        t->avg_latency = latency;
+    } else {
+        t->avg_latency = (t->avg_latency * 7 + latency) / 8;
+    }
+
+    if (t->baseline == 0 || t->avg_latency < t->baseline) {
+        t->baseline = t->avg_latency;
+    } else {
+        t->baseline += (t->avg_latency - t->baseline) / SIDGEN_BASELINE_DECAY;
+    }
+
+    if (t->avg_latency > SIDGEN_LATENCY_FACTOR * t->baseline) {
+        if (t->backoff == 0) {
+            t->backoff = SIDGEN_MIN_BACKOFF;
+        } else if (t->backoff < SIDGEN_MAX_BACKOFF) {
+            t->backoff *= 2;
+        }
+    } else {
+        t->backoff /= 2;
+    }
+
+    return t->backoff;
+}
@@ -40,6 +40,8 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
 
 #include <pthread.h>
 #include <dirsrv/slapi-plugin.h>
@@ -47,20 +49,40 @@
 #include "util.h"
 #include "ipa_sidgen.h"
 
-#define NSEC_PER_SEC     1000000000UL
-
+#define SIDGEN_DEFAULT_WORKERS 4
+#define SIDGEN_MAX_WORKERS 16
+#define SIDGEN_REPORT_INTERVAL 10 /* seconds */
 
 #define AT_CN "cn"
 
 Slapi_ComponentId *global_sidgen_plugin_id = NULL;
 
+struct worker_ctx;
+
+struct sidgen_worker {
+    struct worker_ctx *ctx;
+    pthread_t tid;
+    struct sidgen_queue queue;
+    struct sidgen_throttle throttle;
+};
+
 struct worker_ctx {
     long delay;
+    long workers;
     char *base_dn;
     Slapi_ComponentId *plugin_id;
     pthread_t tid;
     char *dom_sid;
     struct range_info **ranges;
+
+    Slapi_Task *task;
+    struct sidgen_worker *pool;
+    int ret;
+    unsigned long total;
+    unsigned long processed;
+    unsigned long percent;
+    time_t start;
+    time_t last_report;
 };
 
 static const char *fetch_attr(Slapi_Entry *e, const char *attrname,
@@ -86,15 +108,247 @@ static void free_pblock(void *arg)
     slapi_pblock_destroy(pb);
 }
 
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void sleep_ns(uint64_t ns)
+{
+    struct timespec ts;
+
+    if (ns == 0) {
+        return;
+    }
+
+    ts.tv_nsec = ns % NSEC_PER_SEC;
+    ts.tv_sec = (ns - ts.tv_nsec) / NSEC_PER_SEC;
+    nanosleep(&ts, NULL);
+}
+
+/* Entries are assigned to the workers by the POSIX ID their SID is built
+ * from, see sidgen_posix_id() */
+static uint32_t entry_id(Slapi_Entry *e)
+{
+    unsigned long uid_number;
+    unsigned long gid_number;
+    char **objectclasses;
+    bool has_posix_account;
+    bool has_posix_group;
+    bool has_ipa_id_object;
+
+    uid_number = slapi_entry_attr_get_ulong(e, UID_NUMBER);
+    gid_number = slapi_entry_attr_get_ulong(e, GID_NUMBER);
+
+    objectclasses = slapi_entry_attr_get_charray(e, OBJECTCLASS);
+    if (get_objectclass_flags(objectclasses, &has_posix_account,
+                              &has_posix_group, &has_ipa_id_object) != 0) {
+        has_posix_account = false;
+        has_posix_group = false;
+    }
+    slapi_ch_array_free(objectclasses);
+
+    return sidgen_posix_id(has_posix_account, has_posix_group,
+                           uid_number, gid_number);
+}
+
+static void *sidgen_worker_thread(void *arg)
+{
+    struct sidgen_worker *w = (struct sidgen_worker *) arg;
+    struct worker_ctx *ctx = w->ctx;
+    Slapi_Entry *e;
+    uint64_t start;
+    int ret;
+
+    while ((e = sidgen_queue_pop(&w->queue)) != NULL) {
+        if (__sync_fetch_and_add(&ctx->ret, 0) == 0) {
+            start = now_ns();
+            ret = find_sid_for_ldap_entry(e, ctx->plugin_id, ctx->base_dn,
+                                          ctx->dom_sid, ctx->ranges);
+            if (ret != 0) {
+                LOG_FATAL("Cannot add SID to existing entry.\n");
+                __sync_bool_compare_and_swap(&ctx->ret, 0, ret);
+            } else {
+                __sync_add_and_fetch(&ctx->processed, 1);
+                sleep_ns(ctx->delay +
+                         sidgen_throttle(&w->throttle, now_ns() - start));
+            }
+        }
+        slapi_entry_free(e);
+    }
+
+    return NULL;
+}
+
+static void report_progress(struct worker_ctx *ctx, bool final)
+{
+    unsigned long processed;
+    unsigned long total;
+    unsigned long percent;
+    time_t now;
+    time_t elapsed;
+    time_t eta;
+
+    now = time(NULL);
+    if (!final && now < ctx->last_report + SIDGEN_REPORT_INTERVAL) {
+        return;
+    }
+    ctx->last_report = now;
+
+    processed = __sync_fetch_and_add(&ctx->processed, 0);
+    total = (ctx->total > processed) ? ctx->total : processed;
+
+    percent = (total == 0) ? 100 : (processed * 100) / total;
+    if (final && ctx->ret == 0) {
+        percent = 100;
+    }
+    for (; ctx->percent < percent; ctx->percent++) {
+        slapi_task_inc_progress(ctx->task);
+    }
+
+    elapsed = now - ctx->start;
+    if (processed == 0 || final) {
+        slapi_task_log_status(ctx->task,
+                              "Added SIDs to %lu of %lu entries in %lds.",
+                              processed, total, (long) elapsed);
+    } else {
+        eta = (time_t) (((double) elapsed) * (total - processed) / processed);
+        slapi_task_log_status(ctx->task,
+                              "Added SIDs to %lu of %lu entries in %lds, "
+                              "about %lds remaining.",
+                              processed, total, (long) elapsed, (long) eta);
+    }
+}
+
+static int count_entry(Slapi_Entry *e, void *cb_data)
+{
+    struct worker_ctx *ctx = (struct worker_ctx *) cb_data;
+
+    ctx->total++;
+
+    return 0;
+}
+
+static int dispatch_entry(Slapi_Entry *e, void *cb_data)
+{
+    struct worker_ctx *ctx = (struct worker_ctx *) cb_data;
+    Slapi_Entry *dup;
+    uint32_t id;
+
+    if (__sync_fetch_and_add(&ctx->ret, 0) != 0) {
+        /* a worker failed, stop the search */
+        return -1;
+    }
+
+    id = entry_id(e);
+    if (id == 0) {
+        /* nothing to do for find_sid_for_ldap_entry() */
+        __sync_add_and_fetch(&ctx->processed, 1);
+    } else {
+        dup = slapi_entry_dup(e);
+        if (dup == NULL) {
+            __sync_bool_compare_and_swap(&ctx->ret, 0, ENOMEM);
+            return -1;
+        }
+        sidgen_queue_push(&ctx->pool[id % ctx->workers].queue, dup);
+    }
+
+    report_progress(ctx, false);
+
+    return 0;
+}
+
+static int search_entries(struct worker_ctx *ctx, Slapi_PBlock *pb,
+                          const char *filter, char **attrs,
+                          plugin_search_entry_callback cb)
+{
+    int ret;
+
+    slapi_search_internal_set_pb(pb, ctx->base_dn, LDAP_SCOPE_SUBTREE,
+                                 filter, attrs, 0, NULL, NULL,
+                                 ctx->plugin_id, 0);
+    ret = slapi_search_internal_callback_pb(pb, ctx, NULL, cb, NULL);
+    if (ret == 0) {
+        slapi_pblock_get(pb, SLAPI_PLUGIN_INTOP_RESULT, &ret);
+    }
+    if (ret != 0) {
+        if (ctx->ret != 0) {
+            /* search was stopped because a worker failed */
+            return ctx->ret;
+        }
+        LOG_FATAL("Search failed with [%d].\n", ret);
+    }
+
+    return ret;
+}
+
+static int start_workers(struct worker_ctx *ctx)
+{
+    struct sidgen_worker *w;
+    long c;
+    int ret;
+
+    ctx->pool = (struct sidgen_worker *) slapi_ch_calloc(ctx->workers,
+                                                 sizeof(struct sidgen_worker));
+    if (ctx->pool == NULL) {
+        return ENOMEM;
+    }
+
+    for (c = 0; c < ctx->workers; c++) {
+        w = &ctx->pool[c];
+        w->ctx = ctx;
+        ret = sidgen_queue_init(&w->queue);
+        if (ret != 0) {
+            LOG_FATAL("unable to initialize sidgen worker queue!\n");
+            ctx->workers = c;
+            return ret;
+        }
+
+        ret = pthread_create(&w->tid, NULL, sidgen_worker_thread, w);
+        if (ret != 0) {
+            LOG_FATAL("unable to create sidgen worker thread!\n");
+            sidgen_queue_destroy(&w->queue);
+            ctx->workers = c;
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+static void stop_workers(struct worker_ctx *ctx)
+{
+    struct sidgen_worker *w;
+    long c;
+
+    if (ctx->pool == NULL) {
+        return;
+    }
+
+    for (c = 0; c < ctx->workers; c++) {
+        sidgen_queue_done(&ctx->pool[c].queue);
+    }
+
+    for (c = 0; c < ctx->workers; c++) {
+        w = &ctx->pool[c];
+        pthread_join(w->tid, NULL);
+        sidgen_queue_destroy(&w->queue);
+    }
+
+    slapi_ch_free((void **) &ctx->pool);
+}
+
 static int do_work(struct worker_ctx *worker_ctx)
 {
     Slapi_PBlock *pb;
     int ret;
-    size_t c;
     char *filter = NULL;
     char *attrs[] = { OBJECTCLASS, UID_NUMBER, GID_NUMBER, NULL };
-    Slapi_Entry **e = NULL;
-    struct timespec ts;
+    char *no_attrs[] = { LDAP_NO_ATTRS, NULL };
 
     pb = slapi_pblock_new();
     if (pb == NULL) {
@@ -117,52 +371,45 @@ static int do_work(struct worker_ctx *worker_ctx)
     }
     LOG("Base DN: [%s], Filter: [%s].\n", worker_ctx->base_dn, filter);
 
-    slapi_search_internal_set_pb(pb, worker_ctx->base_dn, LDAP_SCOPE_SUBTREE,
-                                 filter, attrs, 0, NULL, NULL,
-                                 worker_ctx->plugin_id, 0);
-    ret = slapi_search_internal_pb(pb);
-    if (ret != 0) {
-        slapi_pblock_get(pb, SLAPI_PLUGIN_INTOP_RESULT, &ret);
-        if (ret != 0) {
-            LOG_FATAL("Search failed with [%d].\n", ret);
-        } else {
-            LOG_FATAL("slapi_search_internal_pb failed, "
-                      "but no error code available.\n");
-            ret = EFAULT;
-        }
-        goto done;
-    }
+    worker_ctx->start = time(NULL);
 
-    ret = slapi_pblock_get(pb, SLAPI_PLUGIN_INTOP_SEARCH_ENTRIES, &e);
+    /* Count the candidates first so that progress and ETA can be reported,
+     * without attributes this is cheap compared to the modifications. */
+    ret = search_entries(worker_ctx, pb, filter, no_attrs, count_entry);
     if (ret != 0) {
-        LOG_FATAL("slapi_pblock_get failed.\n");
-        ret = EFAULT;
         goto done;
     }
+    slapi_pblock_init(pb);
 
-    if (e == NULL || e[0] == NULL) {
+    if (worker_ctx->total == 0) {
         LOG("No entry with missing SID found.\n");
         ret = 0;
         goto done;
     }
+    LOG("Adding SIDs to [%lu] entries using [%ld] workers.\n",
+        worker_ctx->total, worker_ctx->workers);
 
-    for (c = 0; e[c] != NULL; c++) {
-        ret = find_sid_for_ldap_entry(e[c], worker_ctx->plugin_id,
-                                      worker_ctx->base_dn, worker_ctx->dom_sid,
-                                      worker_ctx->ranges);
-        if (ret != 0) {
-            LOG_FATAL("Cannot add SID to existing entry.\n");
-            goto done;
-        }
+    ret = start_workers(worker_ctx);
+    if (ret != 0) {
+        worker_ctx->ret = ret;
+        goto done;
+    }
 
-        if (worker_ctx->delay != 0) {
-            ts.tv_nsec = worker_ctx->delay % NSEC_PER_SEC;
-            ts.tv_sec = (worker_ctx->delay - ts.tv_nsec) / NSEC_PER_SEC;
-            nanosleep(&ts, NULL);
-        }
-    };
+    /* The entries are streamed to the workers instead of collecting the
+     * whole result set first. Each worker has a small bounded queue, so
+     * the search is slowed down to the speed the SIDs can be written. */
+    ret = search_entries(worker_ctx, pb, filter, attrs, dispatch_entry);
+    if (ret != 0) {
+        __sync_bool_compare_and_swap(&worker_ctx->ret, 0, ret);
+    }
 
 done:
+    stop_workers(worker_ctx);
+    if (ret == 0) {
+        ret = worker_ctx->ret;
+    }
+    report_progress(worker_ctx, true);
+
     slapi_ch_free_string(&filter);
     pthread_cleanup_pop(1);
 
@@ -190,14 +437,16 @@ static void *sidgen_task_thread(void *arg)
         goto done;
     }
 
-    slapi_task_begin(task, 1);
+    worker_ctx->task = task;
     LOG_FATAL("Sidgen task starts ...\n");
 
+    /* progress is reported in percent, the total is not known yet */
+    slapi_task_begin(task, 100);
+
     ret = do_work(worker_ctx);
 
 done:
     LOG_FATAL("Sidgen task finished [%d].\n", ret);
-    slapi_task_inc_progress(task);
     slapi_task_finish(task, ret);
 
     return NULL;
@@ -255,6 +504,21 @@ int sidgen_task_add(Slapi_PBlock *pb, Slapi_Entry *e,
     }
     LOG("delay is [%li].\n", worker_ctx->delay);
 
+    worker_ctx->workers = SIDGEN_DEFAULT_WORKERS;
+    str = fetch_attr(e, "workers", NULL);
+    if (str != NULL) {
+        errno = 0;
+        worker_ctx->workers = strtol(str, &endptr, 10);
+        if (errno != 0 || worker_ctx->workers < 1 ||
+            worker_ctx->workers > SIDGEN_MAX_WORKERS) {
+            LOG_FATAL("invalid number of workers [%s]!\n", str);
+            *returncode = LDAP_CONSTRAINT_VIOLATION;
+            ret = SLAPI_DSE_CALLBACK_ERROR;
+            goto done;
+        }
+    }
+    LOG("workers is [%li].\n", worker_ctx->workers);
+
     str = fetch_attr(e, "nsslapd-basedn", NULL);
     if (str == NULL) {
         LOG_FATAL("Missing nsslapd-basedn!\n");
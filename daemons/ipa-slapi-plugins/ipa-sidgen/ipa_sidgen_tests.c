@@ -0,0 +1,318 @@
+/*
+    Copyright (C) 2026 Red Hat
+
+    Tests for the work distribution of the FreeIPA SIDGEN task
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirsrv/slapi-plugin.h>
+
+#include "ipa_sidgen.h"
+
+#define ENTRY(n) ((Slapi_Entry *) (uintptr_t) (n))
+#define PRODUCED (3 * SIDGEN_QUEUE_SIZE)
+
+#define DOM_SID "S-1-5-21-1-2-3"
+
+/* The internal searches of find_sid_for_id() are answered from a list of
+ * used SIDs instead of a directory. */
+static const char *used_sids[4];
+static int searches;
+static bool sid_found;
+static bool attrs_requested;
+static Slapi_Entry *search_entries[] = { ENTRY(1), NULL };
+static int fake_pb;
+
+Slapi_PBlock *slapi_pblock_new(void)
+{
+    return (Slapi_PBlock *) &fake_pb;
+}
+
+void slapi_pblock_destroy(Slapi_PBlock *pb)
+{
+}
+
+void slapi_search_internal_set_pb(Slapi_PBlock *pb, const char *base,
+                                  int scope, const char *filter, char **attrs,
+                                  int attrsonly, LDAPControl **controls,
+                                  const char *uniqueid,
+                                  Slapi_ComponentId *plugin_identity,
+                                  int operation_flags)
+{
+    const char *sid;
+    size_t c;
+
+    /* the uniqueness check only needs to know if there is an entry */
+    if (attrs == NULL || strcmp(attrs[0], LDAP_NO_ATTRS) != 0) {
+        attrs_requested = true;
+    }
+
+    sid = strchr(filter, '=') + 1;
+    sid_found = false;
+    for (c = 0; used_sids[c] != NULL; c++) {
+        if (strcmp(used_sids[c], sid) == 0) {
+            sid_found = true;
+        }
+    }
+}
+
+int slapi_search_internal_pb(Slapi_PBlock *pb)
+{
+    searches++;
+
+    return 0;
+}
+
+int slapi_pblock_get(Slapi_PBlock *pb, int arg, void *value)
+{
+    switch (arg) {
+    case SLAPI_PLUGIN_INTOP_RESULT:
+        *((int *) value) = LDAP_SUCCESS;
+        break;
+    case SLAPI_PLUGIN_INTOP_SEARCH_ENTRIES:
+        *((Slapi_Entry ***) value) = sid_found ? search_entries : NULL;
+        break;
+    default:
+        return -1;
+    }
+
+    return 0;
+}
+
+void slapi_free_search_results_internal(Slapi_PBlock *pb)
+{
+}
+
+static void *producer(void *arg)
+{
+    struct sidgen_queue *q = (struct sidgen_queue *) arg;
+    uintptr_t c;
+
+    for (c = 1; c <= PRODUCED; c++) {
+        sidgen_queue_push(q, ENTRY(c));
+    }
+    sidgen_queue_done(q);
+
+    return NULL;
+}
+
+static size_t queue_count(struct sidgen_queue *q)
+{
+    size_t count;
+
+    pthread_mutex_lock(&q->lock);
+    count = q->count;
+    pthread_mutex_unlock(&q->lock);
+
+    return count;
+}
+
+void test_queue(void **state)
+{
+    struct sidgen_queue q;
+    pthread_t tid;
+    uintptr_t c;
+
+    assert_int_equal(sidgen_queue_init(&q), 0);
+
+    /* the producer fills the queue and then blocks until entries are
+     * taken, entries come out in order */
+    assert_int_equal(pthread_create(&tid, NULL, producer, &q), 0);
+    while (queue_count(&q) < SIDGEN_QUEUE_SIZE) {
+        usleep(1000);
+    }
+    usleep(10000);
+    assert_int_equal(queue_count(&q), SIDGEN_QUEUE_SIZE);
+
+    for (c = 1; c <= PRODUCED; c++) {
+        assert_true(sidgen_queue_pop(&q) == ENTRY(c));
+        assert_true(queue_count(&q) <= SIDGEN_QUEUE_SIZE);
+    }
+
+    /* empty and done */
+    assert_null(sidgen_queue_pop(&q));
+    assert_int_equal(pthread_join(tid, NULL), 0);
+
+    sidgen_queue_destroy(&q);
+
+    /* entries queued before done are still delivered */
+    assert_int_equal(sidgen_queue_init(&q), 0);
+    sidgen_queue_push(&q, ENTRY(1));
+    sidgen_queue_push(&q, ENTRY(2));
+    sidgen_queue_done(&q);
+    assert_true(sidgen_queue_pop(&q) == ENTRY(1));
+    assert_true(sidgen_queue_pop(&q) == ENTRY(2));
+    assert_null(sidgen_queue_pop(&q));
+    sidgen_queue_destroy(&q);
+}
+
+void test_posix_id(void **state)
+{
+    /* a user and its user private group go to the same worker */
+    assert_int_equal(sidgen_posix_id(true, false, 1000, 1000), 1000);
+    assert_int_equal(sidgen_posix_id(false, true, 0, 1000), 1000);
+
+    /* the user with a shared primary group */
+    assert_int_equal(sidgen_posix_id(true, false, 1001, 500), 1001);
+    assert_int_equal(sidgen_posix_id(false, true, 0, 500), 500);
+
+    /* entries without posix object classes */
+    assert_int_equal(sidgen_posix_id(false, false, 1002, 0), 1002);
+    assert_int_equal(sidgen_posix_id(false, false, 0, 1003), 1003);
+    assert_int_equal(sidgen_posix_id(true, false, 1004, 0), 1004);
+    assert_int_equal(sidgen_posix_id(false, false, 0, 0), 0);
+}
+
+void test_throttle(void **state)
+{
+    struct sidgen_throttle t = { 0 };
+    uint64_t backoff;
+    uint64_t last;
+    int c;
+
+    /* steady latency, no extra delay */
+    for (c = 0; c < 100; c++) {
+        assert_int_equal(sidgen_throttle(&t, 1000), 0);
+    }
+
+    /* the server gets much slower for a while: exponential backoff */
+    last = 0;
+    for (c = 0; c < 10; c++) {
+        backoff = sidgen_throttle(&t, 100000);
+        if (last == 0) {
+            assert_true(backoff == 0 || backoff == SIDGEN_MIN_BACKOFF);
+        } else {
+            assert_int_equal(backoff, 2 * last);
+        }
+        last = backoff;
+    }
+    assert_true(last > SIDGEN_MIN_BACKOFF);
+
+    /* it recovers, once the average follows the delay is halved again
+     * until it is gone */
+    for (c = 0; c < 100; c++) {
+        last = sidgen_throttle(&t, 1000);
+    }
+    assert_int_equal(last, 0);
+}
+
+void test_throttle_step(void **state)
+{
+    struct sidgen_throttle t = { 0 };
+    uint64_t backoff;
+    uint64_t total = 0;
+    int c;
+
+    for (c = 0; c < 100; c++) {
+        assert_int_equal(sidgen_throttle(&t, 1000), 0);
+    }
+
+    /* a lasting step in latency, e.g. after a fast start on a warm cache:
+     * the worker backs off at first, but the higher latency becomes the
+     * new baseline and the extra delay goes away for good */
+    for (c = 0; c < 200; c++) {
+        backoff = sidgen_throttle(&t, 100000);
+        assert_true(backoff < 2 * SIDGEN_MAX_BACKOFF);
+        total += backoff;
+    }
+    assert_int_equal(backoff, 0);
+    assert_true(total < 60 * NSEC_PER_SEC);
+
+    for (c = 0; c < 100000; c++) {
+        assert_int_equal(sidgen_throttle(&t, 100000), 0);
+    }
+
+    /* getting faster again never adds a delay */
+    for (c = 0; c < 100; c++) {
+        assert_int_equal(sidgen_throttle(&t, 1000), 0);
+    }
+
+    /* and a new spike is throttled relative to the new baseline */
+    for (c = 0; c < 10; c++) {
+        backoff = sidgen_throttle(&t, 100000);
+    }
+    assert_true(backoff > 0);
+}
+
+static void check_sid(uint32_t id, struct range_info **ranges,
+                      int exp_ret, const char *exp_sid, int exp_searches)
+{
+    char *sid = NULL;
+    int ret;
+
+    searches = 0;
+    attrs_requested = false;
+    ret = find_sid_for_id(id, NULL, "dc=example,dc=test", DOM_SID, ranges,
+                          &sid);
+    assert_int_equal(ret, exp_ret);
+    if (exp_sid != NULL) {
+        assert_string_equal(sid, exp_sid);
+    } else {
+        assert_null(sid);
+    }
+    assert_int_equal(searches, exp_searches);
+    assert_false(attrs_requested);
+
+    slapi_ch_free_string(&sid);
+}
+
+void test_find_sid_for_id(void **state)
+{
+    struct range_info range = { 1000, 100, 1000, 2000 };
+    struct range_info *ranges[] = { &range, NULL };
+
+    /* free primary RID */
+    check_sid(1000, ranges, 0, DOM_SID "-1000", 1);
+
+    /* no range */
+    check_sid(1100, ranges, LDAP_NO_SUCH_OBJECT, NULL, 0);
+
+    /* used primary RID, e.g. by the user private group of a user */
+    used_sids[0] = DOM_SID "-1010";
+    check_sid(1010, ranges, 0, DOM_SID "-2010", 2);
+
+    /* only the secondary RID is used */
+    used_sids[0] = DOM_SID "-2020";
+    check_sid(1020, ranges, 0, DOM_SID "-1020", 1);
+
+    /* both used */
+    used_sids[0] = DOM_SID "-1040";
+    used_sids[1] = DOM_SID "-2040";
+    check_sid(1040, ranges, LDAP_CONSTRAINT_VIOLATION, NULL, 2);
+    used_sids[1] = NULL;
+}
+
+int main(int argc, const char *argv[])
+{
+
+    const UnitTest tests[] = {
+        unit_test(test_queue),
+        unit_test(test_posix_id),
+        unit_test(test_throttle),
+        unit_test(test_throttle_step),
+        unit_test(test_find_sid_for_id),
+    };
+
+    return run_tests(tests);
+}
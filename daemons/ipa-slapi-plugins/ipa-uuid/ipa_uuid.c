@@ -39,9 +39,9 @@
  */
 #include <string.h>
 #include <stdbool.h>
+#include <sched.h>
 #include "slapi-plugin.h"
 #include "nspr.h"
-#include "prclist.h"
 #include "uuid/uuid.h"
 #include <pthread.h>
 
@@ -79,23 +79,42 @@ static Slapi_PluginDesc pdesc = {
 };
 
 /**
- * linked list of config entries
+ * config entries
  */
 
 struct configEntry {
-    PRCList list;
     char *dn;
     char *attr;
     char *prefix;
     char *filter;
     Slapi_Filter *slapi_filter;
+    char **objectclasses;   /* entry needs one of them to match filter */
+    char **attrs;           /* attr and the attributes used by filter */
     char *generate;
     char *scope;
     bool enforce;
 };
 
-static PRCList *ipauuid_global_config = NULL;
-static pthread_rwlock_t g_ipauuid_cache_lock;
+/**
+ * Immutable snapshot of all config entries, sorted by scope with the
+ * longest scope first. A reload builds a new snapshot and swaps it in.
+ */
+struct ipauuid_config {
+    struct configEntry **entries;
+    size_t count;
+};
+
+/**
+ * Readers pin the current slot by counting themselves in it and never
+ * block. A reload waits for the readers of the other slot, which holds the
+ * snapshot replaced by the previous reload, to go away before reusing it.
+ */
+static struct {
+    struct ipauuid_config *config;
+    int readers;
+} ipauuid_snapshots[2];
+static int ipauuid_current_snapshot;
+static pthread_mutex_t g_ipauuid_config_lock;
 
 static void *_PluginID = NULL;
 static char *_PluginDN = NULL;
@@ -120,8 +139,9 @@ static int ipauuid_postop_init(Slapi_PBlock * pb);
  *
  */
 static int ipauuid_load_plugin_config(void);
-static int ipauuid_parse_config_entry(Slapi_Entry * e, bool apply);
-static void ipauuid_delete_config(void);
+static int ipauuid_parse_config_entry(Slapi_Entry * e,
+                                      struct ipauuid_config *config);
+static void ipauuid_free_config(struct ipauuid_config **config);
 static void ipauuid_free_config_entry(struct configEntry ** entry);
 
 /**
@@ -151,22 +171,45 @@ void ipauuid_dump_config_entry(struct configEntry *);
 
 /**
  *
- * Deal with cache locking
+ * Deal with config snapshots
  *
  */
-void ipauuid_read_lock(void)
+static struct ipauuid_config *ipauuid_config_get(int *slot)
 {
-    pthread_rwlock_rdlock(&g_ipauuid_cache_lock);
+    int cur;
+
+    for (;;) {
+        cur = __sync_fetch_and_add(&ipauuid_current_snapshot, 0);
+        __sync_fetch_and_add(&ipauuid_snapshots[cur].readers, 1);
+
+        /* make sure a reload did not move on before we were counted */
+        if (cur == __sync_fetch_and_add(&ipauuid_current_snapshot, 0)) {
+            break;
+        }
+        __sync_fetch_and_sub(&ipauuid_snapshots[cur].readers, 1);
+    }
+
+    *slot = cur;
+    return ipauuid_snapshots[cur].config;
 }
 
-void ipauuid_write_lock(void)
+static void ipauuid_config_put(int slot)
 {
-    pthread_rwlock_wrlock(&g_ipauuid_cache_lock);
+    __sync_fetch_and_sub(&ipauuid_snapshots[slot].readers, 1);
 }
 
-void ipauuid_unlock(void)
+/* Call with g_ipauuid_config_lock held */
+static void ipauuid_config_swap(struct ipauuid_config *config)
 {
-    pthread_rwlock_unlock(&g_ipauuid_cache_lock);
+    int next = 1 - __sync_fetch_and_add(&ipauuid_current_snapshot, 0);
+
+    while (__sync_fetch_and_add(&ipauuid_snapshots[next].readers, 0) != 0) {
+        sched_yield();
+    }
+
+    ipauuid_free_config(&ipauuid_snapshots[next].config);
+    ipauuid_snapshots[next].config = config;
+    __sync_bool_compare_and_swap(&ipauuid_current_snapshot, 1 - next, next);
 }
 
 /**
@@ -325,7 +368,7 @@ ipauuid_start(Slapi_PBlock * pb)
         goto done;
     }
 
-    if (pthread_rwlock_init(&g_ipauuid_cache_lock, NULL) != 0) {
+    if (pthread_mutex_init(&g_ipauuid_config_lock, NULL) != 0) {
         LOG_FATAL("lock creation failed\n");
 
         return EFAIL;
@@ -350,9 +393,9 @@ ipauuid_start(Slapi_PBlock * pb)
     /*
      * Load the config for our plug-in
      */
-    ipauuid_global_config = (PRCList *)
-        slapi_ch_calloc(1, sizeof(struct configEntry));
-    PR_INIT_CLIST(ipauuid_global_config);
+    ipauuid_snapshots[0].config = (struct ipauuid_config *)
+        slapi_ch_calloc(1, sizeof(struct ipauuid_config));
+    ipauuid_current_snapshot = 0;
 
     if (ipauuid_load_plugin_config() != EOK) {
         LOG_FATAL("unable to load plug-in configuration\n");
@@ -377,9 +420,8 @@ ipauuid_close(Slapi_PBlock * pb)
 {
     LOG_TRACE( "--in-->\n");
 
-    ipauuid_delete_config();
-
-    slapi_ch_free((void **)&ipauuid_global_config);
+    ipauuid_free_config(&ipauuid_snapshots[0].config);
+    ipauuid_free_config(&ipauuid_snapshots[1].config);
 
     LOG_TRACE("<--out--\n");
 
@@ -404,11 +446,14 @@ ipauuid_load_plugin_config()
     int i;
     Slapi_PBlock *search_pb;
     Slapi_Entry **entries = NULL;
+    struct ipauuid_config *config;
 
     LOG_TRACE("--in-->\n");
 
-    ipauuid_write_lock();
-    ipauuid_delete_config();
+    pthread_mutex_lock(&g_ipauuid_config_lock);
+
+    config = (struct ipauuid_config *)
+        slapi_ch_calloc(1, sizeof(struct ipauuid_config));
 
     search_pb = slapi_pblock_new();
 
@@ -434,36 +479,129 @@ ipauuid_load_plugin_config()
         /* We don't care about the status here because we may have
          * some invalid config entries, but we just want to continue
          * looking for valid ones. */
-        ipauuid_parse_config_entry(entries[i], true);
+        ipauuid_parse_config_entry(entries[i], config);
     }
 
   cleanup:
+    /* On failure readers are left with an empty config, as before */
+    ipauuid_config_swap(config);
     slapi_free_search_results_internal(search_pb);
     slapi_pblock_destroy(search_pb);
-    ipauuid_unlock();
+    pthread_mutex_unlock(&g_ipauuid_config_lock);
     LOG_TRACE("<--out--\n");
 
     return status;
 }
 
+/*
+ * ipauuid_filter_objectclasses()
+ *
+ * Collects the objectclasses an entry must have one of in order to
+ * match the filter, so most entries can be rejected without evaluating
+ * it. Returns NULL if the filter does not allow such a shortcut.
+ */
+static char **
+ipauuid_filter_objectclasses(Slapi_Filter *filter)
+{
+    Slapi_Filter *f;
+    char **ocs = NULL;
+    char **sub;
+    char *type;
+    struct berval *bval;
+    int i;
+
+    switch (slapi_filter_get_choice(filter)) {
+    case LDAP_FILTER_EQUALITY:
+        if (slapi_filter_get_ava(filter, &type, &bval) == 0 &&
+            strcasecmp(type, SLAPI_ATTR_OBJECTCLASS) == 0) {
+            slapi_ch_array_add(&ocs, slapi_ch_smprintf("%.*s",
+                                                       (int)bval->bv_len,
+                                                       bval->bv_val));
+        }
+        break;
+
+    case LDAP_FILTER_OR:
+        /* every branch has to be restricted */
+        for (f = slapi_filter_list_first(filter); f != NULL;
+             f = slapi_filter_list_next(filter, f)) {
+            sub = ipauuid_filter_objectclasses(f);
+            if (sub == NULL) {
+                slapi_ch_array_free(ocs);
+                return NULL;
+            }
+            for (i = 0; sub[i]; i++) {
+                slapi_ch_array_add(&ocs, sub[i]);
+            }
+            slapi_ch_free((void **)&sub);
+        }
+        break;
+
+    case LDAP_FILTER_AND:
+        /* a single restricted branch is enough */
+        for (f = slapi_filter_list_first(filter); f != NULL;
+             f = slapi_filter_list_next(filter, f)) {
+            ocs = ipauuid_filter_objectclasses(f);
+            if (ocs != NULL) {
+                break;
+            }
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return ocs;
+}
+
+static bool
+ipauuid_entry_has_objectclass(Slapi_Entry *e, char **ocs)
+{
+    int i;
+
+    if (ocs == NULL) {
+        return true;
+    }
+
+    for (i = 0; ocs[i]; i++) {
+        if (slapi_entry_attr_hasvalue(e, SLAPI_ATTR_OBJECTCLASS, ocs[i])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int
+ipauuid_add_filter_attr(Slapi_Filter *f, void *arg)
+{
+    char ***attrs = (char ***)arg;
+    char *type = NULL;
+
+    if (slapi_filter_get_attribute_type(f, &type) == 0 && type != NULL &&
+        !ipauuid_list_contains_attr(*attrs, type)) {
+        slapi_ch_array_add(attrs, slapi_ch_strdup(type));
+    }
+
+    return SLAPI_FILTER_SCAN_CONTINUE;
+}
+
 /*
  * ipauuid_parse_config_entry()
  *
- * Parses a single config entry.  If apply is non-zero, then
- * we will load and start using the new config.  You can simply
- * validate config without making any changes by setting apply
- * to 0.
+ * Parses a single config entry.  If config is not NULL, then the
+ * entry is added to it.  You can simply validate config without
+ * making any changes by passing NULL.
  *
  * Returns EOK if the entry is valid and EFAIL
  * if it is invalid.
  */
 static int
-ipauuid_parse_config_entry(Slapi_Entry * e, bool apply)
+ipauuid_parse_config_entry(Slapi_Entry * e, struct ipauuid_config *config)
 {
     char *value;
     struct configEntry *entry = NULL;
-    struct configEntry *config_entry;
-    PRCList *list;
+    size_t i;
     int entry_added = 0;
     int ret = EOK;
 
@@ -518,6 +656,14 @@ ipauuid_parse_config_entry(Slapi_Entry * e, bool apply)
             ret = EFAIL;
             goto bail;
         }
+        entry->objectclasses =
+            ipauuid_filter_objectclasses(entry->slapi_filter);
+
+        /* everything a modify has to look at to evaluate this entry */
+        slapi_ch_array_add(&entry->attrs, slapi_ch_strdup(entry->attr));
+        slapi_filter_apply(entry->slapi_filter, ipauuid_add_filter_attr,
+                           &entry->attrs, &ret);
+        ret = EOK;
     } else {
         LOG_FATAL("The %s config setting is required for %s.\n",
                   IPAUUID_FILTER, entry->dn);
@@ -543,51 +689,41 @@ ipauuid_parse_config_entry(Slapi_Entry * e, bool apply)
 
     /* If we were only called to validate config, we can
      * just bail out before applying the config changes */
-    if (!apply) {
+    if (config == NULL) {
         goto bail;
     }
 
     /**
-     * Finally add the entry to the list.
+     * Finally add the entry to the snapshot.
      * We sort by scope dn length with longer
      * dn's first - this allows the scope
      * checking code to be simple and quick and
      * cunningly linear.
      */
-    if (!PR_CLIST_IS_EMPTY(ipauuid_global_config)) {
-        list = PR_LIST_HEAD(ipauuid_global_config);
-        while (list != ipauuid_global_config) {
-            config_entry = (struct configEntry *) list;
-
-            if (slapi_dn_issuffix(entry->scope, config_entry->scope)) {
-                PR_INSERT_BEFORE(&(entry->list), list);
-                LOG_CONFIG("store [%s] before [%s] \n",
-                           entry->scope, config_entry->scope);
-                entry_added = 1;
-                break;
-            }
-
-            list = PR_NEXT_LINK(list);
-
-            if (ipauuid_global_config == list) {
-                /* add to tail */
-                PR_INSERT_BEFORE(&(entry->list), list);
-                LOG_CONFIG("store [%s] at tail\n", entry->scope);
-                entry_added = 1;
-                break;
-            }
+    for (i = 0; i < config->count; i++) {
+        if (slapi_dn_issuffix(entry->scope, config->entries[i]->scope)) {
+            LOG_CONFIG("store [%s] before [%s] \n",
+                       entry->scope, config->entries[i]->scope);
+            break;
         }
-    } else {
-        /* first entry */
-        PR_INSERT_LINK(&(entry->list), ipauuid_global_config);
-        LOG_CONFIG("store [%s] at head \n", entry->scope);
-        entry_added = 1;
     }
+    if (i == config->count) {
+        LOG_CONFIG("store [%s] at tail\n", entry->scope);
+    }
+
+    config->entries = (struct configEntry **)
+        slapi_ch_realloc((char *)config->entries,
+                         (config->count + 1) * sizeof(struct configEntry *));
+    memmove(&config->entries[i + 1], &config->entries[i],
+            (config->count - i) * sizeof(struct configEntry *));
+    config->entries[i] = entry;
+    config->count++;
+    entry_added = 1;
 
 bail:
     if (0 == entry_added) {
         /* Don't log error if we weren't asked to apply config */
-        if (apply && (entry != NULL)) {
+        if ((config != NULL) && (entry != NULL)) {
             LOG_FATAL("Invalid config entry [%s] skipped\n", entry->dn);
         }
         ipauuid_free_config_entry(&entry);
@@ -632,6 +768,9 @@ ipauuid_free_config_entry(struct configEntry **entry)
         slapi_filter_free(e->slapi_filter, 1);
     }
 
+    slapi_ch_array_free(e->objectclasses);
+    slapi_ch_array_free(e->attrs);
+
     if (e->generate) {
         slapi_ch_free_string(&e->generate);
     }
@@ -644,23 +783,20 @@ ipauuid_free_config_entry(struct configEntry **entry)
 }
 
 static void
-ipauuid_delete_configEntry(PRCList *entry)
+ipauuid_free_config(struct ipauuid_config **config)
 {
-    PR_REMOVE_LINK(entry);
-    ipauuid_free_config_entry((struct configEntry **) &entry);
-}
+    size_t i;
 
-static void
-ipauuid_delete_config()
-{
-    PRCList *list;
+    if (!config || !*config) {
+        return;
+    }
 
-    while (!PR_CLIST_IS_EMPTY(ipauuid_global_config)) {
-        list = PR_LIST_HEAD(ipauuid_global_config);
-        ipauuid_delete_configEntry(list);
+    for (i = 0; i < (*config)->count; i++) {
+        ipauuid_free_config_entry(&(*config)->entries[i]);
     }
 
-    return;
+    slapi_ch_free((void **)&(*config)->entries);
+    slapi_ch_free((void **)config);
 }
 
 /****************************************************
@@ -739,6 +875,87 @@ static void ipauuid_generate_uuid(char *out)
     uuid_unparse_lower(uu, out);
 }
 
+/*
+ * ipauuid_modify_attrs()
+ *
+ * A modify can only make a config entry generate a value if it touches
+ * the managed attribute or an attribute its filter depends on, anything
+ * else leaves both the value and the filter result as they were.
+ * Returns the attributes needed to process the modify, or NULL if no
+ * config entry in scope of dn is affected by mods.
+ */
+static char **
+ipauuid_modify_attrs(struct ipauuid_config *config, char *dn, LDAPMod **mods)
+{
+    struct configEntry *cfgentry;
+    char **attrs = NULL;
+    bool affected = false;
+    size_t i;
+    int j;
+
+    for (i = 0; i < config->count; i++) {
+        cfgentry = config->entries[i];
+
+        if (cfgentry->scope && !slapi_dn_issuffix(dn, cfgentry->scope)) {
+            continue;
+        }
+
+        for (j = 0; mods && mods[j] && !affected; j++) {
+            affected = ipauuid_list_contains_attr(cfgentry->attrs,
+                                                  mods[j]->mod_type);
+        }
+
+        for (j = 0; cfgentry->attrs && cfgentry->attrs[j]; j++) {
+            if (!ipauuid_list_contains_attr(attrs, cfgentry->attrs[j])) {
+                slapi_ch_array_add(&attrs,
+                                   slapi_ch_strdup(cfgentry->attrs[j]));
+            }
+        }
+    }
+
+    if (!affected) {
+        slapi_ch_array_free(attrs);
+        return NULL;
+    }
+
+    return attrs;
+}
+
+/*
+ * ipauuid_apply_mods()
+ *
+ * Applies mods to an entry which was fetched with only attrs, or with
+ * all attributes if attrs is NULL. Mods of attributes which were not
+ * fetched are skipped, they would not apply.
+ */
+static int
+ipauuid_apply_mods(Slapi_Entry *e, LDAPMod **mods, char **attrs)
+{
+    LDAPMod **relevant;
+    int count;
+    int i;
+    int j = 0;
+    int ret;
+
+    if (attrs == NULL) {
+        return slapi_entry_apply_mods(e, mods);
+    }
+
+    for (count = 0; mods[count]; count++) ;
+
+    relevant = (LDAPMod **)slapi_ch_calloc(count + 1, sizeof(LDAPMod *));
+    for (i = 0; i < count; i++) {
+        if (ipauuid_list_contains_attr(attrs, mods[i]->mod_type)) {
+            relevant[j++] = mods[i];
+        }
+    }
+
+    ret = slapi_entry_apply_mods(e, relevant);
+    slapi_ch_free((void **)&relevant);
+
+    return ret;
+}
+
 /* for mods and adds:
 	where dn's are supplied, the closest in scope
 	is used as long as the type filter matches
@@ -748,12 +965,15 @@ static void ipauuid_generate_uuid(char *out)
 static int ipauuid_pre_op(Slapi_PBlock *pb, int modtype)
 {
     char *dn = NULL;
-    PRCList *list = NULL;
+    struct ipauuid_config *config = NULL;
+    int slot = -1;
+    size_t i;
     struct configEntry *cfgentry = NULL;
     struct slapi_entry *e = NULL;
     Slapi_Entry *resulting_e = NULL;
     char *value = NULL;
     char **generated_attrs = NULL;
+    char **fetch_attrs = NULL;
     Slapi_Mods *smods = NULL;
     Slapi_Mod *smod = NULL;
     Slapi_Mod *next_mod;
@@ -762,7 +982,6 @@ static int ipauuid_pre_op(Slapi_PBlock *pb, int modtype)
     char *errstr = NULL;
     bool generate;
     int ret = LDAP_SUCCESS;
-    bool locked = false;
     bool set_attr;
     int is_repl_op;
     int is_config_dn;
@@ -798,6 +1017,13 @@ static int ipauuid_pre_op(Slapi_PBlock *pb, int modtype)
         goto done;
     }
 
+    if (!is_config_dn) {
+        config = ipauuid_config_get(&slot);
+        if (config->count == 0) {
+            goto done;
+        }
+    }
+
     if (LDAP_CHANGETYPE_ADD == modtype) {
         slapi_pblock_get(pb, SLAPI_ADD_ENTRY, &e);
     } else {
@@ -812,9 +1038,22 @@ static int ipauuid_pre_op(Slapi_PBlock *pb, int modtype)
          *
          slapi_pblock_get( pb, SLAPI_MODIFY_EXISTING_ENTRY, &e);
          */
+
+        /* Only go get the entry if the mods can make a config entry
+         * apply, and only with the attributes it needs. Config entries
+         * are validated as a whole. */
+        slapi_pblock_get(pb, SLAPI_MODIFY_MODS, &mods);
+        if (!is_config_dn) {
+            fetch_attrs = ipauuid_modify_attrs(config, dn, mods);
+            if (fetch_attrs == NULL) {
+                goto done;
+            }
+        }
+
         Slapi_DN *tmp_dn = slapi_sdn_new_dn_byref(dn);
         if (tmp_dn) {
-            ret = slapi_search_internal_get_entry(tmp_dn, NULL, &e, getPluginID());
+            ret = slapi_search_internal_get_entry(tmp_dn, fetch_attrs, &e,
+                                                  getPluginID());
             slapi_sdn_free(&tmp_dn);
 
             if (ret == LDAP_REFERRAL) {
@@ -838,7 +1077,6 @@ static int ipauuid_pre_op(Slapi_PBlock *pb, int modtype)
         /* grab the mods - we'll put them back later with
          * our modifications appended
          */
-        slapi_pblock_get(pb, SLAPI_MODIFY_MODS, &mods);
         smods = slapi_mods_new();
         slapi_mods_init_passin(smods, mods);
 
@@ -846,7 +1084,8 @@ static int ipauuid_pre_op(Slapi_PBlock *pb, int modtype)
          * see if the entry is within the scope. */
         if (e) {
             resulting_e = slapi_entry_dup(e);
-            if (mods && (slapi_entry_apply_mods(resulting_e, mods) != LDAP_SUCCESS)) {
+            if (mods && (ipauuid_apply_mods(resulting_e, mods,
+                                            fetch_attrs) != LDAP_SUCCESS)) {
                 /* The mods don't apply cleanly, so we just let this op go
                  * to let the main server handle it. */
                 goto done;
@@ -872,7 +1111,7 @@ static int ipauuid_pre_op(Slapi_PBlock *pb, int modtype)
             test_e = resulting_e;
         }
 
-        if (ipauuid_parse_config_entry(test_e, false) != EOK) {
+        if (ipauuid_parse_config_entry(test_e, NULL) != EOK) {
             /* Refuse the operation if config parsing failed. */
             ret = LDAP_UNWILLING_TO_PERFORM;
             if (LDAP_CHANGETYPE_ADD == modtype) {
@@ -888,19 +1127,8 @@ static int ipauuid_pre_op(Slapi_PBlock *pb, int modtype)
         goto done;
     }
 
-    ipauuid_read_lock();
-    locked = true;
-
-    if (PR_CLIST_IS_EMPTY(ipauuid_global_config)) {
-        goto done;
-    }
-
-    list = PR_LIST_HEAD(ipauuid_global_config);
-
-    for(list = PR_LIST_HEAD(ipauuid_global_config);
-        list != ipauuid_global_config;
-        list = PR_NEXT_LINK(list)) {
-        cfgentry = (struct configEntry *) list;
+    for (i = 0; i < config->count; i++) {
+        cfgentry = config->entries[i];
 
         generate = false;
         set_attr = false;
@@ -930,6 +1158,11 @@ static int ipauuid_pre_op(Slapi_PBlock *pb, int modtype)
                 test_e = resulting_e;
             }
 
+            if (!ipauuid_entry_has_objectclass(test_e,
+                                               cfgentry->objectclasses)) {
+                continue;
+            }
+
             ret = slapi_vattr_filter_test(pb, test_e,
                                           cfgentry->slapi_filter, 0);
             if (ret != LDAP_SUCCESS) {
@@ -1173,8 +1406,8 @@ static int ipauuid_pre_op(Slapi_PBlock *pb, int modtype)
     ret = LDAP_SUCCESS;
 
 done:
-    if (locked) {
-        ipauuid_unlock();
+    if (slot >= 0) {
+        ipauuid_config_put(slot);
     }
 
     if (smods != NULL) {
@@ -1188,6 +1421,7 @@ done:
     }
 
     slapi_ch_array_free(generated_attrs);
+    slapi_ch_array_free(fetch_attrs);
     slapi_ch_free_string(&value);
 
     if (free_entry && e) {
@@ -0,0 +1,404 @@
+/** BEGIN COPYRIGHT BLOCK
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Additional permission under GPLv3 section 7:
+ *
+ * In the following paragraph, "GPL" means the GNU General Public
+ * License, version 3 or any later version, and "Non-GPL Code" means
+ * code that is governed neither by the GPL nor a license
+ * compatible with the GPL.
+ *
+ * You may link the code of this Program with Non-GPL Code and convey
+ * linked combinations including the two, provided that such Non-GPL
+ * Code only links to the code of this Program through those well
+ * defined interfaces identified in the file named EXCEPTION found in
+ * the source code files (the "Approved Interfaces"). The files of
+ * Non-GPL Code may instantiate templates or use macros or inline
+ * functions from the Approved Interfaces without causing the resulting
+ * work to be covered by the GPL. Only the copyright holders of this
+ * Program may make changes or additions to the list of Approved
+ * Interfaces.
+ *
+ * Copyright (C) 2026 FreeIPA Contributors
+ * All rights reserved.
+ * END COPYRIGHT BLOCK **/
+
+/*
+ * Microbenchmarks for libotp.
+ *
+ * This measures hotp() per algorithm and otp_token_validate_berval() for
+ * realistic window sizes and token counts, reporting ns/op and heap
+ * allocations per op. It gives a baseline for the per-bind OTP CPU cost
+ * inside 389-ds.
+ *
+ * libotp is linked against a minimal in-process emulation of the slapi calls
+ * it makes (entries, DNs, internal searches and modifies; see t_slapi.c)
+ * instead of a running directory server. Directory costs are therefore NOT included:
+ * searches return prebuilt entries and modifies are counted but discarded.
+ * Token changes are fed to otp_config_update() as the post-op hooks would.
+ * Allocations are counted by interposing malloc(), calloc() and realloc().
+ */
+
+#define _GNU_SOURCE 1
+#include "hotp.h"
+#include "otp_config.h"
+#include "otp_token.h"
+#include "t_slapi.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <nss.h>
+
+/*
+ * Allocation counting
+ */
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static size_t allocs;
+
+void *malloc(size_t size)
+{
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+/*
+ * Benchmarks
+ */
+
+#define KEY "12345678901234567890123456789012" \
+            "34567890123456789012345678901234"
+
+static const char *const algos[] = { "sha1", "sha256", "sha384", "sha512" };
+
+struct result {
+    uint64_t ns;
+    size_t allocs;
+    size_t modifies;
+    size_t iterations;
+    size_t failures;
+};
+
+static unsigned int iterations = 10000;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void print_header(void)
+{
+    printf("%-44s %10s %12s %10s %8s\n",
+           "benchmark", "ops", "ns/op", "allocs/op", "fail");
+}
+
+static void print_result(const char *name, const struct result *r)
+{
+    printf("%-44s %10zu %12.0f %10.1f %8zu\n", name, r->iterations,
+           (double) r->ns / r->iterations,
+           (double) r->allocs / r->iterations, r->failures);
+}
+
+static void bench_hotp(void)
+{
+    struct hotp_context *ctx;
+    struct result r;
+    uint64_t start;
+    size_t a;
+    uint32_t otp;
+    char name[64];
+
+    for (size_t i = 0; i < sizeof(algos) / sizeof(*algos); i++) {
+        struct hotp_token token = {
+            { (uint8_t *) KEY, strcmp(algos[i], "sha1") == 0 ? 20 : 64 },
+            (char *) algos[i], 6
+        };
+
+        /* One-shot: imports the key for every code. */
+        memset(&r, 0, sizeof(r));
+        a = allocs;
+        start = now_ns();
+        for (r.iterations = 0; r.iterations < iterations; r.iterations++) {
+            if (!hotp(&token, r.iterations, &otp))
+                r.failures++;
+        }
+        r.ns = now_ns() - start;
+        r.allocs = allocs - a;
+        snprintf(name, sizeof(name), "hotp/%s", algos[i]);
+        print_result(name, &r);
+
+        /* Reused context, as used by window searches. */
+        memset(&r, 0, sizeof(r));
+        ctx = hotp_context_new(&token);
+        a = allocs;
+        start = now_ns();
+        for (r.iterations = 0; r.iterations < iterations; r.iterations++) {
+            if (ctx == NULL || !hotp_ctx(ctx, r.iterations, &otp))
+                r.failures++;
+        }
+        r.ns = now_ns() - start;
+        r.allocs = allocs - a;
+        hotp_context_free(ctx);
+        snprintf(name, sizeof(name), "hotp_ctx/%s", algos[i]);
+        print_result(name, &r);
+    }
+}
+
+struct case_spec {
+    const char *name;
+    bool totp;
+    unsigned int tokens;  /* Number of tokens owned by the user. */
+    int step;             /* Relative step of the code, from the last token. */
+    bool miss;            /* Send a code that is not in the window. */
+    bool sync;
+};
+
+static const struct case_spec cases[] = {
+    { "validate/totp/auth/1tok/step0",         true,   1,    0, false, false },
+    { "validate/totp/auth/1tok/step-9",        true,   1,   -9, false, false },
+    { "validate/totp/auth/1tok/miss",          true,   1,    0, true,  false },
+    { "validate/totp/auth/4tok/step0",         true,   4,    0, false, false },
+    { "validate/totp/auth/4tok/miss",          true,   4,    0, true,  false },
+    { "validate/totp/auth/16tok/miss",         true,  16,    0, true,  false },
+    { "validate/totp/sync/1tok/step0",         true,   1,    0, false, true  },
+    { "validate/totp/sync/1tok/step2000",      true,   1, 2000, false, true  },
+    { "validate/totp/sync/1tok/miss",          true,   1,    0, true,  true  },
+    { "validate/totp/sync/4tok/miss",          true,   4,    0, true,  true  },
+    { "validate/hotp/auth/1tok/step0",         false,  1,    0, false, false },
+    { "validate/hotp/auth/1tok/miss",          false,  1,    0, true,  false },
+    { "validate/hotp/sync/1tok/step50",        false,  1,   50, false, true  },
+    { "validate/hotp/sync/1tok/miss",          false,  1,    0, true,  true  },
+};
+
+static Slapi_Entry token_entries[MAX_TOKENS];
+static char token_dns[MAX_TOKENS][64];
+
+static void setup_tokens(struct otp_config *cfg, const struct case_spec *c)
+{
+    Slapi_PBlock pb = { 0 };
+
+    /* Delete the tokens of the previous case. */
+    for (unsigned int i = 0; search_results[i] != NULL; i++) {
+        pb.target = &search_results[i]->sdn;
+        pb.pre = search_results[i];
+        pb.post = NULL;
+        otp_config_update(cfg, &pb);
+        search_results[i] = NULL;
+    }
+    pb.pre = NULL;
+
+    for (unsigned int i = 0; i < c->tokens; i++) {
+        Slapi_Entry *e = &token_entries[i];
+
+        memset(e, 0, sizeof(*e));
+        snprintf(token_dns[i], sizeof(token_dns[i]),
+                 "ipatokenUniqueID=%u,cn=otp," SUFFIX, i);
+        e->sdn.dn = token_dns[i];
+        entry_add(e, "objectClass", "ipaToken", 8);
+        if (c->totp)
+            entry_add(e, "objectClass", "ipaTokenTOTP", 12);
+        else
+            entry_add(e, "objectClass", "ipaTokenHOTP", 12);
+        entry_add(e, "ipatokenOwner", USER_DN, strlen(USER_DN));
+        /* Give every token a different key. */
+        entry_add(e, "ipatokenOTPkey", KEY + i, 20);
+        entry_add(e, "ipatokenOTPdigits", "6", 1);
+        entry_add(e, "ipatokenOTPalgorithm", "sha1", 4);
+        entry_add(e, "ipatokenTOTPtimeStep", "30", 2);
+        entry_add(e, "ipatokenHOTPcounter", "1000", 4);
+        search_results[i] = e;
+
+        /* Add it. */
+        pb.target = &e->sdn;
+        pb.post = e;
+        otp_config_update(cfg, &pb);
+    }
+    search_results[c->tokens] = NULL;
+}
+
+/* Compute the code(s) the client would send for this case. */
+static bool make_codes(const struct case_spec *c, char *first, char *second)
+{
+    struct hotp_token token = {
+        { (uint8_t *) KEY + c->tokens - 1, 20 }, "sha1", 6
+    };
+    uint64_t step;
+    uint32_t otp;
+
+    if (c->totp)
+        step = time(NULL) / 30 + c->step;
+    else
+        step = 1000 + c->step;
+
+    if (!hotp(&token, step, &otp))
+        return false;
+    sprintf(first, "password%06u", c->miss ? (otp + 1) % 1000000 : otp);
+
+    if (!hotp(&token, step + 1, &otp))
+        return false;
+    sprintf(second, "password%06u", c->miss ? (otp + 1) % 1000000 : otp);
+    return true;
+}
+
+static void bench_validate(struct otp_config *cfg)
+{
+    char first[32], second[32];
+    struct otp_token **tokens;
+    struct berval bv1, bv2;
+    struct result r;
+    uint64_t start;
+    size_t a, m;
+    bool ok;
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++) {
+        const struct case_spec *c = &cases[i];
+        unsigned int n = iterations;
+
+        /* Wide sync searches are slow; keep the run time reasonable. */
+        if (c->sync && c->totp)
+            n = n / 100 > 0 ? n / 100 : 1;
+
+        setup_tokens(cfg, c);
+        memset(&r, 0, sizeof(r));
+        for (r.iterations = 0; r.iterations < n; r.iterations++) {
+            if (!make_codes(c, first, second)) {
+                r.failures++;
+                continue;
+            }
+            bv1.bv_val = first;
+            bv1.bv_len = strlen(first);
+            bv2.bv_val = second;
+            bv2.bv_len = strlen(second);
+
+            /* Token lookup happens per bind too, but is measured apart. */
+            tokens = otp_token_find(cfg, USER_DN, NULL, true, NULL);
+            if (tokens == NULL) {
+                r.failures++;
+                continue;
+            }
+
+            a = allocs;
+            m = modifies;
+            start = now_ns();
+            ok = otp_token_validate_berval(tokens, &bv1,
+                                           c->sync ? &bv2 : NULL);
+            r.ns += now_ns() - start;
+            r.allocs += allocs - a;
+            r.modifies += modifies - m;
+            if (ok == c->miss)
+                r.failures++;
+
+            otp_token_free_array(tokens);
+        }
+
+        print_result(c->name, &r);
+    }
+}
+
+static void bench_find(struct otp_config *cfg)
+{
+    static const unsigned int counts[] = { 1, 4, 16 };
+    struct case_spec c = { NULL, true, 1, 0, false, false };
+    struct otp_token **tokens;
+    struct result r;
+    uint64_t start;
+    size_t a;
+    char name[64];
+
+    for (size_t i = 0; i < sizeof(counts) / sizeof(*counts); i++) {
+        c.tokens = counts[i];
+        setup_tokens(cfg, &c);
+
+        memset(&r, 0, sizeof(r));
+        a = allocs;
+        start = now_ns();
+        for (r.iterations = 0; r.iterations < iterations; r.iterations++) {
+            tokens = otp_token_find(cfg, USER_DN, NULL, true, NULL);
+            if (tokens == NULL)
+                r.failures++;
+            otp_token_free_array(tokens);
+        }
+        r.ns = now_ns() - start;
+        r.allocs = allocs - a;
+
+        snprintf(name, sizeof(name), "find/%utok (no directory)", counts[i]);
+        print_result(name, &r);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct otp_config *cfg;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n ITERATIONS]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (iterations == 0)
+        iterations = 1;
+
+    NSS_NoDB_Init(".");
+
+    /* Default IPA windows: TOTP 300/86400 seconds, HOTP 10/100 steps. */
+    window_entry.sdn.dn = "cn=otp,cn=etc," SUFFIX;
+    entry_add(&window_entry, "ipatokenTOTPauthWindow", "300", 3);
+    entry_add(&window_entry, "ipatokenTOTPsyncWindow", "86400", 5);
+    entry_add(&window_entry, "ipatokenHOTPauthWindow", "10", 2);
+    entry_add(&window_entry, "ipatokenHOTPsyncWindow", "100", 3);
+
+    cfg = otp_config_init(NULL);
+    if (cfg == NULL) {
+        fprintf(stderr, "Unable to create config\n");
+        return 1;
+    }
+
+    print_header();
+    bench_hotp();
+    bench_find(cfg);
+    bench_validate(cfg);
+
+    otp_config_fini(&cfg);
+    NSS_Shutdown();
+    return 0;
+}
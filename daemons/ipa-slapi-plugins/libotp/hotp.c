@@ -66,94 +66,121 @@ static const struct {
     { }
 };
 
+struct hotp_context {
+    PK11SlotInfo *slot;
+    PK11SymKey *symkey;
+    PK11Context *ctx;
+    PRUint64 div;
+};
+
 /*
  * This code is mostly cargo-cult taken from here:
  *   http://www.mozilla.org/projects/security/pki/nss/tech-notes/tn5.html
  *
  * It should implement HMAC with the given mechanism (SHA: 1, 256, 384, 512).
+ *
+ * Finding the slot and importing the key are by far the most expensive part,
+ * so they are done once per context. The HMAC context is then restarted with
+ * PK11_DigestBegin() for every counter value.
  */
-static bool hmac(SECItem *key, CK_MECHANISM_TYPE mech, const SECItem *in,
-                 struct digest_buffer *out)
+struct hotp_context *hotp_context_new(const struct hotp_token *token)
 {
+    SECItem keyitm = { siBuffer, token->key.bytes, token->key.len };
+    CK_MECHANISM_TYPE mech = CKM_SHA_1_HMAC;
     SECItem param = { siBuffer, NULL, 0 };
-    PK11SlotInfo *slot = NULL;
-    PK11SymKey *symkey = NULL;
-    PK11Context *ctx = NULL;
-    bool ret = false;
-    SECStatus s;
+    struct hotp_context *ctx;
+    int digits = token->digits;
+    int i;
+
+    ctx = calloc(1, sizeof(*ctx));
+    if (ctx == NULL)
+        return NULL;
+
+    /* Find the mech. */
+    for (i = 0; algo2mech[i].algo; i++) {
+        if (strcasecmp(algo2mech[i].algo, token->algo) == 0) {
+            mech = algo2mech[i].mech;
+            break;
+        }
+    }
+
+    /* Create the digits divisor. */
+    for (ctx->div = 1; digits > 0; digits--) {
+        ctx->div *= 10;
+    }
 
-    slot = PK11_GetBestSlot(mech, NULL);
-    if (slot == NULL) {
-        slot = PK11_GetInternalKeySlot();
-        if (slot == NULL) {
-            goto done;
+    ctx->slot = PK11_GetBestSlot(mech, NULL);
+    if (ctx->slot == NULL) {
+        ctx->slot = PK11_GetInternalKeySlot();
+        if (ctx->slot == NULL) {
+            goto error;
         }
     }
 
-    symkey = PK11_ImportSymKey(slot, mech, PK11_OriginUnwrap,
-                               CKA_SIGN, key, NULL);
-    if (symkey == NULL)
-        goto done;
+    ctx->symkey = PK11_ImportSymKey(ctx->slot, mech, PK11_OriginUnwrap,
+                                    CKA_SIGN, &keyitm, NULL);
+    if (ctx->symkey == NULL)
+        goto error;
+
+    ctx->ctx = PK11_CreateContextBySymKey(mech, CKA_SIGN, ctx->symkey, &param);
+    if (ctx->ctx == NULL)
+        goto error;
+
+    return ctx;
+
+error:
+    hotp_context_free(ctx);
+    return NULL;
+}
 
-    ctx = PK11_CreateContextBySymKey(mech, CKA_SIGN, symkey, &param);
+void hotp_context_free(struct hotp_context *ctx)
+{
     if (ctx == NULL)
-        goto done;
+        return;
+
+    if (ctx->ctx != NULL)
+        PK11_DestroyContext(ctx->ctx, PR_TRUE);
+    if (ctx->symkey != NULL)
+        PK11_FreeSymKey(ctx->symkey);
+    if (ctx->slot != NULL)
+        PK11_FreeSlot(ctx->slot);
+    free(ctx);
+}
 
-    s = PK11_DigestBegin(ctx);
-    if (s != SECSuccess)
-        goto done;
+static bool hmac(struct hotp_context *ctx, const SECItem *in,
+                 struct digest_buffer *out)
+{
+    SECStatus s;
 
-    s = PK11_DigestOp(ctx, in->data, in->len);
+    s = PK11_DigestBegin(ctx->ctx);
     if (s != SECSuccess)
-        goto done;
+        return false;
 
-    s = PK11_DigestFinal(ctx, out->buf, &out->len, sizeof(out->buf));
+    s = PK11_DigestOp(ctx->ctx, in->data, in->len);
     if (s != SECSuccess)
-        goto done;
+        return false;
 
-    ret = true;
+    s = PK11_DigestFinal(ctx->ctx, out->buf, &out->len, sizeof(out->buf));
+    if (s != SECSuccess)
+        return false;
 
-done:
-    if (ctx != NULL)
-        PK11_DestroyContext(ctx, PR_TRUE);
-    if (symkey != NULL)
-        PK11_FreeSymKey(symkey);
-    if (slot != NULL)
-        PK11_FreeSlot(slot);
-    return ret;
+    return true;
 }
 
 /*
- * An implementation of HOTP (RFC 4226).
+ * An implementation of HOTP (RFC 4226) using a precomputed context.
  */
-bool hotp(const struct hotp_token *token, uint64_t counter, uint32_t *out)
+bool hotp_ctx(struct hotp_context *ctx, uint64_t counter, uint32_t *out)
 {
     const SECItem cntr = { siBuffer, (uint8_t *) &counter, sizeof(counter) };
-    SECItem keyitm = { siBuffer, token->key.bytes, token->key.len };
-    CK_MECHANISM_TYPE mech = CKM_SHA_1_HMAC;
-    PRUint64 offset, binary, div;
+    PRUint64 offset, binary;
     struct digest_buffer digest;
-    int digits = token->digits;
-    int i;
 
     /* Convert counter to network byte order. */
     counter = PR_htonll(counter);
 
-    /* Find the mech. */
-    for (i = 0; algo2mech[i].algo; i++) {
-        if (strcasecmp(algo2mech[i].algo, token->algo) == 0) {
-            mech = algo2mech[i].mech;
-            break;
-        }
-    }
-
-    /* Create the digits divisor. */
-    for (div = 1; digits > 0; digits--) {
-        div *= 10;
-    }
-
     /* Do the digest. */
-    if (!hmac(&keyitm, mech, &cntr, &digest)) {
+    if (!hmac(ctx, &cntr, &digest)) {
         return false;
     }
 
@@ -163,8 +190,25 @@ bool hotp(const struct hotp_token *token, uint64_t counter, uint32_t *out)
     binary |= (digest.buf[offset + 1] & 0xff) << 0x10;
     binary |= (digest.buf[offset + 2] & 0xff) << 0x08;
     binary |= (digest.buf[offset + 3] & 0xff) << 0x00;
-    binary  = binary % div;
+    binary  = binary % ctx->div;
 
     *out = binary;
     return true;
 }
+
+/*
+ * An implementation of HOTP (RFC 4226).
+ */
+bool hotp(const struct hotp_token *token, uint64_t counter, uint32_t *out)
+{
+    struct hotp_context *ctx;
+    bool ret;
+
+    ctx = hotp_context_new(token);
+    if (ctx == NULL)
+        return false;
+
+    ret = hotp_ctx(ctx, counter, out);
+    hotp_context_free(ctx);
+    return ret;
+}
@@ -54,6 +54,24 @@ struct hotp_token {
     int digits;
 };
 
+struct hotp_context;
+
+/*
+ * Creates a reusable HMAC context for the token's key and algorithm.
+ *
+ * The token must outlive the context. Returns NULL on error.
+ */
+struct hotp_context *hotp_context_new(const struct hotp_token *token);
+
+/* Frees a context created by hotp_context_new(). */
+void hotp_context_free(struct hotp_context *ctx);
+
+/*
+ * An implementation of HOTP (RFC 4226) using a context from
+ * hotp_context_new(). Use this when computing many codes for one token.
+ */
+bool hotp_ctx(struct hotp_context *ctx, uint64_t counter, uint32_t *out);
+
 /*
  * An implementation of HOTP (RFC 4226).
  */
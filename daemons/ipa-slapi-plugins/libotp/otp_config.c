@@ -40,28 +40,79 @@
 #include "otp_config.h"
 #include "util.h"
 
+#include <ctype.h>
+#include <pthread.h>
 #include <pratom.h>
 #include <plstr.h>
+#include <stdbool.h>
 
 #define OTP_CONFIG_AUTH_TYPE_DISABLED (1 << 31)
 
 struct spec {
     uint32_t (*func)(Slapi_Entry *, const char *attr);
-    const char *prefix;
+    const char *base; /* Config entry DN, relative to the suffix. */
     const char *attr;
     uint32_t dflt;
+    size_t index;
 };
 
-struct record {
-    struct record *next;
-    const struct spec *spec;
-    Slapi_DN *sdn;
-    uint32_t value;
+#define SPEC_COUNT 5
+
+/* The config values of one suffix, indexed by spec. */
+struct suffix {
+    char *ndn;
+    uint32_t values[SPEC_COUNT];
+};
+
+/*
+ * The token index maps owner DNs to the DNs of their tokens. Each link
+ * lives in two chained hash tables at once: one keyed by the owner (for
+ * lookups) and one keyed by the token (for updates).
+ *
+ * The index is loaded on first use and kept current by otp_config_update(),
+ * which only sees committed changes. Betxn post-ops use
+ * otp_config_update_betxn() instead, which leaves the index alone: a link
+ * added inside a transaction that later aborts would otherwise outlive it.
+ * Until it is loaded, otp_config_user_tokens() returns NULL and callers fall
+ * back to searching the directory.
+ *
+ * The lock only guards in-memory work. Loading searches every suffix, so it
+ * runs without the lock into a private index that is swapped in afterwards,
+ * unless a token changed in the meantime (gen moved). Writes to entries that
+ * are not tokens never take the lock at all.
+ */
+struct link {
+    struct link *onext;
+    struct link *tnext;
+    uint32_t ohash;
+    uint32_t thash;
+    char *owner;
+    char *token;
+};
+
+struct index {
+    pthread_rwlock_t lock;
+    bool loaded;
+    bool loading;
+    uint64_t gen;
+    struct link **owners;
+    struct link **tokens;
+    size_t mask;
+    size_t count;
 };
 
 struct otp_config {
     Slapi_ComponentId *plugin_id;
-    struct record *records;
+    struct suffix *suffixes;
+    size_t nsuffixes;
+
+    /* Suffixes are indexed in an open addressing hash table keyed by their
+     * normalized DN. The table is built once by otp_config_init() and never
+     * resized, so lookups need no locking; only the values change,
+     * atomically. */
+    struct suffix **table;
+    size_t mask;
+    struct index index;
 };
 
 static uint32_t string_to_types(const char *str)
@@ -119,65 +170,123 @@ static uint32_t entry_to_window(Slapi_Entry *e, const char *attr)
 
 static const struct spec authtypes = {
     entry_to_authtypes,
-    "cn=ipaConfig,cn=etc,%s",
+    "cn=ipaConfig,cn=etc,",
     "ipaUserAuthType",
-    OTP_CONFIG_AUTH_TYPE_PASSWORD
+    OTP_CONFIG_AUTH_TYPE_PASSWORD,
+    0
 };
 
 static const struct spec totp_auth_window = {
     entry_to_window,
-    "cn=otp,cn=etc,%s",
+    "cn=otp,cn=etc,",
     "ipatokenTOTPauthWindow",
-    300
+    300,
+    1
 };
 
 static const struct spec totp_sync_window = {
     entry_to_window,
-    "cn=otp,cn=etc,%s",
+    "cn=otp,cn=etc,",
     "ipatokenTOTPsyncWindow",
-    86400
+    86400,
+    2
 };
 
 static const struct spec hotp_auth_window = {
     entry_to_window,
-    "cn=otp,cn=etc,%s",
+    "cn=otp,cn=etc,",
     "ipatokenHOTPauthWindow",
-    10
+    10,
+    3
 };
 
 static const struct spec hotp_sync_window = {
     entry_to_window,
-    "cn=otp,cn=etc,%s",
+    "cn=otp,cn=etc,",
     "ipatokenHOTPsyncWindow",
-    100
+    100,
+    4
+};
+
+static const struct spec *specs[SPEC_COUNT + 1] = {
+    &authtypes,
+    &totp_auth_window,
+    &totp_sync_window,
+    &hotp_auth_window,
+    &hotp_sync_window,
+    NULL
 };
 
-static Slapi_DN *make_sdn(const char *prefix, const Slapi_DN *suffix)
+static uint32_t hash_ndn(const char *ndn)
 {
-    char *dn = slapi_ch_smprintf(prefix, slapi_sdn_get_dn(suffix));
-    return slapi_sdn_new_dn_passin(dn);
+    uint32_t hash = 2166136261U; /* FNV-1a */
+
+    for (; *ndn != '\0'; ndn++) {
+        hash ^= (unsigned char) tolower((unsigned char) *ndn);
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+static struct suffix *find_suffix(const struct otp_config *cfg,
+                                  const char *ndn)
+{
+    struct suffix *sfx;
+    size_t i;
+
+    if (ndn == NULL || cfg->table == NULL)
+        return NULL;
+
+    for (i = hash_ndn(ndn) & cfg->mask; (sfx = cfg->table[i]) != NULL;
+         i = (i + 1) & cfg->mask) {
+        if (strcasecmp(sfx->ndn, ndn) == 0)
+            return sfx;
+    }
+
+    return NULL;
 }
 
 static uint32_t find_value(const struct otp_config *cfg,
                            const Slapi_DN *suffix, const struct spec *spec)
 {
-    uint32_t value = 0;
-    Slapi_DN *sdn;
+    struct suffix *sfx;
+
+    if (suffix == NULL)
+        return 0;
+
+    sfx = find_suffix(cfg, slapi_sdn_get_ndn(suffix));
+    if (sfx == NULL)
+        return 0;
+
+    return PR_ATOMIC_ADD(&sfx->values[spec->index], 0);
+}
+
+/* Update the values of the config entry ndn, or reset them if it is gone. */
+static void update_dn(const struct otp_config *cfg, const char *ndn,
+                      Slapi_Entry *entry)
+{
+    struct suffix *sfx;
 
-    sdn = make_sdn(spec->prefix, suffix);
-    for (struct record *rec = cfg->records; rec != NULL; rec = rec->next) {
-        if (rec->spec != spec)
+    for (size_t i = 0; specs[i] != NULL; i++) {
+        size_t len = strlen(specs[i]->base);
+        uint32_t val = specs[i]->dflt;
+
+        if (strncasecmp(ndn, specs[i]->base, len) != 0)
             continue;
 
-        if (slapi_sdn_compare(sdn, rec->sdn) != 0)
+        sfx = find_suffix(cfg, ndn + len);
+        if (sfx == NULL)
             continue;
 
-        value = PR_ATOMIC_ADD(&rec->value, 0);
-        break;
-    }
+        if (entry != NULL) {
+            Slapi_Attr *attr = NULL;
+            if (slapi_entry_attr_find(entry, specs[i]->attr, &attr) == 0)
+                val = specs[i]->func(entry, specs[i]->attr);
+        }
 
-    slapi_sdn_free(&sdn);
-    return value;
+        PR_ATOMIC_SET(&sfx->values[specs[i]->index], val);
+    }
 }
 
 static void update(const struct otp_config *cfg, Slapi_DN *src,
@@ -185,114 +294,434 @@ static void update(const struct otp_config *cfg, Slapi_DN *src,
 {
     Slapi_DN *dst = entry == NULL ? NULL : slapi_entry_get_sdn(entry);
 
-    for (struct record *rec = cfg->records; rec != NULL; rec = rec->next) {
-        uint32_t val = rec->spec->dflt;
+    /* If deleted or moved out of place... */
+    if (src != NULL && (dst == NULL || slapi_sdn_compare(src, dst) != 0))
+        update_dn(cfg, slapi_sdn_get_ndn(src), NULL);
 
-        /* If added, modified or moved into place... */
-        if (dst != NULL && slapi_sdn_compare(rec->sdn, dst) == 0) {
-            Slapi_Attr *attr = NULL;
-            if (slapi_entry_attr_find(entry, rec->spec->attr, &attr) == 0)
-                val = rec->spec->func(entry, rec->spec->attr);
+    /* If added, modified or moved into place... */
+    if (dst != NULL)
+        update_dn(cfg, slapi_sdn_get_ndn(dst), entry);
+}
+
+static char *normalize_dn(const char *dn)
+{
+    Slapi_DN *sdn;
+    char *ndn;
+
+    sdn = slapi_sdn_new_dn_byref(dn);
+    ndn = slapi_ch_strdup(slapi_sdn_get_ndn(sdn));
+    slapi_sdn_free(&sdn);
+
+    return ndn;
+}
+
+static bool entry_is_token(Slapi_Entry *entry)
+{
+    return slapi_entry_attr_hasvalue(entry, SLAPI_ATTR_OBJECTCLASS,
+                                     "ipaToken") != 0;
+}
+
+static void index_clear(struct index *idx)
+{
+    for (size_t i = 0; idx->tokens != NULL && i <= idx->mask; i++) {
+        for (struct link *l = idx->tokens[i], *n; l != NULL; l = n) {
+            n = l->tnext;
+            slapi_ch_free_string(&l->owner);
+            slapi_ch_free_string(&l->token);
+            slapi_ch_free((void **) &l);
+        }
+    }
+
+    slapi_ch_free((void **) &idx->owners);
+    slapi_ch_free((void **) &idx->tokens);
+    idx->loaded = false;
+    idx->count = 0;
+    idx->mask = 0;
+}
+
+static void index_resize(struct index *idx, size_t size)
+{
+    struct link **owners;
+    struct link **tokens;
+
+    owners = (typeof(owners)) slapi_ch_calloc(size, sizeof(*owners));
+    tokens = (typeof(tokens)) slapi_ch_calloc(size, sizeof(*tokens));
+
+    for (size_t i = 0; idx->tokens != NULL && i <= idx->mask; i++) {
+        for (struct link *l = idx->tokens[i], *n; l != NULL; l = n) {
+            n = l->tnext;
+            l->onext = owners[l->ohash & (size - 1)];
+            owners[l->ohash & (size - 1)] = l;
+            l->tnext = tokens[l->thash & (size - 1)];
+            tokens[l->thash & (size - 1)] = l;
+        }
+    }
+
+    slapi_ch_free((void **) &idx->owners);
+    slapi_ch_free((void **) &idx->tokens);
+    idx->owners = owners;
+    idx->tokens = tokens;
+    idx->mask = size - 1;
+}
+
+/* Removes all links of the token. */
+static void index_remove(struct index *idx, const char *token)
+{
+    struct link **tp;
+    struct link **op;
+    uint32_t hash;
 
-        /* If NOT deleted or moved out of place... */
-        } else if (slapi_sdn_compare(rec->sdn, src) != 0)
+    hash = hash_ndn(token);
+    for (tp = &idx->tokens[hash & idx->mask]; *tp != NULL; ) {
+        struct link *l = *tp;
+
+        if (l->thash != hash || strcasecmp(l->token, token) != 0) {
+            tp = &l->tnext;
             continue;
+        }
 
-        PR_ATOMIC_SET(&rec->value, val);
+        for (op = &idx->owners[l->ohash & idx->mask]; *op != l; )
+            op = &(*op)->onext;
+        *op = l->onext;
+        *tp = l->tnext;
+
+        slapi_ch_free_string(&l->owner);
+        slapi_ch_free_string(&l->token);
+        slapi_ch_free((void **) &l);
+        idx->count--;
     }
 }
 
-struct otp_config *otp_config_init(Slapi_ComponentId *plugin_id)
+/* Replaces the links of the token with those of the entry, if any. */
+static void index_set(struct index *idx, const char *token, Slapi_Entry *entry)
 {
-    static const struct spec *specs[] = {
-        &authtypes,
-        &totp_auth_window,
-        &totp_sync_window,
-        &hotp_auth_window,
-        &hotp_sync_window,
-        NULL
-    };
+    char **owners;
+
+    index_remove(idx, token);
+    if (entry == NULL || !entry_is_token(entry))
+        return;
 
+    owners = slapi_entry_attr_get_charray(entry, "ipatokenOwner");
+    for (size_t i = 0; owners != NULL && owners[i] != NULL; i++) {
+        struct link *l;
+
+        if (idx->count > idx->mask)
+            index_resize(idx, (idx->mask + 1) * 2);
+
+        l = (typeof(l)) slapi_ch_calloc(1, sizeof(*l));
+        l->owner = normalize_dn(owners[i]);
+        l->token = slapi_ch_strdup(token);
+        l->ohash = hash_ndn(l->owner);
+        l->thash = hash_ndn(l->token);
+        l->onext = idx->owners[l->ohash & idx->mask];
+        idx->owners[l->ohash & idx->mask] = l;
+        l->tnext = idx->tokens[l->thash & idx->mask];
+        idx->tokens[l->thash & idx->mask] = l;
+        idx->count++;
+    }
+
+    slapi_ch_array_free(owners);
+}
+
+/* Loads all the tokens of all suffixes into a private index. */
+static bool index_load(const struct otp_config *cfg, struct index *idx)
+{
+    char *attrs[] = { SLAPI_ATTR_OBJECTCLASS, "ipatokenOwner", NULL };
+
+    index_resize(idx, 64);
+
+    for (size_t i = 0; i < cfg->nsuffixes; i++) {
+        Slapi_Entry **entries = NULL;
+        Slapi_PBlock *pb = NULL;
+        int result = -1;
+
+        pb = slapi_pblock_new();
+        slapi_search_internal_set_pb(pb, cfg->suffixes[i].ndn,
+                                     LDAP_SCOPE_SUBTREE,
+                                     "(objectClass=ipaToken)", attrs, 0,
+                                     NULL, NULL, cfg->plugin_id, 0);
+        slapi_search_internal_pb(pb);
+
+        slapi_pblock_get(pb, SLAPI_PLUGIN_INTOP_RESULT, &result);
+        if (result != LDAP_SUCCESS) {
+            LOG_TRACE("Unable to load the tokens of '%s' (%d)\n",
+                      cfg->suffixes[i].ndn, result);
+            slapi_free_search_results_internal(pb);
+            slapi_pblock_destroy(pb);
+            index_clear(idx);
+            return false;
+        }
+
+        slapi_pblock_get(pb, SLAPI_PLUGIN_INTOP_SEARCH_ENTRIES, &entries);
+        for (size_t j = 0; entries != NULL && entries[j] != NULL; j++) {
+            const char *ndn = slapi_sdn_get_ndn(slapi_entry_get_sdn(entries[j]));
+            index_set(idx, ndn, entries[j]);
+        }
+
+        slapi_free_search_results_internal(pb);
+        slapi_pblock_destroy(pb);
+    }
+
+    idx->loaded = true;
+    return true;
+}
+
+/* Loads the shared index if needed. On success, the read lock is held. */
+static bool index_rdlock(const struct otp_config *cfg, struct index *idx)
+{
+    struct index tmp = { .loaded = false };
+    bool loaded;
+    uint64_t gen;
+
+    pthread_rwlock_rdlock(&idx->lock);
+    if (idx->loaded)
+        return true;
+    pthread_rwlock_unlock(&idx->lock);
+
+    /* Only one thread loads; the others search the directory meanwhile. */
+    pthread_rwlock_wrlock(&idx->lock);
+    if (idx->loading) {
+        pthread_rwlock_unlock(&idx->lock);
+        return false;
+    }
+    if (idx->loaded) {
+        pthread_rwlock_unlock(&idx->lock);
+        pthread_rwlock_rdlock(&idx->lock);
+        return true;
+    }
+    idx->loading = true;
+    gen = idx->gen;
+    pthread_rwlock_unlock(&idx->lock);
+
+    loaded = index_load(cfg, &tmp);
+
+    /* If a token changed while we searched, the searches may or may not
+     * have seen it: drop the result and let a later lookup try again. */
+    pthread_rwlock_wrlock(&idx->lock);
+    idx->loading = false;
+    if (loaded && idx->gen == gen) {
+        idx->owners = tmp.owners;
+        idx->tokens = tmp.tokens;
+        idx->mask = tmp.mask;
+        idx->count = tmp.count;
+        idx->loaded = true;
+        memset(&tmp, 0, sizeof(tmp));
+    } else {
+        loaded = false;
+    }
+    pthread_rwlock_unlock(&idx->lock);
+
+    index_clear(&tmp);
+    if (!loaded)
+        return false;
+
+    /* Nothing unloads the index before otp_config_fini(). */
+    pthread_rwlock_rdlock(&idx->lock);
+    return true;
+}
+
+static void index_update(struct otp_config *cfg, Slapi_DN *src,
+                         Slapi_Entry *pre, Slapi_Entry *entry)
+{
+    Slapi_DN *dst = entry == NULL ? NULL : slapi_entry_get_sdn(entry);
+    struct index *idx = &cfg->index;
+
+    /* Skip entries that are not tokens before or after the change. Without
+     * a pre-op entry a delete could be anything, so it is not skipped. */
+    if ((pre != NULL || entry != NULL) &&
+        (pre == NULL || !entry_is_token(pre)) &&
+        (entry == NULL || !entry_is_token(entry)))
+        return;
+
+    pthread_rwlock_wrlock(&idx->lock);
+
+    idx->gen++;
+    if (idx->loaded) {
+        /* If deleted or moved out of place... */
+        if (src != NULL && (dst == NULL || slapi_sdn_compare(src, dst) != 0))
+            index_remove(idx, slapi_sdn_get_ndn(src));
+
+        /* If added, modified or moved into place... */
+        if (dst != NULL)
+            index_set(idx, slapi_sdn_get_ndn(dst), entry);
+    }
+
+    pthread_rwlock_unlock(&idx->lock);
+}
+
+struct otp_config *otp_config_init(Slapi_ComponentId *plugin_id)
+{
     struct otp_config *cfg = NULL;
     void *node = NULL;
     int search_result = 0;
+    size_t count = 0;
 
     cfg = (typeof(cfg)) slapi_ch_calloc(1, sizeof(*cfg));
     cfg->plugin_id = plugin_id;
+    if (pthread_rwlock_init(&cfg->index.lock, NULL) != 0) {
+        slapi_ch_free((void **) &cfg);
+        return NULL;
+    }
 
-    /* Build the config table. */
+    /* Count the suffixes and size the table for a load factor <= 0.5. */
     for (Slapi_DN *sfx = slapi_get_first_suffix(&node, 0);
          sfx != NULL;
+         sfx = slapi_get_next_suffix(&node, 0))
+        count++;
+
+    for (cfg->mask = 1; cfg->mask < count * 2; cfg->mask <<= 1)
+        continue;
+    cfg->table = (typeof(cfg->table))
+        slapi_ch_calloc(cfg->mask, sizeof(*cfg->table));
+    cfg->suffixes = (typeof(cfg->suffixes))
+        slapi_ch_calloc(count > 0 ? count : 1, sizeof(*cfg->suffixes));
+    cfg->mask--;
+
+    /* Build the config table. */
+    node = NULL;
+    for (Slapi_DN *sfx = slapi_get_first_suffix(&node, 0);
+         sfx != NULL && cfg->nsuffixes < count;
          sfx = slapi_get_next_suffix(&node, 0)) {
-        for (size_t i = 0; specs[i] != NULL; i++) {
-            Slapi_Entry *entry = NULL;
-            struct record *rec;
+        struct suffix *suffix = &cfg->suffixes[cfg->nsuffixes];
+        size_t i;
+
+        suffix->ndn = slapi_ch_strdup(slapi_sdn_get_ndn(sfx));
+        if (find_suffix(cfg, suffix->ndn) != NULL) {
+            slapi_ch_free_string(&suffix->ndn);
+            continue;
+        }
 
-            /* Create the config entry. */
-            rec = (typeof(rec)) slapi_ch_calloc(1, sizeof(*rec));
-            rec->spec = specs[i];
-            rec->sdn = make_sdn(rec->spec->prefix, sfx);
+        for (i = hash_ndn(suffix->ndn) & cfg->mask; cfg->table[i] != NULL;
+             i = (i + 1) & cfg->mask)
+            continue;
+        cfg->table[i] = suffix;
+        cfg->nsuffixes++;
 
-            /* Add config to the list. */
-            rec->next = cfg->records;
-            cfg->records = rec;
+        for (i = 0; specs[i] != NULL; i++) {
+            Slapi_Entry *entry = NULL;
+            Slapi_DN *sdn;
+
+            suffix->values[specs[i]->index] = specs[i]->dflt;
 
             /* Load the specified entry. */
-            search_result = slapi_search_internal_get_entry(rec->sdn,
+            sdn = slapi_sdn_new_dn_passin(
+                    slapi_ch_smprintf("%s%s", specs[i]->base,
+                                      slapi_sdn_get_dn(sfx)));
+            search_result = slapi_search_internal_get_entry(sdn,
                     NULL, &entry, plugin_id);
             if (search_result != LDAP_SUCCESS) {
                 LOG_TRACE("File '%s' line %d: Unable to access LDAP entry "
                         "'%s'. Perhaps it doesn't exist? "
                         "Error code: %d\n", __FILE__, __LINE__,
-                        slapi_sdn_get_dn(rec->sdn), search_result);
+                        slapi_sdn_get_dn(sdn), search_result);
             }
-            update(cfg, rec->sdn, entry);
+            update(cfg, sdn, entry);
             slapi_entry_free(entry);
+            slapi_sdn_free(&sdn);
         }
     }
 
     return cfg;
 }
 
-static void record_fini(struct record **rec)
-{
-    if (rec == NULL || *rec == NULL)
-        return;
-
-    record_fini(&(*rec)->next);
-    slapi_sdn_free(&(*rec)->sdn);
-    slapi_ch_free((void **) rec);
-}
-
 void otp_config_fini(struct otp_config **cfg)
 {
     if (cfg == NULL || *cfg == NULL)
         return;
 
-    record_fini(&(*cfg)->records);
+    index_clear(&(*cfg)->index);
+    pthread_rwlock_destroy(&(*cfg)->index.lock);
+
+    for (size_t i = 0; i < (*cfg)->nsuffixes; i++)
+        slapi_ch_free_string(&(*cfg)->suffixes[i].ndn);
+    slapi_ch_free((void **) &(*cfg)->suffixes);
+    slapi_ch_free((void **) &(*cfg)->table);
     slapi_ch_free((void **) cfg);
 }
 
-void otp_config_update(struct otp_config *cfg, Slapi_PBlock *pb)
+static bool get_op(Slapi_PBlock *pb, Slapi_DN **src,
+                   Slapi_Entry **pre, Slapi_Entry **entry)
 {
-    Slapi_Entry *entry = NULL;
-    Slapi_DN *src = NULL;
     int oprc = 0;
 
     /* Just bail if the operation failed. */
     if (slapi_pblock_get(pb, SLAPI_PLUGIN_OPRETURN, &oprc) != 0 || oprc != 0)
-        return;
+        return false;
 
     /* Get the source SDN. */
-    if (slapi_pblock_get(pb, SLAPI_TARGET_SDN, &src) != 0)
+    if (slapi_pblock_get(pb, SLAPI_TARGET_SDN, src) != 0)
+        return false;
+
+    /* Ignore the errors here (add and delete operations). */
+    (void) slapi_pblock_get(pb, SLAPI_ENTRY_PRE_OP, pre);
+    (void) slapi_pblock_get(pb, SLAPI_ENTRY_POST_OP, entry);
+    return true;
+}
+
+void otp_config_update(struct otp_config *cfg, Slapi_PBlock *pb)
+{
+    Slapi_Entry *entry = NULL;
+    Slapi_Entry *pre = NULL;
+    Slapi_DN *src = NULL;
+
+    if (!get_op(pb, &src, &pre, &entry))
         return;
 
-    /* Ignore the error here (delete operations). */
-    (void) slapi_pblock_get(pb, SLAPI_ENTRY_POST_OP, &entry);
+    update(cfg, src, entry);
+    index_update(cfg, src, pre, entry);
+}
+
+void otp_config_update_betxn(struct otp_config *cfg, Slapi_PBlock *pb)
+{
+    Slapi_Entry *entry = NULL;
+    Slapi_Entry *pre = NULL;
+    Slapi_DN *src = NULL;
+
+    if (!get_op(pb, &src, &pre, &entry))
+        return;
 
     update(cfg, src, entry);
 }
 
+char **otp_config_user_tokens(const struct otp_config *cfg,
+                              const char *user_dn)
+{
+    struct index *idx;
+    char **dns = NULL;
+    size_t count = 0;
+    uint32_t hash;
+    char *ndn;
+
+    if (cfg == NULL || user_dn == NULL)
+        return NULL;
+
+    /* The index is only written under the lock, so casting away const here
+     * is no different from the atomic updates of the config values. */
+    idx = (struct index *) &cfg->index;
+
+    if (!index_rdlock(cfg, idx))
+        return NULL;
+
+    ndn = normalize_dn(user_dn);
+    hash = hash_ndn(ndn);
+
+    for (struct link *l = idx->owners[hash & idx->mask]; l; l = l->onext) {
+        if (l->ohash == hash && strcasecmp(l->owner, ndn) == 0)
+            count++;
+    }
+
+    dns = (typeof(dns)) slapi_ch_calloc(count + 1, sizeof(*dns));
+    count = 0;
+    for (struct link *l = idx->owners[hash & idx->mask]; l; l = l->onext) {
+        if (l->ohash == hash && strcasecmp(l->owner, ndn) == 0)
+            dns[count++] = slapi_ch_strdup(l->token);
+    }
+
+    pthread_rwlock_unlock(&idx->lock);
+    slapi_ch_free_string(&ndn);
+    return dns;
+}
+
 Slapi_ComponentId *otp_config_plugin_id(const struct otp_config *cfg)
 {
     if (cfg == NULL)
@@ -60,8 +60,22 @@ void otp_config_fini(struct otp_config **cfg);
 
 void otp_config_update(struct otp_config *cfg, Slapi_PBlock *pb);
 
+/* Like otp_config_update(), but for betxn post-ops: the config values are
+ * updated, the token index is not. It must only follow committed changes,
+ * so the post-op that runs after the commit updates it. */
+void otp_config_update_betxn(struct otp_config *cfg, Slapi_PBlock *pb);
+
 Slapi_ComponentId *otp_config_plugin_id(const struct otp_config *cfg);
 
+/* Gets the DNs of the tokens owned by the user from the token index.
+ *
+ * The index is loaded on the first call and kept current by
+ * otp_config_update(). Returns NULL if the index is unavailable; otherwise
+ * the (possibly empty) array must be freed with slapi_ch_array_free().
+ */
+char **otp_config_user_tokens(const struct otp_config *cfg,
+                              const char *user_dn);
+
 /* Gets the permitted authentication types for the given user entry.
  *
  * The entry should be queried for the "ipaUserAuthType" attribute.
@@ -43,6 +43,7 @@
 
 #include <time.h>
 #include <errno.h>
+#include <stdint.h>
 
 #define TOKEN(s) "ipaToken" s
 #define O(s) TOKEN("OTP" s)
@@ -63,6 +64,7 @@ struct otp_token {
     const struct otp_config *cfg;
     Slapi_DN *sdn;
     struct hotp_token token;
+    struct hotp_context *hmac; /* Created on first use by validate(). */
     enum type type;
     struct otp_config_window window;
     union {
@@ -145,6 +147,15 @@ error:
     return success;
 }
 
+/* Window searches compute many codes, so keep the key imported. */
+static bool token_hmac(struct otp_token *token)
+{
+    if (token->hmac == NULL)
+        token->hmac = hotp_context_new(&token->token);
+
+    return token->hmac != NULL;
+}
+
 /**
  * Validate a token.
  *
@@ -156,6 +167,9 @@ static bool validate(struct otp_token *token, time_t now, ssize_t step,
     const char *attr;
     uint32_t tmp;
 
+    if (!token_hmac(token))
+        return false;
+
     /* Calculate the absolute step. */
     switch (token->type) {
     case TYPE_TOTP:
@@ -175,7 +189,7 @@ static bool validate(struct otp_token *token, time_t now, ssize_t step,
     }
 
     /* Validate the first code. */
-    if (!hotp(&token->token, step++, &tmp))
+    if (!hotp_ctx(token->hmac, step++, &tmp))
         return false;
 
     if (first != tmp)
@@ -183,7 +197,7 @@ static bool validate(struct otp_token *token, time_t now, ssize_t step,
 
     /* Validate the second code if specified. */
     if (second != NULL) {
-        if (!hotp(&token->token, step++, &tmp))
+        if (!hotp_ctx(token->hmac, step++, &tmp))
             return false;
 
         if (*second != tmp)
@@ -221,6 +235,7 @@ static void otp_token_free(struct otp_token *token)
     if (token == NULL)
         return;
 
+    hotp_context_free(token->hmac);
     slapi_sdn_free(&token->sdn);
     free(token->token.key.bytes);
     slapi_ch_free_string(&token->token.algo);
@@ -321,18 +336,71 @@ error:
     return NULL;
 }
 
+/* Appends the tokens found by the search to the array. */
+static bool search(const struct otp_config *cfg, const char *base, int scope,
+                   const char *filter, bool missing_ok,
+                   struct otp_token ***tokens, size_t *count)
+{
+    struct otp_token **tmp;
+    Slapi_Entry **entries = NULL;
+    Slapi_PBlock *pb = NULL;
+    bool success = false;
+    size_t n;
+    int result = -1;
+
+    pb = slapi_pblock_new();
+    slapi_search_internal_set_pb(pb, base, scope, filter, NULL, 0, NULL, NULL,
+                                 otp_config_plugin_id(cfg), 0);
+    slapi_search_internal_pb(pb);
+
+    /* Get the results. */
+    slapi_pblock_get(pb, SLAPI_PLUGIN_INTOP_RESULT, &result);
+    if (result == LDAP_NO_SUCH_OBJECT && missing_ok) {
+        success = true;
+        goto egress;
+    }
+    if (result != LDAP_SUCCESS)
+        goto egress;
+    slapi_pblock_get(pb, SLAPI_PLUGIN_INTOP_SEARCH_ENTRIES, &entries);
+    if (entries == NULL)
+        goto egress;
+
+    /* TODO: Can I get the count another way? */
+    for (n = 0; entries[n] != NULL; n++)
+        continue;
+
+    /* Grow the array. */
+    tmp = realloc(*tokens, (*count + n + 1) * sizeof(*tmp));
+    if (tmp == NULL)
+        goto egress;
+    *tokens = tmp;
+    tmp[*count] = NULL;
+
+    for (n = 0; entries[n] != NULL; n++) {
+        tmp[*count] = otp_token_new(cfg, entries[n]);
+        if (tmp[*count] == NULL)
+            goto egress;
+        tmp[++*count] = NULL;
+    }
+
+    success = true;
+
+egress:
+    slapi_pblock_destroy(pb);
+    return success;
+}
+
 static struct otp_token **find(const struct otp_config *cfg, const char *user_dn,
                                const char *token_dn, const char *intfilter,
                                const char *extfilter)
 {
     struct otp_token **tokens = NULL;
     const Slapi_DN *basedn = NULL;
-    Slapi_Entry **entries = NULL;
-    Slapi_PBlock *pb = NULL;
     Slapi_DN *sdn = NULL;
+    char **dns = NULL;
     char *filter = NULL;
     size_t count = 0;
-    int result = -1;
+    bool success = false;
 
     if (intfilter == NULL)
         intfilter = "";
@@ -350,55 +418,43 @@ static struct otp_token **find(const struct otp_config *cfg, const char *user_dn
                                       user_dn, intfilter, extfilter);
     }
 
-    /* Create the search. */
-    pb = slapi_pblock_new();
+    /* Start with an empty array. */
+    tokens = calloc(1, sizeof(*tokens));
+    if (tokens == NULL)
+        goto error;
+
     if (token_dn != NULL) {
         /* Find only the token specified. */
-        slapi_search_internal_set_pb(pb, token_dn, LDAP_SCOPE_BASE, filter,
-                                     NULL, 0, NULL, NULL,
-                                     otp_config_plugin_id(cfg), 0);
+        success = search(cfg, token_dn, LDAP_SCOPE_BASE, filter, false,
+                         &tokens, &count);
+    } else if ((dns = otp_config_user_tokens(cfg, user_dn)) != NULL) {
+        /* Fetch only the user's tokens, as listed by the token index. The
+         * filter still applies, so a stale index entry is harmless. */
+        success = true;
+        for (size_t i = 0; success && dns[i] != NULL; i++) {
+            success = search(cfg, dns[i], LDAP_SCOPE_BASE, filter, true,
+                             &tokens, &count);
+        }
+        slapi_ch_array_free(dns);
     } else {
         sdn = slapi_sdn_new_dn_byval(user_dn);
         basedn = slapi_get_suffix_by_dn(sdn);
         slapi_sdn_free(&sdn);
-        if (basedn == NULL)
-            goto error;
 
         /* Find all user tokens. */
-        slapi_search_internal_set_pb(pb, slapi_sdn_get_dn(basedn),
-                                     LDAP_SCOPE_SUBTREE, filter, NULL, 0,
-                                     NULL, NULL, otp_config_plugin_id(cfg), 0);
-    }
-    slapi_search_internal_pb(pb);
-    slapi_ch_free_string(&filter);
-
-    /* Get the results. */
-    slapi_pblock_get(pb, SLAPI_PLUGIN_INTOP_RESULT, &result);
-    if (result != LDAP_SUCCESS)
-        goto error;
-    slapi_pblock_get(pb, SLAPI_PLUGIN_INTOP_SEARCH_ENTRIES, &entries);
-    if (entries == NULL)
-        goto error;
-
-    /* TODO: Can I get the count another way? */
-    for (count = 0; entries[count] != NULL; count++)
-        continue;
-
-    /* Create the array. */
-    tokens = calloc(count + 1, sizeof(*tokens));
-    if (tokens == NULL)
-        goto error;
-    for (count = 0; entries[count] != NULL; count++) {
-        tokens[count] = otp_token_new(cfg, entries[count]);
-        if (tokens[count] == NULL) {
-            otp_token_free_array(tokens);
-            tokens = NULL;
-            goto error;
+        if (basedn != NULL) {
+            success = search(cfg, slapi_sdn_get_dn(basedn), LDAP_SCOPE_SUBTREE,
+                             filter, false, &tokens, &count);
         }
     }
 
 error:
-    slapi_pblock_destroy(pb);
+    slapi_ch_free_string(&filter);
+    if (!success) {
+        otp_token_free_array(tokens);
+        return NULL;
+    }
+
     return tokens;
 }
 
@@ -477,6 +533,147 @@ static bool step_is_valid(struct otp_token *token, bool sync, uint32_t i)
     }
 }
 
+/*
+ * Find the step of a synchronization code pair within the sync window.
+ *
+ * The outward search used for authentication computes two codes per step and
+ * has to reach the edge of the window before it can reject a pair. Sync
+ * windows are large, so instead all codes in the window are computed once and
+ * indexed by value. Matching is then a hash table probe.
+ *
+ * Only steps at or after the current one are searched: synchronization never
+ * moves a token backwards. The sync window is set by the administrator, so
+ * the search is capped at OTP_SYNC_STEPS_MAX steps to keep the tables built
+ * on every sync bind small. On success, *out is set to the nearest matching
+ * step relative to the current one.
+ */
+static bool find_sync_step(struct otp_token *token, time_t now,
+                           uint32_t first, uint32_t second, ssize_t *out)
+{
+    uint32_t *codes = NULL, *slots = NULL, mask, count, h, n, best = 0;
+    int64_t lo;
+    bool found = false;
+
+    switch (token->type) {
+    case TYPE_TOTP:
+        n = token->window.sync / token->totp.step;
+        if (token->window.sync % token->totp.step != 0)
+            n++;
+        lo = (now + token->totp.offset) / token->totp.step;
+        break;
+    case TYPE_HOTP:
+        n = token->window.sync;
+        lo = token->hotp.counter;
+        break;
+    default:
+        return false;
+    }
+
+    /* The last candidate for the first code is lo + n - 1. One more code
+     * is needed after it to check the second code. */
+    if (n == 0 || !token_hmac(token))
+        return false;
+    if (n > OTP_SYNC_STEPS_MAX)
+        n = OTP_SYNC_STEPS_MAX;
+    count = n + 1;
+
+    /* At most half full; count is small enough for this not to overflow. */
+    for (mask = 1; mask < count * 2; mask <<= 1)
+        continue;
+    mask--;
+
+    codes = calloc(count, sizeof(*codes));
+    slots = calloc(mask + 1, sizeof(*slots));
+    if (codes == NULL || slots == NULL)
+        goto egress;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (!hotp_ctx(token->hmac, lo + i, &codes[i]))
+            goto egress;
+
+        if (i == count - 1)
+            break;
+
+        /* Slots hold the code index plus one; zero marks an empty slot. */
+        for (h = (codes[i] * 2654435761U) & mask; slots[h] != 0;
+             h = (h + 1) & mask)
+            continue;
+        slots[h] = i + 1;
+    }
+
+    for (h = (first * 2654435761U) & mask; slots[h] != 0; h = (h + 1) & mask) {
+        uint32_t i = slots[h] - 1;
+
+        if (codes[i] != first || codes[i + 1] != second)
+            continue;
+
+        if (token->type == TYPE_TOTP && token->totp.watermark > 0 &&
+            lo + i < token->totp.watermark)
+            continue;
+
+        if (!found || i < best) {
+            best = i;
+            found = true;
+        }
+    }
+
+    *out = best;
+
+egress:
+    free(codes);
+    free(slots);
+    return found;
+}
+
+/* Strip the validated codes from the end of the credentials. */
+static void strip_codes(const struct otp_token *token,
+                        struct berval *first_code, struct berval *second_code)
+{
+    first_code->bv_len -= token->token.digits;
+    first_code->bv_val[first_code->bv_len] = '\0';
+    if (second_code != NULL) {
+        second_code->bv_len -= token->token.digits;
+        second_code->bv_val[second_code->bv_len] = '\0';
+    }
+}
+
+static bool validate_sync(struct otp_token * const *tokens, time_t now,
+                          struct berval *first_code,
+                          struct berval *second_code)
+{
+    uint32_t first, second, bestfirst = 0, bestsecond = 0;
+    ssize_t step, beststep = 0;
+    int best = -1;
+
+    for (int j = 0; tokens[j] != NULL; j++) {
+        if (!bvtod(first_code, tokens[j]->token.digits, &first))
+            continue;
+
+        if (!bvtod(second_code, tokens[j]->token.digits, &second))
+            continue;
+
+        if (!find_sync_step(tokens[j], now, first, second, &step))
+            continue;
+
+        /* The nearest step wins; earlier tokens win ties. */
+        if (best < 0 || step < beststep) {
+            best = j;
+            beststep = step;
+            bestfirst = first;
+            bestsecond = second;
+        }
+    }
+
+    if (best < 0)
+        return false;
+
+    if (!validate(tokens[best], now, beststep, bestfirst, &bestsecond))
+        return false;
+
+    strip_codes(tokens[best], first_code, second_code);
+    return true;
+}
+
 bool otp_token_validate_berval(struct otp_token * const *tokens,
                                struct berval *first_code,
                                struct berval *second_code)
@@ -489,15 +686,16 @@ bool otp_token_validate_berval(struct otp_token * const *tokens,
     if (time(&now) == (time_t) -1)
         return false;
 
+    if (second_code != NULL)
+        return validate_sync(tokens, now, first_code, second_code);
+
     for (uint32_t i = 0, cnt = 1; cnt != 0; i++) {
         cnt = 0;
         for (int j = 0; tokens[j] != NULL; j++) {
-            uint32_t *secondp = NULL;
-            uint32_t second;
             uint32_t first;
 
             /* Don't validate beyond the specified window. */
-            if (!step_is_valid(tokens[j], second_code != NULL, i))
+            if (!step_is_valid(tokens[j], false, i))
                 continue;
             cnt++;
 
@@ -505,26 +703,16 @@ bool otp_token_validate_berval(struct otp_token * const *tokens,
             if (!bvtod(first_code, tokens[j]->token.digits, &first))
                 continue;
 
-            /* Parse the second code. */
-            if (second_code != NULL) {
-                secondp = &second;
-                if (!bvtod(second_code, tokens[j]->token.digits, secondp))
-                    continue;
-            }
-
-            /* Validate the positive/negative steps. */
-            if (!validate(tokens[j], now, i, first, secondp) &&
-                !validate(tokens[j], now, 0 - i, first, secondp))
+            /* Validate the positive/negative steps. Negative steps let a
+             * TOTP token whose clock runs behind authenticate; validate()
+             * still rejects anything at or below the watermark, and never
+             * moves a HOTP counter backwards. */
+            if (!validate(tokens[j], now, i, first, NULL) &&
+                !validate(tokens[j], now, -(ssize_t) i, first, NULL))
                 continue;
 
             /* Codes validated; strip. */
-            first_code->bv_len -= tokens[j]->token.digits;
-            first_code->bv_val[first_code->bv_len] = '\0';
-            if (second_code != NULL) {
-                second_code->bv_len -= tokens[j]->token.digits;
-                second_code->bv_val[second_code->bv_len] = '\0';
-            }
-
+            strip_codes(tokens[j], first_code, NULL);
             return true;
         }
     }
@@ -73,13 +73,19 @@ struct otp_token **otp_token_find(const struct otp_config *cfg,
 /* Get the SDN of the token. */
 const Slapi_DN *otp_token_get_sdn(struct otp_token *token);
 
+/* The most steps synchronization searches ahead, whatever the configured
+ * sync window. For TOTP tokens with the default 30 second step this is
+ * about 5.7 days. */
+#define OTP_SYNC_STEPS_MAX 16384
+
 /* Perform OTP authentication.
  *
  * If only the first code is specified, validation will be performed and the
  * validated token will be stripped.
  *
  * If both codes are specified, synchronization will be performed and the
- * validated tokens will be stripped.
+ * validated tokens will be stripped. At most OTP_SYNC_STEPS_MAX steps of the
+ * sync window are searched.
  *
  * Returns true if and only if all specified tokens were validated.
  */
@@ -101,6 +101,7 @@ static const struct {
 int
 main(int argc, const char *argv[])
 {
+    struct hotp_context *ctx;
     uint32_t otp;
     int i;
 
@@ -111,6 +112,15 @@ main(int argc, const char *argv[])
         assert(otp == hotp_answers[i]);
     }
 
+    /* A reused context must give the same answers, in any order. */
+    ctx = hotp_context_new(&hotp_token);
+    assert(ctx != NULL);
+    for (i = sizeof(hotp_answers) / sizeof(*hotp_answers) - 1; i >= 0; i--) {
+        assert(hotp_ctx(ctx, i, &otp));
+        assert(otp == hotp_answers[i]);
+    }
+    hotp_context_free(ctx);
+
     for (i = 0; i < sizeof(totp_tests) / sizeof(*totp_tests); i++) {
         assert(hotp(&totp_tests[i].token, totp_tests[i].time / 30, &otp));
         assert(otp == totp_tests[i].answer);
@@ -0,0 +1,302 @@
+/** BEGIN COPYRIGHT BLOCK
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Additional permission under GPLv3 section 7:
+ *
+ * In the following paragraph, "GPL" means the GNU General Public
+ * License, version 3 or any later version, and "Non-GPL Code" means
+ * code that is governed neither by the GPL nor a license
+ * compatible with the GPL.
+ *
+ * You may link the code of this Program with Non-GPL Code and convey
+ * linked combinations including the two, provided that such Non-GPL
+ * Code only links to the code of this Program through those well
+ * defined interfaces identified in the file named EXCEPTION found in
+ * the source code files (the "Approved Interfaces"). The files of
+ * Non-GPL Code may instantiate templates or use macros or inline
+ * functions from the Approved Interfaces without causing the resulting
+ * work to be covered by the GPL. Only the copyright holders of this
+ * Program may make changes or additions to the list of Approved
+ * Interfaces.
+ *
+ * Copyright (C) 2026 FreeIPA Contributors
+ * All rights reserved.
+ * END COPYRIGHT BLOCK **/
+
+/*
+ * Pins which relative steps otp_token_validate_berval() accepts.
+ *
+ * Authentication searches both directions for TOTP, to tolerate a token
+ * clock running behind, but never goes back past the watermark. HOTP and all
+ * synchronization only ever move forward.
+ */
+
+#include "hotp.h"
+#include "otp_config.h"
+#include "otp_token.h"
+#include "t_slapi.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <nss.h>
+
+#define KEY "12345678901234567890"
+#define COUNTER 1000
+
+static const struct hotp_token hotp_token = {
+    { (uint8_t *) KEY, sizeof(KEY) - 1 }, "sha1", 6
+};
+
+static char token_dn[] = "ipatokenUniqueID=test,cn=otp," SUFFIX;
+static Slapi_Entry token_entry;
+static struct otp_config *cfg;
+
+/* Replace the user's tokens with a single token of the given type. */
+static void set_token(bool totp)
+{
+    Slapi_PBlock pb = { 0 };
+
+    if (search_results[0] != NULL) {
+        pb.target = &search_results[0]->sdn;
+        pb.pre = search_results[0];
+        otp_config_update(cfg, &pb);
+        pb.pre = NULL;
+    }
+
+    memset(&token_entry, 0, sizeof(token_entry));
+    token_entry.sdn.dn = token_dn;
+    entry_add(&token_entry, "objectClass", "ipaToken", 8);
+    if (totp)
+        entry_add(&token_entry, "objectClass", "ipaTokenTOTP", 12);
+    else
+        entry_add(&token_entry, "objectClass", "ipaTokenHOTP", 12);
+    entry_add(&token_entry, "ipatokenOwner", USER_DN, strlen(USER_DN));
+    entry_add(&token_entry, "ipatokenOTPkey", KEY, sizeof(KEY) - 1);
+    entry_add(&token_entry, "ipatokenOTPdigits", "6", 1);
+    entry_add(&token_entry, "ipatokenOTPalgorithm", "sha1", 4);
+    entry_add(&token_entry, "ipatokenTOTPtimeStep", "30", 2);
+    entry_add(&token_entry, "ipatokenHOTPcounter", "1000", 4);
+    search_results[0] = &token_entry;
+    search_results[1] = NULL;
+
+    pb.target = &token_entry.sdn;
+    pb.post = &token_entry;
+    otp_config_update(cfg, &pb);
+}
+
+static void make_code(bool totp, long long step, char *out)
+{
+    uint32_t otp;
+
+    if (totp)
+        step += time(NULL) / 30;
+    else
+        step += COUNTER;
+
+    assert(hotp(&hotp_token, step, &otp));
+    sprintf(out, "password%06u", otp);
+}
+
+static bool validate(struct otp_token **tokens, bool totp, bool sync,
+                     long long step)
+{
+    char first[32], second[32];
+    struct berval bv1, bv2;
+
+    make_code(totp, step, first);
+    make_code(totp, step + 1, second);
+    bv1.bv_val = first;
+    bv1.bv_len = strlen(first);
+    bv2.bv_val = second;
+    bv2.bv_len = strlen(second);
+
+    return otp_token_validate_berval(tokens, &bv1, sync ? &bv2 : NULL);
+}
+
+/* Try the code(s) of a step relative to the current one on a fresh token. */
+static bool check(bool totp, bool sync, long long step)
+{
+    struct otp_token **tokens;
+    time_t start;
+    bool ok;
+
+    /* Retry if the TOTP step changed under us. */
+    do {
+        start = time(NULL) / 30;
+        tokens = otp_token_find(cfg, USER_DN, NULL, true, NULL);
+        assert(tokens != NULL && tokens[0] != NULL);
+        ok = validate(tokens, totp, sync, step);
+        otp_token_free_array(tokens);
+    } while (totp && time(NULL) / 30 != start);
+
+    return ok;
+}
+
+static void test_totp(void)
+{
+    struct otp_token **tokens;
+    time_t start;
+
+    set_token(true);
+
+    /* The auth window is 300 seconds: 9 steps each way. */
+    for (long long step = -9; step <= 9; step++)
+        assert(check(true, false, step));
+    assert(!check(true, false, -10));
+    assert(!check(true, false, 10));
+
+    /* A used code, or any earlier one, is never accepted again. */
+    do {
+        start = time(NULL) / 30;
+        tokens = otp_token_find(cfg, USER_DN, NULL, true, NULL);
+        assert(tokens != NULL);
+        assert(validate(tokens, true, false, 0));
+        assert(!validate(tokens, true, false, 0));
+        assert(!validate(tokens, true, false, -1));
+        assert(validate(tokens, true, false, 1));
+        otp_token_free_array(tokens);
+    } while (time(NULL) / 30 != start);
+
+    /* The sync window is 600 seconds, forward only. */
+    assert(check(true, true, 0));
+    assert(check(true, true, 19));
+    assert(!check(true, true, 20));
+    assert(!check(true, true, -1));
+    assert(!check(true, true, -10));
+}
+
+static void test_hotp(void)
+{
+    set_token(false);
+
+    /* The auth window is 10 counters, forward only. */
+    for (long long step = 0; step <= 9; step++)
+        assert(check(false, false, step));
+    assert(!check(false, false, 10));
+    assert(!check(false, false, -1));
+    assert(!check(false, false, -5));
+
+    /* The sync window is 100 counters, forward only. */
+    assert(check(false, true, 0));
+    assert(check(false, true, 99));
+    assert(!check(false, true, 100));
+    assert(!check(false, true, -1));
+}
+
+/* Change a value of the cn=otp config entry and let the config pick it up. */
+static void set_window(const char *type, const char *val)
+{
+    Slapi_PBlock pb = { 0 };
+
+    for (size_t i = 0; i < window_entry.nattrs; i++) {
+        if (strcmp(window_entry.attrs[i].type, type) != 0)
+            continue;
+        window_entry.attrs[i].value.bv.bv_val = (char *) val;
+        window_entry.attrs[i].value.bv.bv_len = strlen(val);
+    }
+
+    pb.target = &window_entry.sdn;
+    pb.post = &window_entry;
+    otp_config_update(cfg, &pb);
+}
+
+static void test_huge_sync_window(void)
+{
+    /* An administrator may set any sync window; the search stops at
+     * OTP_SYNC_STEPS_MAX steps instead of sizing its tables by it. */
+    set_window("ipatokenHOTPsyncWindow", "4294967295");
+    set_token(false);
+    assert(check(false, true, 0));
+    assert(check(false, true, OTP_SYNC_STEPS_MAX - 1));
+    assert(!check(false, true, OTP_SYNC_STEPS_MAX));
+    assert(!check(false, true, -1));
+
+    set_window("ipatokenTOTPsyncWindow", "4294967295");
+    set_token(true);
+    assert(check(true, true, 0));
+    assert(check(true, true, OTP_SYNC_STEPS_MAX - 1));
+    assert(!check(true, true, OTP_SYNC_STEPS_MAX));
+
+    set_window("ipatokenHOTPsyncWindow", "100");
+    set_window("ipatokenTOTPsyncWindow", "600");
+}
+
+static size_t count_tokens(void)
+{
+    char **dns;
+    size_t count;
+
+    dns = otp_config_user_tokens(cfg, USER_DN);
+    assert(dns != NULL);
+    for (count = 0; dns[count] != NULL; count++)
+        continue;
+    slapi_ch_array_free(dns);
+    return count;
+}
+
+static void test_betxn_index(void)
+{
+    static char dn[] = "ipatokenUniqueID=test2,cn=otp," SUFFIX;
+    Slapi_Entry entry = { .sdn.dn = dn };
+    Slapi_PBlock pb = { 0 };
+
+    set_token(false);
+    assert(count_tokens() == 1);
+
+    /* The transaction may still abort, so the index waits for the commit. */
+    entry_add(&entry, "objectClass", "ipaToken", 8);
+    entry_add(&entry, "ipatokenOwner", USER_DN, strlen(USER_DN));
+    pb.target = &entry.sdn;
+    pb.post = &entry;
+    otp_config_update_betxn(cfg, &pb);
+    assert(count_tokens() == 1);
+
+    otp_config_update(cfg, &pb);
+    assert(count_tokens() == 2);
+
+    pb.pre = &entry;
+    pb.post = NULL;
+    otp_config_update_betxn(cfg, &pb);
+    assert(count_tokens() == 2);
+
+    otp_config_update(cfg, &pb);
+    assert(count_tokens() == 1);
+}
+
+int
+main(int argc, const char *argv[])
+{
+    NSS_NoDB_Init(".");
+
+    window_entry.sdn.dn = "cn=otp,cn=etc," SUFFIX;
+    entry_add(&window_entry, "ipatokenTOTPauthWindow", "300", 3);
+    entry_add(&window_entry, "ipatokenTOTPsyncWindow", "600", 3);
+    entry_add(&window_entry, "ipatokenHOTPauthWindow", "10", 2);
+    entry_add(&window_entry, "ipatokenHOTPsyncWindow", "100", 3);
+
+    cfg = otp_config_init(NULL);
+    assert(cfg != NULL);
+
+    test_totp();
+    test_hotp();
+    test_huge_sync_window();
+    test_betxn_index();
+
+    otp_config_fini(&cfg);
+    NSS_Shutdown();
+    return 0;
+}
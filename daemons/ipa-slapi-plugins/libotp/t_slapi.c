@@ -0,0 +1,386 @@
+/** BEGIN COPYRIGHT BLOCK
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Additional permission under GPLv3 section 7:
+ *
+ * In the following paragraph, "GPL" means the GNU General Public
+ * License, version 3 or any later version, and "Non-GPL Code" means
+ * code that is governed neither by the GPL nor a license
+ * compatible with the GPL.
+ *
+ * You may link the code of this Program with Non-GPL Code and convey
+ * linked combinations including the two, provided that such Non-GPL
+ * Code only links to the code of this Program through those well
+ * defined interfaces identified in the file named EXCEPTION found in
+ * the source code files (the "Approved Interfaces"). The files of
+ * Non-GPL Code may instantiate templates or use macros or inline
+ * functions from the Approved Interfaces without causing the resulting
+ * work to be covered by the GPL. Only the copyright holders of this
+ * Program may make changes or additions to the list of Approved
+ * Interfaces.
+ *
+ * Copyright (C) 2026 FreeIPA Contributors
+ * All rights reserved.
+ * END COPYRIGHT BLOCK **/
+
+#define _GNU_SOURCE 1
+#include "t_slapi.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct slapi_dn suffix = { SUFFIX };
+Slapi_Entry *search_results[MAX_TOKENS + 1];
+Slapi_Entry window_entry;
+size_t modifies;
+
+void entry_add(Slapi_Entry *e, const char *type, const char *val,
+                      size_t len)
+{
+    e->attrs[e->nattrs].type = type;
+    e->attrs[e->nattrs].value.bv.bv_val = (char *) val;
+    e->attrs[e->nattrs].value.bv.bv_len = len;
+    e->nattrs++;
+}
+
+static const struct slapi_attr *entry_find(const Slapi_Entry *e,
+                                           const char *type)
+{
+    for (size_t i = 0; i < e->nattrs; i++) {
+        if (strcasecmp(e->attrs[i].type, type) == 0)
+            return &e->attrs[i];
+    }
+
+    return NULL;
+}
+
+int slapi_log_error(int severity, char *subsystem, char *fmt, ...)
+{
+    return 0;
+}
+
+char *slapi_ch_malloc(unsigned long size)
+{
+    return malloc(size);
+}
+
+char *slapi_ch_calloc(unsigned long nelem, unsigned long size)
+{
+    return calloc(nelem, size);
+}
+
+char *slapi_ch_strdup(const char *s)
+{
+    return s == NULL ? NULL : strdup(s);
+}
+
+void slapi_ch_free(void **ptr)
+{
+    free(*ptr);
+    *ptr = NULL;
+}
+
+void slapi_ch_free_string(char **s)
+{
+    slapi_ch_free((void **) s);
+}
+
+void slapi_ch_array_free(char **array)
+{
+    for (size_t i = 0; array != NULL && array[i] != NULL; i++)
+        free(array[i]);
+    free(array);
+}
+
+char *slapi_ch_smprintf(const char *fmt, ...)
+{
+    char *out = NULL;
+    va_list ap;
+
+    va_start(ap, fmt);
+    if (vasprintf(&out, fmt, ap) < 0)
+        out = NULL;
+    va_end(ap);
+    return out;
+}
+
+char *slapi_filter_sprintf(const char *fmt, ...)
+{
+    /* The filter is never evaluated; only its allocation matters. */
+    return strdup(fmt);
+}
+
+Slapi_DN *slapi_sdn_new_dn_passin(const char *dn)
+{
+    Slapi_DN *sdn = calloc(1, sizeof(*sdn));
+    sdn->dn = (char *) dn;
+    return sdn;
+}
+
+Slapi_DN *slapi_sdn_new_dn_byval(const char *dn)
+{
+    return slapi_sdn_new_dn_passin(strdup(dn));
+}
+
+Slapi_DN *slapi_sdn_new_dn_byref(const char *dn)
+{
+    return slapi_sdn_new_dn_byval(dn);
+}
+
+Slapi_DN *slapi_sdn_dup(const Slapi_DN *sdn)
+{
+    return slapi_sdn_new_dn_byval(sdn->dn);
+}
+
+void slapi_sdn_free(Slapi_DN **sdn)
+{
+    if (*sdn == NULL)
+        return;
+
+    free((*sdn)->dn);
+    free(*sdn);
+    *sdn = NULL;
+}
+
+const char *slapi_sdn_get_dn(const Slapi_DN *sdn)
+{
+    return sdn->dn;
+}
+
+const char *slapi_sdn_get_ndn(const Slapi_DN *sdn)
+{
+    return sdn->dn;
+}
+
+int slapi_sdn_compare(const Slapi_DN *sdn1, const Slapi_DN *sdn2)
+{
+    if (sdn1 == NULL || sdn2 == NULL)
+        return sdn1 == sdn2 ? 0 : 1;
+
+    return strcasecmp(sdn1->dn, sdn2->dn);
+}
+
+const Slapi_DN *slapi_get_suffix_by_dn(const Slapi_DN *dn)
+{
+    return &suffix;
+}
+
+Slapi_DN *slapi_get_first_suffix(void **node, int show_private)
+{
+    *node = &suffix;
+    return &suffix;
+}
+
+Slapi_DN *slapi_get_next_suffix(void **node, int show_private)
+{
+    return NULL;
+}
+
+Slapi_DN *slapi_entry_get_sdn(Slapi_Entry *e)
+{
+    return &e->sdn;
+}
+
+const Slapi_DN *slapi_entry_get_sdn_const(const Slapi_Entry *e)
+{
+    return &e->sdn;
+}
+
+void slapi_entry_free(Slapi_Entry *e)
+{
+    if (e != NULL && e->owned)
+        free(e);
+}
+
+int slapi_entry_attr_find(const Slapi_Entry *e, const char *type,
+                          Slapi_Attr **attr)
+{
+    *attr = (Slapi_Attr *) entry_find(e, type);
+    return *attr == NULL ? -1 : 0;
+}
+
+int slapi_attr_first_value(Slapi_Attr *a, Slapi_Value **v)
+{
+    *v = &a->value;
+    return 0;
+}
+
+const struct berval *slapi_value_get_berval(const Slapi_Value *value)
+{
+    return &value->bv;
+}
+
+char **slapi_entry_attr_get_charray(const Slapi_Entry *e, const char *type)
+{
+    char **vals;
+    size_t n = 0;
+
+    vals = calloc(e->nattrs + 1, sizeof(*vals));
+    for (size_t i = 0; i < e->nattrs; i++) {
+        if (strcasecmp(e->attrs[i].type, type) == 0)
+            vals[n++] = strndup(e->attrs[i].value.bv.bv_val,
+                                e->attrs[i].value.bv.bv_len);
+    }
+
+    if (n == 0) {
+        free(vals);
+        return NULL;
+    }
+
+    return vals;
+}
+
+int slapi_entry_attr_hasvalue(const Slapi_Entry *e, const char *type,
+                              const char *value)
+{
+    for (size_t i = 0; i < e->nattrs; i++) {
+        if (strcasecmp(e->attrs[i].type, type) == 0 &&
+            strncasecmp(e->attrs[i].value.bv.bv_val, value,
+                        e->attrs[i].value.bv.bv_len) == 0 &&
+            strlen(value) == e->attrs[i].value.bv.bv_len)
+            return 1;
+    }
+
+    return 0;
+}
+
+char *slapi_entry_attr_get_charptr(const Slapi_Entry *e, const char *type)
+{
+    const struct slapi_attr *a = entry_find(e, type);
+
+    if (a == NULL)
+        return NULL;
+
+    return strndup(a->value.bv.bv_val, a->value.bv.bv_len);
+}
+
+long long slapi_entry_attr_get_longlong(const Slapi_Entry *e,
+                                        const char *type)
+{
+    const struct slapi_attr *a = entry_find(e, type);
+
+    return a == NULL ? 0 : strtoll(a->value.bv.bv_val, NULL, 10);
+}
+
+int slapi_entry_attr_get_int(const Slapi_Entry *e, const char *type)
+{
+    return slapi_entry_attr_get_longlong(e, type);
+}
+
+unsigned int slapi_entry_attr_get_uint(const Slapi_Entry *e,
+                                       const char *type)
+{
+    return slapi_entry_attr_get_longlong(e, type);
+}
+
+Slapi_PBlock *slapi_pblock_new(void)
+{
+    return calloc(1, sizeof(Slapi_PBlock));
+}
+
+void slapi_pblock_destroy(Slapi_PBlock *pb)
+{
+    free(pb);
+}
+
+int slapi_pblock_get(Slapi_PBlock *pb, int arg, void *value)
+{
+    switch (arg) {
+    case SLAPI_PLUGIN_INTOP_RESULT:
+        *(int *) value = pb->result;
+        return 0;
+    case SLAPI_PLUGIN_INTOP_SEARCH_ENTRIES:
+        if (pb->scope == LDAP_SCOPE_BASE)
+            *(Slapi_Entry ***) value = pb->entries;
+        else
+            *(Slapi_Entry ***) value = search_results;
+        return 0;
+    case SLAPI_PLUGIN_OPRETURN:
+        *(int *) value = 0;
+        return 0;
+    case SLAPI_TARGET_SDN:
+        *(Slapi_DN **) value = pb->target;
+        return 0;
+    case SLAPI_ENTRY_PRE_OP:
+        *(Slapi_Entry **) value = pb->pre;
+        return 0;
+    case SLAPI_ENTRY_POST_OP:
+        *(Slapi_Entry **) value = pb->post;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+int slapi_search_internal_get_entry(Slapi_DN *dn, char **attrlist,
+                                    Slapi_Entry **ret_entry,
+                                    void *caller_identity)
+{
+    if (strncasecmp(dn->dn, "cn=otp,", 7) != 0) {
+        *ret_entry = NULL;
+        return LDAP_NO_SUCH_OBJECT;
+    }
+
+    *ret_entry = &window_entry;
+    return LDAP_SUCCESS;
+}
+
+void slapi_search_internal_set_pb(Slapi_PBlock *pb, const char *base,
+                                  int scope, const char *filter, char **attrs,
+                                  int attrsonly, LDAPControl **controls,
+                                  const char *uniqueid,
+                                  Slapi_ComponentId *plugin_identity,
+                                  int operation_flags)
+{
+    pb->base = base;
+    pb->scope = scope;
+}
+
+int slapi_search_internal_pb(Slapi_PBlock *pb)
+{
+    pb->result = LDAP_SUCCESS;
+    if (pb->scope != LDAP_SCOPE_BASE)
+        return 0;
+
+    for (size_t i = 0; search_results[i] != NULL; i++) {
+        if (strcasecmp(search_results[i]->sdn.dn, pb->base) == 0) {
+            pb->entries[0] = search_results[i];
+            return 0;
+        }
+    }
+
+    pb->result = LDAP_NO_SUCH_OBJECT;
+    return 0;
+}
+
+void slapi_free_search_results_internal(Slapi_PBlock *pb)
+{
+}
+
+void slapi_modify_internal_set_pb(Slapi_PBlock *pb, const char *dn,
+                                  LDAPMod **mods, LDAPControl **controls,
+                                  const char *uniqueid,
+                                  Slapi_ComponentId *plugin_identity,
+                                  int operation_flags)
+{
+}
+
+int slapi_modify_internal_pb(Slapi_PBlock *pb)
+{
+    modifies++;
+    pb->result = LDAP_SUCCESS;
+    return 0;
+}
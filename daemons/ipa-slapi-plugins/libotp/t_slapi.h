@@ -0,0 +1,95 @@
+/** BEGIN COPYRIGHT BLOCK
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Additional permission under GPLv3 section 7:
+ *
+ * In the following paragraph, "GPL" means the GNU General Public
+ * License, version 3 or any later version, and "Non-GPL Code" means
+ * code that is governed neither by the GPL nor a license
+ * compatible with the GPL.
+ *
+ * You may link the code of this Program with Non-GPL Code and convey
+ * linked combinations including the two, provided that such Non-GPL
+ * Code only links to the code of this Program through those well
+ * defined interfaces identified in the file named EXCEPTION found in
+ * the source code files (the "Approved Interfaces"). The files of
+ * Non-GPL Code may instantiate templates or use macros or inline
+ * functions from the Approved Interfaces without causing the resulting
+ * work to be covered by the GPL. Only the copyright holders of this
+ * Program may make changes or additions to the list of Approved
+ * Interfaces.
+ *
+ * Copyright (C) 2026 FreeIPA Contributors
+ * All rights reserved.
+ * END COPYRIGHT BLOCK **/
+
+/*
+ * A minimal in-process emulation of the slapi calls made by libotp, so that
+ * the tests and the benchmark can drive libotp without a directory server.
+ *
+ * Searches return the prebuilt entries in search_results[] and the cn=otp
+ * config entry in window_entry. Modifies are counted and discarded, so any
+ * state libotp writes back only lives in the otp_token objects.
+ */
+
+#ifndef T_SLAPI_H_
+#define T_SLAPI_H_
+
+#include <dirsrv/slapi-plugin.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SUFFIX "dc=example,dc=test"
+#define USER_DN "uid=user,cn=users,cn=accounts," SUFFIX
+#define MAX_TOKENS 16
+#define MAX_ATTRS 16
+
+struct slapi_dn {
+    char *dn;
+};
+
+struct slapi_value {
+    struct berval bv;
+};
+
+struct slapi_attr {
+    const char *type;
+    struct slapi_value value;
+};
+
+struct slapi_entry {
+    struct slapi_dn sdn;
+    struct slapi_attr attrs[MAX_ATTRS];
+    size_t nattrs;
+    bool owned;
+};
+
+struct slapi_pblock {
+    int result;
+    int scope;
+    const char *base;
+    Slapi_Entry *entries[2];
+    Slapi_DN *target;
+    Slapi_Entry *pre;
+    Slapi_Entry *post;
+};
+
+extern Slapi_Entry *search_results[MAX_TOKENS + 1];
+extern Slapi_Entry window_entry;
+extern size_t modifies;
+
+/* Appends an attribute value to e; val is not copied. */
+void entry_add(Slapi_Entry *e, const char *type, const char *val, size_t len);
+
+#endif /* T_SLAPI_H_ */
@@ -558,6 +558,466 @@ done:
     return ret;
 }
 
+/* Batch mode: all principals are handled over a single LDAP connection,
+ * with up to 'window' extended operations in flight at any time. Servers
+ * that know the batch operation get up to BATCH_CHUNK principals per
+ * request, older ones one GetKeytab request per principal. The first batch
+ * is sent alone: only its answer tells whether the server knows the batch
+ * operation at all. */
+
+#define BATCH_WINDOW_DEFAULT 4
+#define BATCH_WINDOW_MAX 32
+#define BATCH_CHUNK 50
+#define BATCH_TIMEOUT 60
+
+struct batch_entry {
+    char *principal;
+    krb5_principal sprinc;
+    long *etypes;
+    int num_etypes;
+    struct keys_container keys;
+    int kvno;
+    int result;
+    bool done;
+};
+
+struct batch_op {
+    int msgid;
+    int first;
+    int count;
+};
+
+static void free_batch_entries(krb5_context krbctx,
+                               struct batch_entry *ents, int nents)
+{
+    int i;
+
+    for (i = 0; i < nents; i++) {
+        free(ents[i].principal);
+        krb5_free_principal(krbctx, ents[i].sprinc);
+        free(ents[i].etypes);
+        free_keys_contents(krbctx, &ents[i].keys);
+    }
+    free(ents);
+}
+
+static int batch_entry_enctypes(const char *enctypes, struct batch_entry *ent,
+                                char **err_msg)
+{
+    struct krb_key_salt *es = NULL;
+    int num_es = 0;
+    int i, ret;
+
+    ret = ipa_string_to_enctypes(enctypes, &es, &num_es, err_msg);
+    if (ret || num_es == 0) {
+        free(es);
+        return -1;
+    }
+
+    ent->etypes = calloc(num_es, sizeof(long));
+    if (!ent->etypes) {
+        free(es);
+        *err_msg = _("Out of memory\n");
+        return -1;
+    }
+    for (i = 0; i < num_es; i++) {
+        ent->etypes[i] = es[i].enctype;
+    }
+    ent->num_etypes = num_es;
+
+    free(es);
+    return 0;
+}
+
+/* Each line holds a principal name, optionally followed by the encryption
+ * types to use for it. Empty lines and lines starting with '#' are
+ * skipped. */
+static int read_batch_file(krb5_context krbctx, const char *filename,
+                           const char *enctypes,
+                           struct batch_entry **_ents, int *_nents)
+{
+    struct batch_entry *ents = NULL;
+    struct batch_entry *tmp;
+    int nents = 0;
+    int size = 0;
+    FILE *f;
+    char *line = NULL;
+    size_t linesize = 0;
+    char *name, *types, *saveptr;
+    const char *ent_enctypes;
+    char *err_msg;
+    int lineno = 0;
+    int ret = -1;
+
+    if (strcmp(filename, "-") == 0) {
+        f = stdin;
+    } else {
+        f = fopen(filename, "r");
+        if (!f) {
+            fprintf(stderr, _("Failed to open %1$s: %2$s\n"),
+                            filename, strerror(errno));
+            return -1;
+        }
+    }
+
+    while (getline(&line, &linesize, f) != -1) {
+        lineno++;
+
+        name = strtok_r(line, " \t\r\n", &saveptr);
+        if (!name || name[0] == '#') continue;
+        types = strtok_r(NULL, " \t\r\n", &saveptr);
+        if (strtok_r(NULL, " \t\r\n", &saveptr)) {
+            fprintf(stderr, _("Invalid line %1$d in %2$s\n"),
+                            lineno, filename);
+            goto done;
+        }
+
+        if (nents == size) {
+            size = size ? size * 2 : 16;
+            tmp = realloc(ents, size * sizeof(struct batch_entry));
+            if (!tmp) {
+                fprintf(stderr, _("Out of memory\n"));
+                goto done;
+            }
+            ents = tmp;
+        }
+        memset(&ents[nents], 0, sizeof(struct batch_entry));
+        ents[nents].kvno = -1;
+        nents++;
+
+        ents[nents - 1].principal = strdup(name);
+        if (!ents[nents - 1].principal) {
+            fprintf(stderr, _("Out of memory\n"));
+            goto done;
+        }
+
+        if (krb5_parse_name(krbctx, name, &ents[nents - 1].sprinc)) {
+            fprintf(stderr, _("Invalid Service Principal Name %1$s "
+                              "(line %2$d)\n"), name, lineno);
+            goto done;
+        }
+
+        ent_enctypes = types ? types : enctypes;
+        if (ent_enctypes) {
+            err_msg = NULL;
+            if (batch_entry_enctypes(ent_enctypes, &ents[nents - 1],
+                                     &err_msg)) {
+                if (err_msg) fprintf(stderr, "%s", err_msg);
+                fprintf(stderr, _("Invalid encryption types for %1$s "
+                                  "(line %2$d)\n"), name, lineno);
+                goto done;
+            }
+        }
+    }
+
+    if (ferror(f)) {
+        fprintf(stderr, _("Failed to read %1$s: %2$s\n"),
+                        filename, strerror(errno));
+        goto done;
+    }
+
+    if (nents == 0) {
+        fprintf(stderr, _("No principals found in %s\n"), filename);
+        goto done;
+    }
+
+    ret = 0;
+
+done:
+    free(line);
+    if (f != stdin) fclose(f);
+    if (ret) {
+        free_batch_entries(krbctx, ents, nents);
+    } else {
+        *_ents = ents;
+        *_nents = nents;
+    }
+    return ret;
+}
+
+static int batch_send(LDAP *ld, bool generate, struct batch_entry *ents,
+                      struct batch_op *op)
+{
+    struct ipaasn1_getkt_req reqs[op->count];
+    struct batch_entry *ent;
+    struct berval bv = { 0 };
+    const char *oid;
+    bool ret;
+    int i, rc;
+
+    if (op->count == 1) {
+        ent = &ents[op->first];
+        oid = KEYTAB_GET_OID;
+        ret = ipaasn1_enc_getkt(generate, ent->principal, NULL,
+                                ent->etypes, ent->num_etypes,
+                                (void **)&bv.bv_val, &bv.bv_len);
+    } else {
+        for (i = 0; i < op->count; i++) {
+            ent = &ents[op->first + i];
+            reqs[i].newkt = generate;
+            reqs[i].princ = ent->principal;
+            reqs[i].pwd = NULL;
+            reqs[i].etypes = ent->etypes;
+            reqs[i].numtypes = ent->num_etypes;
+        }
+        oid = KEYTAB_BATCH_OID;
+        ret = ipaasn1_enc_getkt_batch(reqs, op->count,
+                                      (void **)&bv.bv_val, &bv.bv_len);
+    }
+    if (!ret) {
+        fprintf(stderr, _("Failed to create control!\n"));
+        return LDAP_ENCODING_ERROR;
+    }
+
+    rc = ldap_extended_operation(ld, oid, &bv, NULL, NULL, &op->msgid);
+    free(bv.bv_val);
+    if (rc != LDAP_SUCCESS) {
+        fprintf(stderr, _("Operation failed: %s\n"), ldap_err2string(rc));
+    }
+    return rc;
+}
+
+static void batch_fail(struct batch_entry *ents, int first, int count,
+                       int result)
+{
+    int i;
+
+    for (i = first; i < first + count; i++) {
+        if (ents[i].done) continue;
+        ents[i].result = result;
+        ents[i].done = true;
+    }
+}
+
+/* Returns true if the server does not know the batch operation, in which
+ * case the entries are left untouched so they can be retried one by one.
+ * That is only ever assumed for the answer to the first batch ('probe');
+ * once the server has handled a batch a protocol error is a real failure */
+static bool batch_receive(krb5_context krbctx, LDAP *ld, LDAPMessage *res,
+                          struct batch_entry *ents, struct batch_op *op,
+                          bool probe)
+{
+    struct ipaasn1_getkt_res *results = NULL;
+    LDAPControl **srvctrl = NULL;
+    struct batch_entry *ent;
+    struct berval data;
+    char *err = NULL;
+    bool unsupported = false;
+    int nresults = 0;
+    int ret, rc, i;
+
+    ret = ldap_parse_result(ld, res, &rc, NULL, &err, NULL, &srvctrl, 0);
+    if (ret != LDAP_SUCCESS) rc = ret;
+
+    if (rc == LDAP_PROTOCOL_ERROR && probe && op->count > 1) {
+        unsupported = true;
+        goto done;
+    }
+
+    if (rc != LDAP_SUCCESS) {
+        for (i = op->first; i < op->first + op->count; i++) {
+            fprintf(stderr, _("Failed to get keytab for %1$s: %2$s\n"),
+                            ents[i].principal,
+                            err && *err ? err : ldap_err2string(rc));
+        }
+        batch_fail(ents, op->first, op->count, rc);
+        goto done;
+    }
+
+    if (op->count == 1) {
+        ent = &ents[op->first];
+        rc = find_control_data(srvctrl, KEYTAB_GET_OID, &data);
+        if (rc == LDAP_SUCCESS &&
+            !ipaasn1_dec_getktreply(data.bv_val, data.bv_len,
+                                    &ent->kvno, &ent->keys)) {
+            fprintf(stderr, _("Failed to decode control reply!\n"));
+            rc = LDAP_DECODING_ERROR;
+        }
+        ent->result = rc;
+        ent->done = true;
+        goto done;
+    }
+
+    rc = find_control_data(srvctrl, KEYTAB_BATCH_OID, &data);
+    if (rc == LDAP_SUCCESS &&
+        (!ipaasn1_dec_getkt_batchreply(data.bv_val, data.bv_len,
+                                       &results, &nresults) ||
+         nresults != op->count)) {
+        fprintf(stderr, _("Failed to decode control reply!\n"));
+        rc = LDAP_DECODING_ERROR;
+    }
+    if (rc != LDAP_SUCCESS) {
+        batch_fail(ents, op->first, op->count, rc);
+        goto done;
+    }
+
+    for (i = 0; i < op->count; i++) {
+        ent = &ents[op->first + i];
+        ent->result = results[i].result;
+        ent->done = true;
+        if (ent->result != LDAP_SUCCESS) {
+            fprintf(stderr, _("Failed to get keytab for %1$s: %2$s\n"),
+                            ent->principal, ldap_err2string(ent->result));
+            continue;
+        }
+        ent->kvno = results[i].kvno;
+        ent->keys = results[i].keys;
+        results[i].keys.ksdata = NULL;
+        results[i].keys.nkeys = 0;
+    }
+
+done:
+    for (i = 0; i < nresults; i++) {
+        free_keys_contents(krbctx, &results[i].keys);
+    }
+    free(results);
+    if (err) ldap_memfree(err);
+    if (srvctrl) ldap_controls_free(srvctrl);
+    return unsupported;
+}
+
+static int batch_get_keytabs(krb5_context krbctx, LDAP *ld, bool generate,
+                             int window, int chunk,
+                             struct batch_entry *ents, int nents)
+{
+    struct batch_op ops[BATCH_WINDOW_MAX];
+    LDAPMessage *res;
+    struct timeval tv;
+    int inflight = 0;
+    int next = 0;
+    bool probe = (chunk > 1);
+    bool unsupported = false;
+    int msgid;
+    int ret, i;
+
+    if (window > BATCH_WINDOW_MAX) window = BATCH_WINDOW_MAX;
+
+    while (true) {
+        /* fill the window, with a single batch until the server proved it
+         * knows the operation */
+        while (!unsupported && inflight < (probe ? 1 : window)) {
+            while (next < nents && ents[next].done) next++;
+            if (next == nents) break;
+
+            ops[inflight].first = next;
+            ops[inflight].count = 0;
+            while (next < nents && ops[inflight].count < chunk &&
+                   !ents[next].done) {
+                ops[inflight].count++;
+                next++;
+            }
+
+            ret = batch_send(ld, generate, ents, &ops[inflight]);
+            if (ret != LDAP_SUCCESS) {
+                batch_fail(ents, ops[inflight].first,
+                           ops[inflight].count, ret);
+                continue;
+            }
+            inflight++;
+        }
+
+        if (inflight == 0) break;
+
+        tv.tv_sec = BATCH_TIMEOUT;
+        tv.tv_usec = 0;
+        ret = ldap_result(ld, LDAP_RES_ANY, 1, &tv, &res);
+        if (ret <= 0) {
+            ret = (ret == 0) ? LDAP_TIMEOUT : LDAP_SERVER_DOWN;
+            fprintf(stderr, _("Failed to get result: %s\n"),
+                            ldap_err2string(ret));
+            batch_fail(ents, 0, nents, ret);
+            return ret;
+        }
+
+        msgid = ldap_msgid(res);
+        for (i = 0; i < inflight; i++) {
+            if (ops[i].msgid == msgid) break;
+        }
+        if (i < inflight) {
+            if (batch_receive(krbctx, ld, res, ents, &ops[i], probe)) {
+                unsupported = true;
+            }
+            probe = false;
+            ops[i] = ops[--inflight];
+        }
+        ldap_msgfree(res);
+    }
+
+    /* the server does not support batches, retry one principal at a time */
+    if (unsupported) {
+        return batch_get_keytabs(krbctx, ld, generate, window, 1,
+                                 ents, nents);
+    }
+
+    return LDAP_SUCCESS;
+}
+
+static int run_batch(krb5_context krbctx, const char *filename, int window,
+                     bool generate, const char *enctypes, const char *server,
+                     krb5_principal uprinc, const char *binddn,
+                     const char *bindpw, krb5_keytab kt)
+{
+    struct batch_entry *ents = NULL;
+    int nents = 0;
+    LDAP *ld = NULL;
+    krb5_error_code krberr;
+    int nfailed = 0;
+    int i, j, ret;
+
+    ret = read_batch_file(krbctx, filename, enctypes, &ents, &nents);
+    if (ret) {
+        return 2;
+    }
+
+    ret = ipa_ldap_bind(server, uprinc, binddn, bindpw, &ld);
+    if (ret != LDAP_SUCCESS) {
+        fprintf(stderr, _("Failed to bind to server!\n"));
+        ret = 9;
+        goto done;
+    }
+
+    batch_get_keytabs(krbctx, ld, generate, window, BATCH_CHUNK,
+                      ents, nents);
+
+    /* store everything we got in one pass */
+    for (i = 0; i < nents; i++) {
+        if (!ents[i].done || ents[i].result != LDAP_SUCCESS) {
+            nfailed++;
+            continue;
+        }
+
+        for (j = 0; j < ents[i].keys.nkeys; j++) {
+            krb5_keytab_entry kt_entry;
+            memset((char *)&kt_entry, 0, sizeof(kt_entry));
+            kt_entry.principal = ents[i].sprinc;
+            kt_entry.key = ents[i].keys.ksdata[j].key;
+            kt_entry.vno = ents[i].kvno;
+
+            krberr = krb5_kt_add_entry(krbctx, kt, &kt_entry);
+            if (krberr) {
+                fprintf(stderr,
+                        _("Failed to add key to the keytab\n"));
+                ret = 11;
+                goto done;
+            }
+        }
+    }
+
+    if (nfailed) {
+        fprintf(stderr, _("Failed to get keytab for %1$d of %2$d "
+                          "principals\n"), nfailed, nents);
+        ret = 9;
+        goto done;
+    }
+
+    ret = 0;
+
+done:
+    if (ld) ldap_unbind_ext(ld, NULL, NULL);
+    free_batch_entries(krbctx, ents, nents);
+    return ret;
+}
+
 static char *ask_password(krb5_context krbctx)
 {
     krb5_prompt ap_prompts[2];
@@ -604,6 +1064,8 @@ int main(int argc, const char *argv[])
 	static const char *enctypes_string = NULL;
 	static const char *binddn = NULL;
 	static const char *bindpw = NULL;
+	static const char *batch_file = NULL;
+	int window = BATCH_WINDOW_DEFAULT;
 	int quiet = 0;
 	int askpass = 0;
 	int permitted_enctypes = 0;
@@ -634,6 +1096,13 @@ int main(int argc, const char *argv[])
               _("LDAP password"), _("password to use if not using kerberos") },
 	    { "retrieve", 'r', POPT_ARG_NONE, &retrieve, 0,
               _("Retrieve current keys without changing them"), NULL },
+	    { "batch", 'b', POPT_ARG_STRING, &batch_file, 0,
+              _("Get keytabs for all the principals listed in this file "
+                "('-' for standard input)"),
+              _("File Name") },
+	    { "window", 0, POPT_ARG_INT, &window, 0,
+              _("Maximum number of requests in flight in batch mode"),
+              _("Number") },
             POPT_AUTOHELP
             POPT_TABLEEND
 	};
@@ -688,7 +1157,9 @@ int main(int argc, const char *argv[])
 		exit (0);
 	}
 
-	if (ret != -1 || !server || !principal || !keytab || permitted_enctypes) {
+	if (ret != -1 || !server || !(principal || batch_file) ||
+	    (principal && batch_file) || !keytab || permitted_enctypes ||
+	    window < 1 || window > BATCH_WINDOW_MAX) {
 		if (!quiet) {
 			poptPrintUsage(pc, stderr, 0);
 		}
@@ -708,6 +1179,11 @@ int main(int argc, const char *argv[])
         exit(2);
     }
 
+    if (askpass && batch_file) {
+        fprintf(stderr, _("Incompatible options provided (-b and -P)\n"));
+        exit(2);
+    }
+
         if (askpass) {
 		password = ask_password(krbctx);
 		if (!password) {
@@ -725,10 +1201,12 @@ int main(int argc, const char *argv[])
 		exit(3);
 	}
 
-	krberr = krb5_parse_name(krbctx, principal, &sprinc);
-	if (krberr) {
-		fprintf(stderr, _("Invalid Service Principal Name\n"));
-		exit(4);
+	if (principal) {
+		krberr = krb5_parse_name(krbctx, principal, &sprinc);
+		if (krberr) {
+			fprintf(stderr, _("Invalid Service Principal Name\n"));
+			exit(4);
+		}
 	}
 
 	if (NULL == bindpw) {
@@ -755,6 +1233,15 @@ int main(int argc, const char *argv[])
 		exit(7);
 	}
 
+    if (batch_file) {
+        ret = run_batch(krbctx, batch_file, window, (retrieve == 0),
+                        enctypes_string, server, uprinc, binddn, bindpw, kt);
+        if (ret) {
+            exit(ret);
+        }
+        goto close_keytab;
+    }
+
     kvno = -1;
     ret = ldap_get_keytab(krbctx, (retrieve == 0), password, enctypes_string,
                           server, principal, uprinc, binddn, bindpw,
@@ -807,6 +1294,7 @@ int main(int argc, const char *argv[])
 
 	free_keys_contents(krbctx, &keys);
 
+close_keytab:
 	krberr = krb5_kt_close(krbctx, kt);
 	if (krberr) {
 		fprintf(stderr, _("Failed to close the keytab\n"));
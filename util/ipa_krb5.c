@@ -25,6 +25,8 @@
 #include <errno.h>
 #include <lber.h>
 #include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include <libintl.h>
 #define _(STRING) gettext(STRING)
@@ -107,6 +109,239 @@ krb5_error_code ipa_krb5_principal2salt_norealm(krb5_context context,
 void krb5int_c_free_keyblock_contents(krb5_context context,
                                       register krb5_keyblock *key);
 
+/*
+ * String-to-key is by far the most expensive part of generating a key set
+ * (PBKDF2 for the AES and Camellia enctypes), and the derivations for the
+ * different enctypes do not depend on each other, so a server may spread
+ * them over a small pool of worker threads, see ipa_krb5_s2k_pool_start().
+ * Each worker keeps one krb5 context for its whole life, as contexts cannot
+ * be shared between threads.
+ *
+ * Callers queue their derivations and keep taking them back from their
+ * own batch, so a call never waits for a busy pool: at worst it does all
+ * the work itself. Without a pool, or with fewer than IPA_S2K_MIN_KEYS
+ * keys, everything runs in the calling thread and no lock is taken.
+ */
+#define IPA_S2K_MIN_KEYS 2
+
+struct ipa_s2k_job {
+    krb5_enctype enctype;
+    krb5_data *salt;
+    krb5_keyblock *key;
+    krb5_error_code kerr;
+};
+
+struct ipa_s2k_batch {
+    krb5_data *pwd;
+    struct ipa_s2k_job *jobs;
+    int num_jobs;
+    int next;
+    int done;
+    struct ipa_s2k_batch *qnext;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t queued;
+    pthread_cond_t done;
+    struct ipa_s2k_batch *queue;
+    pthread_t tids[IPA_S2K_MAX_THREADS];
+    krb5_context ctxs[IPA_S2K_MAX_THREADS];
+    int num_threads;
+    int stop;
+} ipa_s2k_pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .queued = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+/* Takes the next job of a batch, the pool lock must be held. The batch
+ * leaves the queue with its last job. */
+static struct ipa_s2k_job *ipa_s2k_claim(struct ipa_s2k_batch *batch)
+{
+    struct ipa_s2k_batch **b;
+
+    if (batch->next >= batch->num_jobs) {
+        return NULL;
+    }
+
+    if (batch->next + 1 == batch->num_jobs) {
+        for (b = &ipa_s2k_pool.queue; *b; b = &(*b)->qnext) {
+            if (*b == batch) {
+                *b = batch->qnext;
+                break;
+            }
+        }
+    }
+
+    return &batch->jobs[batch->next++];
+}
+
+static void ipa_s2k_derive(krb5_context krbctx, krb5_data *pwd,
+                           struct ipa_s2k_job *job)
+{
+    job->kerr = krb5_c_string_to_key(krbctx, job->enctype,
+                                     pwd, job->salt, job->key);
+}
+
+static void *ipa_s2k_worker(void *arg)
+{
+    krb5_context krbctx = arg;
+    struct ipa_s2k_batch *batch;
+    struct ipa_s2k_job *job;
+
+    pthread_mutex_lock(&ipa_s2k_pool.lock);
+    for (;;) {
+        while (!ipa_s2k_pool.stop && !ipa_s2k_pool.queue) {
+            pthread_cond_wait(&ipa_s2k_pool.queued, &ipa_s2k_pool.lock);
+        }
+        if (ipa_s2k_pool.stop) {
+            break;
+        }
+
+        batch = ipa_s2k_pool.queue;
+        job = ipa_s2k_claim(batch);
+        pthread_mutex_unlock(&ipa_s2k_pool.lock);
+
+        ipa_s2k_derive(krbctx, batch->pwd, job);
+
+        pthread_mutex_lock(&ipa_s2k_pool.lock);
+        if (++batch->done == batch->num_jobs) {
+            pthread_cond_broadcast(&ipa_s2k_pool.done);
+        }
+    }
+    pthread_mutex_unlock(&ipa_s2k_pool.lock);
+
+    return NULL;
+}
+
+krb5_error_code ipa_krb5_s2k_pool_start(int num_threads)
+{
+    krb5_error_code kerr = 0;
+    long ncpus;
+    int i;
+
+    /* the calling threads derive keys too */
+    ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_threads > ncpus - 1) {
+        num_threads = ncpus - 1;
+    }
+    if (num_threads > IPA_S2K_MAX_THREADS) {
+        num_threads = IPA_S2K_MAX_THREADS;
+    }
+
+    pthread_mutex_lock(&ipa_s2k_pool.lock);
+    while (ipa_s2k_pool.num_threads < num_threads) {
+        i = ipa_s2k_pool.num_threads;
+
+        kerr = krb5_init_context(&ipa_s2k_pool.ctxs[i]);
+        if (kerr) {
+            break;
+        }
+
+        kerr = pthread_create(&ipa_s2k_pool.tids[i], NULL,
+                              ipa_s2k_worker, ipa_s2k_pool.ctxs[i]);
+        if (kerr) {
+            krb5_free_context(ipa_s2k_pool.ctxs[i]);
+            break;
+        }
+
+        /* read without the lock by ipa_string_to_keys() */
+        __atomic_add_fetch(&ipa_s2k_pool.num_threads, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&ipa_s2k_pool.lock);
+
+    return kerr;
+}
+
+void ipa_krb5_s2k_pool_stop(void)
+{
+    int i;
+
+    pthread_mutex_lock(&ipa_s2k_pool.lock);
+    ipa_s2k_pool.stop = 1;
+    pthread_cond_broadcast(&ipa_s2k_pool.queued);
+    pthread_mutex_unlock(&ipa_s2k_pool.lock);
+
+    /* queued batches are finished by their callers */
+    for (i = 0; i < ipa_s2k_pool.num_threads; i++) {
+        pthread_join(ipa_s2k_pool.tids[i], NULL);
+        krb5_free_context(ipa_s2k_pool.ctxs[i]);
+    }
+
+    pthread_mutex_lock(&ipa_s2k_pool.lock);
+    __atomic_store_n(&ipa_s2k_pool.num_threads, 0, __ATOMIC_RELAXED);
+    ipa_s2k_pool.stop = 0;
+    pthread_mutex_unlock(&ipa_s2k_pool.lock);
+}
+
+static krb5_error_code ipa_string_to_keys(krb5_context krbctx,
+                                          krb5_data *pwd, int num_keys,
+                                          krb5_key_salt_tuple *encsalts,
+                                          krb5_data *salts,
+                                          krb5_keyblock *keys)
+{
+    struct ipa_s2k_batch batch = { 0 };
+    struct ipa_s2k_job *job;
+    krb5_error_code kerr = 0;
+    int i;
+
+    if (num_keys < IPA_S2K_MIN_KEYS ||
+        __atomic_load_n(&ipa_s2k_pool.num_threads, __ATOMIC_RELAXED) == 0) {
+        for (i = 0; i < num_keys; i++) {
+            kerr = krb5_c_string_to_key(krbctx, encsalts[i].ks_enctype,
+                                        pwd, &salts[i], &keys[i]);
+            if (kerr) {
+                return kerr;
+            }
+        }
+        return 0;
+    }
+
+    batch.pwd = pwd;
+    batch.num_jobs = num_keys;
+    batch.jobs = calloc(num_keys, sizeof(struct ipa_s2k_job));
+    if (!batch.jobs) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < num_keys; i++) {
+        batch.jobs[i].enctype = encsalts[i].ks_enctype;
+        batch.jobs[i].salt = &salts[i];
+        batch.jobs[i].key = &keys[i];
+    }
+
+    pthread_mutex_lock(&ipa_s2k_pool.lock);
+    if (ipa_s2k_pool.num_threads > 0 && !ipa_s2k_pool.stop) {
+        struct ipa_s2k_batch **b = &ipa_s2k_pool.queue;
+
+        while (*b) {
+            b = &(*b)->qnext;
+        }
+        *b = &batch;
+        pthread_cond_broadcast(&ipa_s2k_pool.queued);
+    }
+
+    /* the calling thread does its share too */
+    while ((job = ipa_s2k_claim(&batch)) != NULL) {
+        pthread_mutex_unlock(&ipa_s2k_pool.lock);
+        ipa_s2k_derive(krbctx, pwd, job);
+        pthread_mutex_lock(&ipa_s2k_pool.lock);
+        batch.done++;
+    }
+    while (batch.done < batch.num_jobs) {
+        pthread_cond_wait(&ipa_s2k_pool.done, &ipa_s2k_pool.lock);
+    }
+    pthread_mutex_unlock(&ipa_s2k_pool.lock);
+
+    for (i = 0; i < num_keys && !kerr; i++) {
+        kerr = batch.jobs[i].kerr;
+    }
+
+    free(batch.jobs);
+    return kerr;
+}
+
 /*
  * Generate a krb5_key_data set by encrypting keys according to
  * enctype/salttype preferences
@@ -122,25 +357,22 @@ krb5_error_code ipa_krb5_generate_key_data(krb5_context krbctx,
 {
     krb5_error_code kerr;
     krb5_key_data *keys;
+    krb5_keyblock *kblocks = NULL;
+    krb5_data *salts = NULL;
     int num_keys;
     int i;
 
     num_keys = num_encsalts;
     keys = calloc(num_keys, sizeof(krb5_key_data));
-    if (!keys) {
-        return ENOMEM;
+    salts = calloc(num_keys, sizeof(krb5_data));
+    kblocks = calloc(num_keys, sizeof(krb5_keyblock));
+    if (!keys || !salts || !kblocks) {
+        kerr = ENOMEM;
+        goto done;
     }
 
     for (i = 0; i < num_keys; i++) {
-        krb5_keyblock key;
-        krb5_data salt;
-        krb5_octet *ptr;
-        krb5_data plain;
-        krb5_enc_data cipher;
-        krb5_int16 t;
-        size_t len;
-
-        salt.data = NULL;
+        krb5_data *salt = &salts[i];
 
         keys[i].key_data_ver = 2; /* we always have a salt */
         keys[i].key_data_kvno = kvno;
@@ -153,18 +385,18 @@ krb5_error_code ipa_krb5_generate_key_data(krb5_context krbctx,
                 kerr = EINVAL;
                 goto done;
             }
-            salt.length = principal->realm.length;
-            salt.data = malloc(salt.length);
-            if (!salt.data) {
+            salt->length = principal->realm.length;
+            salt->data = malloc(salt->length);
+            if (!salt->data) {
                 kerr = ENOMEM;
                 goto done;
             }
-            memcpy(salt.data, principal->realm.data, salt.length);
+            memcpy(salt->data, principal->realm.data, salt->length);
             break;
 
         case KRB5_KDB_SALTTYPE_NOREALM:
 
-            kerr = ipa_krb5_principal2salt_norealm(krbctx, principal, &salt);
+            kerr = ipa_krb5_principal2salt_norealm(krbctx, principal, salt);
             if (kerr) {
                 goto done;
             }
@@ -172,7 +404,7 @@ krb5_error_code ipa_krb5_generate_key_data(krb5_context krbctx,
 
         case KRB5_KDB_SALTTYPE_NORMAL:
 
-            kerr = krb5_principal2salt(krbctx, principal, &salt);
+            kerr = krb5_principal2salt(krbctx, principal, salt);
             if (kerr) {
                 goto done;
             }
@@ -180,14 +412,14 @@ krb5_error_code ipa_krb5_generate_key_data(krb5_context krbctx,
 
         case KRB5_KDB_SALTTYPE_SPECIAL:
 
-            kerr = ipa_get_random_salt(krbctx, &salt);
+            kerr = ipa_get_random_salt(krbctx, salt);
             if (kerr) {
                 goto done;
             }
             break;
 
         case KRB5_KDB_SALTTYPE_V4:
-            salt.length = 0;
+            salt->length = 0;
             break;
 
         case KRB5_KDB_SALTTYPE_AFS3:
@@ -196,67 +428,75 @@ krb5_error_code ipa_krb5_generate_key_data(krb5_context krbctx,
                 kerr = EINVAL;
                 goto done;
             }
-            salt.data = strndup((char *)principal->realm.data,
-                                        principal->realm.length);
-            if (!salt.data) {
+            salt->data = strndup((char *)principal->realm.data,
+                                         principal->realm.length);
+            if (!salt->data) {
                 kerr = ENOMEM;
                 goto done;
             }
-            salt.length = SALT_TYPE_AFS_LENGTH; /* special value */
+            salt->length = SALT_TYPE_AFS_LENGTH; /* special value */
             break;
 
         default:
             kerr = EINVAL;
             goto done;
         }
+    }
 
-        /* need to build the key now to manage the AFS salt.length
-         * special case */
-        if (pwd.data == NULL) {
+    /* need to build the keys now to manage the AFS salt.length
+     * special case */
+    if (pwd.data == NULL) {
+        for (i = 0; i < num_keys; i++) {
             kerr = krb5_c_make_random_key(krbctx,
                                           encsalts[i].ks_enctype,
-                                          &key);
-        } else {
-            kerr = krb5_c_string_to_key(krbctx,
-                                        encsalts[i].ks_enctype,
-                                        &pwd, &salt, &key);
+                                          &kblocks[i]);
+            if (kerr) {
+                goto done;
+            }
         }
+    } else {
+        kerr = ipa_string_to_keys(krbctx, &pwd, num_keys,
+                                  encsalts, salts, kblocks);
         if (kerr) {
-            krb5_free_data_contents(krbctx, &salt);
             goto done;
         }
-        if (salt.length == SALT_TYPE_AFS_LENGTH) {
-            salt.length = strlen(salt.data);
+    }
+
+    for (i = 0; i < num_keys; i++) {
+        krb5_keyblock *key = &kblocks[i];
+        krb5_data *salt = &salts[i];
+        krb5_octet *ptr;
+        krb5_data plain;
+        krb5_enc_data cipher;
+        krb5_int16 t;
+        size_t len;
+
+        if (salt->length == SALT_TYPE_AFS_LENGTH) {
+            salt->length = strlen(salt->data);
         }
 
         kerr = krb5_c_encrypt_length(krbctx,
-                                     kmkey->enctype, key.length, &len);
+                                     kmkey->enctype, key->length, &len);
         if (kerr) {
-            krb5int_c_free_keyblock_contents(krbctx, &key);
-            krb5_free_data_contents(krbctx, &salt);
             goto done;
         }
 
         if ((ptr = (krb5_octet *) malloc(2 + len)) == NULL) {
             kerr = ENOMEM;
-            krb5int_c_free_keyblock_contents(krbctx, &key);
-            krb5_free_data_contents(krbctx, &salt);
             goto done;
         }
 
-        t = htole16(key.length);
+        t = htole16(key->length);
         memcpy(ptr, &t, 2);
 
-        plain.length = key.length;
-        plain.data = (char *)key.contents;
+        plain.length = key->length;
+        plain.data = (char *)key->contents;
 
         cipher.ciphertext.length = len;
         cipher.ciphertext.data = (char *)ptr+2;
 
         kerr = krb5_c_encrypt(krbctx, kmkey, 0, 0, &plain, &cipher);
         if (kerr) {
-            krb5int_c_free_keyblock_contents(krbctx, &key);
-            krb5_free_data_contents(krbctx, &salt);
             free(ptr);
             goto done;
         }
@@ -264,26 +504,16 @@ krb5_error_code ipa_krb5_generate_key_data(krb5_context krbctx,
         /* KrbSalt  */
         keys[i].key_data_type[1] = encsalts[i].ks_salttype;
 
-        if (salt.length) {
-            keys[i].key_data_length[1] = salt.length;
-            keys[i].key_data_contents[1] = (krb5_octet *)salt.data;
+        if (salt->length) {
+            keys[i].key_data_length[1] = salt->length;
+            keys[i].key_data_contents[1] = (krb5_octet *)salt->data;
+            salt->data = NULL;
         }
 
         /* EncryptionKey */
-        keys[i].key_data_type[0] = key.enctype;
+        keys[i].key_data_type[0] = key->enctype;
         keys[i].key_data_length[0] = len + 2;
-        keys[i].key_data_contents[0] = malloc(len + 2);
-        if (!keys[i].key_data_contents[0]) {
-            kerr = ENOMEM;
-            krb5int_c_free_keyblock_contents(krbctx, &key);
-            free(ptr);
-            goto done;
-        }
-        memcpy(keys[i].key_data_contents[0], ptr, len + 2);
-
-        /* make sure we free the memory used now that we are done with it */
-        krb5int_c_free_keyblock_contents(krbctx, &key);
-        free(ptr);
+        keys[i].key_data_contents[0] = ptr;
     }
 
     *_num_keys = num_keys;
@@ -294,6 +524,18 @@ done:
     if (kerr) {
         ipa_krb5_free_key_data(keys, num_keys);
     }
+    for (i = 0; kblocks && i < num_keys; i++) {
+        /* make sure we free the memory used now that we are done with it */
+        krb5int_c_free_keyblock_contents(krbctx, &kblocks[i]);
+    }
+    for (i = 0; salts && i < num_keys; i++) {
+        if (salts[i].length == SALT_TYPE_AFS_LENGTH) {
+            salts[i].length = strlen(salts[i].data);
+        }
+        krb5_free_data_contents(krbctx, &salts[i]);
+    }
+    free(kblocks);
+    free(salts);
 
     return kerr;
 }
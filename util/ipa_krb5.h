@@ -29,6 +29,7 @@ struct keys_container {
 #define KEYTAB_SET_OID "2.16.840.1.113730.3.8.10.1"
 #define KEYTAB_RET_OID "2.16.840.1.113730.3.8.10.2"
 #define KEYTAB_GET_OID "2.16.840.1.113730.3.8.10.5"
+#define KEYTAB_BATCH_OID "2.16.840.1.113730.3.8.10.7"
 
 int krb5_klog_syslog(int, const char *, ...);
 
@@ -50,6 +51,20 @@ krb5_error_code ipa_krb5_generate_key_data(krb5_context krbctx,
 
 void ipa_krb5_free_key_data(krb5_key_data *keys, int num_keys);
 
+#define IPA_S2K_MAX_THREADS 4
+
+/* Starts up to num_threads (at most IPA_S2K_MAX_THREADS, and one less than
+ * the number of CPUs) workers that ipa_krb5_generate_key_data() hands its
+ * password derivations to. Without a pool all keys are derived in the
+ * calling thread. Only long running, non forking servers that derive keys
+ * for many clients should opt in. On error the workers started so far keep
+ * running. */
+krb5_error_code ipa_krb5_s2k_pool_start(int num_threads);
+
+/* Stops the workers. Must not run concurrently with
+ * ipa_krb5_s2k_pool_start(). */
+void ipa_krb5_s2k_pool_stop(void);
+
 int ber_encode_krb5_key_data(krb5_key_data *data,
                              int numk, int mkvno,
                              struct berval **encoded);
@@ -162,29 +162,48 @@ static int ipapwd_gentime_cmp(const void *p1, const void *p2)
 /* SHA*_LENGTH leghts come from nss3/hasht.h */
 #define SHA_HASH_MAX_LENGTH SHA512_LENGTH
 
-static int ipapwd_hash_type_to_alg(char *hash_type,
-                                   SECOidTag *hash_alg,
-                                   unsigned int *hash_alg_len)
+static const struct ipapwd_hash_alg {
+    const char *type;
+    SECOidTag alg;
+    unsigned int len;
+} ipapwd_hash_algs[] = {
+    { "{SSHA}", SEC_OID_SHA1, SHA1_LENGTH },
+    { "{SHA256}", SEC_OID_SHA256, SHA256_LENGTH },
+    { "{SHA384}", SEC_OID_SHA384, SHA384_LENGTH },
+    { "{SHA512}", SEC_OID_SHA512, SHA512_LENGTH },
+};
+
+#define IPAPWD_NUM_HASH_ALGS \
+    (sizeof(ipapwd_hash_algs) / sizeof(ipapwd_hash_algs[0]))
+
+/**
+* @brief    Makes sure NSS is usable for hashing and base64 coding
+*
+* NSS_NoDB_Init() serializes on a global lock even when NSS is already up,
+* so check the (lockless) initialized flag first. Callers invoke this once
+* per public entry point rather than once per hashed element.
+*
+* @return 0 on success, -1 on error.
+*/
+static int ipapwd_nss_init(void)
 {
-    if (strncmp("{SSHA}", hash_type, 6) == 0) {
-        *hash_alg = SEC_OID_SHA1;
-        *hash_alg_len = SHA1_LENGTH;
-        return 0;
-    }
-    if (strncmp("{SHA256}", hash_type, 8) == 0) {
-        *hash_alg = SEC_OID_SHA256;
-        *hash_alg_len = SHA256_LENGTH;
-        return 0;
-    }
-    if (strncmp("{SHA384}", hash_type, 8) == 0) {
-        *hash_alg = SEC_OID_SHA384;
-        *hash_alg_len = SHA384_LENGTH;
+    if (NSS_IsInitialized()) {
         return 0;
     }
-    if (strncmp("{SHA512}", hash_type, 8) == 0) {
-        *hash_alg = SEC_OID_SHA512;
-        *hash_alg_len = SHA512_LENGTH;
-        return 0;
+
+    return (NSS_NoDB_Init(".") == SECSuccess) ? 0 : -1;
+}
+
+/* returns the index in ipapwd_hash_algs or -1 if hash_type is unknown */
+static int ipapwd_hash_type_to_alg(char *hash_type)
+{
+    int i;
+
+    for (i = 0; i < IPAPWD_NUM_HASH_ALGS; i++) {
+        if (strncmp(ipapwd_hash_algs[i].type, hash_type,
+                    strlen(ipapwd_hash_algs[i].type)) == 0) {
+            return i;
+        }
     }
 
     return -1;
@@ -198,6 +217,8 @@ static int ipapwd_hash_type_to_alg(char *hash_type,
 * @param hash_type      The hash type ({SSHA}, {SHA256}, {SHA384}, {SHA512})
 * @param full_hash      The resulting hash with the salt appended
 *
+* NSS must have been initialized by the caller.
+*
 * @return 0 on success, -1 on error.
 */
 static int ipapwd_hash_password(char *password,
@@ -218,17 +239,17 @@ static int ipapwd_hash_password(char *password,
     PK11Context *ctx = NULL;
     int ret;
 
-    NSS_NoDB_Init(".");
-
     if (!salt) {
         PK11_GenerateRandom(saltbuf, SHA_SALT_LENGTH);
         salt = saltbuf;
     }
 
-    ret = ipapwd_hash_type_to_alg(hash_type, &hash_alg, &hash_alg_len);
-    if (ret) {
+    ret = ipapwd_hash_type_to_alg(hash_type);
+    if (ret == -1) {
         return -1;
     }
+    hash_alg = ipapwd_hash_algs[ret].alg;
+    hash_alg_len = ipapwd_hash_algs[ret].len;
 
     ctx = PK11_CreateDigestContext(hash_alg);
     if (ctx == NULL) {
@@ -273,10 +294,63 @@ done:
     return ret;
 }
 
+/* The history hash is H(password || salt), so within a single policy check
+ * the password part of the digest is the same for every element that uses
+ * the same algorithm. Digest it once per algorithm and clone the resulting
+ * context for each element, so that each comparison only hashes the salt. */
+struct ipapwd_hist_ctx {
+    unsigned char *password;
+    unsigned int pwdlen;
+    PK11Context *seeded[IPAPWD_NUM_HASH_ALGS];
+};
+
+static void ipapwd_hist_ctx_init(struct ipapwd_hist_ctx *hc, char *password)
+{
+    memset(hc, 0, sizeof(struct ipapwd_hist_ctx));
+    hc->password = (unsigned char *)password;
+    hc->pwdlen = strlen(password);
+}
+
+static void ipapwd_hist_ctx_free(struct ipapwd_hist_ctx *hc)
+{
+    int i;
+
+    for (i = 0; i < IPAPWD_NUM_HASH_ALGS; i++) {
+        if (hc->seeded[i]) {
+            PK11_DestroyContext(hc->seeded[i], 1);
+        }
+    }
+}
+
+/* returns a fresh context that has already digested the password */
+static PK11Context *ipapwd_hist_ctx_get(struct ipapwd_hist_ctx *hc, int idx)
+{
+    PK11Context *ctx;
+    SECStatus rv;
+
+    if (hc->seeded[idx] == NULL) {
+        ctx = PK11_CreateDigestContext(ipapwd_hash_algs[idx].alg);
+        if (ctx == NULL) {
+            return NULL;
+        }
+        rv = PK11_DigestBegin(ctx);
+        if (rv == SECSuccess) {
+            rv = PK11_DigestOp(ctx, hc->password, hc->pwdlen);
+        }
+        if (rv != SECSuccess) {
+            PK11_DestroyContext(ctx, 1);
+            return NULL;
+        }
+        hc->seeded[idx] = ctx;
+    }
+
+    return PK11_CloneContext(hc->seeded[idx]);
+}
+
 /**
 * @brief    Compares the provided password with a history element
 *
-* @param password       A cleartext password
+* @param hc             The per-check state holding the cleartext password
 * @param historyString  A history element.
 *
 * A history element is a base64 string of a hash+salt buffer, prepended
@@ -284,20 +358,26 @@ done:
 *
 * @return   0 if password matches, 1 if it doesn't and -1 on errors.
 */
-static int ipapwd_cmp_password(char *password, char *historyString)
+static int ipapwd_cmp_password(struct ipapwd_hist_ctx *hc, char *historyString)
 {
-    char *hash_type;
     char *b64part;
     size_t b64_len;
     SECItem *item;
     unsigned char *salt;
-    unsigned char *hash = NULL;
+    unsigned char hash[SHA_HASH_MAX_LENGTH];
     unsigned int hash_len;
+    unsigned int hash_alg_len;
+    PK11Context *ctx = NULL;
+    SECStatus rv;
+    int idx;
     int ret;
 
-    NSS_NoDB_Init(".");
+    idx = ipapwd_hash_type_to_alg(historyString);
+    if (idx == -1) {
+        return -1;
+    }
+    hash_alg_len = ipapwd_hash_algs[idx].len;
 
-    hash_type = historyString;
     b64part = strchr(historyString, '}');
     if (!b64part) {
         return -1;
@@ -313,15 +393,25 @@ static int ipapwd_cmp_password(char *password, char *historyString)
         ret = -1;
         goto done;
     }
+    if (item->len != hash_alg_len + SHA_SALT_LENGTH) {
+        ret = 1;
+        goto done;
+    }
 
     salt = item->data + (item->len - SHA_SALT_LENGTH);
-    ret = ipapwd_hash_password(password, hash_type, salt, &hash, &hash_len);
-    if (ret != 0) {
+
+    ctx = ipapwd_hist_ctx_get(hc, idx);
+    if (ctx == NULL) {
+        ret = -1;
         goto done;
     }
 
-    if (hash_len != item->len) {
-        ret = 1;
+    rv = PK11_DigestOp(ctx, salt, SHA_SALT_LENGTH);
+    if (rv == SECSuccess) {
+        rv = PK11_DigestFinal(ctx, hash, &hash_len, hash_alg_len);
+    }
+    if (rv != SECSuccess || hash_len != hash_alg_len) {
+        ret = -1;
         goto done;
     }
 
@@ -333,8 +423,10 @@ static int ipapwd_cmp_password(char *password, char *historyString)
     ret = 0;
 
 done:
+    if (ctx) {
+        PK11_DestroyContext(ctx, 1);
+    }
     SECITEM_FreeItem(item, 1);
-    free(hash);
     return ret;
 }
 
@@ -368,8 +460,6 @@ static char *ipapwd_hash_to_history(time_t hash_time,
     }
     strftime(timestr, GENERALIZED_TIME_LENGTH+1, "%Y%m%d%H%M%SZ", &utctime);
 
-    NSS_NoDB_Init(".");
-
     item.type = siBuffer;
     item.data = hash;
     item.len = hash_len;
@@ -523,18 +613,32 @@ int ipapwd_check_policy(struct ipapwd_policy *policy,
         }
     }
 
-    if (pwd_history) {
+    if (pwd_history && pwd_history[0]) {
+        struct ipapwd_hist_ctx hc;
         char *hash;
         int i;
 
+        if (ipapwd_nss_init() != 0) {
+            return IPAPWD_POLICY_ERROR;
+        }
+
+        ipapwd_hist_ctx_init(&hc, password);
+
+        ret = 1;
         for (i = 0; pwd_history[i]; i++) {
             hash = pwd_history[i] + GENERALIZED_TIME_LENGTH;
 
-            ret = ipapwd_cmp_password(password, hash);
+            ret = ipapwd_cmp_password(&hc, hash);
             if (ret == 0) {
-                return IPAPWD_POLICY_PWD_IN_HISTORY;
+                break;
             }
         }
+
+        ipapwd_hist_ctx_free(&hc);
+
+        if (ret == 0) {
+            return IPAPWD_POLICY_PWD_IN_HISTORY;
+        }
     }
 
     return IPAPWD_POLICY_OK;
@@ -591,6 +695,10 @@ int ipapwd_generate_new_history(char *password,
         return EINVAL;
     }
 
+    if (ipapwd_nss_init() != 0) {
+        return IPAPWD_POLICY_ERROR;
+    }
+
     /* hardcode best hash we know about for now */
     ret = ipapwd_hash_password(password, DEFAULT_HASH_TYPE, NULL,
                                &hash, &hash_len);